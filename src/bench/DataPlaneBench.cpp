@@ -0,0 +1,435 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief End-to-end benchmark for the data plane
+
+	Runs the real WaveformServerThread against a simulated radio, with a minimal client on a loopback socket reading
+	v1 waveforms, and reports throughput and latency for every combination of the swept parameters.
+
+	Usage: dataplane-bench [options]
+		--depths N,N...		Samples per waveform (default 10000,100000,1000000,10000000)
+		--formats F,F...	Wire formats (default fc32,sc16,sc8)
+		--modes M,M...		block, continuous or both (default block,continuous)
+		--rates R,R...		Sample rates in Hz. 0 means unpaced, i.e. the simulator produces samples as fast as the
+							bridge takes them (default 0,10000000,61440000)
+		--channels N		Number of channels to stream (default 1)
+		--seconds S			Measurement time for each run, after the first waveform arrives (default 2)
+		--port N			Loopback port for the data plane (default 5099)
+		--csv				Output CSV rather than JSON
+		--output path		Write results to a file rather than stdout
+
+	Latency is the time from the device timestamp of the last sample in a waveform to the moment the client has
+	finished reading it. It's only meaningful when paced, since unpaced device time runs ahead of the wall clock, and
+	is reported as -1 for unpaced runs.
+ */
+
+#include "uhdbridge.h"
+#include "BlockRing.h"
+#include "RxBlockPool.h"
+#include "RxConfig.h"
+#include "RxSource.h"
+#include "SampleFormat.h"
+#include "Subscriber.h"
+#include "TriggerEngine.h"
+#include "WaveformHeader.h"
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <sys/time.h>
+
+using namespace std;
+
+//Globals normally owned by main()
+string g_model;
+string g_serial;
+Socket g_scpiSocket(AF_INET6, SOCK_STREAM, IPPROTO_TCP);
+Socket g_dataSocket(AF_INET6, SOCK_STREAM, IPPROTO_TCP);
+
+///@brief One point in the sweep
+struct BenchConfig
+{
+	size_t depth;
+	SampleFormat format;
+	bool continuous;
+	double rate;
+	size_t channels;
+	double seconds;
+};
+
+///@brief Measurements from one run
+struct BenchResult
+{
+	///@brief Actual sample rate of the simulated radio
+	double rate;
+
+	///@brief Waveforms fully received during the measurement window
+	uint64_t waveforms;
+
+	///@brief Samples per second per channel received
+	double samplesPerSec;
+
+	///@brief Waveforms per second received
+	double waveformsPerSec;
+
+	///@brief Payload megabytes per second received, all channels
+	double megabytesPerSec;
+
+	///@brief Mean latency in ms, or -1 if unpaced
+	double latencyMean;
+
+	///@brief 99th percentile latency in ms, or -1 if unpaced
+	double latencyP99;
+
+	///@brief Waveforms dropped by the bridge's ring
+	uint64_t drops;
+
+	///@brief Gaps in the sequence numbers seen by the client
+	uint64_t sequenceGaps;
+
+	///@brief False if the client timed out or saw a malformed header
+	bool ok;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Reference client
+
+/**
+	@brief Reads one waveform, discarding the payload
+
+	@return False on timeout, disconnect or a bad header
+ */
+static bool ReadWaveform(Socket& client, WaveformHeader& header, vector<uint8_t>& scratch)
+{
+	if(!client.RecvLooped(reinterpret_cast<unsigned char*>(&header), sizeof(header)))
+		return false;
+	if( (header.magic != WAVEFORM_MAGIC) || (header.headerLength < sizeof(header)) )
+	{
+		LogError("Bad waveform header (magic %08x, length %u)\n", header.magic, header.headerLength);
+		return false;
+	}
+
+	//Skip anything we don't know about at the end of the header, then the channel headers and payload
+	uint64_t remaining = (header.headerLength - sizeof(header)) +
+		static_cast<uint64_t>(header.numChannels) * header.channelHeaderLength +
+		header.payloadLength;
+	while(remaining > 0)
+	{
+		size_t chunk = min(remaining, static_cast<uint64_t>(scratch.size()));
+		if(!client.RecvLooped(&scratch[0], chunk))
+			return false;
+		remaining -= chunk;
+	}
+	return true;
+}
+
+/**
+	@brief Runs the bridge's data plane for one sweep point and measures it from the client side
+ */
+static BenchResult RunOne(const BenchConfig& config, uint16_t port)
+{
+	BenchResult result = {};
+
+	//Fresh radio every time, since pacing is fixed when it's created
+	char args[128];
+	snprintf(args, sizeof(args), "sim:chans=%zu,realtime=%d", config.channels, (config.rate > 0) ? 1 : 0);
+	g_source = RxSource::Create(args);
+	g_source->SetSampleRate( (config.rate > 0) ? config.rate : 61.44e6);
+	result.rate = g_source->GetSampleRate();
+	g_rxRate = llround(result.rate);
+
+	g_rxChannels.assign(config.channels, RxChannelConfig());
+	for(auto& c : g_rxChannels)
+		c.m_enabled = true;
+
+	g_dataPlaneVersion = 1;
+	g_wireFormat = config.format;
+	g_rxBlockSize = config.depth;
+	g_continuousMode = config.continuous;
+	g_triggerMode = TRIGGER_FREERUN;
+	g_triggerOneShot = false;
+	g_blockPool.SetBufferSize(config.depth * GetBytesPerSample(config.format) * config.channels);
+	g_rxControl.Publish();
+
+	//Connect before starting the server thread. The accept thread adds us as a subscriber, and the receive thread
+	//won't start until it has
+	Socket client(AF_INET6, SOCK_STREAM, IPPROTO_TCP);
+	if(!client.Connect("::1", port))
+	{
+		LogError("Couldn't connect to loopback data plane socket\n");
+		return result;
+	}
+	struct timeval tv;
+	tv.tv_sec = 5;
+	tv.tv_usec = 0;
+	setsockopt(static_cast<ZSOCKET>(client), SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	thread server(WaveformServerThread);
+	g_triggerArmed = true;
+
+	//Wait for the first waveform before starting the clock so setup cost isn't counted
+	vector<uint8_t> scratch(4 * 1024 * 1024);
+	WaveformHeader header;
+	result.ok = ReadWaveform(client, header, scratch);
+	uint64_t droppedAtStart = g_droppedWaveforms;
+	uint64_t lastSequence = header.sequence;
+	uint64_t samples = 0;
+	uint64_t bytes = 0;
+	vector<double> latencies;
+	auto start = chrono::steady_clock::now();
+	double elapsed = 0;
+	while(result.ok && (elapsed < config.seconds) )
+	{
+		result.ok = ReadWaveform(client, header, scratch);
+		if(!result.ok)
+			break;
+		elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+		result.waveforms ++;
+		samples += header.numSamples;
+		bytes += header.payloadLength;
+		if(header.sequence != lastSequence + 1)
+			result.sequenceGaps ++;
+		lastSequence = header.sequence;
+
+		if( (config.rate > 0) && (header.flags & WAVEFORM_FLAG_TIME_VALID) )
+		{
+			double end = header.timeSeconds + header.timeFracSeconds +
+				static_cast<double>(header.numSamples) / header.sampleRate;
+			latencies.push_back( (g_source->GetTimeNow().get_real_secs() - end) * 1e3);
+		}
+	}
+	result.drops = g_droppedWaveforms - droppedAtStart;
+
+	//Tear down the way main() does when the control plane disconnects
+	g_triggerArmed = false;
+	g_waveformThreadQuit = true;
+	client.Close();
+	server.join();
+	g_subscribers.DisconnectAll();
+	g_waveformThreadQuit = false;
+	g_source.reset();
+
+	if(elapsed > 0)
+	{
+		result.samplesPerSec = samples / elapsed;
+		result.waveformsPerSec = result.waveforms / elapsed;
+		result.megabytesPerSec = bytes / elapsed / 1e6;
+	}
+
+	result.latencyMean = -1;
+	result.latencyP99 = -1;
+	if(!latencies.empty())
+	{
+		double sum = 0;
+		for(auto l : latencies)
+			sum += l;
+		result.latencyMean = sum / latencies.size();
+
+		size_t i99 = min(latencies.size() - 1, latencies.size() * 99 / 100);
+		nth_element(latencies.begin(), latencies.begin() + i99, latencies.end());
+		result.latencyP99 = latencies[i99];
+	}
+
+	return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Argument parsing and output
+
+///@brief Splits a comma separated list
+static vector<string> SplitList(const string& s)
+{
+	vector<string> ret;
+	size_t start = 0;
+	while(start <= s.length())
+	{
+		size_t end = s.find(',', start);
+		if(end == string::npos)
+			end = s.length();
+		if(end > start)
+			ret.push_back(s.substr(start, end - start));
+		start = end + 1;
+	}
+	return ret;
+}
+
+static void PrintResult(FILE* fp, bool csv, bool first, const BenchConfig& config, const BenchResult& result)
+{
+	if(csv)
+	{
+		if(first)
+		{
+			fprintf(fp, "depth,format,mode,channels,rate,ok,waveforms,samples_per_sec,waveforms_per_sec,"
+				"megabytes_per_sec,latency_mean_ms,latency_p99_ms,drops,sequence_gaps\n");
+		}
+		fprintf(fp, "%zu,%s,%s,%zu,%.0f,%d,%llu,%.0f,%.3f,%.3f,%.3f,%.3f,%llu,%llu\n",
+			config.depth,
+			GetFormatName(config.format).c_str(),
+			config.continuous ? "continuous" : "block",
+			config.channels,
+			config.rate,
+			result.ok ? 1 : 0,
+			(unsigned long long)result.waveforms,
+			result.samplesPerSec,
+			result.waveformsPerSec,
+			result.megabytesPerSec,
+			result.latencyMean,
+			result.latencyP99,
+			(unsigned long long)result.drops,
+			(unsigned long long)result.sequenceGaps);
+	}
+	else
+	{
+		fprintf(fp,
+			"%s\n  {\"depth\": %zu, \"format\": \"%s\", \"mode\": \"%s\", \"channels\": %zu, \"rate\": %.0f, "
+			"\"ok\": %s, \"waveforms\": %llu, \"samples_per_sec\": %.0f, \"waveforms_per_sec\": %.3f, "
+			"\"megabytes_per_sec\": %.3f, \"latency_mean_ms\": %.3f, \"latency_p99_ms\": %.3f, \"drops\": %llu, "
+			"\"sequence_gaps\": %llu}",
+			first ? "[" : ",",
+			config.depth,
+			GetFormatName(config.format).c_str(),
+			config.continuous ? "continuous" : "block",
+			config.channels,
+			config.rate,
+			result.ok ? "true" : "false",
+			(unsigned long long)result.waveforms,
+			result.samplesPerSec,
+			result.waveformsPerSec,
+			result.megabytesPerSec,
+			result.latencyMean,
+			result.latencyP99,
+			(unsigned long long)result.drops,
+			(unsigned long long)result.sequenceGaps);
+	}
+	fflush(fp);
+}
+
+int main(int argc, char* argv[])
+{
+	g_log_sinks.emplace(g_log_sinks.begin(), new ColoredSTDLogSink(Severity::WARNING));
+
+	vector<string> depths = SplitList("10000,100000,1000000,10000000");
+	vector<string> formats = SplitList("fc32,sc16,sc8");
+	vector<string> modes = SplitList("block,continuous");
+	vector<string> rates = SplitList("0,10000000,61440000");
+	size_t channels = 1;
+	double seconds = 2;
+	uint16_t port = 5099;
+	bool csv = false;
+	string outpath;
+	for(int i=1; i<argc; i++)
+	{
+		string s(argv[i]);
+		bool hasArg = (i+1 < argc);
+
+		if( (s == "--depths") && hasArg)
+			depths = SplitList(argv[++i]);
+		else if( (s == "--formats") && hasArg)
+			formats = SplitList(argv[++i]);
+		else if( (s == "--modes") && hasArg)
+			modes = SplitList(argv[++i]);
+		else if( (s == "--rates") && hasArg)
+			rates = SplitList(argv[++i]);
+		else if( (s == "--channels") && hasArg)
+			channels = max(1, atoi(argv[++i]));
+		else if( (s == "--seconds") && hasArg)
+			seconds = atof(argv[++i]);
+		else if( (s == "--port") && hasArg)
+			port = atoi(argv[++i]);
+		else if(s == "--csv")
+			csv = true;
+		else if( (s == "--output") && hasArg)
+			outpath = argv[++i];
+		else
+		{
+			fprintf(stderr, "Unrecognized argument \"%s\", see the comment at the top of DataPlaneBench.cpp\n",
+				s.c_str());
+			return 1;
+		}
+	}
+
+	FILE* fp = stdout;
+	if(!outpath.empty())
+	{
+		fp = fopen(outpath.c_str(), "w");
+		if(!fp)
+		{
+			LogError("Couldn't open %s\n", outpath.c_str());
+			return 1;
+		}
+	}
+
+	//The client closes its end at the end of every run, so the server's last send may hit a dead socket
+	signal(SIGPIPE, SIG_IGN);
+	g_dataSocket.Bind(port);
+	g_dataSocket.Listen();
+	thread(DataPlaneAcceptThread).detach();
+
+	bool first = true;
+	for(auto& depth : depths)
+	{
+		for(auto& format : formats)
+		{
+			for(auto& mode : modes)
+			{
+				for(auto& rate : rates)
+				{
+					BenchConfig config;
+					config.depth = strtoull(depth.c_str(), nullptr, 10);
+					config.continuous = (mode == "continuous");
+					config.rate = atof(rate.c_str());
+					config.channels = channels;
+					config.seconds = seconds;
+					if(!ParseFormatName(format, config.format) || (config.depth == 0) )
+					{
+						LogError("Skipping bad sweep point (depth %s, format %s)\n", depth.c_str(), format.c_str());
+						continue;
+					}
+
+					//Progress goes to stderr so it doesn't end up in the results
+					fprintf(stderr, "Depth %zu, %s, %s, rate %s\n",
+						config.depth, format.c_str(), mode.c_str(), rate.c_str());
+					BenchResult result = RunOne(config, port);
+					PrintResult(fp, csv, first, config, result);
+					first = false;
+				}
+			}
+		}
+	}
+
+	if(!csv && !first)
+		fprintf(fp, "\n]\n");
+	if(fp != stdout)
+		fclose(fp);
+
+	return 0;
+}
@@ -0,0 +1,105 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Micro-benchmark for the magnitude trigger kernels
+
+	Scans a buffer of noise which never crosses the threshold (so every sample is looked at) with each kernel the CPU
+	supports, and reports throughput in samples per second.
+
+	Usage: magnitude-bench [samples per buffer] [iterations]
+ */
+
+#include "MagnitudeKernels.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+	size_t count = 1024 * 1024;
+	size_t iterations = 200;
+	if(argc > 1)
+		count = strtoull(argv[1], nullptr, 10);
+	if(argc > 2)
+		iterations = strtoull(argv[2], nullptr, 10);
+
+	//Gaussian noise well below the threshold
+	vector<float> iq(count * 2);
+	minstd_rand rng(1);
+	normal_distribution<float> noise(0, 0.1);
+	for(auto& f : iq)
+		f = noise(rng);
+	float threshold = 100;
+
+	printf("%zu samples x %zu iterations, best ISA: %s\n", count, iterations, GetSimdLevelName(GetBestSimdLevel()));
+	printf("%-10s %15s %15s\n", "ISA", "above (Msps)", "below (Msps)");
+
+	for(int i=0; i<SIMD_LEVEL_COUNT; i++)
+	{
+		SimdLevel level = static_cast<SimdLevel>(i);
+		if(!IsSimdLevelSupported(level))
+		{
+			printf("%-10s %15s %15s\n", GetSimdLevelName(level), "unsupported", "unsupported");
+			continue;
+		}
+
+		auto& kernels = GetMagnitudeKernels(level);
+		double rates[2];
+		for(int j=0; j<2; j++)
+		{
+			MagnitudeScanFunction fn = j ? kernels.m_findBelow : kernels.m_findAbove;
+			float t = j ? -1 : threshold;
+
+			//Warm up caches, then time the real thing. Check results so the calls can't be optimized out.
+			size_t hits = fn(&iq[0], count, t) != SIZE_MAX;
+			auto start = chrono::steady_clock::now();
+			for(size_t k=0; k<iterations; k++)
+			{
+				if(fn(&iq[0], count, t) != SIZE_MAX)
+					hits ++;
+			}
+			double dt = chrono::duration_cast<chrono::duration<double>>(chrono::steady_clock::now() - start).count();
+			if(hits)
+				fprintf(stderr, "%s kernel found a crossing that shouldn't be there\n", GetSimdLevelName(level));
+
+			rates[j] = (dt > 0) ? (count * iterations / dt) : 0;
+		}
+
+		printf("%-10s %15.1f %15.1f\n", GetSimdLevelName(level), rates[0] * 1e-6, rates[1] * 1e-6);
+	}
+
+	return 0;
+}
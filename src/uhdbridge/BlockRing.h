@@ -0,0 +1,163 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of BlockRing
+ */
+
+#ifndef BlockRing_h
+#define BlockRing_h
+
+#include "RxBlock.h"
+#include <atomic>
+#include <vector>
+
+/**
+	@brief Lock-free single-producer, single-consumer ring of RxBlock pointers
+
+	Only the producer may call TryPush(). TryPop() is normally called by the consumer, but the producer may also call it
+	to evict the oldest block when the ring is full; the tail index is advanced with a compare-and-swap so the two
+	sides can never both claim the same block.
+ */
+class BlockRing
+{
+public:
+
+	///@brief What the producer does when the ring is full
+	enum DropPolicy
+	{
+		///@brief Evict the oldest queued block to make room for the new one
+		DROP_OLDEST,
+
+		///@brief Throw away the new block
+		DROP_NEWEST,
+
+		///@brief Wait for the consumer to make room (may cause overflows on the radio)
+		DROP_BLOCK
+	};
+
+	BlockRing(size_t depth)
+		: m_head(0)
+		, m_tail(0)
+		, m_slots(depth)
+	{
+		for(auto& s : m_slots)
+			s.store(nullptr);
+	}
+
+	///@brief Empties the ring and changes its depth. Only safe while neither side is using it.
+	void Reset(size_t depth)
+	{
+		std::vector< std::atomic<RxBlock*> > slots(depth);
+		for(auto& s : slots)
+			s.store(nullptr);
+		m_slots.swap(slots);
+		m_head = 0;
+		m_tail = 0;
+	}
+
+	///@brief Returns the maximum number of blocks the ring can hold
+	size_t GetDepth() const
+	{ return m_slots.size(); }
+
+	///@brief Returns the number of blocks currently in the ring (approximate if called from a third thread)
+	size_t GetSize() const
+	{ return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire); }
+
+	/**
+		@brief Adds a block to the ring. Producer only.
+
+		@return False if the ring was full
+	 */
+	bool TryPush(RxBlock* block)
+	{
+		uint64_t head = m_head.load(std::memory_order_relaxed);
+		uint64_t tail = m_tail.load(std::memory_order_acquire);
+		if( (head - tail) >= m_slots.size())
+			return false;
+
+		m_slots[head % m_slots.size()].store(block, std::memory_order_release);
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+		@brief Removes the oldest block from the ring
+
+		@return The block, or null if the ring was empty
+	 */
+	RxBlock* TryPop()
+	{
+		uint64_t tail = m_tail.load(std::memory_order_acquire);
+		while(true)
+		{
+			if(tail == m_head.load(std::memory_order_acquire))
+				return nullptr;
+
+			//If the slot was recycled by the producer after we read tail, the CAS will fail and we'll try again
+			RxBlock* block = m_slots[tail % m_slots.size()].load(std::memory_order_acquire);
+			if(m_tail.compare_exchange_weak(tail, tail + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+				return block;
+		}
+	}
+
+protected:
+
+	/**
+		@brief Spacing which keeps the two indexes out of each other's cache lines, and out of their neighbours'
+
+		This is done with padding rather than alignas(), since rings live inside heap allocated objects and operator new
+		doesn't honour extended alignment before C++17.
+	 */
+	static const size_t CACHE_LINE_SIZE = 64;
+
+	///@brief Padding between m_head and whatever comes before the ring
+	char m_headPad[CACHE_LINE_SIZE];
+
+	///@brief Index of the next slot to write (only ever written by the producer)
+	std::atomic<uint64_t> m_head;
+
+	///@brief Padding between m_head and m_tail
+	char m_tailPad[CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>)];
+
+	///@brief Index of the next slot to read
+	std::atomic<uint64_t> m_tail;
+
+	///@brief Padding between m_tail and the rest
+	char m_slotsPad[CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>)];
+
+	///@brief The slots themselves
+	std::vector< std::atomic<RxBlock*> > m_slots;
+};
+
+extern std::atomic<BlockRing::DropPolicy> g_dropPolicy;
+
+#endif
@@ -0,0 +1,224 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of BridgeStats
+ */
+
+#include "uhdbridge.h"
+#include "BridgeStats.h"
+#include <math.h>
+
+using namespace std;
+
+BridgeStats g_stats;
+
+//Upper bound of the first histogram bucket, in seconds
+static const double g_firstBucketBound = 10e-6;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// DurationHistogram
+
+DurationHistogram::DurationHistogram()
+	: m_count(0)
+	, m_sumNanoseconds(0)
+{
+	for(auto& b : m_buckets)
+		b.store(0);
+}
+
+/**
+	@brief Returns the upper bound of a bucket, in seconds
+ */
+double DurationHistogram::GetUpperBound(size_t bucket)
+{
+	return ldexp(g_firstBucketBound, bucket);
+}
+
+/**
+	@brief Adds one duration to the histogram
+ */
+void DurationHistogram::Record(double seconds)
+{
+	size_t bucket = 0;
+	while( (bucket < NUM_BUCKETS) && (seconds > GetUpperBound(bucket)) )
+		bucket ++;
+
+	m_buckets[bucket].fetch_add(1, memory_order_relaxed);
+	m_count.fetch_add(1, memory_order_relaxed);
+	m_sumNanoseconds.fetch_add(llround(max(seconds, 0.0) * 1e9), memory_order_relaxed);
+}
+
+/**
+	@brief Estimates a quantile (0 to 1) as the upper bound of the bucket it falls in
+
+	@return The estimate in seconds, 0 if nothing has been recorded, or infinity if it's in the overflow bucket
+ */
+double DurationHistogram::GetQuantile(double q) const
+{
+	uint64_t total = GetCount();
+	if(total == 0)
+		return 0;
+
+	uint64_t target = ceil(q * total);
+	uint64_t sum = 0;
+	for(size_t i=0; i<NUM_BUCKETS; i++)
+	{
+		sum += GetBucketCount(i);
+		if(sum >= target)
+			return GetUpperBound(i);
+	}
+	return INFINITY;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// BridgeStats
+
+BridgeStats::BridgeStats()
+	: m_samplesReceived(0)
+	, m_bytesSent(0)
+	, m_waveformsSent(0)
+	, m_overflows(0)
+	, m_timeouts(0)
+	, m_recvErrors(0)
+	, m_shortBlocks(0)
+	, m_droppedWaveforms(0)
+	, m_scanDwells(0)
+	, m_scanSkipped(0)
+	, m_ringOccupancy(0)
+	, m_ringDepth(0)
+{
+}
+
+/**
+	@brief Formats the counters as a single line of comma separated key=value pairs, for the STATS? query
+
+	Durations are in microseconds.
+ */
+string BridgeStats::GetSummary() const
+{
+	char buf[512];
+	snprintf(buf, sizeof(buf),
+		"SAMPLES=%zu,BYTES=%zu,WAVEFORMS=%zu,OVERFLOWS=%zu,TIMEOUTS=%zu,ERRORS=%zu,SHORT=%zu,DROPS=%zu,"
+		"DWELLS=%zu,SKIPPED=%zu,RING=%zu/%zu,RECV_P50=%.0f,RECV_P99=%.0f,SEND_P50=%.0f,SEND_P99=%.0f",
+		(size_t)m_samplesReceived,
+		(size_t)m_bytesSent,
+		(size_t)m_waveformsSent,
+		(size_t)m_overflows,
+		(size_t)m_timeouts,
+		(size_t)m_recvErrors,
+		(size_t)m_shortBlocks,
+		(size_t)m_droppedWaveforms,
+		(size_t)m_scanDwells,
+		(size_t)m_scanSkipped,
+		(size_t)m_ringOccupancy,
+		(size_t)m_ringDepth,
+		m_recvTime.GetQuantile(0.5) * 1e6,
+		m_recvTime.GetQuantile(0.99) * 1e6,
+		m_sendTime.GetQuantile(0.5) * 1e6,
+		m_sendTime.GetQuantile(0.99) * 1e6);
+	return buf;
+}
+
+///@brief Appends one metric in Prometheus text format
+static void AppendMetric(string& out, const char* name, const char* type, const char* help, uint64_t value)
+{
+	char buf[512];
+	snprintf(buf, sizeof(buf), "# HELP %s %s\n# TYPE %s %s\n%s %zu\n", name, help, name, type, name, (size_t)value);
+	out += buf;
+}
+
+///@brief Appends a histogram in Prometheus text format (buckets are cumulative there)
+static void AppendHistogram(string& out, const char* name, const char* help, const DurationHistogram& hist)
+{
+	char buf[512];
+	snprintf(buf, sizeof(buf), "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+	out += buf;
+
+	uint64_t sum = 0;
+	for(size_t i=0; i<DurationHistogram::NUM_BUCKETS; i++)
+	{
+		sum += hist.GetBucketCount(i);
+		snprintf(buf, sizeof(buf), "%s_bucket{le=\"%g\"} %zu\n", name, DurationHistogram::GetUpperBound(i), (size_t)sum);
+		out += buf;
+	}
+	sum += hist.GetBucketCount(DurationHistogram::NUM_BUCKETS);
+	snprintf(buf, sizeof(buf), "%s_bucket{le=\"+Inf\"} %zu\n%s_sum %.9f\n%s_count %zu\n",
+		name, (size_t)sum, name, hist.GetSum(), name, (size_t)sum);
+	out += buf;
+}
+
+/**
+	@brief Formats the counters for a Prometheus scrape
+ */
+string BridgeStats::GetPrometheusText() const
+{
+	string out;
+
+	char buf[512];
+	snprintf(buf, sizeof(buf),
+		"# HELP uhdbridge_info Radio this bridge is connected to\n# TYPE uhdbridge_info gauge\n"
+		"uhdbridge_info{model=\"%s\",serial=\"%s\"} 1\n",
+		g_model.c_str(), g_serial.c_str());
+	out += buf;
+
+	AppendMetric(out, "uhdbridge_samples_received_total", "counter",
+		"Samples received from the radio, per channel", m_samplesReceived);
+	AppendMetric(out, "uhdbridge_bytes_sent_total", "counter",
+		"Bytes sent on the data plane socket, including headers", m_bytesSent);
+	AppendMetric(out, "uhdbridge_waveforms_sent_total", "counter",
+		"Waveforms sent on the data plane socket", m_waveformsSent);
+	AppendMetric(out, "uhdbridge_overflows_total", "counter",
+		"Overflows reported by the radio", m_overflows);
+	AppendMetric(out, "uhdbridge_timeouts_total", "counter",
+		"Radio receive calls which timed out", m_timeouts);
+	AppendMetric(out, "uhdbridge_recv_errors_total", "counter",
+		"Radio receive calls which failed with any other error", m_recvErrors);
+	AppendMetric(out, "uhdbridge_short_blocks_total", "counter",
+		"Block mode waveforms with fewer samples than requested", m_shortBlocks);
+	AppendMetric(out, "uhdbridge_dropped_waveforms_total", "counter",
+		"Waveforms discarded because a ring was full", m_droppedWaveforms);
+	AppendMetric(out, "uhdbridge_scan_dwells_total", "counter",
+		"Scan dwells captured", m_scanDwells);
+	AppendMetric(out, "uhdbridge_scan_skipped_total", "counter",
+		"Scan dwells discarded because the retune was late or samples were lost", m_scanSkipped);
+	AppendMetric(out, "uhdbridge_ring_occupancy", "gauge",
+		"Waveforms queued between the receive and data plane threads", m_ringOccupancy);
+	AppendMetric(out, "uhdbridge_ring_depth", "gauge",
+		"Capacity of the queue between the receive and data plane threads", m_ringDepth);
+
+	AppendHistogram(out, "uhdbridge_recv_duration_seconds",
+		"Time taken by each receive call on the radio stream", m_recvTime);
+	AppendHistogram(out, "uhdbridge_send_duration_seconds",
+		"Time taken to send each waveform to the client", m_sendTime);
+
+	return out;
+}
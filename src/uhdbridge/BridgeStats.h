@@ -0,0 +1,146 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of BridgeStats
+ */
+
+#ifndef BridgeStats_h
+#define BridgeStats_h
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/**
+	@brief Lock-free histogram of durations, with power-of-two bucket sizes from 10 us to about 5 s
+
+	Any thread may call Record() at any time. Readers see each bucket atomically but not necessarily a consistent
+	snapshot across buckets, which is fine for monitoring.
+ */
+class DurationHistogram
+{
+public:
+	DurationHistogram();
+
+	///@brief Number of finite buckets; there is one more for everything longer than the last one
+	static const size_t NUM_BUCKETS = 20;
+
+	void Record(double seconds);
+
+	static double GetUpperBound(size_t bucket);
+
+	///@brief Returns the number of durations in a bucket (not cumulative). Bucket NUM_BUCKETS is the overflow bucket.
+	uint64_t GetBucketCount(size_t bucket) const
+	{ return m_buckets[bucket].load(std::memory_order_relaxed); }
+
+	///@brief Returns the total number of durations recorded
+	uint64_t GetCount() const
+	{ return m_count.load(std::memory_order_relaxed); }
+
+	///@brief Returns the sum of all durations recorded, in seconds
+	double GetSum() const
+	{ return m_sumNanoseconds.load(std::memory_order_relaxed) * 1e-9; }
+
+	double GetQuantile(double q) const;
+
+protected:
+
+	///@brief Number of durations in each bucket, plus the overflow bucket
+	std::atomic<uint64_t> m_buckets[NUM_BUCKETS + 1];
+
+	///@brief Total number of durations recorded
+	std::atomic<uint64_t> m_count;
+
+	///@brief Sum of all durations, in ns so it can be added to atomically
+	std::atomic<uint64_t> m_sumNanoseconds;
+};
+
+/**
+	@brief Performance counters for the data plane
+
+	Counters are cumulative over the life of the process (never reset, so rates can be computed by whoever is scraping
+	them) and are updated with atomic adds from the data plane threads, so reading them never stalls streaming.
+ */
+class BridgeStats
+{
+public:
+	BridgeStats();
+
+	std::string GetSummary() const;
+	std::string GetPrometheusText() const;
+
+	///@brief Samples received from the radio, per channel
+	std::atomic<uint64_t> m_samplesReceived;
+
+	///@brief Bytes written to the data plane socket, including headers
+	std::atomic<uint64_t> m_bytesSent;
+
+	///@brief Waveforms written to the data plane socket
+	std::atomic<uint64_t> m_waveformsSent;
+
+	///@brief Overflows reported by the radio
+	std::atomic<uint64_t> m_overflows;
+
+	///@brief recv() calls which timed out
+	std::atomic<uint64_t> m_timeouts;
+
+	///@brief recv() calls which failed for any other reason
+	std::atomic<uint64_t> m_recvErrors;
+
+	///@brief Block mode waveforms which came back with fewer samples than requested
+	std::atomic<uint64_t> m_shortBlocks;
+
+	///@brief Waveforms thrown away because the ring was full
+	std::atomic<uint64_t> m_droppedWaveforms;
+
+	///@brief Scan dwells captured
+	std::atomic<uint64_t> m_scanDwells;
+
+	///@brief Scan dwells thrown away because the retune reached the radio late, or samples were lost
+	std::atomic<uint64_t> m_scanSkipped;
+
+	///@brief Number of waveforms waiting in the ring, as of the last time the data plane thread looked
+	std::atomic<uint64_t> m_ringOccupancy;
+
+	///@brief Capacity of the ring
+	std::atomic<uint64_t> m_ringDepth;
+
+	///@brief Time taken by each recv() call on the radio stream
+	DurationHistogram m_recvTime;
+
+	///@brief Time taken to send each waveform to the client
+	DurationHistogram m_sendTime;
+};
+
+extern BridgeStats g_stats;
+
+#endif
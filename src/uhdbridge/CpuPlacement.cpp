@@ -0,0 +1,564 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of CpuList and the thread placement helpers
+ */
+
+#include "uhdbridge.h"
+#include "CpuPlacement.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string.h>
+#include <omp.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/mempolicy.h>
+#endif
+
+using namespace std;
+
+ThreadPlacement g_threadPlacement;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// CpuList
+
+/**
+	@brief Parses a comma separated list of cores and inclusive ranges, e.g. "0-3,8"
+
+	@return False (leaving the list unchanged) if the string is malformed or empty
+ */
+bool CpuList::Parse(const string& str)
+{
+	vector<int> cpus;
+	stringstream stream(str);
+	string item;
+	while(getline(stream, item, ','))
+	{
+		int first;
+		int last;
+		char dash;
+		char extra;
+		int n = sscanf(item.c_str(), "%d%c%d%c", &first, &dash, &last, &extra);
+		if(n == 1)
+			last = first;
+		else if( (n != 3) || (dash != '-') )
+			return false;
+		if( (first < 0) || (last < first) )
+			return false;
+
+		for(int i=first; i<=last; i++)
+			cpus.push_back(i);
+	}
+	if(cpus.empty())
+		return false;
+
+	sort(cpus.begin(), cpus.end());
+	cpus.erase(unique(cpus.begin(), cpus.end()), cpus.end());
+	m_cpus = cpus;
+	return true;
+}
+
+/**
+	@brief Formats the list in cpulist format, with consecutive cores collapsed into ranges
+ */
+string CpuList::ToString() const
+{
+	string ret;
+	for(size_t i=0; i<m_cpus.size(); )
+	{
+		size_t j = i;
+		while( (j+1 < m_cpus.size()) && (m_cpus[j+1] == m_cpus[j] + 1) )
+			j++;
+
+		if(!ret.empty())
+			ret += ",";
+		ret += to_string(m_cpus[i]);
+		if(j > i)
+			ret += "-" + to_string(m_cpus[j]);
+		i = j + 1;
+	}
+	return ret;
+}
+
+/**
+	@brief Returns the cores belonging to a NUMA node, or an empty list if there's no such node
+ */
+CpuList CpuList::GetNumaNodeCpus(int node)
+{
+	CpuList ret;
+	ifstream in("/sys/devices/system/node/node" + to_string(node) + "/cpulist");
+	string line;
+	if(getline(in, line))
+		ret.Parse(line);
+	return ret;
+}
+
+/**
+	@brief Returns the cores the process may run on (those of the main thread), or an empty list if unknown
+ */
+CpuList CpuList::GetProcessCpus()
+{
+	CpuList ret;
+	ifstream in("/proc/self/status");
+	string line;
+	const string key = "Cpus_allowed_list:";
+	while(getline(in, line))
+	{
+		if(line.compare(0, key.length(), key) != 0)
+			continue;
+		size_t start = line.find_first_not_of(" \t", key.length());
+		if(start != string::npos)
+			ret.Parse(line.substr(start));
+		break;
+	}
+	return ret;
+}
+
+/**
+	@brief Returns the cores the calling thread may run on, or an empty list if unknown
+ */
+CpuList CpuList::GetThreadCpus()
+{
+	CpuList ret;
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if(pthread_getaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+		return ret;
+	for(int i=0; i<CPU_SETSIZE; i++)
+	{
+		if(CPU_ISSET(i, &set))
+			ret.m_cpus.push_back(i);
+	}
+#endif
+	return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Placement
+
+/**
+	@brief Restricts the calling thread, and every thread it creates afterwards, to a set of cores
+
+	Call before starting any other threads to place the whole process.
+ */
+bool SetProcessAffinity(const CpuList& cpus)
+{
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for(auto i : cpus.m_cpus)
+	{
+		if(i < CPU_SETSIZE)
+			CPU_SET(i, &set);
+	}
+	if(sched_setaffinity(0, sizeof(set), &set) != 0)
+	{
+		LogError("Failed to set CPU affinity to %s: %s\n", cpus.ToString().c_str(), strerror(errno));
+		return false;
+	}
+	return true;
+#else
+	(void)cpus;
+	LogWarning("CPU affinity is not supported on this platform\n");
+	return false;
+#endif
+}
+
+/**
+	@brief Asks the kernel to allocate memory for the calling thread, and threads it creates afterwards, on a NUMA node
+
+	Memory still comes from other nodes if this one runs out.
+ */
+bool SetPreferredNumaNode(int node)
+{
+#ifdef __linux__
+	unsigned long mask[16] = {0};
+	size_t bits = sizeof(mask) * 8;
+	if( (node < 0) || (static_cast<size_t>(node) >= bits) )
+	{
+		LogError("Invalid NUMA node %d\n", node);
+		return false;
+	}
+	mask[node / (sizeof(unsigned long) * 8)] |= 1UL << (node % (sizeof(unsigned long) * 8));
+
+	if(syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, bits + 1) != 0)
+	{
+		LogError("Failed to prefer NUMA node %d: %s\n", node, strerror(errno));
+		return false;
+	}
+	return true;
+#else
+	(void)node;
+	LogWarning("NUMA placement is not supported on this platform\n");
+	return false;
+#endif
+}
+
+/**
+	@brief Returns the NUMA node the calling thread's memory policy prefers or is bound to, or -1 if it has no single one
+ */
+int GetPreferredNumaNode()
+{
+#ifdef __linux__
+	int mode = 0;
+	unsigned long mask[16] = {0};
+	size_t bits = sizeof(mask) * 8;
+	if(syscall(SYS_get_mempolicy, &mode, mask, bits, nullptr, 0) != 0)
+	{
+		LogWarning("Failed to read the memory policy: %s\n", strerror(errno));
+		return -1;
+	}
+	if( (mode != MPOL_PREFERRED) && (mode != MPOL_BIND) )
+		return -1;
+
+	int node = -1;
+	for(size_t i=0; i<bits; i++)
+	{
+		if( (mask[i / (sizeof(unsigned long) * 8)] & (1UL << (i % (sizeof(unsigned long) * 8)))) == 0)
+			continue;
+		if(node >= 0)
+			return -1;
+		node = i;
+	}
+	return node;
+#else
+	return -1;
+#endif
+}
+
+/**
+	@brief Restricts the calling thread to a set of cores, without affecting the rest of the process
+ */
+bool SetThreadAffinity(const CpuList& cpus)
+{
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for(auto i : cpus.m_cpus)
+	{
+		if(i < CPU_SETSIZE)
+			CPU_SET(i, &set);
+	}
+	int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	if(err != 0)
+	{
+		LogError("Failed to set thread CPU affinity to %s: %s\n", cpus.ToString().c_str(), strerror(err));
+		return false;
+	}
+	return true;
+#else
+	(void)cpus;
+	LogWarning("CPU affinity is not supported on this platform\n");
+	return false;
+#endif
+}
+
+/**
+	@brief Switches the calling thread to SCHED_FIFO at a priority, or back to normal scheduling if the priority is 0
+
+	Needs CAP_SYS_NICE, or an RLIMIT_RTPRIO at least as high as the priority.
+ */
+bool SetThreadPriority(int priority)
+{
+#ifdef __linux__
+	sched_param param;
+	memset(&param, 0, sizeof(param));
+	int policy = SCHED_OTHER;
+	if(priority > 0)
+	{
+		policy = SCHED_FIFO;
+		param.sched_priority = min(priority, sched_get_priority_max(SCHED_FIFO));
+	}
+
+	int err = pthread_setschedparam(pthread_self(), policy, &param);
+	if(err != 0)
+	{
+		LogWarning("Failed to set SCHED_FIFO priority %d (check RLIMIT_RTPRIO or CAP_SYS_NICE): %s\n",
+			priority, strerror(err));
+		return false;
+	}
+	return true;
+#else
+	if(priority > 0)
+		LogWarning("Real-time priority is not supported on this platform\n");
+	return false;
+#endif
+}
+
+/**
+	@brief Describes the calling thread's scheduling, e.g. "FIFO/50" or "OTHER/0"
+ */
+string GetThreadPolicy()
+{
+#ifdef __linux__
+	int policy;
+	sched_param param;
+	if(pthread_getschedparam(pthread_self(), &policy, &param) != 0)
+		return "UNKNOWN";
+
+	string name;
+	switch(policy)
+	{
+		case SCHED_FIFO:
+			name = "FIFO";
+			break;
+
+		case SCHED_RR:
+			name = "RR";
+			break;
+
+		default:
+			name = "OTHER";
+			break;
+	}
+	return name + "/" + to_string(param.sched_priority);
+#else
+	return "OTHER/0";
+#endif
+}
+
+/**
+	@brief Asks for the pages of a buffer to be allocated on a NUMA node, falling back to others if it runs out
+
+	Only affects pages which haven't been touched yet, so call right after mapping the buffer.
+ */
+bool BindToNumaNode(void* data, size_t len, int node)
+{
+#ifdef __linux__
+	unsigned long mask[16] = {0};
+	size_t bits = sizeof(mask) * 8;
+	if( (node < 0) || (static_cast<size_t>(node) >= bits) )
+	{
+		LogError("Invalid NUMA node %d\n", node);
+		return false;
+	}
+	mask[node / (sizeof(unsigned long) * 8)] |= 1UL << (node % (sizeof(unsigned long) * 8));
+
+	if(syscall(SYS_mbind, data, len, MPOL_PREFERRED, mask, bits + 1, 0) != 0)
+	{
+		LogWarning("Failed to place buffer on NUMA node %d: %s\n", node, strerror(errno));
+		return false;
+	}
+	return true;
+#else
+	(void)data;
+	(void)len;
+	(void)node;
+	return false;
+#endif
+}
+
+/**
+	@brief Returns the NUMA node a network interface is attached to
+
+	@return The node, or -1 if the interface doesn't exist, is virtual, or the machine has only one node
+ */
+int GetNicNumaNode(const string& iface)
+{
+	ifstream in("/sys/class/net/" + iface + "/device/numa_node");
+	int node = -1;
+	if(!(in >> node))
+		return -1;
+	return node;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// ThreadPlacement
+
+static const char* g_threadRoleNames[THREAD_ROLE_COUNT] =
+{
+	"RX",
+	"PROC",
+	"SEND"
+};
+
+///@brief Returns the short name of a thread role, as used in PLACEMENT commands
+const char* GetThreadRoleName(ThreadRole role)
+{
+	if(role >= THREAD_ROLE_COUNT)
+		return "UNKNOWN";
+	return g_threadRoleNames[role];
+}
+
+ThreadPlacement::ThreadPlacement()
+	: m_priority(0)
+	, m_version(0)
+{
+}
+
+/**
+	@brief Sets the cores for threads of one role, or lets them run anywhere the process may if the list is empty
+ */
+void ThreadPlacement::SetCpus(ThreadRole role, const CpuList& cpus)
+{
+	lock_guard<mutex> lock(m_mutex);
+	m_cpus[role] = cpus;
+	m_version ++;
+}
+
+///@brief Returns the cores for threads of one role, or an empty list if they aren't pinned
+CpuList ThreadPlacement::GetCpus(ThreadRole role)
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_cpus[role];
+}
+
+/**
+	@brief Sets the SCHED_FIFO priority of the receive threads, or 0 for normal scheduling
+
+	The receive thread gets this priority, and the processing and send threads one less, so that when they compete
+	for a core the radio is always drained first.
+ */
+void ThreadPlacement::SetPriority(int priority)
+{
+	lock_guard<mutex> lock(m_mutex);
+	m_priority = priority;
+	m_version ++;
+}
+
+///@brief Returns the SCHED_FIFO priority of the receive thread, or 0 for normal scheduling
+int ThreadPlacement::GetPriority()
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_priority;
+}
+
+///@brief Returns the SCHED_FIFO priority for threads of one role, or 0 for normal scheduling
+int ThreadPlacement::GetPriority(ThreadRole role)
+{
+	lock_guard<mutex> lock(m_mutex);
+	return GetRolePriority(role);
+}
+
+///@brief Returns the SCHED_FIFO priority for threads of one role. Call with m_mutex held.
+int ThreadPlacement::GetRolePriority(ThreadRole role) const
+{
+	if( (role == THREAD_RX) || (m_priority <= 1) )
+		return m_priority;
+	return m_priority - 1;
+}
+
+/**
+	@brief Applies the placement for a role to the calling thread, if it changed since the thread last called this
+
+	Cheap enough to call for every block.
+ */
+void ThreadPlacement::Refresh(ThreadRole role)
+{
+	static thread_local uint64_t applied = 0;
+	uint64_t version = m_version.load(memory_order_acquire);
+	if(version == applied)
+		return;
+	applied = version;
+
+	CpuList cpus;
+	int priority;
+	{
+		lock_guard<mutex> lock(m_mutex);
+		cpus = m_cpus[role];
+		priority = GetRolePriority(role);
+	}
+
+	//Unpinned threads go back to wherever the process may run, in case they were pinned before
+	if(cpus.empty())
+		cpus = CpuList::GetProcessCpus();
+	if(!cpus.empty())
+		SetThreadAffinity(cpus);
+	SetThreadPriority(priority);
+
+	string actual = CpuList::GetThreadCpus().ToString();
+	string policy = GetThreadPolicy();
+	LogNotice("%s thread running on CPUs %s, policy %s\n", GetThreadRoleName(role), actual.c_str(), policy.c_str());
+	string effective = actual + "/" + policy;
+
+	lock_guard<mutex> lock(m_mutex);
+	m_effective[role] = effective;
+}
+
+/**
+	@brief Places the OpenMP team of the calling thread, if the placement changed since it last called this
+
+	The FFT and DDC spread their work over an OpenMP team started from the processing thread. The helper threads would
+	inherit the processing thread's cores and real-time priority, so a single --proc-cpus core would leave the whole
+	team spinning on it at SCHED_FIFO. Instead they run at normal priority, anywhere the process may. The calling
+	thread keeps its own placement.
+
+	OpenMP reuses the same helper threads for every parallel region of the same size from the same thread, so placing
+	them once is enough. Call before the first parallel region for each block.
+ */
+void ThreadPlacement::RefreshHelpers()
+{
+	static thread_local uint64_t applied = 0;
+	uint64_t version = m_version.load(memory_order_acquire);
+	if(version == applied)
+		return;
+	applied = version;
+
+	CpuList cpus = CpuList::GetProcessCpus();
+
+	#pragma omp parallel
+	{
+		if(omp_get_thread_num() != 0)
+		{
+			if(!cpus.empty())
+				SetThreadAffinity(cpus);
+			SetThreadPriority(0);
+		}
+	}
+
+	LogVerbose("Processing helper threads running on CPUs %s, normal priority\n",
+		cpus.empty() ? "any" : cpus.ToString().c_str());
+}
+
+/**
+	@brief Returns where the last thread of each role to refresh ended up, as semicolon separated ROLE=cpus/policy
+	entries (e.g. RX=2/FIFO/50;PROC=3/FIFO/49;SEND=DEFAULT). DEFAULT means no thread of that role has been placed.
+ */
+string ThreadPlacement::GetSummary()
+{
+	lock_guard<mutex> lock(m_mutex);
+	string ret;
+	for(int i=0; i<THREAD_ROLE_COUNT; i++)
+	{
+		if(!ret.empty())
+			ret += ";";
+		ret += string(g_threadRoleNames[i]) + "=" + (m_effective[i].empty() ? "DEFAULT" : m_effective[i]);
+	}
+	return ret;
+}
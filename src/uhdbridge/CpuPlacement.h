@@ -0,0 +1,135 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of CpuList and the thread placement helpers
+ */
+
+#ifndef CpuPlacement_h
+#define CpuPlacement_h
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+	@brief A set of CPU cores, as written in Linux cpulist format ("0-3,8,10-11")
+ */
+class CpuList
+{
+public:
+	bool Parse(const std::string& str);
+	std::string ToString() const;
+
+	static CpuList GetNumaNodeCpus(int node);
+	static CpuList GetProcessCpus();
+	static CpuList GetThreadCpus();
+
+	///@brief True if no cores are in the list
+	bool empty() const
+	{ return m_cpus.empty(); }
+
+	///@brief Core numbers, in ascending order with no duplicates
+	std::vector<int> m_cpus;
+};
+
+bool SetProcessAffinity(const CpuList& cpus);
+bool SetPreferredNumaNode(int node);
+int GetPreferredNumaNode();
+bool SetThreadAffinity(const CpuList& cpus);
+bool SetThreadPriority(int priority);
+std::string GetThreadPolicy();
+bool BindToNumaNode(void* data, size_t len, int node);
+int GetNicNumaNode(const std::string& iface);
+
+///@brief The threads on the data path which can be placed separately
+enum ThreadRole
+{
+	///@brief Receive thread, which pulls samples from the radio
+	THREAD_RX,
+
+	///@brief Data plane thread, which runs the on-bridge processing and hands waveforms to the subscribers
+	THREAD_PROCESSING,
+
+	///@brief Send threads, one per data plane subscriber
+	THREAD_SEND,
+
+	THREAD_ROLE_COUNT
+};
+
+const char* GetThreadRoleName(ThreadRole role);
+
+/**
+	@brief Which cores the data path threads run on, and their real-time priority
+
+	Each thread calls Refresh() from its main loop, which applies any change made since the thread last did, so
+	changes take effect on threads which are already running. Threads are left alone until something is set.
+ */
+class ThreadPlacement
+{
+public:
+	ThreadPlacement();
+
+	void SetCpus(ThreadRole role, const CpuList& cpus);
+	CpuList GetCpus(ThreadRole role);
+	void SetPriority(int priority);
+	int GetPriority();
+	int GetPriority(ThreadRole role);
+
+	void Refresh(ThreadRole role);
+	void RefreshHelpers();
+
+	std::string GetSummary();
+
+protected:
+	int GetRolePriority(ThreadRole role) const;
+
+	///@brief Mutex protecting everything but the version
+	std::mutex m_mutex;
+
+	///@brief Cores for each role, or empty for wherever the process may run
+	CpuList m_cpus[THREAD_ROLE_COUNT];
+
+	///@brief SCHED_FIFO priority of the receive threads, or 0 for normal scheduling
+	int m_priority;
+
+	///@brief Placement the last thread of each role to refresh actually ended up with, or empty if none has yet
+	std::string m_effective[THREAD_ROLE_COUNT];
+
+	///@brief Incremented by every change, so threads can cheaply check if they're out of date
+	std::atomic<uint64_t> m_version;
+};
+
+extern ThreadPlacement g_threadPlacement;
+
+#endif
@@ -0,0 +1,372 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of DataPlaneSender
+ */
+
+#include "uhdbridge.h"
+#include "DataPlaneSender.h"
+#include "RxBlockPool.h"
+#include <string.h>
+#include <errno.h>
+
+#ifdef __linux__
+#include <linux/errqueue.h>
+#include <poll.h>
+#include <limits.h>
+#endif
+
+using namespace std;
+
+//Below this size the page pinning overhead of MSG_ZEROCOPY costs more than the copy it saves
+static const size_t g_zerocopyThreshold = 16384;
+
+//Stop and wait for the kernel if it's holding on to more than this many blocks
+static const size_t g_maxPendingBlocks = 8;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+DataPlaneSender::DataPlaneSender(Socket& sock, bool zerocopy)
+	: m_socket(sock)
+	, m_zerocopy(false)
+	, m_zerocopySends(0)
+	, m_zerocopyDone(0)
+	, m_lastSyscalls(0)
+	, m_lastBytes(0)
+	, m_warnedCopied(false)
+{
+	if(!zerocopy)
+		return;
+
+#if defined(__linux__) && defined(SO_ZEROCOPY)
+	int one = 1;
+	if(setsockopt(m_socket, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0)
+	{
+		m_zerocopy = true;
+		LogVerbose("Using MSG_ZEROCOPY on data plane socket\n");
+	}
+	else
+		LogWarning("Failed to enable SO_ZEROCOPY (%s), falling back to copying sends\n", strerror(errno));
+#else
+	LogWarning("Zero-copy sends are not supported on this platform\n");
+#endif
+}
+
+/**
+	@brief Gets back anything the kernel still has, resetting the connection if need be. Never waits.
+ */
+DataPlaneSender::~DataPlaneSender()
+{
+	ReapCompletions(false);
+	if(!m_pending.empty())
+		Abort();
+}
+
+/**
+	@brief Resets the connection and closes the socket, then releases every block still waiting for the kernel
+
+	Closing with a zero linger time makes the kernel send a reset and throw away everything still queued on the socket,
+	rather than hanging on to it until the client reads it or the connection times out, so nothing refers to the
+	buffers any more. Whatever the client gets before the reset is the end of a broken stream, so it can't be mistaken
+	for a complete waveform.
+ */
+void DataPlaneSender::Abort()
+{
+	if(!m_pending.empty())
+		LogDebug("Resetting data plane connection with %zu waveforms still in flight\n", m_pending.size());
+
+#ifndef _WIN32
+	linger lin;
+	lin.l_onoff = 1;
+	lin.l_linger = 0;
+	setsockopt(m_socket, SOL_SOCKET, SO_LINGER, &lin, sizeof(lin));
+#endif
+	m_socket.Close();
+
+	for(auto& p : m_pending)
+		g_blockPool.Release(p.m_block);
+	m_pending.clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Sending
+
+/**
+	@brief Returns an empty buffer to build the next waveform's header in
+
+	The buffer stays valid until the next block passed to Retire() is released.
+ */
+vector<uint8_t>& DataPlaneSender::GetHeaderBuffer()
+{
+	m_header.clear();
+	return m_header;
+}
+
+/**
+	@brief Adds a buffer to the waveform being built
+
+	The buffer must stay valid until Send() returns, or until the block it belongs to is released if zero-copy is on.
+ */
+void DataPlaneSender::Append(const void* data, size_t len)
+{
+	if(len == 0)
+		return;
+
+#ifndef _WIN32
+	iovec iov;
+	iov.iov_base = const_cast<void*>(data);
+	iov.iov_len = len;
+	m_iov.push_back(iov);
+#else
+	m_iov.push_back(pair<const void*, size_t>(data, len));
+#endif
+}
+
+/**
+	@brief Sends everything appended since the last call
+
+	@return False if the socket was closed
+ */
+bool DataPlaneSender::Send()
+{
+	m_lastSyscalls = 0;
+	m_lastBytes = 0;
+
+#ifdef _WIN32
+
+	//No scatter-gather, just send each piece (in chunks SendLooped can handle)
+	bool ok = true;
+	for(auto& p : m_iov)
+	{
+		const uint8_t* data = static_cast<const uint8_t*>(p.first);
+		size_t len = p.second;
+		while(ok && (len > 0) )
+		{
+			size_t chunk = min(len, (size_t)0x40000000);
+			ok = m_socket.SendLooped(data, chunk);
+			m_lastSyscalls ++;
+			m_lastBytes += chunk;
+			data += chunk;
+			len -= chunk;
+		}
+	}
+	m_iov.clear();
+	return ok;
+
+#else
+
+	size_t total = 0;
+	for(auto& v : m_iov)
+		total += v.iov_len;
+	m_lastBytes = total;
+
+	int flags = 0;
+	#ifdef MSG_NOSIGNAL
+	flags |= MSG_NOSIGNAL;
+	#endif
+	bool zerocopy = false;
+	#ifdef MSG_ZEROCOPY
+	zerocopy = m_zerocopy && (total >= g_zerocopyThreshold);
+	#endif
+
+	size_t first = 0;
+	while(first < m_iov.size())
+	{
+		msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = &m_iov[first];
+		msg.msg_iovlen = min(m_iov.size() - first, (size_t)IOV_MAX);
+
+		int sendflags = flags;
+		#ifdef MSG_ZEROCOPY
+		if(zerocopy)
+			sendflags |= MSG_ZEROCOPY;
+		#endif
+
+		ssize_t n = sendmsg(m_socket, &msg, sendflags);
+		m_lastSyscalls ++;
+		if(n < 0)
+		{
+			if(errno == EINTR)
+				continue;
+
+			//Out of locked memory for pinning pages, do the rest the old fashioned way
+			if(zerocopy && (errno == ENOBUFS) )
+			{
+				zerocopy = false;
+				continue;
+			}
+
+			m_iov.clear();
+			return false;
+		}
+
+		//The kernel numbers zero-copy sends by the number of calls that sent something
+		if(zerocopy && (n > 0) )
+			m_zerocopySends ++;
+
+		//Skip past whatever got sent
+		size_t left = n;
+		while( (first < m_iov.size()) && (left >= m_iov[first].iov_len) )
+		{
+			left -= m_iov[first].iov_len;
+			first ++;
+		}
+		if(left > 0)
+		{
+			m_iov[first].iov_base = static_cast<uint8_t*>(m_iov[first].iov_base) + left;
+			m_iov[first].iov_len -= left;
+		}
+	}
+
+	m_iov.clear();
+
+	if(m_zerocopy)
+		ReapCompletions(false);
+	return true;
+
+#endif
+}
+
+/**
+	@brief Releases a block once the kernel is done with everything sent so far
+
+	The current header buffer is held along with it.
+ */
+void DataPlaneSender::Retire(RxBlock* block)
+{
+	if(block == nullptr)
+		return;
+
+	if(m_zerocopyDone == m_zerocopySends)
+	{
+		g_blockPool.Release(block);
+		return;
+	}
+
+	PendingBlock pending;
+	pending.m_block = block;
+	pending.m_sends = m_zerocopySends;
+	pending.m_header.swap(m_header);
+	m_pending.push_back(move(pending));
+	if(!m_spareHeaders.empty())
+	{
+		m_header.swap(m_spareHeaders.back());
+		m_spareHeaders.pop_back();
+	}
+
+	//Don't let the kernel hog too many buffers or the pool will just keep growing.
+	//Nothing more will complete once the socket is dead, and the next send will fail anyway, so stop waiting then.
+	while(m_pending.size() > g_maxPendingBlocks)
+	{
+		if(!ReapCompletions(true))
+			break;
+	}
+}
+
+/**
+	@brief Reads zero-copy completion notifications from the socket error queue and releases finished blocks
+
+	@param wait		If true, block (briefly) until something shows up
+
+	@return False if the socket has been closed or reset, so no more completions are coming
+ */
+bool DataPlaneSender::ReapCompletions(bool wait)
+{
+	bool alive = true;
+
+#if defined(__linux__) && defined(SO_EE_ORIGIN_ZEROCOPY)
+	if(wait)
+	{
+		//POLLERR and POLLHUP are always reported, no need to ask for them. POLLERR just means there's something in
+		//the error queue, which is normally our completions, so only a hang up counts as the socket dying.
+		pollfd pfd;
+		pfd.fd = m_socket;
+		pfd.events = 0;
+		pfd.revents = 0;
+		int ret = poll(&pfd, 1, 100);
+		if( ( (ret < 0) && (errno != EINTR) ) || (pfd.revents & (POLLHUP | POLLNVAL)) )
+			alive = false;
+	}
+
+	while(true)
+	{
+		uint8_t control[128];
+		msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		if(recvmsg(m_socket, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+			break;
+
+		for(cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm))
+		{
+			bool ipv4 = (cm->cmsg_level == SOL_IP) && (cm->cmsg_type == IP_RECVERR);
+			bool ipv6 = (cm->cmsg_level == SOL_IPV6) && (cm->cmsg_type == IPV6_RECVERR);
+			if(!ipv4 && !ipv6)
+				continue;
+
+			auto serr = reinterpret_cast<sock_extended_err*>(CMSG_DATA(cm));
+			if( (serr->ee_errno != 0) || (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY) )
+				continue;
+
+			if( (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) && !m_warnedCopied)
+			{
+				LogDebug("Kernel fell back to copying zero-copy sends (loopback or unsupported NIC?)\n");
+				m_warnedCopied = true;
+			}
+
+			//Completions cover the inclusive range [ee_info, ee_data], and TCP reports them in order
+			uint32_t done = serr->ee_data + 1;
+			if(static_cast<int32_t>(done - m_zerocopyDone) > 0)
+				m_zerocopyDone = done;
+		}
+	}
+#else
+	(void)wait;
+	m_zerocopyDone = m_zerocopySends;
+#endif
+
+	//Release everything the kernel is done with
+	size_t n = 0;
+	while( (n < m_pending.size()) && (static_cast<int32_t>(m_zerocopyDone - m_pending[n].m_sends) >= 0) )
+	{
+		g_blockPool.Release(m_pending[n].m_block);
+		if(m_pending[n].m_header.capacity() != 0)
+			m_spareHeaders.push_back(move(m_pending[n].m_header));
+		n++;
+	}
+	m_pending.erase(m_pending.begin(), m_pending.begin() + n);
+
+	return alive;
+}
@@ -0,0 +1,146 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of DataPlaneSender
+ */
+
+#ifndef DataPlaneSender_h
+#define DataPlaneSender_h
+
+#include "../../lib/xptools/Socket.h"
+#include "RxBlock.h"
+#include <vector>
+#include <utility>
+
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
+
+/**
+	@brief Scatter-gather sender for the data plane socket
+
+	A waveform (header plus one or more sample buffers) is gathered with Append() and sent with a single sendmsg() call
+	(looping only on partial writes). On Linux the payload can optionally be sent with MSG_ZEROCOPY, in which case the
+	kernel reads straight from the pooled sample buffer. Blocks passed to Retire() are then held until the kernel
+	reports that it's done with them, and only then released. Headers are built in a buffer from GetHeaderBuffer(),
+	which is held along with the block, since blocks may be shared with other senders and can't carry our header.
+
+	On Windows, or if zero-copy isn't available, this degrades to ordinary copying sends and Retire() releases blocks
+	immediately.
+
+	Once the connection is finished with, the kernel may still be holding on to blocks, for instance if the client
+	stopped reading and the data is stuck in the socket buffer. The owner can keep calling ReapCompletions() for a
+	while to get them back, then Abort() resets the connection so the kernel discards whatever is left.
+ */
+class DataPlaneSender
+{
+public:
+	DataPlaneSender(Socket& sock, bool zerocopy);
+	~DataPlaneSender();
+
+	std::vector<uint8_t>& GetHeaderBuffer();
+	void Append(const void* data, size_t len);
+	bool Send();
+	void Retire(RxBlock* block);
+	bool ReapCompletions(bool wait);
+	void Abort();
+
+	///@brief Returns the number of retired blocks the kernel hasn't finished with yet
+	size_t GetPendingCount() const
+	{ return m_pending.size(); }
+
+	///@brief Returns true if MSG_ZEROCOPY is in use
+	bool IsZeroCopy()
+	{ return m_zerocopy; }
+
+	///@brief Returns the number of send syscalls made by the last Send()
+	size_t GetLastSyscallCount()
+	{ return m_lastSyscalls; }
+
+	///@brief Returns the number of bytes sent by the last Send()
+	size_t GetLastByteCount()
+	{ return m_lastBytes; }
+
+protected:
+	///@brief The socket we're sending to
+	Socket& m_socket;
+
+	///@brief True if MSG_ZEROCOPY is enabled on the socket
+	bool m_zerocopy;
+
+#ifndef _WIN32
+	///@brief Gather list for the waveform being built
+	std::vector<iovec> m_iov;
+#else
+	///@brief Gather list for the waveform being built
+	std::vector< std::pair<const void*, size_t> > m_iov;
+#endif
+
+	///@brief Number of zero-copy sends issued so far (the kernel numbers completions the same way)
+	uint32_t m_zerocopySends;
+
+	///@brief Number of zero-copy sends the kernel has told us are complete
+	uint32_t m_zerocopyDone;
+
+	///@brief A retired block waiting for the kernel
+	struct PendingBlock
+	{
+		///@brief The block
+		RxBlock* m_block;
+
+		///@brief Number of zero-copy sends which must complete before it can be released
+		uint32_t m_sends;
+
+		///@brief Header sent along with it, if any
+		std::vector<uint8_t> m_header;
+	};
+
+	///@brief Blocks waiting for the kernel
+	std::vector<PendingBlock> m_pending;
+
+	///@brief Header for the waveform being built
+	std::vector<uint8_t> m_header;
+
+	///@brief Header buffers the kernel is done with, kept to avoid allocating new ones
+	std::vector< std::vector<uint8_t> > m_spareHeaders;
+
+	///@brief Syscall count of the last Send()
+	size_t m_lastSyscalls;
+
+	///@brief Byte count of the last Send()
+	size_t m_lastBytes;
+
+	///@brief True if we've already warned that the kernel fell back to copying
+	bool m_warnedCopied;
+};
+
+#endif
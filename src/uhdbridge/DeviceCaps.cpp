@@ -0,0 +1,158 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of DeviceCaps
+ */
+
+#include "uhdbridge.h"
+#include "DeviceCaps.h"
+#include "RxSource.h"
+#include <algorithm>
+#include <math.h>
+
+using namespace std;
+
+DeviceCaps g_caps;
+
+//Largest decimation to consider when listing sample rates
+static const uint64_t g_maxDecimation = 65536;
+
+//Spacing of listed sample rates if the master clock rate isn't known
+static const double g_minRateStep = 500000;
+
+DeviceCaps::DeviceCaps()
+	: m_masterClockRate(0)
+	, m_maxDecimation(1)
+{
+}
+
+/**
+	@brief Queries everything from the radio
+ */
+void DeviceCaps::Refresh(RxSource& source)
+{
+	m_subdevSpec = source.GetSubdevSpec();
+
+	size_t nchans = source.GetChannelCount();
+	m_channels.resize(nchans);
+	for(size_t i=0; i<nchans; i++)
+	{
+		auto& chan = m_channels[i];
+		chan.m_gainRange = source.GetGainRange(i);
+		chan.m_bandwidthRange = source.GetBandwidthRange(i);
+		chan.m_frequencyRange = source.GetFrequencyRange(i);
+		chan.m_antennas = source.GetAntennas(i);
+	}
+
+	m_masterClockRate = source.GetMasterClockRate();
+	m_masterClockRange = source.GetMasterClockRates();
+
+	auto rates = source.GetSampleRates();
+	m_sampleRates = GetExactRates(rates, m_masterClockRate);
+	if(!rates.empty() && (rates.start() > 0) )
+	{
+		uint64_t decim = floor(m_masterClockRate / rates.start() + 1e-9);
+		m_maxDecimation = max((uint64_t)1, min(g_maxDecimation, decim));
+	}
+
+	if(!m_sampleRates.empty())
+	{
+		LogVerbose("Master clock %.3f MHz, %zu exact sample rates from %.3f to %.3f Msps\n",
+			m_masterClockRate * 1e-6,
+			m_sampleRates.size(),
+			m_sampleRates.front() * 1e-6,
+			m_sampleRates.back() * 1e-6);
+	}
+}
+
+/**
+	@brief Lists the sample rates in a range which the radio can produce exactly, in whole Hz
+
+	Every rate is the master clock divided by an integer decimation, so walking the decimations (rather than stepping
+	through the range) gives only rates the DSP can actually hit, and there are few enough of them with a whole number
+	of Hz to make a sensible list.
+ */
+vector<size_t> DeviceCaps::GetExactRates(const uhd::meta_range_t& range, double clock)
+{
+	vector<size_t> rates;
+	if(range.empty())
+		return rates;
+
+	double lo = range.start();
+	double hi = range.stop();
+
+	if(clock > 0)
+	{
+		uint64_t dmin = max((uint64_t)1, (uint64_t)ceil(clock / hi - 1e-9));
+		uint64_t dmax = min(g_maxDecimation, (uint64_t)floor(clock / lo + 1e-9));
+		for(uint64_t d = dmax; d >= dmin; d--)
+		{
+			double rate = clock / d;
+			double rounded = round(rate);
+			if(fabs(rate - rounded) > 1e-3)
+				continue;
+
+			//Skip decimations the DSP doesn't support
+			if(fabs(range.clip(rounded, true) - rounded) > 0.5)
+				continue;
+
+			rates.push_back(rounded);
+		}
+	}
+
+	//No master clock to go by, so step through the range in whole Hz
+	else
+	{
+		double step = max(round(range.step()), 1.0);
+		if(step < g_minRateStep)
+			step *= ceil(g_minRateStep / step);
+
+		for(double f = round(hi); f >= lo; f -= step)
+			rates.push_back(f);
+		reverse(rates.begin(), rates.end());
+	}
+
+	return rates;
+}
+
+/**
+	@brief Formats a range as start,stop,step for SCPI replies
+ */
+string DeviceCaps::FormatRange(const uhd::meta_range_t& range)
+{
+	if(range.empty())
+		return "0,0,0";
+
+	char buf[128];
+	snprintf(buf, sizeof(buf), "%.15g,%.15g,%.15g", range.start(), range.stop(), range.step());
+	return buf;
+}
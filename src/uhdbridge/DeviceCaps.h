@@ -0,0 +1,104 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of DeviceCaps
+ */
+
+#ifndef DeviceCaps_h
+#define DeviceCaps_h
+
+#include <string>
+#include <vector>
+#include <uhd/types/ranges.hpp>
+
+class RxSource;
+
+/**
+	@brief What one receive channel can be tuned to
+ */
+class ChannelCaps
+{
+public:
+	///@brief Gain range, in dB
+	uhd::gain_range_t m_gainRange;
+
+	///@brief Analog bandwidth range, in Hz
+	uhd::freq_range_t m_bandwidthRange;
+
+	///@brief Center frequency range, in Hz
+	uhd::freq_range_t m_frequencyRange;
+
+	///@brief Names of the antenna ports
+	std::vector<std::string> m_antennas;
+};
+
+/**
+	@brief Capabilities of the radio, queried once at connect
+
+	Each of these is a round trip to the radio (several, for some of them) and none of them change unless the subdev
+	spec does, so the control plane answers from here instead of asking the radio every time a client connects. Only
+	changed at startup.
+ */
+class DeviceCaps
+{
+public:
+	DeviceCaps();
+
+	void Refresh(RxSource& source);
+
+	static std::string FormatRange(const uhd::meta_range_t& range);
+
+	///@brief Master clock rate at startup, which the sample rate list is derived from, in Hz
+	double m_masterClockRate;
+
+	///@brief Master clock rates the radio supports
+	uhd::meta_range_t m_masterClockRange;
+
+	///@brief Largest decimation the DSP supports
+	size_t m_maxDecimation;
+
+	///@brief Subdev spec the channels were created from
+	std::string m_subdevSpec;
+
+	///@brief Sample rates the radio can produce exactly from the startup master clock, in ascending order
+	std::vector<size_t> m_sampleRates;
+
+	///@brief Capabilities of each receive channel
+	std::vector<ChannelCaps> m_channels;
+
+protected:
+	static std::vector<size_t> GetExactRates(const uhd::meta_range_t& range, double clock);
+};
+
+extern DeviceCaps g_caps;
+
+#endif
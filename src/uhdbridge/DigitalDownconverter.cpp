@@ -0,0 +1,325 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of DigitalDownconverter
+ */
+
+#include "uhdbridge.h"
+#include "DigitalDownconverter.h"
+#include "RxBlockPool.h"
+#include "CpuPlacement.h"
+#include <complex>
+#include <limits>
+#include <math.h>
+
+using namespace std;
+
+//Number of filter taps per output phase. At 32 the Blackman transition band ends just short of the output Nyquist
+//frequency, so nothing aliases into the passband.
+static const size_t g_tapsPerPhase = 32;
+
+//Number of samples each thread mixes before re-seeding the NCO from the absolute phase
+static const size_t g_mixChunkSize = 4096;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+DigitalDownconverter::DigitalDownconverter()
+	: m_decimation(1)
+	, m_frequency(0)
+	, m_rate(0)
+	, m_channels(0)
+{
+	DesignFilter();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Configuration
+
+/**
+	@brief Sets up the filter for a new decimation ratio / rate and forgets all history
+ */
+void DigitalDownconverter::Configure(size_t decimation, double frequency, int64_t rate, size_t nchans)
+{
+	m_decimation = decimation;
+	m_frequency = frequency;
+	m_rate = rate;
+	m_channels = nchans;
+	DesignFilter();
+
+	LogDebug("DDC: %.3f MHz shift, decimate by %zu (%zu taps)\n", frequency * 1e-6, decimation, m_taps.size());
+}
+
+/**
+	@brief Builds a Blackman-windowed sinc low-pass with its cutoff at 80% of the output Nyquist frequency
+ */
+void DigitalDownconverter::DesignFilter()
+{
+	//No decimation, no filter: just the mixer
+	if(m_decimation <= 1)
+	{
+		m_taps.assign(1, 1.0f);
+		return;
+	}
+
+	size_t ntaps = g_tapsPerPhase * m_decimation + 1;
+	double cutoff = 0.4 / m_decimation;
+	double mid = (ntaps - 1) / 2.0;
+	vector<double> taps(ntaps);
+	double sum = 0;
+	for(size_t i=0; i<ntaps; i++)
+	{
+		double x = i - mid;
+		double sinc = (x == 0) ? (2 * cutoff) : (sin(2 * M_PI * cutoff * x) / (M_PI * x));
+		double window = 0.42 - 0.5*cos(2 * M_PI * i / (ntaps - 1)) + 0.08*cos(4 * M_PI * i / (ntaps - 1));
+		taps[i] = sinc * window;
+		sum += taps[i];
+	}
+
+	//Normalize for unity gain at DC, and store reversed so the inner loop walks forward through both arrays
+	m_taps.resize(ntaps);
+	for(size_t i=0; i<ntaps; i++)
+		m_taps[i] = taps[ntaps - 1 - i] / sum;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Processing
+
+/**
+	@brief Downconverts a block
+
+	@param in			Block straight from the radio. Ownership passes to the DDC.
+	@param contiguous	True if the block immediately follows the previous one, so filter history can be reused
+
+	@return The downconverted block, or the input block untouched if the DDC is off (or there's no buffer for it)
+ */
+RxBlock* DigitalDownconverter::Process(RxBlock* in, bool contiguous)
+{
+	size_t decimation = max(g_ddcDecimation.load(), (size_t)1);
+	double frequency = g_ddcFrequency.load();
+	if( (decimation == 1) && (frequency == 0) )
+		return in;
+	g_threadPlacement.RefreshHelpers();
+
+	size_t nchans = in->m_channels.size();
+	if( (decimation != m_decimation) || (frequency != m_frequency) || (in->m_rate != m_rate) || (nchans != m_channels))
+	{
+		Configure(decimation, frequency, in->m_rate, nchans);
+		contiguous = false;
+	}
+
+	//Start from silence if we don't have the samples leading up to this block
+	size_t nhist = m_taps.size() - 1;
+	if(!contiguous)
+	{
+		m_historyI.assign(nchans, vector<float>(nhist, 0.0f));
+		m_historyQ.assign(nchans, vector<float>(nhist, 0.0f));
+	}
+
+	//Keep the decimation phase locked to the absolute sample number, so consecutive blocks line up
+	uint64_t first = in->m_firstSample;
+	uint64_t firstKept = (first + decimation - 1) / decimation * decimation;
+	size_t skip = min<uint64_t>(firstKept - first, in->m_length);
+	size_t count = (in->m_length - skip + decimation - 1) / decimation;
+
+	//Get a buffer for the output (same format and fewer samples, so a pool buffer always fits)
+	RxBlock* out = g_blockPool.Acquire();
+	if(!out)
+		return in;
+	out->m_format = in->m_format;
+	out->m_channels = in->m_channels;
+	if(out->GetSampleCapacity() < count)
+	{
+		g_blockPool.Release(out);
+		return in;
+	}
+	out->m_stride = count;
+
+	for(size_t c=0; c<nchans; c++)
+	{
+		switch(in->m_format)
+		{
+			case FORMAT_SC16:
+				LoadChannel<int16_t>(*in, c);
+				StoreChannel<int16_t>(*out, c, skip, count);
+				break;
+
+			case FORMAT_SC8:
+				LoadChannel<int8_t>(*in, c);
+				StoreChannel<int8_t>(*out, c, skip, count);
+				break;
+
+			case FORMAT_FC32:
+			default:
+				LoadChannel<float>(*in, c);
+				StoreChannel<float>(*out, c, skip, count);
+				break;
+		}
+
+		//Save the tail for next time
+		size_t total = m_scratchI.size();
+		m_historyI[c].assign(m_scratchI.begin() + (total - nhist), m_scratchI.end());
+		m_historyQ[c].assign(m_scratchQ.begin() + (total - nhist), m_scratchQ.end());
+	}
+
+	//Output is centered on the NCO frequency, and can't be any wider than the new Nyquist bandwidth
+	double outRate = static_cast<double>(in->m_rate) / decimation;
+	for(auto& chan : out->m_channels)
+	{
+		chan.m_centerFrequency += frequency;
+		if(decimation > 1)
+			chan.m_bandwidth = min(chan.m_bandwidth, 0.8 * outRate);
+	}
+
+	//Each output sample lines up with the center of the filter, (taps-1)/2 input samples before the newest one
+	out->m_length = count;
+	out->m_requested = in->m_requested / decimation;
+	out->m_rate = in->m_rate / decimation;
+	out->m_firstSample = firstKept / decimation;
+	out->m_startTime = in->m_startTime + uhd::time_spec_t::from_ticks(skip, in->m_rate)
+		- uhd::time_spec_t::from_ticks(nhist / 2, in->m_rate);
+	out->m_timeValid = in->m_timeValid;
+	out->m_sequence = in->m_sequence;
+	out->m_discontinuity = in->m_discontinuity;
+	out->m_overflow = in->m_overflow;
+	out->m_triggered = in->m_triggered;
+
+	//Output sample k is centered on input sample skip + k*decimation - nhist/2, same as the start time above, so the
+	//trigger goes on the nearest one. Triggers outside the output (the filter delay pushes the last few past the
+	//end) are clamped to the nearest sample.
+	if(in->m_triggered)
+	{
+		uint64_t center = in->m_triggerOffset + nhist / 2;
+		uint64_t offset = (center > skip) ? (center - skip + decimation/2) / decimation : 0;
+		out->m_triggerOffset = (count > 0) ? min<uint64_t>(offset, count - 1) : 0;
+	}
+	out->m_scanStep = in->m_scanStep;
+	out->m_scanSteps = in->m_scanSteps;
+
+	g_blockPool.Release(in);
+	return out;
+}
+
+/**
+	@brief Converts one channel of a block to planar float, mixes it down, and appends it to the filter history
+
+	Leaves the history followed by the new samples in m_scratchI / m_scratchQ.
+ */
+template<class T>
+void DigitalDownconverter::LoadChannel(RxBlock& in, size_t chan)
+{
+	size_t nhist = m_historyI[chan].size();
+	size_t len = in.m_length;
+	m_scratchI.resize(nhist + len);
+	m_scratchQ.resize(nhist + len);
+	copy(m_historyI[chan].begin(), m_historyI[chan].end(), m_scratchI.begin());
+	copy(m_historyQ[chan].begin(), m_historyQ[chan].end(), m_scratchQ.begin());
+
+	const T* src = static_cast<const T*>(in.GetSample(chan, 0));
+	float* dstI = &m_scratchI[nhist];
+	float* dstQ = &m_scratchQ[nhist];
+	float scale = GetFormatScale(in.m_format);
+
+	//NCO phase is a function of the absolute sample number, so it's continuous across blocks with no extra state.
+	//Each chunk is seeded from the exact phase then rotated sample by sample.
+	double cyclesPerSample = -m_frequency / m_rate;
+	complex<float> step = polar(1.0f, (float)(2 * M_PI * cyclesPerSample));
+	uint64_t first = in.m_firstSample;
+	size_t nchunks = (len + g_mixChunkSize - 1) / g_mixChunkSize;
+
+	#pragma omp parallel for
+	for(size_t chunk=0; chunk<nchunks; chunk++)
+	{
+		size_t start = chunk * g_mixChunkSize;
+		size_t end = min(start + g_mixChunkSize, len);
+
+		double cycles = cyclesPerSample * static_cast<double>(first + start);
+		complex<float> nco = polar(1.0f, (float)(2 * M_PI * (cycles - floor(cycles))));
+		for(size_t i=start; i<end; i++)
+		{
+			complex<float> sample(src[i*2] * scale, src[i*2 + 1] * scale);
+			sample *= nco;
+			dstI[i] = sample.real();
+			dstQ[i] = sample.imag();
+			nco *= step;
+		}
+	}
+}
+
+/**
+	@brief Filters and decimates the samples loaded by LoadChannel() into one channel of the output block
+
+	@param out		Output block
+	@param chan		Channel index
+	@param first	Offset of the first kept sample in the input block
+	@param count	Number of output samples
+ */
+template<class T>
+void DigitalDownconverter::StoreChannel(RxBlock& out, size_t chan, size_t first, size_t count)
+{
+	T* dst = static_cast<T*>(out.GetSample(chan, 0));
+	float scale = GetFormatScale(out.m_format);
+	size_t ntaps = m_taps.size();
+	size_t decimation = m_decimation;
+	const float* taps = &m_taps[0];
+	const float* srcI = m_scratchI.data();
+	const float* srcQ = m_scratchQ.data();
+
+	//Output sample i sits on input sample (first + i*decimation), which is at the end of the filter window since the
+	//history is in front of it
+	#pragma omp parallel for
+	for(size_t i=0; i<count; i++)
+	{
+		size_t base = first + i*decimation;
+		float accI = 0;
+		float accQ = 0;
+
+		#pragma omp simd reduction(+:accI,accQ)
+		for(size_t k=0; k<ntaps; k++)
+		{
+			accI += taps[k] * srcI[base + k];
+			accQ += taps[k] * srcQ[base + k];
+		}
+
+		accI /= scale;
+		accQ /= scale;
+		if(numeric_limits<T>::is_integer)
+		{
+			accI = max(min(accI, (float)numeric_limits<T>::max()), (float)numeric_limits<T>::min());
+			accQ = max(min(accQ, (float)numeric_limits<T>::max()), (float)numeric_limits<T>::min());
+			accI = roundf(accI);
+			accQ = roundf(accQ);
+		}
+		dst[i*2] = static_cast<T>(accI);
+		dst[i*2 + 1] = static_cast<T>(accQ);
+	}
+}
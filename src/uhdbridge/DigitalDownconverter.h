@@ -0,0 +1,97 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of DigitalDownconverter
+ */
+
+#ifndef DigitalDownconverter_h
+#define DigitalDownconverter_h
+
+#include "RxBlock.h"
+#include <atomic>
+#include <vector>
+
+/**
+	@brief Frequency shift and decimation of received blocks, so the client only gets the sub-band it cares about
+
+	Each channel is mixed with an NCO (shifting g_ddcFrequency down to DC), low-pass filtered, and decimated by
+	g_ddcDecimation. The FIR only evaluates the outputs which are kept, so it costs the same as a polyphase
+	implementation. Filter history is carried over between contiguous blocks, so continuous streams come out seamless.
+
+	Output stays in the same sample format as the input.
+ */
+class DigitalDownconverter
+{
+public:
+	DigitalDownconverter();
+
+	RxBlock* Process(RxBlock* in, bool contiguous);
+
+protected:
+	void Configure(size_t decimation, double frequency, int64_t rate, size_t nchans);
+	void DesignFilter();
+
+	template<class T> void LoadChannel(RxBlock& in, size_t chan);
+	template<class T> void StoreChannel(RxBlock& out, size_t chan, size_t first, size_t count);
+
+	///@brief Decimation factor
+	size_t m_decimation;
+
+	///@brief NCO frequency, relative to the center frequency, in Hz
+	double m_frequency;
+
+	///@brief Input sample rate, in Hz
+	int64_t m_rate;
+
+	///@brief Number of channels the history is sized for
+	size_t m_channels;
+
+	///@brief Low-pass filter taps, time reversed
+	std::vector<float> m_taps;
+
+	///@brief Last (taps - 1) mixed I samples of each channel from the previous block
+	std::vector< std::vector<float> > m_historyI;
+
+	///@brief Last (taps - 1) mixed Q samples of each channel from the previous block
+	std::vector< std::vector<float> > m_historyQ;
+
+	///@brief Filter history followed by the mixed I samples of the current block, for the channel being processed
+	std::vector<float> m_scratchI;
+
+	///@brief Filter history followed by the mixed Q samples of the current block, for the channel being processed
+	std::vector<float> m_scratchQ;
+};
+
+extern std::atomic<size_t> g_ddcDecimation;
+extern std::atomic<double> g_ddcFrequency;
+
+#endif
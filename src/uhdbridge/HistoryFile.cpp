@@ -0,0 +1,632 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of HistoryFile
+ */
+
+#include "uhdbridge.h"
+#include "HistoryFile.h"
+#include "RxConfig.h"
+#include <string.h>
+#include <errno.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+using namespace std;
+
+HistoryFile g_history;
+
+//Samples per channel copied out per chunk while saving
+static const size_t g_saveChunk = 256 * 1024;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+HistoryFile::HistoryFile()
+	: m_wantEnabled(false)
+	, m_wantSize(0)
+	, m_fd(-1)
+	, m_map(nullptr)
+	, m_mapSize(0)
+	, m_active(false)
+	, m_format(FORMAT_FC32)
+	, m_rate(1)
+	, m_capacity(0)
+	, m_written(0)
+	, m_writeEnd(0)
+	, m_break(true)
+	, m_currentTimeValid(false)
+	, m_cancelSave(false)
+	, m_saveArmed(false)
+	, m_saveReady(false)
+	, m_saveWait(false)
+	, m_savePre(0)
+	, m_savePost(0)
+{
+}
+
+HistoryFile::~HistoryFile()
+{
+	CancelSave();
+	Unmap();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Control plane
+
+/**
+	@brief Starts keeping history in the given file, from the next stream start
+
+	@param path		Backing file, which is created (or overwritten) and allocated up front
+	@param bytes	Size of the file
+ */
+void HistoryFile::Enable(const string& path, size_t bytes)
+{
+	lock_guard<mutex> lock(m_mapMutex);
+	m_wantPath = path;
+	m_wantSize = bytes;
+	m_wantEnabled = true;
+}
+
+/**
+	@brief Stops keeping history right away, and releases the file at the next stream start
+ */
+void HistoryFile::Disable()
+{
+	CancelSave();
+	m_wantEnabled = false;
+}
+
+/**
+	@brief Gets the device times of the oldest and newest samples in the history
+
+	@return False if there's no timestamped history
+ */
+bool HistoryFile::GetRange(uhd::time_spec_t& start, uhd::time_spec_t& end)
+{
+	lock_guard<mutex> lock(m_indexMutex);
+	uint64_t written = m_written;
+	uint64_t oldest = (written > m_capacity) ? (written - m_capacity) : 0;
+
+	bool found = false;
+	for(size_t i=0; i<m_segments.size(); i++)
+	{
+		auto& seg = m_segments[i];
+		uint64_t segEnd = (i+1 < m_segments.size()) ? m_segments[i+1].m_sampleStart : written;
+		if(!seg.m_timeValid || (segEnd <= oldest) || (segEnd <= seg.m_sampleStart) )
+			continue;
+
+		if(!found)
+			start = GetSampleTime(seg, max(oldest, seg.m_sampleStart));
+		end = GetSampleTime(seg, segEnd);
+		found = true;
+	}
+	return found;
+}
+
+/**
+	@brief Saves the part of the history between two device times as a SigMF recording
+
+	Whatever part of the range is still in the history is saved; each segment becomes a SigMF capture. Runs on the
+	save thread while streaming carries on, and gives up early if the save is cancelled.
+
+	@return False if nothing could be saved
+ */
+bool HistoryFile::Save(const string& path, const uhd::time_spec_t& start, const uhd::time_spec_t& end)
+{
+	lock_guard<mutex> lock(m_mapMutex);
+	if(m_map == nullptr)
+	{
+		LogError("No history to save\n");
+		return false;
+	}
+
+	//Snapshot the index, the writer may add to it while we're copying
+	vector<SigMFCapture> segments;
+	uint64_t written;
+	{
+		lock_guard<mutex> ilock(m_indexMutex);
+		segments = m_segments;
+		written = m_written;
+	}
+	uint64_t oldest = (written > m_capacity) ? (written - m_capacity) : 0;
+
+	//Work out which samples of each segment fall in the range
+	SigMFMetadata meta;
+	meta.m_format = m_format;
+	meta.m_rate = m_rate;
+	meta.m_numChannels = m_channels.size();
+	vector< pair<uint64_t, uint64_t> > pieces;
+	uint64_t total = 0;
+	for(size_t i=0; i<segments.size(); i++)
+	{
+		auto& seg = segments[i];
+		if(!seg.m_timeValid)
+			continue;
+
+		int64_t segStart = max(oldest, seg.m_sampleStart);
+		int64_t segEnd = (i+1 < segments.size()) ? segments[i+1].m_sampleStart : written;
+		int64_t first = seg.m_sampleStart + (start - seg.m_time).to_ticks(m_rate);
+		int64_t last = seg.m_sampleStart + (end - seg.m_time).to_ticks(m_rate);
+		first = max(first, segStart);
+		last = min(last, segEnd);
+		if(first >= last)
+			continue;
+
+		SigMFCapture capture = seg;
+		capture.m_sampleStart = total;
+		capture.m_time = GetSampleTime(seg, first);
+		capture.m_discontinuity = !pieces.empty() && (static_cast<uint64_t>(first) != pieces.back().second);
+		meta.m_captures.push_back(capture);
+		pieces.push_back(pair<uint64_t, uint64_t>(first, last));
+		total += last - first;
+	}
+	if(pieces.empty())
+	{
+		LogError("Requested time range is not in the history\n");
+		return false;
+	}
+
+	string base = SigMFMetadata::GetBasePath(path);
+	string dataPath = base + ".sigmf-data";
+	FILE* fp = fopen(dataPath.c_str(), "wb");
+	if(!fp)
+	{
+		LogError("Couldn't create %s: %s\n", dataPath.c_str(), strerror(errno));
+		return false;
+	}
+
+	//Copy out, stopping early if the writer catches up with us
+	vector<uint8_t> buf;
+	uint64_t saved = 0;
+	bool overwritten = false;
+	bool writeFailed = false;
+	bool cancelled = false;
+	int writeError = 0;
+	for(size_t i=0; (i < pieces.size()) && !overwritten && !writeFailed && !cancelled; i++)
+	{
+		for(uint64_t pos = pieces[i].first; pos < pieces[i].second; )
+		{
+			if(m_cancelSave)
+			{
+				cancelled = true;
+				break;
+			}
+
+			uint64_t count = min<uint64_t>(g_saveChunk, pieces[i].second - pos);
+			if(!CopyOut(pos, count, buf))
+			{
+				overwritten = true;
+				break;
+			}
+			if(fwrite(&buf[0], 1, buf.size(), fp) != buf.size())
+			{
+				writeFailed = true;
+				writeError = errno;
+				break;
+			}
+			pos += count;
+			saved += count;
+		}
+	}
+	fclose(fp);
+
+	if(overwritten)
+	{
+		LogWarning("History was overwritten while saving, only saved %zu of %zu samples\n",
+			(size_t)saved, (size_t)total);
+	}
+	else if(writeFailed)
+	{
+		LogError("Failed to write %s, only saved %zu of %zu samples: %s\n",
+			dataPath.c_str(), (size_t)saved, (size_t)total, strerror(writeError));
+	}
+	else if(cancelled)
+		LogWarning("History save cancelled, only saved %zu of %zu samples\n", (size_t)saved, (size_t)total);
+
+	//Keep what we got, with the metadata trimmed to match
+	if(overwritten || writeFailed || cancelled)
+	{
+		while(!meta.m_captures.empty() && (meta.m_captures.back().m_sampleStart >= saved) )
+			meta.m_captures.pop_back();
+	}
+
+	if(!meta.Write(base + ".sigmf-meta"))
+	{
+		LogError("Failed to write %s.sigmf-meta\n", base.c_str());
+		return false;
+	}
+
+	LogNotice("Saved %.3f s of history to %s\n", static_cast<double>(saved) / m_rate, dataPath.c_str());
+	return saved > 0;
+}
+
+/**
+	@brief Interleaves samples out of the mapping into a buffer
+
+	Sample n shares its slot with sample n + m_capacity, so the copy is only good if no write that has started, before
+	or during it, reaches past start + m_capacity.
+
+	@return False if the samples were overwritten while we were copying them
+ */
+bool HistoryFile::CopyOut(uint64_t start, uint64_t count, vector<uint8_t>& buf)
+{
+	size_t nchans = m_channels.size();
+	size_t bytesPerSample = GetBytesPerSample(m_format);
+	buf.resize(count * nchans * bytesPerSample);
+
+	//Too old already, or being overwritten right now?
+	if(m_writeEnd.load(memory_order_acquire) > start + m_capacity)
+		return false;
+
+	//Single channel is just a straight copy (in two parts if it wraps), otherwise interleave as we go
+	uint64_t pos = start % m_capacity;
+	if(nchans == 1)
+	{
+		size_t first = min<uint64_t>(count, m_capacity - pos);
+		memcpy(&buf[0], m_map + pos*bytesPerSample, first * bytesPerSample);
+		if(first < count)
+			memcpy(&buf[first * bytesPerSample], m_map, (count - first) * bytesPerSample);
+	}
+	else
+	{
+		for(size_t c=0; c<nchans; c++)
+		{
+			const uint8_t* region = m_map + c * m_capacity * bytesPerSample;
+			for(uint64_t i=0; i<count; i++)
+			{
+				memcpy(&buf[(i*nchans + c) * bytesPerSample], region + pos*bytesPerSample, bytesPerSample);
+				if(++pos == m_capacity)
+					pos = 0;
+			}
+			pos = start % m_capacity;
+		}
+	}
+
+	//If the writer started on any of these samples while we were copying, what we have may be torn
+	atomic_thread_fence(memory_order_acquire);
+	if(m_writeEnd.load(memory_order_relaxed) > start + m_capacity)
+		return false;
+
+	return true;
+}
+
+/**
+	@brief Saves the part of the history between two device times as a SigMF recording, in the background
+
+	Replaces any save which is already armed or in progress.
+
+	@param path		Path of the SigMF recording to write
+	@param start	Device time of the first sample to save
+	@param end		Device time of the end of the range
+ */
+void HistoryFile::QueueSave(const string& path, const uhd::time_spec_t& start, const uhd::time_spec_t& end)
+{
+	CancelSave();
+
+	lock_guard<mutex> lock(m_saveMutex);
+	m_savePath = path;
+	m_saveStart = start;
+	m_saveEnd = end;
+	m_saveWait = false;
+	m_saveReady = true;
+	m_cancelSave = false;
+	m_saveThread = thread(&HistoryFile::SaveThread, this);
+}
+
+/**
+	@brief Saves the history around the next software trigger, once enough post-trigger samples have arrived
+
+	Replaces any save which is already armed or in progress.
+
+	@param path		Path of the SigMF recording to write
+	@param pre		Seconds of history before the trigger to save
+	@param post		Seconds of history after the trigger to save
+ */
+void HistoryFile::ArmSave(const string& path, double pre, double post)
+{
+	CancelSave();
+
+	lock_guard<mutex> lock(m_saveMutex);
+	m_savePath = path;
+	m_savePre = pre;
+	m_savePost = post;
+	m_saveWait = true;
+	m_saveReady = false;
+	m_cancelSave = false;
+	m_saveArmed = true;
+	m_saveThread = thread(&HistoryFile::SaveThread, this);
+}
+
+/**
+	@brief Gives up on any pending save
+ */
+void HistoryFile::CancelSave()
+{
+	m_cancelSave = true;
+	if(m_saveThread.joinable())
+		m_saveThread.join();
+	m_saveArmed = false;
+}
+
+/**
+	@brief Saves the pending range, first waiting for the trigger and the post-trigger samples if it's armed
+ */
+void HistoryFile::SaveThread()
+{
+#ifdef __linux__
+	pthread_setname_np(pthread_self(), "HistorySave");
+#endif
+
+	while(!m_cancelSave)
+	{
+		if(m_saveReady)
+		{
+			string path;
+			uhd::time_spec_t start;
+			uhd::time_spec_t end;
+			bool wait;
+			{
+				lock_guard<mutex> lock(m_saveMutex);
+				path = m_savePath;
+				start = m_saveStart;
+				end = m_saveEnd;
+				wait = m_saveWait;
+			}
+
+			uhd::time_spec_t oldest;
+			uhd::time_spec_t newest;
+			if(!wait || (GetRange(oldest, newest) && (newest >= end)) )
+			{
+				Save(path, start, end);
+				m_saveArmed = false;
+				break;
+			}
+		}
+		this_thread::sleep_for(chrono::milliseconds(10));
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Data plane thread
+
+/**
+	@brief Tells a pending ArmSave() that the software trigger fired at the given device time
+
+	Only the first trigger after arming counts.
+ */
+void HistoryFile::OnTrigger(const uhd::time_spec_t& time)
+{
+	if(m_saveReady || !m_saveArmed)
+		return;
+
+	lock_guard<mutex> lock(m_saveMutex);
+	m_saveStart = time - uhd::time_spec_t(m_savePre);
+	m_saveEnd = time + uhd::time_spec_t(m_savePost);
+	m_saveReady = true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Receive thread
+
+/**
+	@brief Gets ready for a new stream, applying any settings changes
+
+	Starts the history over if the file, format, rate or channels changed, otherwise carries on where the last stream
+	left off (with a gap).
+ */
+void HistoryFile::BeginStream(SampleFormat format, int64_t rate, const vector<size_t>& channels)
+{
+	lock_guard<mutex> lock(m_mapMutex);
+	m_active = false;
+	if(!m_wantEnabled)
+	{
+		Unmap();
+		return;
+	}
+
+	bool reset = (m_map == nullptr) || (m_path != m_wantPath) || (m_mapSize != m_wantSize) ||
+		(m_format != format) || (m_rate != rate) || (m_channels != channels);
+	if(reset)
+	{
+		Unmap();
+		m_path = m_wantPath;
+		m_mapSize = m_wantSize;
+		if(!Map())
+			return;
+
+		lock_guard<mutex> ilock(m_indexMutex);
+		m_format = format;
+		m_rate = rate;
+		m_channels = channels;
+		m_capacity = m_mapSize / (GetBytesPerSample(format) * channels.size());
+		m_written = 0;
+		m_writeEnd = 0;
+		m_segments.clear();
+
+		LogNotice("Keeping %.1f s of history in %s\n", static_cast<double>(m_capacity) / rate, m_path.c_str());
+	}
+
+	m_break = true;
+	m_active = true;
+}
+
+/**
+	@brief Adds newly received samples to the history
+
+	@param buffs		Samples for each channel, in stream order
+	@param count		Number of samples per channel
+	@param time			Device time of the first sample
+	@param timeValid	True if time came from the radio
+	@param config		Settings the samples were received with
+ */
+void HistoryFile::Append(
+	const vector<void*>& buffs,
+	size_t count,
+	const uhd::time_spec_t& time,
+	bool timeValid,
+	const RxConfig& config)
+{
+	if(!m_active || !m_wantEnabled || (count == 0) )
+		return;
+
+	if(m_break || (timeValid && !m_currentTimeValid) || IsRetuned(config))
+		StartSegment(time, timeValid, config);
+
+	//Copy each channel into its region, wrapping around the end if needed
+	size_t bytesPerSample = GetBytesPerSample(m_format);
+	uint64_t written = m_written.load(memory_order_relaxed);
+	uint64_t pos = written % m_capacity;
+
+	//Tell CopyOut() which slots are about to change before touching them, so it can't miss a write in progress
+	m_writeEnd.store(written + count, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	size_t first = min<uint64_t>(count, m_capacity - pos);
+	for(size_t c=0; c<buffs.size(); c++)
+	{
+		uint8_t* region = m_map + c * m_capacity * bytesPerSample;
+		const uint8_t* src = static_cast<const uint8_t*>(buffs[c]);
+		memcpy(region + pos*bytesPerSample, src, first * bytesPerSample);
+		if(first < count)
+			memcpy(region, src + first*bytesPerSample, (count - first) * bytesPerSample);
+	}
+	m_written.store(written + count, memory_order_release);
+}
+
+/**
+	@brief Starts a new segment at the current write position, forgetting segments which have been overwritten
+ */
+void HistoryFile::StartSegment(const uhd::time_spec_t& time, bool timeValid, const RxConfig& config)
+{
+	SigMFCapture seg;
+	seg.m_sampleStart = m_written;
+	seg.m_time = time;
+	seg.m_timeValid = timeValid;
+	seg.m_discontinuity = m_break;
+	for(auto i : m_channels)
+	{
+		auto& chan = config.m_channels[i];
+		seg.m_channels.push_back(RxBlockChannel(i, chan.m_centerFrequency, chan.m_gain, chan.m_bandwidth));
+	}
+	m_current = seg.m_channels;
+	m_currentTimeValid = timeValid;
+	m_break = false;
+
+	uint64_t oldest = (seg.m_sampleStart > m_capacity) ? (seg.m_sampleStart - m_capacity) : 0;
+	lock_guard<mutex> lock(m_indexMutex);
+	while( (m_segments.size() > 1) && (m_segments[1].m_sampleStart <= oldest) )
+		m_segments.erase(m_segments.begin());
+	m_segments.push_back(seg);
+}
+
+/**
+	@brief Checks if the radio has been retuned since the current segment started
+ */
+bool HistoryFile::IsRetuned(const RxConfig& config)
+{
+	for(auto& c : m_current)
+	{
+		auto& chan = config.m_channels[c.m_index];
+		if( (chan.m_centerFrequency != c.m_centerFrequency) || (chan.m_gain != c.m_gain) ||
+			(chan.m_bandwidth != c.m_bandwidth) )
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Helpers
+
+///@brief Returns the device time of a sample, given the segment it's in
+uhd::time_spec_t HistoryFile::GetSampleTime(const SigMFCapture& segment, uint64_t sample)
+{
+	return segment.m_time + uhd::time_spec_t::from_ticks(sample - segment.m_sampleStart, m_rate);
+}
+
+/**
+	@brief Creates, allocates and maps the backing file. Must be called with m_mapMutex held.
+ */
+bool HistoryFile::Map()
+{
+#ifdef _WIN32
+	LogError("History files are not supported on this platform\n");
+	return false;
+#else
+	m_fd = open(m_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if(m_fd < 0)
+	{
+		LogError("Couldn't create %s: %s\n", m_path.c_str(), strerror(errno));
+		return false;
+	}
+
+	//Allocate the whole file now, so we never take a SIGBUS writing to it if the disk fills up
+	int err = posix_fallocate(m_fd, 0, m_mapSize);
+	if(err != 0)
+	{
+		LogError("Couldn't allocate %zu bytes for %s: %s\n", m_mapSize, m_path.c_str(), strerror(err));
+		Unmap();
+		return false;
+	}
+
+	void* map = mmap(nullptr, m_mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+	if(map == MAP_FAILED)
+	{
+		LogError("Couldn't map %s: %s\n", m_path.c_str(), strerror(errno));
+		Unmap();
+		return false;
+	}
+	m_map = static_cast<uint8_t*>(map);
+	return true;
+#endif
+}
+
+/**
+	@brief Unmaps and closes the backing file, if any. Must be called with m_mapMutex held.
+ */
+void HistoryFile::Unmap()
+{
+#ifndef _WIN32
+	if(m_map)
+		munmap(m_map, m_mapSize);
+	if(m_fd >= 0)
+		close(m_fd);
+#endif
+	m_map = nullptr;
+	m_fd = -1;
+}
@@ -0,0 +1,209 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of HistoryFile
+ */
+
+#ifndef HistoryFile_h
+#define HistoryFile_h
+
+#include "SigMFMetadata.h"
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class RxConfig;
+
+/**
+	@brief Keeps the last few seconds (or minutes) of IQ in a large memory-mapped ring file, for pulling out the
+	samples around an intermittent event after the fact
+
+	The receive thread writes every sample it gets from the radio in continuous and triggered modes straight into the
+	mapping (one planar region per channel, like SampleHistory but on disk), so history depth is limited by disk space
+	rather than RAM. Appending is lock-free apart from starting a new segment, which only happens after an overflow, a
+	retune or the start of a stream. Writing never waits for the disk unless the kernel's dirty page limits are hit;
+	if the disk can't keep up with the radio, that shows up as overflows.
+
+	An index of segments (runs of contiguous samples, each with the device time of its first sample) maps device time
+	to position in the file. QueueSave() copies a time range out to a SigMF recording on a separate thread, so the
+	control plane doesn't wait for the disk; since the copy runs while the receive thread keeps writing, it checks after
+	each chunk that the samples it copied weren't overwritten underneath it. ArmSave() does the same automatically
+	around the next software trigger.
+
+	Settings changes (Enable(), Disable()) take effect the next time a stream starts, so the mapping never changes
+	under the receive thread.
+ */
+class HistoryFile
+{
+public:
+	HistoryFile();
+	~HistoryFile();
+
+	//Control plane
+	void Enable(const std::string& path, size_t bytes);
+	void Disable();
+	bool GetRange(uhd::time_spec_t& start, uhd::time_spec_t& end);
+	void QueueSave(const std::string& path, const uhd::time_spec_t& start, const uhd::time_spec_t& end);
+	void ArmSave(const std::string& path, double pre, double post);
+
+	///@brief Returns true if history will be kept from the next stream start
+	bool IsEnabled() const
+	{ return m_wantEnabled; }
+
+	//Data plane thread
+	void OnTrigger(const uhd::time_spec_t& time);
+
+	//Receive thread
+	void BeginStream(SampleFormat format, int64_t rate, const std::vector<size_t>& channels);
+	void Append(
+		const std::vector<void*>& buffs,
+		size_t count,
+		const uhd::time_spec_t& time,
+		bool timeValid,
+		const RxConfig& config);
+
+	///@brief Notes that samples were lost, so the next Append() starts a new segment
+	void Break()
+	{ m_break = true; }
+
+protected:
+	bool Map();
+	void Unmap();
+	void StartSegment(const uhd::time_spec_t& time, bool timeValid, const RxConfig& config);
+	bool IsRetuned(const RxConfig& config);
+	uhd::time_spec_t GetSampleTime(const SigMFCapture& segment, uint64_t sample);
+	bool Save(const std::string& path, const uhd::time_spec_t& start, const uhd::time_spec_t& end);
+	bool CopyOut(uint64_t start, uint64_t count, std::vector<uint8_t>& buf);
+	void SaveThread();
+	void CancelSave();
+
+	///@brief Protects the mapping and its format, so it can't change while Save() is copying out of it
+	std::mutex m_mapMutex;
+
+	///@brief Protects m_segments
+	std::mutex m_indexMutex;
+
+	///@brief True if history should be kept from the next stream start
+	std::atomic<bool> m_wantEnabled;
+
+	///@brief Backing file requested by Enable()
+	std::string m_wantPath;
+
+	///@brief File size requested by Enable(), in bytes
+	size_t m_wantSize;
+
+	///@brief Backing file currently mapped
+	std::string m_path;
+
+	///@brief File descriptor of the backing file
+	int m_fd;
+
+	///@brief The mapping, or null if none
+	uint8_t* m_map;
+
+	///@brief Size of m_map, in bytes
+	size_t m_mapSize;
+
+	///@brief True if the receive thread should write to the mapping
+	bool m_active;
+
+	///@brief Format of the samples in the mapping
+	SampleFormat m_format;
+
+	///@brief Sample rate of the samples in the mapping
+	int64_t m_rate;
+
+	///@brief Hardware channel stored in each region of the mapping
+	std::vector<size_t> m_channels;
+
+	///@brief Number of samples each channel's region holds
+	uint64_t m_capacity;
+
+	///@brief Total number of samples per channel ever written; the newest m_capacity of them are still in the file
+	std::atomic<uint64_t> m_written;
+
+	///@brief End of the write in progress (or of the last one), published before its samples are copied in
+	std::atomic<uint64_t> m_writeEnd;
+
+	///@brief Set when the next Append() has to start a new segment
+	std::atomic<bool> m_break;
+
+	///@brief Radio settings of the segment being written (receive thread only)
+	std::vector<RxBlockChannel> m_current;
+
+	///@brief True if the segment being written has a valid timestamp (receive thread only)
+	bool m_currentTimeValid;
+
+	///@brief Index of segments still (at least partly) in the file, oldest first. m_sampleStart counts from the
+	///first sample ever written.
+	std::vector<SigMFCapture> m_segments;
+
+	///@brief Protects the pending save
+	std::mutex m_saveMutex;
+
+	///@brief Thread doing the pending save, or waiting for the trigger to do it
+	std::thread m_saveThread;
+
+	///@brief Set to make m_saveThread give up
+	std::atomic<bool> m_cancelSave;
+
+	///@brief True while m_saveThread is waiting for a trigger
+	std::atomic<bool> m_saveArmed;
+
+	///@brief True once the range of the pending save is known: right away for QueueSave(), or once the trigger has
+	///fired for ArmSave()
+	std::atomic<bool> m_saveReady;
+
+	///@brief True if the pending save should wait until the end of its range is in the history
+	bool m_saveWait;
+
+	///@brief Device time of the start of the pending save
+	uhd::time_spec_t m_saveStart;
+
+	///@brief Device time of the end of the pending save
+	uhd::time_spec_t m_saveEnd;
+
+	///@brief Where to save the pending save to
+	std::string m_savePath;
+
+	///@brief Seconds of history before the trigger to save
+	double m_savePre;
+
+	///@brief Seconds of history after the trigger to save
+	double m_savePost;
+};
+
+extern HistoryFile g_history;
+
+#endif
@@ -0,0 +1,324 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of the magnitude scan kernels
+
+	The vector kernels square and sum pairs of floats to get |IQ|^2 for a batch of samples, compare the whole batch
+	against the threshold, and only look at the mask if something matched. Each ISA-specific function is compiled with
+	a target attribute rather than global -m flags, so the rest of the binary still runs on older CPUs.
+ */
+
+#include "MagnitudeKernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MAGNITUDE_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Scalar kernels
+
+static size_t FindAboveScalar(const float* iq, size_t count, float threshold)
+{
+	for(size_t i=0; i<count; i++)
+	{
+		float re = iq[i*2];
+		float im = iq[i*2 + 1];
+		if(re*re + im*im >= threshold)
+			return i;
+	}
+	return SIZE_MAX;
+}
+
+static size_t FindBelowScalar(const float* iq, size_t count, float threshold)
+{
+	for(size_t i=0; i<count; i++)
+	{
+		float re = iq[i*2];
+		float im = iq[i*2 + 1];
+		if(re*re + im*im <= threshold)
+			return i;
+	}
+	return SIZE_MAX;
+}
+
+#ifdef MAGNITUDE_KERNELS_X86
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// SSE2 kernels (4 samples per iteration)
+
+///@brief Computes |IQ|^2 of 4 consecutive samples, in order
+__attribute__((target("sse2")))
+static inline __m128 MagnitudeSquared4(const float* iq)
+{
+	__m128 a = _mm_loadu_ps(iq);
+	__m128 b = _mm_loadu_ps(iq + 4);
+	a = _mm_mul_ps(a, a);
+	b = _mm_mul_ps(b, b);
+
+	//Deinterleave into I^2 and Q^2 and add
+	__m128 re = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+	__m128 im = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+	return _mm_add_ps(re, im);
+}
+
+__attribute__((target("sse2")))
+static size_t FindAboveSSE2(const float* iq, size_t count, float threshold)
+{
+	__m128 thresh = _mm_set1_ps(threshold);
+	size_t end = count - (count % 4);
+	for(size_t i=0; i<end; i+=4)
+	{
+		int mask = _mm_movemask_ps(_mm_cmpge_ps(MagnitudeSquared4(iq + i*2), thresh));
+		if(mask)
+			return i + __builtin_ctz(mask);
+	}
+
+	size_t tail = FindAboveScalar(iq + end*2, count - end, threshold);
+	return (tail == SIZE_MAX) ? SIZE_MAX : end + tail;
+}
+
+__attribute__((target("sse2")))
+static size_t FindBelowSSE2(const float* iq, size_t count, float threshold)
+{
+	__m128 thresh = _mm_set1_ps(threshold);
+	size_t end = count - (count % 4);
+	for(size_t i=0; i<end; i+=4)
+	{
+		int mask = _mm_movemask_ps(_mm_cmple_ps(MagnitudeSquared4(iq + i*2), thresh));
+		if(mask)
+			return i + __builtin_ctz(mask);
+	}
+
+	size_t tail = FindBelowScalar(iq + end*2, count - end, threshold);
+	return (tail == SIZE_MAX) ? SIZE_MAX : end + tail;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// AVX2 kernels (8 samples per iteration)
+
+///@brief Computes |IQ|^2 of 8 consecutive samples, in order
+__attribute__((target("avx2")))
+static inline __m256 MagnitudeSquared8(const float* iq)
+{
+	__m256 a = _mm256_loadu_ps(iq);
+	__m256 b = _mm256_loadu_ps(iq + 8);
+	a = _mm256_mul_ps(a, a);
+	b = _mm256_mul_ps(b, b);
+
+	//hadd works within 128-bit lanes, so this gives samples 0 1 4 5 2 3 6 7. Put them back in order.
+	__m256 mag = _mm256_hadd_ps(a, b);
+	return _mm256_permutevar8x32_ps(mag, _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7));
+}
+
+__attribute__((target("avx2")))
+static size_t FindAboveAVX2(const float* iq, size_t count, float threshold)
+{
+	__m256 thresh = _mm256_set1_ps(threshold);
+	size_t end = count - (count % 8);
+	for(size_t i=0; i<end; i+=8)
+	{
+		int mask = _mm256_movemask_ps(_mm256_cmp_ps(MagnitudeSquared8(iq + i*2), thresh, _CMP_GE_OQ));
+		if(mask)
+			return i + __builtin_ctz(mask);
+	}
+
+	size_t tail = FindAboveScalar(iq + end*2, count - end, threshold);
+	return (tail == SIZE_MAX) ? SIZE_MAX : end + tail;
+}
+
+__attribute__((target("avx2")))
+static size_t FindBelowAVX2(const float* iq, size_t count, float threshold)
+{
+	__m256 thresh = _mm256_set1_ps(threshold);
+	size_t end = count - (count % 8);
+	for(size_t i=0; i<end; i+=8)
+	{
+		int mask = _mm256_movemask_ps(_mm256_cmp_ps(MagnitudeSquared8(iq + i*2), thresh, _CMP_LE_OQ));
+		if(mask)
+			return i + __builtin_ctz(mask);
+	}
+
+	size_t tail = FindBelowScalar(iq + end*2, count - end, threshold);
+	return (tail == SIZE_MAX) ? SIZE_MAX : end + tail;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// AVX-512 kernels (16 samples per iteration)
+
+///@brief Computes |IQ|^2 of 16 consecutive samples, in order
+__attribute__((target("avx512f")))
+static inline __m512 MagnitudeSquared16(const float* iq)
+{
+	__m512 a = _mm512_loadu_ps(iq);
+	__m512 b = _mm512_loadu_ps(iq + 16);
+	a = _mm512_mul_ps(a, a);
+	b = _mm512_mul_ps(b, b);
+
+	//Deinterleave into I^2 and Q^2 across both registers and add
+	__m512i evens = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+	__m512i odds = _mm512_setr_epi32(1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31);
+	__m512 re = _mm512_permutex2var_ps(a, evens, b);
+	__m512 im = _mm512_permutex2var_ps(a, odds, b);
+	return _mm512_add_ps(re, im);
+}
+
+__attribute__((target("avx512f")))
+static size_t FindAboveAVX512(const float* iq, size_t count, float threshold)
+{
+	__m512 thresh = _mm512_set1_ps(threshold);
+	size_t end = count - (count % 16);
+	for(size_t i=0; i<end; i+=16)
+	{
+		__mmask16 mask = _mm512_cmp_ps_mask(MagnitudeSquared16(iq + i*2), thresh, _CMP_GE_OQ);
+		if(mask)
+			return i + __builtin_ctz(mask);
+	}
+
+	size_t tail = FindAboveScalar(iq + end*2, count - end, threshold);
+	return (tail == SIZE_MAX) ? SIZE_MAX : end + tail;
+}
+
+__attribute__((target("avx512f")))
+static size_t FindBelowAVX512(const float* iq, size_t count, float threshold)
+{
+	__m512 thresh = _mm512_set1_ps(threshold);
+	size_t end = count - (count % 16);
+	for(size_t i=0; i<end; i+=16)
+	{
+		__mmask16 mask = _mm512_cmp_ps_mask(MagnitudeSquared16(iq + i*2), thresh, _CMP_LE_OQ);
+		if(mask)
+			return i + __builtin_ctz(mask);
+	}
+
+	size_t tail = FindBelowScalar(iq + end*2, count - end, threshold);
+	return (tail == SIZE_MAX) ? SIZE_MAX : end + tail;
+}
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Dispatch
+
+static const MagnitudeKernels g_magnitudeKernels[SIMD_LEVEL_COUNT] =
+{
+	{ FindAboveScalar, FindBelowScalar },
+#ifdef MAGNITUDE_KERNELS_X86
+	{ FindAboveSSE2, FindBelowSSE2 },
+	{ FindAboveAVX2, FindBelowAVX2 },
+	{ FindAboveAVX512, FindBelowAVX512 }
+#else
+	{ FindAboveScalar, FindBelowScalar },
+	{ FindAboveScalar, FindBelowScalar },
+	{ FindAboveScalar, FindBelowScalar }
+#endif
+};
+
+/**
+	@brief Checks if the CPU (and OS) can run kernels for the given instruction set
+ */
+bool IsSimdLevelSupported(SimdLevel level)
+{
+	switch(level)
+	{
+		case SIMD_SCALAR:
+			return true;
+
+#ifdef MAGNITUDE_KERNELS_X86
+		case SIMD_SSE2:
+			return __builtin_cpu_supports("sse2");
+
+		case SIMD_AVX2:
+			return __builtin_cpu_supports("avx2");
+
+		case SIMD_AVX512:
+			return __builtin_cpu_supports("avx512f");
+#endif
+
+		default:
+			return false;
+	}
+}
+
+static SimdLevel FindBestSimdLevel()
+{
+	int level = SIMD_LEVEL_COUNT - 1;
+	while(!IsSimdLevelSupported(static_cast<SimdLevel>(level)))
+		level --;
+	return static_cast<SimdLevel>(level);
+}
+
+/**
+	@brief Returns the fastest instruction set this CPU supports
+ */
+SimdLevel GetBestSimdLevel()
+{
+	static SimdLevel best = FindBestSimdLevel();
+	return best;
+}
+
+const char* GetSimdLevelName(SimdLevel level)
+{
+	switch(level)
+	{
+		case SIMD_SSE2:
+			return "SSE2";
+
+		case SIMD_AVX2:
+			return "AVX2";
+
+		case SIMD_AVX512:
+			return "AVX-512";
+
+		case SIMD_SCALAR:
+		default:
+			return "scalar";
+	}
+}
+
+/**
+	@brief Returns the kernels for a specific instruction set (caller must check it's supported)
+ */
+const MagnitudeKernels& GetMagnitudeKernels(SimdLevel level)
+{
+	if(level >= SIMD_LEVEL_COUNT)
+		level = SIMD_SCALAR;
+	return g_magnitudeKernels[level];
+}
+
+/**
+	@brief Returns the fastest kernels this CPU supports
+ */
+const MagnitudeKernels& GetMagnitudeKernels()
+{
+	return GetMagnitudeKernels(GetBestSimdLevel());
+}
@@ -0,0 +1,81 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Vectorized |IQ|^2 threshold scans used by the software trigger
+
+	Every kernel scans interleaved complex float32 samples and returns the index of the first sample whose squared
+	magnitude is at or above (or at or below) a threshold, or SIZE_MAX if there isn't one. The best implementation the
+	CPU supports is picked at runtime, so one binary runs everywhere.
+
+	This file deliberately doesn't depend on UHD or the rest of the bridge, so the benchmarks can link it on its own.
+ */
+
+#ifndef MagnitudeKernels_h
+#define MagnitudeKernels_h
+
+#include <cstddef>
+#include <cstdint>
+
+///@brief Instruction set levels we have kernels for, in increasing order of preference
+enum SimdLevel
+{
+	SIMD_SCALAR,
+	SIMD_SSE2,
+	SIMD_AVX2,
+	SIMD_AVX512,
+
+	SIMD_LEVEL_COUNT
+};
+
+///@brief Signature of a magnitude scan kernel
+typedef size_t (*MagnitudeScanFunction)(const float* iq, size_t count, float threshold);
+
+/**
+	@brief One set of magnitude scan kernels for a given instruction set
+ */
+class MagnitudeKernels
+{
+public:
+	///@brief Finds the first sample with |IQ|^2 >= threshold
+	MagnitudeScanFunction m_findAbove;
+
+	///@brief Finds the first sample with |IQ|^2 <= threshold
+	MagnitudeScanFunction m_findBelow;
+};
+
+bool IsSimdLevelSupported(SimdLevel level);
+SimdLevel GetBestSimdLevel();
+const char* GetSimdLevelName(SimdLevel level);
+const MagnitudeKernels& GetMagnitudeKernels(SimdLevel level);
+const MagnitudeKernels& GetMagnitudeKernels();
+
+#endif
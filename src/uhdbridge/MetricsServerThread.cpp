@@ -0,0 +1,285 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Minimal HTTP server exposing BridgeStats for Prometheus
+ */
+
+#include "uhdbridge.h"
+#include "BridgeStats.h"
+#include <functional>
+#include <map>
+#include <sstream>
+
+#ifndef _WIN32
+#include <sys/time.h>
+#endif
+
+using namespace std;
+
+/**
+	@brief Reads an HTTP request header, one byte at a time since requests are tiny and infrequent
+
+	@return The request line (e.g. "GET /metrics HTTP/1.1"), or an empty string if the client went away
+ */
+static string ReadRequest(Socket& client)
+{
+	string request;
+	char c;
+	while(request.length() < 8192)
+	{
+		if(!client.RecvLooped(reinterpret_cast<unsigned char*>(&c), 1))
+			return "";
+		request += c;
+
+		size_t len = request.length();
+		if( (len >= 4) && (request.compare(len - 4, 4, "\r\n\r\n") == 0) )
+			return request.substr(0, request.find("\r\n"));
+	}
+	return "";
+}
+
+///@brief Stops a stuck peer from holding us up for more than a couple of seconds
+static void SetReceiveTimeout(Socket& sock)
+{
+#ifndef _WIN32
+	struct timeval tv;
+	tv.tv_sec = 2;
+	tv.tv_usec = 0;
+	setsockopt(static_cast<ZSOCKET>(sock), SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+#else
+	(void)sock;
+#endif
+}
+
+/**
+	@brief Answers requests on g_metricsSocket until it's closed, one at a time
+
+	@param getBody	Produces the text to send for GET /metrics
+ */
+static void ServeRequests(const function<string()>& getBody)
+{
+	while(true)
+	{
+		Socket client = g_metricsSocket.Accept();
+		if(!client.IsValid())
+			break;
+		SetReceiveTimeout(client);
+
+		string request = ReadRequest(client);
+		if(request.empty())
+			continue;
+
+		string status;
+		string body;
+		if( (request.find("GET /metrics ") == 0) || (request.find("GET / ") == 0) )
+		{
+			status = "200 OK";
+			body = getBody();
+		}
+		else
+		{
+			status = "404 Not Found";
+			body = "Try /metrics\n";
+		}
+
+		string reply =
+			"HTTP/1.0 " + status + "\r\n"
+			"Content-Type: text/plain; version=0.0.4\r\n"
+			"Content-Length: " + to_string(body.length()) + "\r\n"
+			"Connection: close\r\n"
+			"\r\n" +
+			body;
+		client.SendLooped(reinterpret_cast<const unsigned char*>(reply.c_str()), reply.length());
+	}
+}
+
+/**
+	@brief Serves GET /metrics in Prometheus text format, one request per connection
+
+	Runs for the life of the process. Requests are handled one at a time on this thread, and never touch anything the
+	data plane threads wait on.
+ */
+void MetricsServerThread()
+{
+#ifdef __linux__
+	pthread_setname_np(pthread_self(), "MetricsThread");
+#endif
+
+	ServeRequests([]{ return g_stats.GetPrometheusText(); });
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Combined metrics for several bridges
+
+/**
+	@brief One metric family, gathered from several bridges
+ */
+class MetricFamily
+{
+public:
+	///@brief "# HELP" line
+	string m_help;
+
+	///@brief "# TYPE" line
+	string m_type;
+
+	///@brief Samples from every bridge, each labeled with its device
+	vector<string> m_samples;
+};
+
+/**
+	@brief Fetches /metrics from a bridge on this machine
+
+	@return The body, or an empty string if the bridge didn't answer
+ */
+static string FetchMetrics(uint16_t port)
+{
+	Socket sock(AF_INET6, SOCK_STREAM, IPPROTO_TCP);
+	if(!sock.Connect("::1", port))
+		return "";
+	SetReceiveTimeout(sock);
+
+	string request = "GET /metrics HTTP/1.0\r\n\r\n";
+	if(!sock.SendLooped(reinterpret_cast<const unsigned char*>(request.c_str()), request.length()))
+		return "";
+
+	//HTTP/1.0 with Connection: close, so the reply ends when the socket does
+	string reply;
+	char buf[4096];
+	while(true)
+	{
+		auto len = recv(static_cast<ZSOCKET>(sock), buf, sizeof(buf), 0);
+		if(len <= 0)
+			break;
+		reply.append(buf, len);
+	}
+
+	size_t end = reply.find("\r\n\r\n");
+	if( (reply.find("HTTP/1.0 200") != 0) || (end == string::npos) )
+		return "";
+	return reply.substr(end + 4);
+}
+
+/**
+	@brief Adds one bridge's metrics to the families gathered so far, labeling every sample with its device
+
+	@param text		Metrics in Prometheus text format
+	@param device	Device index to label the samples with
+	@param order	Family names, in the order they were first seen
+	@param families	Families gathered so far
+ */
+static void MergeMetrics(const string& text, size_t device, vector<string>& order, map<string, MetricFamily>& families)
+{
+	string label = "device=\"" + to_string(device) + "\"";
+	string family;
+	stringstream stream(text);
+	string line;
+	while(getline(stream, line))
+	{
+		if(line.empty())
+			continue;
+
+		//HELP and TYPE start a new family
+		bool help = (line.compare(0, 7, "# HELP ") == 0);
+		bool type = (line.compare(0, 7, "# TYPE ") == 0);
+		if(help || type)
+		{
+			family = line.substr(7, line.find(' ', 7) - 7);
+			if(families.find(family) == families.end())
+				order.push_back(family);
+			if(help)
+				families[family].m_help = line;
+			else
+				families[family].m_type = line;
+			continue;
+		}
+		if(line[0] == '#')
+			continue;
+
+		//Samples belong to the last family, whatever suffix they have (histograms have _bucket, _sum and _count)
+		size_t brace = line.find('{');
+		size_t space = line.find(' ');
+		if( (brace != string::npos) && (brace < space) )
+			line.insert(brace + 1, label + ",");
+		else if(space != string::npos)
+			line.insert(space, "{" + label + "}");
+		if(family.empty())
+		{
+			family = line.substr(0, min(brace, space));
+			order.push_back(family);
+		}
+		families[family].m_samples.push_back(line);
+	}
+}
+
+/**
+	@brief Serves the metrics of several bridges on this machine as one scrape, labeled by device
+
+	Each request fetches every bridge's own metrics, so the result is always current. uhdbridge_worker_up tells
+	which bridges answered.
+
+	@param ports	Metrics port of each device's bridge, by device index
+ */
+void CombinedMetricsServerThread(vector<uint16_t> ports)
+{
+#ifdef __linux__
+	pthread_setname_np(pthread_self(), "MetricsThread");
+#endif
+
+	ServeRequests([ports]
+	{
+		vector<string> order;
+		map<string, MetricFamily> families;
+		string up =
+			"# HELP uhdbridge_worker_up Whether the bridge for each device answered this scrape\n"
+			"# TYPE uhdbridge_worker_up gauge\n";
+		for(size_t i=0; i<ports.size(); i++)
+		{
+			string text = FetchMetrics(ports[i]);
+			up += "uhdbridge_worker_up{device=\"" + to_string(i) + "\"} " + (text.empty() ? "0" : "1") + "\n";
+			MergeMetrics(text, i, order, families);
+		}
+
+		string out = up;
+		for(auto& name : order)
+		{
+			auto& f = families[name];
+			if(!f.m_help.empty())
+				out += f.m_help + "\n";
+			if(!f.m_type.empty())
+				out += f.m_type + "\n";
+			for(auto& sample : f.m_samples)
+				out += sample + "\n";
+		}
+		return out;
+	});
+}
@@ -0,0 +1,221 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of RxBlock
+ */
+
+#ifndef RxBlock_h
+#define RxBlock_h
+
+#include "SampleFormat.h"
+#include "WaveformHeader.h"
+#include <atomic>
+#include <complex>
+#include <cstdint>
+#include <vector>
+#include <uhd/types/time_spec.hpp>
+
+/**
+	@brief Radio settings for one channel of an RxBlock, at the time it was captured
+ */
+class RxBlockChannel
+{
+public:
+	RxBlockChannel(size_t index = 0, double freq = 0, double gain = 0, double bandwidth = 0)
+		: m_index(index)
+		, m_centerFrequency(freq)
+		, m_gain(gain)
+		, m_bandwidth(bandwidth)
+	{}
+
+	///@brief Hardware channel index
+	size_t m_index;
+
+	///@brief Center frequency, in Hz
+	double m_centerFrequency;
+
+	///@brief RX gain, in dB
+	double m_gain;
+
+	///@brief Analog bandwidth, in Hz
+	double m_bandwidth;
+};
+
+/**
+	@brief One waveform's worth of received samples, plus the metadata needed to ship it to the client
+
+	Blocks are owned by a RxBlockPool and recycled rather than freed, so the sample buffer is allocated once and then
+	reused for as long as the sample depth stays the same. They are reference counted so that one block can be queued
+	for several data plane subscribers at once: Acquire() hands out one reference, AddRef() adds another, and
+	RxBlockPool::Release() drops one and recycles the block when the last is gone. Blocks must not be modified once
+	they've been shared.
+
+	Multi-channel blocks are stored planar (channel i starts m_stride samples after channel i-1) unless m_interleaved
+	is set.
+ */
+class RxBlock
+{
+public:
+	RxBlock(void* data, size_t capacity, bool hugePages)
+		: m_length(0)
+		, m_requested(0)
+		, m_stride(0)
+		, m_format(FORMAT_FC32)
+		, m_payloadType(PAYLOAD_IQ)
+		, m_rate(1)
+		, m_timeValid(false)
+		, m_sequence(0)
+		, m_firstSample(0)
+		, m_discontinuity(false)
+		, m_overflow(false)
+		, m_triggered(false)
+		, m_triggerOffset(0)
+		, m_scanStep(0)
+		, m_scanSteps(0)
+		, m_scanEnd(false)
+		, m_interleaved(false)
+		, m_contiguous(false)
+		, m_publishIndex(0)
+		, m_recordIndex(0)
+		, m_refs(0)
+		, m_data(data)
+		, m_capacity(capacity)
+		, m_hugePages(hugePages)
+	{}
+
+	///@brief Adds a reference to the block, for sharing it with another consumer
+	void AddRef()
+	{ m_refs.fetch_add(1, std::memory_order_relaxed); }
+
+	///@brief Returns the raw sample buffer
+	void* GetData()
+	{ return m_data; }
+
+	///@brief Returns the size of the sample buffer, in bytes
+	size_t GetCapacity() const
+	{ return m_capacity; }
+
+	///@brief Returns a pointer to the i'th sample of the given channel (index into m_channels), whatever the format.
+	///Only valid for planar blocks.
+	void* GetSample(size_t chan, size_t i)
+	{ return static_cast<uint8_t*>(m_data) + (chan*m_stride + i)*GetBytesPerSample(m_format); }
+
+	///@brief Returns the number of samples per channel the buffer can hold, given the current format and channels
+	size_t GetSampleCapacity() const
+	{
+		size_t nchans = m_channels.empty() ? 1 : m_channels.size();
+		return m_capacity / (GetBytesPerSample(m_format) * nchans);
+	}
+
+	///@brief Number of valid samples in the buffer, per channel
+	size_t m_length;
+
+	///@brief Number of samples per channel we asked the radio for
+	size_t m_requested;
+
+	///@brief Distance between the start of consecutive channels in the buffer, in samples
+	size_t m_stride;
+
+	///@brief Format of the samples in the buffer
+	SampleFormat m_format;
+
+	///@brief What the samples in the buffer represent
+	WaveformPayloadType m_payloadType;
+
+	///@brief Channels in the buffer, in the order they're stored
+	std::vector<RxBlockChannel> m_channels;
+
+	///@brief Sample rate the block was captured at, in Hz
+	int64_t m_rate;
+
+	///@brief Device time of the first sample in the block
+	uhd::time_spec_t m_startTime;
+
+	///@brief True if m_startTime came from the radio (or was extrapolated from a time that did)
+	bool m_timeValid;
+
+	///@brief Sequence number of the block, counted from the start of the control plane connection
+	uint64_t m_sequence;
+
+	///@brief Index of the first sample in the block, counted from the start of the stream
+	uint64_t m_firstSample;
+
+	///@brief True if samples were lost between the previous block and this one
+	bool m_discontinuity;
+
+	///@brief True if the radio reported an overflow while (or just before) this block was captured
+	bool m_overflow;
+
+	///@brief True if the block was captured by the software trigger
+	bool m_triggered;
+
+	///@brief Index within the block of the sample which fired the trigger (only valid if m_triggered is set)
+	size_t m_triggerOffset;
+
+	///@brief Index of the frequency this block was captured at, within the scan (only valid if m_scanSteps is set)
+	size_t m_scanStep;
+
+	///@brief Number of frequencies in the scan the block is part of, or 0 if it isn't from a scan
+	size_t m_scanSteps;
+
+	///@brief True for the empty block queued after the last dwell of a scan, to flush the sweep in progress
+	bool m_scanEnd;
+
+	///@brief True if the channels are interleaved (sample 0 of every channel, then sample 1...) rather than planar
+	bool m_interleaved;
+
+	///@brief True if the block immediately follows the previous one published to the subscribers
+	bool m_contiguous;
+
+	///@brief Number of blocks published to the subscribers before this one, so each one can tell if it missed any
+	uint64_t m_publishIndex;
+
+	///@brief Number of blocks offered to the recorder before this one, so it can tell if it missed any
+	uint64_t m_recordIndex;
+
+protected:
+	friend class RxBlockPool;
+
+	///@brief Number of references held
+	std::atomic<int> m_refs;
+
+	///@brief Page-aligned sample buffer
+	void* m_data;
+
+	///@brief Size of m_data, in bytes
+	size_t m_capacity;
+
+	///@brief True if m_data came from the hugetlb pool
+	bool m_hugePages;
+};
+
+#endif
@@ -0,0 +1,294 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of RxBlockPool
+ */
+
+#include "uhdbridge.h"
+#include "RxBlockPool.h"
+#include "CpuPlacement.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+RxBlockPool g_blockPool;
+
+//Huge pages are 2 MB on everything we care about
+static const size_t g_hugePageSize = 2 * 1024 * 1024;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+RxBlockPool::RxBlockPool()
+	: m_bufferSize(0)
+	, m_hugePages(false)
+	, m_locked(false)
+	, m_numaNode(-1)
+	, m_allocations(0)
+{
+}
+
+RxBlockPool::~RxBlockPool()
+{
+	for(auto b : m_freeList)
+		Free(b);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Configuration
+
+/**
+	@brief Sets the size of the buffers handed out by the pool
+
+	Idle buffers of the old size are freed immediately. Does nothing if the size is unchanged.
+ */
+void RxBlockPool::SetBufferSize(size_t bytes)
+{
+	lock_guard<mutex> lock(m_mutex);
+	if(bytes == m_bufferSize)
+		return;
+
+	LogDebug("RxBlockPool: buffer size changed from %zu to %zu bytes, freeing %zu idle buffers\n",
+		(size_t)m_bufferSize, bytes, m_freeList.size());
+
+	for(auto b : m_freeList)
+		Free(b);
+	m_freeList.clear();
+	m_bufferSize = bytes;
+}
+
+/**
+	@brief Requests that buffers be backed by huge pages, to cut down on TLB misses with large sample depths
+
+	Only affects buffers allocated after the call. Falls back to normal pages if no huge pages are available.
+ */
+void RxBlockPool::SetHugePages(bool enable)
+{
+	lock_guard<mutex> lock(m_mutex);
+	m_hugePages = enable;
+}
+
+/**
+	@brief Requests that buffers be locked into RAM so the receive path never takes a page fault
+
+	Only affects buffers allocated after the call.
+ */
+void RxBlockPool::SetLocked(bool enable)
+{
+	lock_guard<mutex> lock(m_mutex);
+	m_locked = enable;
+}
+
+/**
+	@brief Requests that buffers be allocated on a NUMA node (normally the one the NIC is attached to), or -1 for any
+
+	Only affects buffers allocated after the call. Memory still comes from other nodes if this one runs out.
+ */
+void RxBlockPool::SetNumaNode(int node)
+{
+	lock_guard<mutex> lock(m_mutex);
+	m_numaNode = node;
+}
+
+///@brief Returns the NUMA node buffers are allocated on, or -1 for any
+int RxBlockPool::GetNumaNode()
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_numaNode;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Block management
+
+/**
+	@brief Gets a block from the pool, allocating a new one only if none are free
+
+	The returned block has its metadata reset but the sample buffer contents are undefined.
+ */
+RxBlock* RxBlockPool::Acquire()
+{
+	RxBlock* block = nullptr;
+	{
+		lock_guard<mutex> lock(m_mutex);
+		if(!m_freeList.empty())
+		{
+			block = m_freeList.back();
+			m_freeList.pop_back();
+		}
+		else
+			block = Allocate(m_bufferSize);
+	}
+
+	if(block == nullptr)
+		return nullptr;
+
+	block->m_length = 0;
+	block->m_requested = 0;
+	block->m_stride = 0;
+	block->m_format = FORMAT_FC32;
+	block->m_payloadType = PAYLOAD_IQ;
+	block->m_rate = 1;
+	block->m_startTime = uhd::time_spec_t();
+	block->m_timeValid = false;
+	block->m_sequence = 0;
+	block->m_firstSample = 0;
+	block->m_discontinuity = false;
+	block->m_overflow = false;
+	block->m_triggered = false;
+	block->m_triggerOffset = 0;
+	block->m_scanStep = 0;
+	block->m_scanSteps = 0;
+	block->m_scanEnd = false;
+	block->m_interleaved = false;
+	block->m_contiguous = false;
+	block->m_publishIndex = 0;
+	block->m_recordIndex = 0;
+	block->m_channels.clear();
+	block->m_refs = 1;
+	return block;
+}
+
+/**
+	@brief Drops a reference to a block, returning it to the pool if that was the last one
+
+	If the buffer size has changed since the block was handed out, it is freed instead.
+ */
+void RxBlockPool::Release(RxBlock* block)
+{
+	if(block == nullptr)
+		return;
+	if(block->m_refs.fetch_sub(1, memory_order_acq_rel) != 1)
+		return;
+
+	lock_guard<mutex> lock(m_mutex);
+	if(block->m_capacity == m_bufferSize)
+		m_freeList.push_back(block);
+	else
+		Free(block);
+}
+
+/**
+	@brief Allocates a new page-aligned buffer and wraps it in a block
+ */
+RxBlock* RxBlockPool::Allocate(size_t bytes)
+{
+	//Always hand out at least one page so we never have a null buffer
+	if(bytes == 0)
+		bytes = 1;
+
+	bool huge = false;
+	void* data = nullptr;
+
+#ifdef _WIN32
+	data = VirtualAlloc(nullptr, bytes, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	if(data == nullptr)
+	{
+		LogError("RxBlockPool: failed to allocate %zu bytes\n", bytes);
+		return nullptr;
+	}
+	if(m_locked && !VirtualLock(data, bytes))
+		LogWarning("RxBlockPool: VirtualLock failed, buffers may be paged out\n");
+#else
+
+	//Try for huge pages first if requested
+	size_t allocsize = bytes;
+	#ifdef MAP_HUGETLB
+	if(m_hugePages)
+	{
+		allocsize = ((bytes + g_hugePageSize - 1) / g_hugePageSize) * g_hugePageSize;
+		data = mmap(nullptr, allocsize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if(data == MAP_FAILED)
+		{
+			LogDebug("RxBlockPool: no huge pages available, falling back to normal pages\n");
+			data = nullptr;
+			allocsize = bytes;
+		}
+		else
+			huge = true;
+	}
+	#endif
+
+	if(data == nullptr)
+	{
+		data = mmap(nullptr, allocsize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(data == MAP_FAILED)
+		{
+			LogError("RxBlockPool: failed to allocate %zu bytes\n", bytes);
+			return nullptr;
+		}
+
+		//Still ask for transparent huge pages if we couldn't get real ones
+		#ifdef MADV_HUGEPAGE
+		if(m_hugePages)
+			madvise(data, allocsize, MADV_HUGEPAGE);
+		#endif
+	}
+
+	//No pages have been touched yet, so they all land on the node
+	if(m_numaNode >= 0)
+		BindToNumaNode(data, allocsize, m_numaNode);
+
+	if(m_locked && (mlock(data, allocsize) != 0))
+		LogWarning("RxBlockPool: mlock failed (check RLIMIT_MEMLOCK), buffers may be paged out\n");
+#endif
+
+	m_allocations ++;
+	LogDebug("RxBlockPool: allocated buffer #%zu (%.2f MB%s%s, NUMA node %d)\n",
+		(size_t)m_allocations,
+		bytes * 1e-6,
+		huge ? ", huge pages" : "",
+		m_locked ? ", locked" : "",
+		m_numaNode);
+
+	return new RxBlock(data, bytes, huge);
+}
+
+/**
+	@brief Frees a block and its buffer
+ */
+void RxBlockPool::Free(RxBlock* block)
+{
+#ifdef _WIN32
+	VirtualFree(block->m_data, 0, MEM_RELEASE);
+#else
+	size_t allocsize = block->m_capacity;
+	if(block->m_hugePages)
+		allocsize = ((allocsize + g_hugePageSize - 1) / g_hugePageSize) * g_hugePageSize;
+	munmap(block->m_data, allocsize);
+#endif
+
+	delete block;
+}
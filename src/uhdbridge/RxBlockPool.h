@@ -0,0 +1,101 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of RxBlockPool
+ */
+
+#ifndef RxBlockPool_h
+#define RxBlockPool_h
+
+#include "RxBlock.h"
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+/**
+	@brief Recycles RxBlocks and their sample buffers so that steady-state streaming does no allocations
+
+	Buffers are page aligned and optionally backed by huge pages and/or locked into RAM. All buffers in the pool are the
+	same size; changing the size frees idle buffers immediately, and buffers still in use are freed when they come back.
+ */
+class RxBlockPool
+{
+public:
+	RxBlockPool();
+	~RxBlockPool();
+
+	void SetBufferSize(size_t bytes);
+	void SetHugePages(bool enable);
+	void SetLocked(bool enable);
+	void SetNumaNode(int node);
+	int GetNumaNode();
+
+	///@brief Returns the size of buffers currently being handed out, in bytes
+	size_t GetBufferSize()
+	{ return m_bufferSize; }
+
+	///@brief Returns the total number of sample buffers allocated since startup
+	uint64_t GetAllocationCount()
+	{ return m_allocations; }
+
+	RxBlock* Acquire();
+	void Release(RxBlock* block);
+
+protected:
+	RxBlock* Allocate(size_t bytes);
+	void Free(RxBlock* block);
+
+	///@brief Mutex protecting the free list and configuration
+	std::mutex m_mutex;
+
+	///@brief Blocks not currently in use
+	std::vector<RxBlock*> m_freeList;
+
+	///@brief Size of each buffer, in bytes
+	std::atomic<size_t> m_bufferSize;
+
+	///@brief True to try backing buffers with huge pages
+	bool m_hugePages;
+
+	///@brief True to mlock() buffers so they never page out
+	bool m_locked;
+
+	///@brief NUMA node to allocate buffers on, or -1 for any
+	int m_numaNode;
+
+	///@brief Number of sample buffers allocated since startup
+	std::atomic<uint64_t> m_allocations;
+};
+
+extern RxBlockPool g_blockPool;
+
+#endif
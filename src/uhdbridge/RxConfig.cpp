@@ -0,0 +1,360 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of RxConfig and RxController
+ */
+
+#include "uhdbridge.h"
+#include "RxConfig.h"
+#include "RxSource.h"
+
+using namespace std;
+
+RxController g_rxControl;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// RxConfig
+
+/**
+	@brief Returns the indexes of the channels to stream
+ */
+vector<size_t> RxConfig::GetEnabledChannels() const
+{
+	vector<size_t> ret;
+	for(size_t i=0; i<m_channels.size(); i++)
+	{
+		if(m_channels[i].m_enabled)
+			ret.push_back(i);
+	}
+	return ret;
+}
+
+/**
+	@brief Checks if moving from another snapshot to this one needs a new streamer, rather than just a retune
+ */
+bool RxConfig::IsRestartNeeded(const RxConfig& other) const
+{
+	return (m_rate != other.m_rate) ||
+		(m_blockSize != other.m_blockSize) ||
+		(GetEnabledChannels() != other.GetEnabledChannels());
+}
+
+/**
+	@brief Checks if the software trigger settings differ from another snapshot's
+ */
+bool RxConfig::IsTriggerChanged(const RxConfig& other) const
+{
+	return (m_triggerMode != other.m_triggerMode) ||
+		(m_triggerEdge != other.m_triggerEdge) ||
+		(m_triggerLevel != other.m_triggerLevel) ||
+		(m_triggerHysteresis != other.m_triggerHysteresis) ||
+		(m_triggerChannel != other.m_triggerChannel) ||
+		(m_triggerDelay != other.m_triggerDelay);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+RxController::RxController()
+	: m_busy(false)
+	, m_running(false)
+	, m_config(make_shared<RxConfig>())
+	, m_version(0)
+{
+}
+
+/**
+	@brief Stops the worker thread, if it's still running, before the condition variables it waits on go away
+ */
+RxController::~RxController()
+{
+	Stop();
+}
+
+/**
+	@brief Starts the worker thread. The radio must be open.
+ */
+void RxController::Start()
+{
+	{
+		lock_guard<mutex> lock(m_queueMutex);
+		if(m_running)
+			return;
+		m_running = true;
+	}
+	m_thread = thread(&RxController::WorkerThread, this);
+}
+
+/**
+	@brief Stops the worker thread once it's done with the batch in progress. Changes still queued are dropped.
+ */
+void RxController::Stop()
+{
+	bool idle;
+	{
+		unique_lock<mutex> lock(m_queueMutex);
+		m_running = false;
+		m_queue.clear();
+
+		//If the batch in progress is stuck (say waiting for g_mutex, held by whoever is shutting down) leave it be
+		//rather than hang on the way out
+		idle = m_queueDone.wait_for(lock, chrono::seconds(1), [this]{ return !m_busy; });
+	}
+	m_queueReady.notify_all();
+	m_queueDone.notify_all();
+
+	if(!m_thread.joinable())
+		return;
+
+	//exit() may also be called from the worker thread itself, which can't wait for itself to finish
+	if(idle && (m_thread.get_id() != this_thread::get_id()) )
+		m_thread.join();
+	else
+		m_thread.detach();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Control plane
+
+/**
+	@brief Queues changes to apply as soon as possible
+ */
+void RxController::Submit(const vector<RxCommand>& commands)
+{
+	if(commands.empty())
+		return;
+
+	Batch batch;
+	batch.m_commands = commands;
+	batch.m_timed = false;
+
+	{
+		lock_guard<mutex> lock(m_queueMutex);
+		m_queue.push_back(batch);
+	}
+	m_queueReady.notify_one();
+}
+
+/**
+	@brief Queues changes to take effect on the radio at a device time
+
+	The time has to be far enough ahead for the command to reach the radio first, or the radio applies it late.
+ */
+void RxController::Submit(const vector<RxCommand>& commands, const uhd::time_spec_t& time)
+{
+	if(commands.empty())
+		return;
+
+	Batch batch;
+	batch.m_commands = commands;
+	batch.m_timed = true;
+	batch.m_time = time;
+
+	{
+		lock_guard<mutex> lock(m_queueMutex);
+		m_queue.push_back(batch);
+	}
+	m_queueReady.notify_one();
+}
+
+/**
+	@brief Waits until everything queued so far has been applied and published
+ */
+void RxController::Flush()
+{
+	unique_lock<mutex> lock(m_queueMutex);
+	while(m_running && (!m_queue.empty() || m_busy) )
+		m_queueDone.wait(lock);
+}
+
+/**
+	@brief Returns the number of batches of changes not yet applied
+ */
+size_t RxController::GetPendingCount()
+{
+	lock_guard<mutex> lock(m_queueMutex);
+	if(!m_running)
+		return 0;
+	return m_queue.size() + (m_busy ? 1 : 0);
+}
+
+/**
+	@brief Publishes a snapshot of the control plane's current settings
+
+	Call with g_mutex held, unless nothing else is running yet.
+
+	@param timed	True if the tuning changed at a known device time
+	@param time		The device time
+	@param late		True if the change was sent to the radio after that time
+ */
+void RxController::Publish(bool timed, const uhd::time_spec_t& time, bool late)
+{
+	auto config = make_shared<RxConfig>();
+	config->m_version = m_version.load(memory_order_relaxed) + 1;
+	config->m_rate = g_rxRate;
+	config->m_blockSize = g_rxBlockSize;
+	config->m_channels = g_rxChannels;
+	config->m_timed = timed;
+	config->m_time = time;
+	config->m_late = late;
+	config->m_triggerMode = g_triggerMode;
+	config->m_triggerEdge = g_triggerEdge;
+	config->m_triggerLevel = g_triggerLevel;
+	config->m_triggerHysteresis = g_triggerHysteresis;
+	config->m_triggerChannel = g_triggerChannel;
+	config->m_triggerDelay = g_triggerDelay;
+
+	RxConfigPtr ptr = config;
+	atomic_store(&m_recent[config->m_version % RECENT_DEPTH], ptr);
+	atomic_store(&m_config, ptr);
+	m_version.store(config->m_version, memory_order_release);
+}
+
+/**
+	@brief Returns a recent snapshot by version, or null if it's too old to still be around
+ */
+RxConfigPtr RxController::GetConfig(uint64_t version) const
+{
+	auto config = atomic_load(&m_recent[version % RECENT_DEPTH]);
+	if(!config || (config->m_version != version) )
+		return nullptr;
+	return config;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Worker thread
+
+void RxController::WorkerThread()
+{
+#ifdef __linux__
+	pthread_setname_np(pthread_self(), "RxControl");
+#endif
+
+	while(true)
+	{
+		Batch batch;
+		{
+			unique_lock<mutex> lock(m_queueMutex);
+			while(m_running && m_queue.empty())
+				m_queueReady.wait(lock);
+			if(!m_running)
+				break;
+
+			batch = m_queue.front();
+			m_queue.pop_front();
+			m_busy = true;
+		}
+
+		{
+			lock_guard<mutex> lock(g_mutex);
+
+			if(batch.m_timed)
+				g_source->SetCommandTime(batch.m_time);
+			for(auto& c : batch.m_commands)
+			{
+				try
+				{
+					Apply(c);
+				}
+				catch(uhd::exception& ex)
+				{
+					LogError("Failed to apply tuning change: %s\n", ex.what());
+				}
+			}
+			//If the radio's clock already passed the time before we finished, some of the changes went in late
+			bool late = false;
+			if(batch.m_timed)
+			{
+				g_source->ClearCommandTime();
+				late = (batch.m_time < g_source->GetTimeNow());
+				if(late)
+					LogDebug("timed tuning change for %.6f reached the radio late\n", batch.m_time.get_real_secs());
+			}
+
+			Publish(batch.m_timed, batch.m_time, late);
+		}
+
+		{
+			lock_guard<mutex> lock(m_queueMutex);
+			m_busy = false;
+		}
+		m_queueDone.notify_all();
+	}
+}
+
+/**
+	@brief Applies one change to the radio, and records what it actually did. Call with g_mutex held.
+ */
+void RxController::Apply(const RxCommand& command)
+{
+	size_t i = command.m_channel;
+	if(i >= g_rxChannels.size())
+		return;
+
+	switch(command.m_type)
+	{
+		case RxCommand::SET_FREQUENCY:
+			{
+				g_source->SetFrequency(command.m_value, i);
+				auto actual = g_source->GetFrequency(i);
+				g_rxChannels[i].m_centerFrequency = actual;
+
+				LogDebug("set rx frequency on channel %zu: requested %.1f MHz, got %.1f MHz\n",
+					i, command.m_value*1e-6, actual*1e-6);
+			}
+			break;
+
+		case RxCommand::SET_GAIN:
+			{
+				g_source->SetGain(command.m_value, i);
+				auto actual = g_source->GetGain(i);
+				g_rxChannels[i].m_gain = actual;
+
+				LogDebug("set rx gain on channel %zu: requested %.1f dB, got %.1f dB\n", i, command.m_value, actual);
+			}
+			break;
+
+		case RxCommand::SET_BANDWIDTH:
+			{
+				g_source->SetBandwidth(command.m_value, i);
+				auto actual = g_source->GetBandwidth(i);
+				g_rxChannels[i].m_bandwidth = actual;
+
+				LogDebug("set rx bandwidth on channel %zu: requested %.1f MHz, got %.1f MHz\n",
+					i, command.m_value*1e-6, actual*1e-6);
+			}
+			break;
+
+		default:
+			break;
+	}
+}
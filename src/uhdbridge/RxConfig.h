@@ -0,0 +1,241 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of RxConfig and RxController
+ */
+
+#ifndef RxConfig_h
+#define RxConfig_h
+
+#include "TriggerEngine.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <uhd/types/time_spec.hpp>
+
+/**
+	@brief Immutable snapshot of the settings the data path reads
+
+	The control plane never changes a snapshot once it's published, it publishes a new one with a higher version. The
+	receive thread holds on to whichever snapshot applies to the samples it's receiving, so it never sees a half-made
+	change, and never has to take a lock to look at one.
+ */
+class RxConfig
+{
+public:
+	RxConfig()
+		: m_version(0)
+		, m_rate(1)
+		, m_blockSize(0)
+		, m_timed(false)
+		, m_late(false)
+		, m_triggerMode(TRIGGER_FREERUN)
+		, m_triggerEdge(EDGE_RISING)
+		, m_triggerLevel(0)
+		, m_triggerHysteresis(0)
+		, m_triggerChannel(0)
+		, m_triggerDelay(0)
+	{}
+
+	std::vector<size_t> GetEnabledChannels() const;
+	bool IsRestartNeeded(const RxConfig& other) const;
+	bool IsTriggerChanged(const RxConfig& other) const;
+
+	///@brief Incremented by one for each snapshot published
+	uint64_t m_version;
+
+	///@brief Sample rate, in Hz
+	int64_t m_rate;
+
+	///@brief Samples per channel per block
+	size_t m_blockSize;
+
+	///@brief Per-channel settings
+	std::vector<RxChannelConfig> m_channels;
+
+	///@brief True if the tuning in this snapshot took effect at m_time, rather than whenever it was applied
+	bool m_timed;
+
+	///@brief Device time the tuning took effect, if m_timed
+	uhd::time_spec_t m_time;
+
+	///@brief True if the timed tuning only reached the radio after m_time, so the radio applied it late
+	bool m_late;
+
+	///@brief Quantity the software trigger looks at
+	TriggerMode m_triggerMode;
+
+	///@brief Edge(s) the software trigger fires on
+	TriggerEdge m_triggerEdge;
+
+	///@brief Trigger level, in fc32 units
+	double m_triggerLevel;
+
+	///@brief Trigger hysteresis, in fc32 units
+	double m_triggerHysteresis;
+
+	///@brief Zero-based index of the trigger source channel
+	size_t m_triggerChannel;
+
+	///@brief Time from the start of a waveform to its trigger point, in femtoseconds
+	uint64_t m_triggerDelay;
+};
+
+typedef std::shared_ptr<const RxConfig> RxConfigPtr;
+
+/**
+	@brief A tuning change requested by the control plane
+ */
+class RxCommand
+{
+public:
+	enum Type
+	{
+		SET_FREQUENCY,
+		SET_GAIN,
+		SET_BANDWIDTH
+	};
+
+	RxCommand(Type type, size_t channel, double value)
+		: m_type(type)
+		, m_channel(channel)
+		, m_value(value)
+	{}
+
+	///@brief What to change
+	Type m_type;
+
+	///@brief Zero-based channel index
+	size_t m_channel;
+
+	///@brief Requested value, in Hz or dB
+	double m_value;
+};
+
+/**
+	@brief Applies tuning changes to the radio and publishes the settings snapshots the data path reads
+
+	The control plane queues changes and goes straight back to reading commands; a worker thread applies them to the
+	radio, reads back what it actually did, and publishes a new snapshot. Changes can be timed, so they land on the
+	radio at an exact device time and the receive thread can switch snapshots on exactly that sample.
+
+	g_rxChannels, g_rxRate, g_rxBlockSize and the g_trigger* settings are the control plane's working copy of the
+	settings, and are only changed with g_mutex held. Anything which changes them calls Publish() afterwards, still
+	holding the lock.
+ */
+class RxController
+{
+public:
+	RxController();
+	~RxController();
+
+	void Start();
+	void Stop();
+
+	void Submit(const std::vector<RxCommand>& commands);
+	void Submit(const std::vector<RxCommand>& commands, const uhd::time_spec_t& time);
+	void Flush();
+
+	void Publish(bool timed = false, const uhd::time_spec_t& time = uhd::time_spec_t(), bool late = false);
+
+	///@brief Returns the latest snapshot
+	RxConfigPtr GetConfig() const
+	{ return std::atomic_load(&m_config); }
+
+	RxConfigPtr GetConfig(uint64_t version) const;
+
+	///@brief Returns the version of the latest snapshot, which is much cheaper than GetConfig() to poll
+	uint64_t GetVersion() const
+	{ return m_version.load(std::memory_order_acquire); }
+
+	size_t GetPendingCount();
+
+protected:
+	void WorkerThread();
+	void Apply(const RxCommand& command);
+
+	/**
+		@brief A group of changes to apply together, producing one snapshot
+	 */
+	class Batch
+	{
+	public:
+		Batch()
+			: m_timed(false)
+		{}
+
+		std::vector<RxCommand> m_commands;
+		bool m_timed;
+		uhd::time_spec_t m_time;
+	};
+
+	///@brief Changes waiting for the worker thread
+	std::deque<Batch> m_queue;
+
+	///@brief True while the worker thread is applying a batch
+	bool m_busy;
+
+	///@brief True once the worker thread has been started, until it's stopped
+	bool m_running;
+
+	///@brief Protects m_queue, m_busy and m_running
+	std::mutex m_queueMutex;
+
+	///@brief Signalled when a batch is queued, or the worker thread should stop
+	std::condition_variable m_queueReady;
+
+	///@brief Signalled when the worker thread finishes a batch
+	std::condition_variable m_queueDone;
+
+	///@brief The worker thread
+	std::thread m_thread;
+
+	///@brief The latest snapshot, only accessed with std::atomic_load and std::atomic_store
+	RxConfigPtr m_config;
+
+	///@brief Number of recent snapshots kept, so readers which poll less often than changes are made don't miss any
+	static const size_t RECENT_DEPTH = 64;
+
+	///@brief Recent snapshots, indexed by version modulo RECENT_DEPTH. Same access rules as m_config.
+	RxConfigPtr m_recent[RECENT_DEPTH];
+
+	///@brief Version of m_config
+	std::atomic<uint64_t> m_version;
+};
+
+extern RxController g_rxControl;
+
+#endif
@@ -0,0 +1,131 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of RxSource and RxStream
+ */
+
+#ifndef RxSource_h
+#define RxSource_h
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <uhd/stream.hpp>
+#include <uhd/types/ranges.hpp>
+
+/**
+	@brief A stream of samples from an RxSource
+
+	Same semantics as uhd::rx_streamer: Receive() fills up to nsamps samples per channel, reporting errors and
+	timestamps in the metadata.
+ */
+class RxStream
+{
+public:
+	virtual ~RxStream();
+
+	///@brief Returns the largest number of samples per channel delivered in one packet
+	virtual size_t GetMaxPacketSize() =0;
+
+	///@brief Receives up to nsamps samples into each of the per-channel buffers
+	virtual size_t Receive(std::vector<void*>& buffs, size_t nsamps, uhd::rx_metadata_t& meta, double timeout) =0;
+
+	///@brief Starts or stops streaming
+	virtual void IssueStreamCommand(const uhd::stream_cmd_t& cmd) =0;
+};
+
+/**
+	@brief Something we can receive samples from: a real radio, or a simulation of one
+
+	Setters apply to one channel and don't report what the hardware actually did; call the matching getter afterwards.
+ */
+class RxSource
+{
+public:
+	virtual ~RxSource();
+
+	static std::unique_ptr<RxSource> Create(const std::string& devpath);
+
+	//Identification
+	virtual std::string GetModel() =0;
+	virtual std::string GetSerial() =0;
+	virtual std::string GetDescription() =0;
+
+	//Channel setup
+	virtual void SetSubdevSpec(const std::string& spec) =0;
+	virtual std::string GetSubdevSpec() =0;
+	virtual size_t GetChannelCount() =0;
+	virtual void SetAntenna(const std::string& name, size_t chan) =0;
+	virtual std::vector<std::string> GetAntennas(size_t chan) =0;
+	virtual void SetClockSource(const std::string& source) =0;
+
+	//Tuning
+	virtual void SetGain(double gain, size_t chan) =0;
+	virtual double GetGain(size_t chan) =0;
+	virtual uhd::gain_range_t GetGainRange(size_t chan) =0;
+	virtual void SetBandwidth(double bandwidth, size_t chan) =0;
+	virtual double GetBandwidth(size_t chan) =0;
+	virtual uhd::freq_range_t GetBandwidthRange(size_t chan) =0;
+	virtual void SetFrequency(double freq, size_t chan) =0;
+	virtual double GetFrequency(size_t chan) =0;
+	virtual uhd::freq_range_t GetFrequencyRange(size_t chan) =0;
+
+	//Sampling
+	virtual void SetSampleRate(double rate) =0;
+	virtual double GetSampleRate() =0;
+	virtual uhd::meta_range_t GetSampleRates() =0;
+
+	//Master clock, which sample rates are derived from by integer decimation
+	virtual void SetMasterClockRate(double rate) =0;
+	virtual double GetMasterClockRate() =0;
+	virtual uhd::meta_range_t GetMasterClockRates() =0;
+
+	//Device time
+	virtual void SetTimeSource(const std::string& source) =0;
+	virtual uhd::time_spec_t GetTimeNow() =0;
+	virtual uhd::time_spec_t GetTimeLastPPS() =0;
+	virtual void SetTimeNow(const uhd::time_spec_t& time) =0;
+
+	///@brief Sets the device time at the next PPS edge, for synchronizing several radios sharing a PPS signal
+	virtual void SetTimeNextPPS(const uhd::time_spec_t& time) =0;
+
+	///@brief Makes setters called until ClearCommandTime() take effect at a device time, rather than right away
+	virtual void SetCommandTime(const uhd::time_spec_t& time) =0;
+	virtual void ClearCommandTime() =0;
+
+	///@brief Creates a stream with the channels and CPU/wire formats in args
+	virtual std::unique_ptr<RxStream> OpenStream(const uhd::stream_args_t& args) =0;
+};
+
+extern std::unique_ptr<RxSource> g_source;
+
+#endif
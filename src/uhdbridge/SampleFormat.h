@@ -0,0 +1,153 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Sample formats supported on the data plane
+ */
+
+#ifndef SampleFormat_h
+#define SampleFormat_h
+
+#include <atomic>
+#include <string>
+#include <cctype>
+
+/**
+	@brief Format of samples in an RxBlock and on the wire
+ */
+enum SampleFormat
+{
+	///@brief Complex float32, full scale is +/- 1.0
+	FORMAT_FC32,
+
+	///@brief Complex int16, exactly as it came off the radio
+	FORMAT_SC16,
+
+	///@brief Complex int8, exactly as it came off the radio
+	FORMAT_SC8,
+
+	///@brief Real float32, used for computed payloads (e.g. spectra) rather than samples from the radio
+	FORMAT_F32
+};
+
+///@brief Returns the size of one complex sample in the given format, in bytes
+inline size_t GetBytesPerSample(SampleFormat format)
+{
+	switch(format)
+	{
+		case FORMAT_SC16:
+			return 4;
+
+		case FORMAT_SC8:
+			return 2;
+
+		case FORMAT_F32:
+			return 4;
+
+		case FORMAT_FC32:
+		default:
+			return 8;
+	}
+}
+
+///@brief Returns the UHD name of a format
+inline std::string GetFormatName(SampleFormat format)
+{
+	switch(format)
+	{
+		case FORMAT_SC16:
+			return "sc16";
+
+		case FORMAT_SC8:
+			return "sc8";
+
+		case FORMAT_F32:
+			return "f32";
+
+		case FORMAT_FC32:
+		default:
+			return "fc32";
+	}
+}
+
+///@brief Parses a format name (case insensitive), returning false if it's not one we know
+inline bool ParseFormatName(const std::string& name, SampleFormat& format)
+{
+	std::string lower;
+	for(auto c : name)
+		lower += tolower(c);
+
+	if(lower == "fc32")
+		format = FORMAT_FC32;
+	else if(lower == "sc16")
+		format = FORMAT_SC16;
+	else if(lower == "sc8")
+		format = FORMAT_SC8;
+	else
+		return false;
+	return true;
+}
+
+/**
+	@brief Returns the over-the-wire format UHD should use to deliver samples in a given CPU format
+
+	fc32 is converted from sc16 since that's the native ADC width on everything we support. The integer formats are
+	passed through untouched.
+ */
+inline std::string GetOTWFormatName(SampleFormat format)
+{
+	if(format == FORMAT_SC8)
+		return "sc8";
+	return "sc16";
+}
+
+/**
+	@brief Returns the factor to multiply integer samples by to get the same scaling as fc32 (full scale = 1.0)
+ */
+inline float GetFormatScale(SampleFormat format)
+{
+	switch(format)
+	{
+		case FORMAT_SC16:
+			return 1.0f / 32767;
+
+		case FORMAT_SC8:
+			return 1.0f / 127;
+
+		case FORMAT_FC32:
+		default:
+			return 1;
+	}
+}
+
+extern std::atomic<SampleFormat> g_wireFormat;
+
+#endif
@@ -0,0 +1,150 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of SampleHistory
+ */
+
+#ifndef SampleHistory_h
+#define SampleHistory_h
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/**
+	@brief Circular buffer holding the most recent samples of each channel in a stream
+
+	Samples are addressed by their absolute index since the start of the stream. The radio receives directly into the
+	buffer (see GetWriteSpace() / GetWritePointer() / Commit()), so the only copy is the one out into a block once
+	something triggers.
+ */
+class SampleHistory
+{
+public:
+	SampleHistory()
+		: m_capacity(0)
+		, m_bytesPerSample(0)
+		, m_written(0)
+		, m_validStart(0)
+	{}
+
+	/**
+		@brief Allocates space for the given number of samples per channel and forgets everything
+	 */
+	void Reset(size_t nchans, size_t capacity, size_t bytesPerSample)
+	{
+		m_capacity = capacity;
+		m_bytesPerSample = bytesPerSample;
+		m_written = 0;
+		m_validStart = 0;
+		m_buffers.resize(nchans);
+		for(auto& b : m_buffers)
+			b.resize(capacity * bytesPerSample);
+	}
+
+	///@brief Marks everything received so far as invalid (e.g. after an overflow) without changing sample numbering
+	void Invalidate()
+	{ m_validStart = m_written; }
+
+	///@brief Returns the number of samples which can be written in one contiguous run, up to the given limit
+	size_t GetWriteSpace(size_t limit) const
+	{
+		size_t space = m_capacity - (m_written % m_capacity);
+		return (space < limit) ? space : limit;
+	}
+
+	///@brief Returns the location the next sample of a channel will be written to
+	void* GetWritePointer(size_t chan)
+	{ return GetSample(chan, m_written); }
+
+	///@brief Adds samples written via GetWritePointer() to the history
+	void Commit(size_t count)
+	{ m_written += count; }
+
+	///@brief Returns the index of the next sample to be written
+	uint64_t GetEnd() const
+	{ return m_written; }
+
+	///@brief Returns the index of the oldest valid sample still in the buffer
+	uint64_t GetStart() const
+	{
+		uint64_t oldest = (m_written > m_capacity) ? (m_written - m_capacity) : 0;
+		return (oldest > m_validStart) ? oldest : m_validStart;
+	}
+
+	///@brief Returns a pointer to the sample with the given absolute index (caller is responsible for range checks)
+	void* GetSample(size_t chan, uint64_t index)
+	{ return &m_buffers[chan][(index % m_capacity) * m_bytesPerSample]; }
+
+	/**
+		@brief Copies a range of samples of one channel out of the history, handling wraparound
+
+		@param chan		Channel index
+		@param start	Absolute index of the first sample, must be >= GetStart()
+		@param count	Number of samples, start+count must be <= GetEnd()
+		@param dst		Destination buffer
+	 */
+	void CopyOut(size_t chan, uint64_t start, size_t count, void* dst)
+	{
+		uint8_t* out = static_cast<uint8_t*>(dst);
+		while(count > 0)
+		{
+			size_t offset = start % m_capacity;
+			size_t run = m_capacity - offset;
+			if(run > count)
+				run = count;
+			memcpy(out, &m_buffers[chan][offset * m_bytesPerSample], run * m_bytesPerSample);
+			out += run * m_bytesPerSample;
+			start += run;
+			count -= run;
+		}
+	}
+
+protected:
+
+	///@brief Per-channel sample storage
+	std::vector< std::vector<uint8_t> > m_buffers;
+
+	///@brief Size of each buffer, in samples
+	size_t m_capacity;
+
+	///@brief Size of one sample, in bytes
+	size_t m_bytesPerSample;
+
+	///@brief Total number of samples written since Reset()
+	uint64_t m_written;
+
+	///@brief Index of the oldest sample still considered valid
+	uint64_t m_validStart;
+};
+
+#endif
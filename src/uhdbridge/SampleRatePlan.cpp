@@ -0,0 +1,135 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of SampleRatePlan
+ */
+
+#include "uhdbridge.h"
+#include "SampleRatePlan.h"
+#include "DeviceCaps.h"
+#include <math.h>
+
+using namespace std;
+
+///@brief The plan behind the current sample rate
+SampleRatePlan g_ratePlan;
+
+SampleRatePlan::SampleRatePlan()
+	: m_requestedRate(0)
+	, m_masterClockRate(0)
+	, m_decimation(0)
+	, m_actualRate(0)
+{
+}
+
+/**
+	@brief Picks the master clock and decimation for a sample rate
+
+	The decimation comes first from 1 and the even numbers, which run through the DSP's halfband filters, and only
+	then from the odd ones, which use the CIC filter alone and droop at the band edges. Within that, the lowest clock
+	wins if the clock is adjustable over a range (B2xx). On radios with a fixed set of clocks, changing it means
+	reinitializing the radio, so the current clock is kept whenever it divides down exactly.
+
+	If no clock divides down to the rate exactly, the plan keeps the current clock with no decimation and the radio
+	gets as close as it can.
+ */
+SampleRatePlan SampleRatePlan::Choose(double rate, const DeviceCaps& caps, double currentClock)
+{
+	SampleRatePlan plan;
+	plan.m_requestedRate = rate;
+	plan.m_masterClockRate = currentClock;
+	if( (rate <= 0) || caps.m_masterClockRange.empty() )
+		return plan;
+
+	auto& range = caps.m_masterClockRange;
+	bool adjustable = false;
+	for(auto& r : range)
+	{
+		if(r.start() < r.stop())
+			adjustable = true;
+	}
+
+	//Is the current clock good enough?
+	if(!adjustable)
+	{
+		double decim = round(currentClock / rate);
+		if( (decim >= 1) && (decim <= caps.m_maxDecimation) && (fabs(decim * rate - currentClock) < 0.5) )
+		{
+			plan.m_decimation = decim;
+			return plan;
+		}
+	}
+
+	size_t oddDecim = 0;
+	for(size_t decim = 1; decim <= caps.m_maxDecimation; decim++)
+	{
+		double clock = rate * decim;
+		if(clock > range.stop() + 0.5)
+			break;
+		if(clock < range.start() - 0.5)
+			continue;
+		if(fabs(range.clip(clock, true) - clock) > 0.5)
+			continue;
+
+		if( (decim == 1) || (decim % 2 == 0) )
+		{
+			plan.m_masterClockRate = clock;
+			plan.m_decimation = decim;
+			return plan;
+		}
+		if(oddDecim == 0)
+			oddDecim = decim;
+	}
+
+	if(oddDecim != 0)
+	{
+		plan.m_masterClockRate = rate * oddDecim;
+		plan.m_decimation = oddDecim;
+	}
+	return plan;
+}
+
+/**
+	@brief Formats the plan for RATEPLAN? as clock,decimation,actual rate,EXACT|INEXACT
+ */
+string SampleRatePlan::GetSummary() const
+{
+	bool exact = (m_decimation != 0) && (fabs(m_actualRate - m_requestedRate) < 0.5);
+
+	char buf[128];
+	snprintf(buf, sizeof(buf), "%.15g,%zu,%.15g,%s",
+		m_masterClockRate,
+		m_decimation,
+		m_actualRate,
+		exact ? "EXACT" : "INEXACT");
+	return buf;
+}
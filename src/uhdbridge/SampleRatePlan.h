@@ -0,0 +1,74 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of SampleRatePlan
+ */
+
+#ifndef SampleRatePlan_h
+#define SampleRatePlan_h
+
+#include <string>
+
+class DeviceCaps;
+
+/**
+	@brief A master clock rate and decimation chosen to produce a sample rate
+
+	UHD left to itself will reach a rate however it can: with a fractional resampler, or (on B2xx) a master clock far
+	higher than needed, which costs USB bandwidth and is what tips 30+ Msps streams into overflows. Planning the two
+	together gets an exact integer decimation from the lowest clock that can do it.
+ */
+class SampleRatePlan
+{
+public:
+	SampleRatePlan();
+
+	static SampleRatePlan Choose(double rate, const DeviceCaps& caps, double currentClock);
+
+	std::string GetSummary() const;
+
+	///@brief Sample rate the client asked for, in Hz
+	double m_requestedRate;
+
+	///@brief Master clock rate, in Hz
+	double m_masterClockRate;
+
+	///@brief Integer decimation from the master clock to the sample rate, or 0 if there's no exact plan
+	size_t m_decimation;
+
+	///@brief Sample rate the radio reported after applying the plan, in Hz
+	double m_actualRate;
+};
+
+extern SampleRatePlan g_ratePlan;
+
+#endif
@@ -0,0 +1,94 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of ScanPlan
+ */
+
+#include "uhdbridge.h"
+#include "ScanPlan.h"
+#include <math.h>
+
+using namespace std;
+
+///@brief The scan run in STREAMMODE SCAN. Protected by g_mutex.
+ScanPlan g_scanPlan;
+
+//Most steps a scan may have, so a typo in SCAN:RANGE can't eat all the memory
+static const size_t g_maxScanSteps = 1000000;
+
+ScanPlan::ScanPlan()
+	: m_settleTime(1e-3)
+{
+}
+
+/**
+	@brief Replaces the frequency list with evenly spaced steps from start to stop, inclusive
+
+	@return False (leaving the list unchanged) if the range is empty or has too many steps
+ */
+bool ScanPlan::SetRange(double start, double stop, double step)
+{
+	if( (step <= 0) || (stop < start) )
+		return false;
+
+	//Allow for rounding error so that stop itself is included when the steps land on it
+	double nsteps = floor( (stop - start) / step + 1e-9) + 1;
+	if(nsteps > g_maxScanSteps)
+		return false;
+
+	m_frequencies.clear();
+	for(size_t i=0; i<nsteps; i++)
+		m_frequencies.push_back(start + i*step);
+	return true;
+}
+
+/**
+	@brief Returns the number of samples thrown away after each retune while the front end settles
+ */
+size_t ScanPlan::GetSettleSamples(int64_t rate) const
+{
+	return static_cast<size_t>(ceil(m_settleTime * rate));
+}
+
+/**
+	@brief Formats the plan for SCAN? as number of steps, first and last frequency (Hz), and settling time (s)
+ */
+string ScanPlan::GetSummary() const
+{
+	double first = m_frequencies.empty() ? 0 : m_frequencies.front();
+	double last = m_frequencies.empty() ? 0 : m_frequencies.back();
+
+	char buf[128];
+	snprintf(buf, sizeof(buf), "%zu,%.15g,%.15g,%.15g", m_frequencies.size(), first, last, m_settleTime);
+	return buf;
+}
@@ -0,0 +1,199 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of SigMFMetadata
+ */
+
+#include "uhdbridge.h"
+#include "SigMFMetadata.h"
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+using namespace std;
+
+//Device times after 2000-01-01 are assumed to be UTC (e.g. from a GPSDO or TIME:NOW), anything earlier is uptime
+static const int64_t g_minUnixTime = 946684800;
+
+/**
+	@brief Returns the path of a recording without the .sigmf-data or .sigmf-meta extension, if it has either
+ */
+string SigMFMetadata::GetBasePath(const string& path)
+{
+	for(auto ext : { ".sigmf-data", ".sigmf-meta" })
+	{
+		size_t len = strlen(ext);
+		if( (path.length() > len) && (path.compare(path.length() - len, len, ext) == 0) )
+			return path.substr(0, path.length() - len);
+	}
+	return path;
+}
+
+/**
+	@brief Forgets everything, ready for a new recording
+ */
+void SigMFMetadata::Clear()
+{
+	m_format = FORMAT_FC32;
+	m_rate = 1;
+	m_numChannels = 1;
+	m_captures.clear();
+	m_overflows.clear();
+	m_dropped = 0;
+}
+
+///@brief Returns the SigMF datatype for a sample format
+static const char* GetSigMFDatatype(SampleFormat format)
+{
+	switch(format)
+	{
+		case FORMAT_SC16:
+			return "ci16_le";
+
+		case FORMAT_SC8:
+			return "ci8";
+
+		case FORMAT_F32:
+			return "rf32_le";
+
+		case FORMAT_FC32:
+		default:
+			return "cf32_le";
+	}
+}
+
+///@brief Escapes a string for use in JSON
+static string JsonEscape(const string& str)
+{
+	string ret;
+	for(auto c : str)
+	{
+		if( (c == '"') || (c == '\\') )
+			ret += '\\';
+		if(static_cast<unsigned char>(c) >= 0x20)
+			ret += c;
+	}
+	return ret;
+}
+
+///@brief Formats a device time as an ISO 8601 UTC timestamp, or returns an empty string if it isn't wall clock time
+static string FormatDatetime(const uhd::time_spec_t& time)
+{
+	time_t secs = time.get_full_secs();
+	if(secs < g_minUnixTime)
+		return "";
+
+	struct tm tm;
+#ifdef _WIN32
+	gmtime_s(&tm, &secs);
+#else
+	gmtime_r(&secs, &tm);
+#endif
+
+	char buf[64];
+	size_t len = strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &tm);
+	snprintf(buf + len, sizeof(buf) - len, ".%06dZ", static_cast<int>(time.get_frac_secs() * 1e6));
+	return buf;
+}
+
+/**
+	@brief Writes the .sigmf-meta file
+
+	@param path		Path of the metadata file, including the .sigmf-meta extension
+ */
+bool SigMFMetadata::Write(const string& path)
+{
+	FILE* fp = fopen(path.c_str(), "w");
+	if(!fp)
+		return false;
+
+	fprintf(fp, "{\n");
+	fprintf(fp, "  \"global\": {\n");
+	fprintf(fp, "    \"core:datatype\": \"%s\",\n", GetSigMFDatatype(m_format));
+	fprintf(fp, "    \"core:sample_rate\": %lld,\n", (long long)m_rate);
+	fprintf(fp, "    \"core:num_channels\": %zu,\n", m_numChannels);
+	fprintf(fp, "    \"core:version\": \"1.0.0\",\n");
+	fprintf(fp, "    \"core:hw\": \"%s %s\",\n", JsonEscape(g_model).c_str(), JsonEscape(g_serial).c_str());
+	fprintf(fp, "    \"core:recorder\": \"uhdbridge\",\n");
+	fprintf(fp, "    \"core:extensions\": [\n");
+	fprintf(fp, "      { \"name\": \"uhdbridge\", \"version\": \"1.0.0\", \"optional\": true }\n");
+	fprintf(fp, "    ],\n");
+	fprintf(fp, "    \"uhdbridge:dropped_waveforms\": %llu\n", (unsigned long long)m_dropped);
+	fprintf(fp, "  },\n");
+
+	fprintf(fp, "  \"captures\": [");
+	for(size_t i=0; i<m_captures.size(); i++)
+	{
+		auto& cap = m_captures[i];
+		fprintf(fp, "%s\n    {\n", (i == 0) ? "" : ",");
+		fprintf(fp, "      \"core:sample_start\": %llu,\n", (unsigned long long)cap.m_sampleStart);
+		double freq = cap.m_channels.empty() ? 0.0 : cap.m_channels[0].m_centerFrequency;
+		fprintf(fp, "      \"core:frequency\": %.6f,\n", freq);
+		if(cap.m_timeValid)
+		{
+			string datetime = FormatDatetime(cap.m_time);
+			if(!datetime.empty())
+				fprintf(fp, "      \"core:datetime\": \"%s\",\n", datetime.c_str());
+			long long ns = min(llround(cap.m_time.get_frac_secs() * 1e9), 999999999LL);
+			fprintf(fp, "      \"uhdbridge:device_time\": %lld.%09lld,\n", (long long)cap.m_time.get_full_secs(), ns);
+		}
+		fprintf(fp, "      \"uhdbridge:discontinuity\": %s,\n", cap.m_discontinuity ? "true" : "false");
+		fprintf(fp, "      \"uhdbridge:channels\": [");
+		for(size_t c=0; c<cap.m_channels.size(); c++)
+		{
+			auto& chan = cap.m_channels[c];
+			fprintf(fp, "%s\n        { \"index\": %zu, \"frequency\": %.6f, \"gain\": %.2f, \"bandwidth\": %.6f }",
+				(c == 0) ? "" : ",",
+				chan.m_index,
+				chan.m_centerFrequency,
+				chan.m_gain,
+				chan.m_bandwidth);
+		}
+		fprintf(fp, "\n      ]\n    }");
+	}
+	fprintf(fp, "\n  ],\n");
+
+	//Mark overflows so analysis tools know not to trust those samples
+	fprintf(fp, "  \"annotations\": [");
+	for(size_t i=0; i<m_overflows.size(); i++)
+	{
+		fprintf(fp, "%s\n    { \"core:sample_start\": %llu, \"core:sample_count\": %llu, \"core:comment\": "
+			"\"overflow\" }",
+			(i == 0) ? "" : ",",
+			(unsigned long long)m_overflows[i].first,
+			(unsigned long long)m_overflows[i].second);
+	}
+	fprintf(fp, "\n  ]\n");
+	fprintf(fp, "}\n");
+
+	return (fclose(fp) == 0);
+}
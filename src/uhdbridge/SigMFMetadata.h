@@ -0,0 +1,115 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of SigMFMetadata
+ */
+
+#ifndef SigMFMetadata_h
+#define SigMFMetadata_h
+
+#include "RxBlock.h"
+#include <string>
+#include <vector>
+
+/**
+	@brief Start of a capture segment, i.e. a run of contiguous samples with the same radio settings
+ */
+class SigMFCapture
+{
+public:
+	SigMFCapture()
+		: m_sampleStart(0)
+		, m_timeValid(false)
+		, m_discontinuity(false)
+	{}
+
+	///@brief Index of the first sample of the segment in the data file
+	uint64_t m_sampleStart;
+
+	///@brief Device time of the first sample
+	uhd::time_spec_t m_time;
+
+	///@brief True if m_time came from the radio
+	bool m_timeValid;
+
+	///@brief True if samples were lost just before this segment
+	bool m_discontinuity;
+
+	///@brief Radio settings for each channel
+	std::vector<RxBlockChannel> m_channels;
+};
+
+/**
+	@brief Everything needed to write the .sigmf-meta file for a recording
+
+	Core fields cover the format and center frequency. Per-channel gain, bandwidth and the raw device time go in a
+	"uhdbridge" extension, since SigMF core has no fields for them.
+ */
+class SigMFMetadata
+{
+public:
+	SigMFMetadata()
+		: m_format(FORMAT_FC32)
+		, m_rate(1)
+		, m_numChannels(1)
+		, m_dropped(0)
+	{}
+
+	void Clear();
+	bool Write(const std::string& path);
+
+	static std::string GetBasePath(const std::string& path);
+
+	///@brief Returns the size of one sample of every channel, in bytes
+	size_t GetFrameSize() const
+	{ return GetBytesPerSample(m_format) * m_numChannels; }
+
+	///@brief Sample format of the recording
+	SampleFormat m_format;
+
+	///@brief Sample rate of the recording
+	int64_t m_rate;
+
+	///@brief Number of channels in the recording (stored interleaved)
+	size_t m_numChannels;
+
+	///@brief Capture segments, in order
+	std::vector<SigMFCapture> m_captures;
+
+	///@brief Sample ranges which overflowed, as (first sample, count)
+	std::vector< std::pair<uint64_t, uint64_t> > m_overflows;
+
+	///@brief Waveforms missing from the recording because the writer fell behind
+	uint64_t m_dropped;
+};
+
+#endif
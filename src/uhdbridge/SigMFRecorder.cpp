@@ -0,0 +1,512 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of SigMFRecorder
+ */
+
+#include "uhdbridge.h"
+#include "SigMFRecorder.h"
+#include "RxBlockPool.h"
+#include "BridgeStats.h"
+#include <string.h>
+#include <errno.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+SigMFRecorder g_recorder;
+
+//O_DIRECT needs buffers, lengths and file offsets aligned to the logical block size, 4 KiB covers every NVMe drive
+static const size_t g_directAlign = 4096;
+
+//Size of the staging buffer for anything that can't be written straight from the block
+static const size_t g_stagingSize = 8 * 1024 * 1024;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+SigMFRecorder::SigMFRecorder()
+	: m_recording(false)
+	, m_stop(false)
+	, m_ring(1)
+	, m_queuedBytes(0)
+	, m_maxQueuedBytes(0)
+	, m_fd(-1)
+	, m_direct(false)
+	, m_staging(nullptr)
+	, m_stagingUsed(0)
+	, m_bytesWritten(0)
+	, m_dropped(0)
+	, m_haveFormat(false)
+	, m_lastIndex(0)
+	, m_warnedMismatch(false)
+{
+}
+
+SigMFRecorder::~SigMFRecorder()
+{
+	Stop();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Control
+
+/**
+	@brief Starts a new recording
+
+	@param path		Path of the recording. The .sigmf-data and .sigmf-meta extensions are added if not present.
+	@param depth	Number of blocks which may be queued for the writer thread
+	@param maxBytes	Most sample buffer memory the queued blocks may add up to, whatever the depth
+
+	@return False if the data file couldn't be created
+ */
+bool SigMFRecorder::Start(const string& path, size_t depth, size_t maxBytes)
+{
+	Stop();
+
+#ifdef _WIN32
+	(void)path;
+	(void)depth;
+	(void)maxBytes;
+	LogError("Recording is not supported on this platform\n");
+	return false;
+#else
+	m_basePath = SigMFMetadata::GetBasePath(path);
+	string dataPath = m_basePath + ".sigmf-data";
+
+	//Not every filesystem supports O_DIRECT (e.g. tmpfs), fall back to normal buffered writes if not
+	int flags = O_WRONLY | O_CREAT | O_TRUNC;
+	m_direct = false;
+	#ifdef O_DIRECT
+	m_fd = open(dataPath.c_str(), flags | O_DIRECT, 0644);
+	if(m_fd >= 0)
+		m_direct = true;
+	else if(errno == EINVAL)
+		LogWarning("O_DIRECT not supported for %s, recording through the page cache\n", dataPath.c_str());
+	#endif
+	if(m_fd < 0)
+		m_fd = open(dataPath.c_str(), flags, 0644);
+	if(m_fd < 0)
+	{
+		LogError("Couldn't create %s: %s\n", dataPath.c_str(), strerror(errno));
+		return false;
+	}
+
+	if(posix_memalign(reinterpret_cast<void**>(&m_staging), g_directAlign, g_stagingSize) != 0)
+	{
+		LogError("Couldn't allocate recording staging buffer\n");
+		close(m_fd);
+		m_fd = -1;
+		m_staging = nullptr;
+		return false;
+	}
+
+	m_stagingUsed = 0;
+	m_bytesWritten = 0;
+	m_dropped = 0;
+	m_haveFormat = false;
+	m_lastIndex = 0;
+	m_meta.Clear();
+	m_warnedMismatch = false;
+	m_stop = false;
+
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_ring.Reset(depth);
+		m_queuedBytes = 0;
+		m_maxQueuedBytes = maxBytes;
+		m_recording = true;
+	}
+	m_thread = thread(&SigMFRecorder::WriterThread, this);
+
+	LogNotice("Recording to %s%s\n", dataPath.c_str(), m_direct ? " (O_DIRECT)" : "");
+	return true;
+#endif
+}
+
+/**
+	@brief Stops recording, writing out anything still queued and then the metadata
+
+	Does nothing if not recording.
+ */
+void SigMFRecorder::Stop()
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		if(!m_thread.joinable())
+			return;
+		m_recording = false;
+	}
+
+	m_stop = true;
+	m_thread.join();
+	Close();
+
+	LogNotice("Recording stopped: %.2f MB written, %zu blocks dropped\n",
+		m_bytesWritten * 1e-6, (size_t)m_dropped);
+}
+
+/**
+	@brief Returns the recorder status for REC:STATUS?: IDLE, or RECORDING followed by bytes written and blocks dropped
+ */
+string SigMFRecorder::GetStatus()
+{
+	if(!m_recording)
+		return "IDLE";
+
+	char tmp[128];
+	snprintf(tmp, sizeof(tmp), "RECORDING,%llu,%llu",
+		(unsigned long long)m_bytesWritten,
+		(unsigned long long)m_dropped);
+	return tmp;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Writing
+
+/**
+	@brief Queues a block to be written, dropping it if the writer has fallen behind
+
+	Called from the data plane thread. Takes a reference of its own to the block; the caller keeps theirs. Only raw IQ
+	is recorded, anything else is ignored.
+
+	@return True if the recorder is now holding a reference to the block
+ */
+bool SigMFRecorder::Publish(RxBlock* block)
+{
+	lock_guard<mutex> lock(m_mutex);
+	if(!m_recording || (block->m_payloadType != PAYLOAD_IQ) )
+		return false;
+
+	//Queued blocks stay out of the pool until they're written, so big ones can't be allowed to pile up unchecked.
+	//An empty queue always takes a block, however big, or the recording would never get anything.
+	size_t size = block->GetCapacity();
+	size_t queued = m_queuedBytes.load();
+	if( (queued == 0) || (queued + size <= m_maxQueuedBytes) )
+	{
+		block->AddRef();
+		if(m_ring.TryPush(block))
+		{
+			m_queuedBytes += size;
+			return true;
+		}
+		g_blockPool.Release(block);
+	}
+
+	m_dropped ++;
+	g_droppedWaveforms ++;
+	g_stats.m_droppedWaveforms ++;
+	LogDebug("recorder fell behind, dropped waveform\n");
+	return false;
+}
+
+/**
+	@brief Writer thread, which drains the ring into the data file until told to stop and the ring is empty
+ */
+void SigMFRecorder::WriterThread()
+{
+#ifdef __linux__
+	pthread_setname_np(pthread_self(), "RecorderThread");
+#endif
+
+	while(true)
+	{
+		RxBlock* block = m_ring.TryPop();
+		if(!block)
+		{
+			if(m_stop)
+				break;
+			this_thread::sleep_for(chrono::microseconds(100));
+			continue;
+		}
+
+		if(m_fd >= 0)
+			WriteBlock(block);
+		size_t size = block->GetCapacity();
+		g_blockPool.Release(block);
+		m_queuedBytes -= size;
+	}
+}
+
+/**
+	@brief Writes one block to the data file, starting a new capture segment if needed
+ */
+void SigMFRecorder::WriteBlock(RxBlock* block)
+{
+	//Spectra have no place in an IQ recording, and mustn't fix its format either
+	if(block->m_payloadType != PAYLOAD_IQ)
+		return;
+
+	//The format, rate and channel count are fixed for the whole recording by the first block
+	size_t nchans = block->m_channels.size();
+	if(!m_haveFormat)
+	{
+		m_meta.m_format = block->m_format;
+		m_meta.m_rate = block->m_rate;
+		m_meta.m_numChannels = nchans;
+		m_haveFormat = true;
+	}
+	if( (block->m_format != m_meta.m_format) || (block->m_rate != m_meta.m_rate) || (nchans != m_meta.m_numChannels) )
+	{
+		if(!m_warnedMismatch)
+		{
+			LogWarning("Acquisition settings changed while recording, skipping waveforms until they change back\n");
+			m_warnedMismatch = true;
+		}
+		return;
+	}
+
+	//New capture segment on every gap, or if the radio was retuned
+	auto& captures = m_meta.m_captures;
+	bool contiguous = !captures.empty() && block->m_contiguous && (block->m_recordIndex == m_lastIndex + 1);
+	bool retuned = false;
+	if(!captures.empty())
+	{
+		auto& last = captures.back().m_channels;
+		for(size_t c=0; c<nchans; c++)
+		{
+			auto& a = last[c];
+			auto& b = block->m_channels[c];
+			if( (a.m_centerFrequency != b.m_centerFrequency) || (a.m_gain != b.m_gain) ||
+				(a.m_bandwidth != b.m_bandwidth) )
+			{
+				retuned = true;
+			}
+		}
+	}
+	if(!contiguous || retuned)
+		BeginCapture(block, !captures.empty() && !contiguous);
+	m_lastIndex = block->m_recordIndex;
+
+	uint64_t firstSample = m_bytesWritten / (m_meta.GetFrameSize());
+	if(block->m_overflow)
+		m_meta.m_overflows.push_back(pair<uint64_t, uint64_t>(firstSample, block->m_length));
+
+	size_t len = block->m_length * m_meta.GetFrameSize();
+	bool ok;
+	if( (nchans == 1) || block->m_interleaved)
+	{
+		//Write the aligned part straight from the pool buffer if we can, and stage the rest
+		const uint8_t* data = static_cast<const uint8_t*>(block->GetData());
+		size_t direct = 0;
+		if(m_stagingUsed == 0)
+			direct = len & ~(g_directAlign - 1);
+		ok = WriteAll(data, direct) && Stage(data + direct, len - direct);
+	}
+	else
+		ok = StagePlanar(block);
+
+	if(!ok)
+	{
+		LogError("Recording stopped early: %s\n", strerror(errno));
+		close(m_fd);
+		m_fd = -1;
+		m_recording = false;
+		return;
+	}
+	m_bytesWritten += len;
+}
+
+/**
+	@brief Starts a new capture segment at the current end of the recording
+ */
+void SigMFRecorder::BeginCapture(RxBlock* block, bool discontinuity)
+{
+	SigMFCapture capture;
+	capture.m_sampleStart = m_bytesWritten / m_meta.GetFrameSize();
+	capture.m_time = block->m_startTime;
+	capture.m_timeValid = block->m_timeValid;
+	capture.m_discontinuity = discontinuity;
+	capture.m_channels = block->m_channels;
+	m_meta.m_captures.push_back(capture);
+
+	if(discontinuity)
+		LogDebug("recording discontinuous at sample %zu\n", (size_t)capture.m_sampleStart);
+}
+
+/**
+	@brief Copies data into the staging buffer, writing it out whenever it fills up
+ */
+bool SigMFRecorder::Stage(const void* data, size_t len)
+{
+	const uint8_t* p = static_cast<const uint8_t*>(data);
+	while(len > 0)
+	{
+		size_t n = min(len, g_stagingSize - m_stagingUsed);
+		memcpy(m_staging + m_stagingUsed, p, n);
+		m_stagingUsed += n;
+		p += n;
+		len -= n;
+
+		if( (m_stagingUsed == g_stagingSize) && !FlushStaging(false) )
+			return false;
+	}
+	return true;
+}
+
+/**
+	@brief Copies count samples of every channel of a planar block, starting at sample first, into an interleaved buffer
+ */
+template<class T>
+static void InterleaveInto(RxBlock* block, size_t first, size_t count, uint8_t* out)
+{
+	size_t nchans = block->m_channels.size();
+	T* dst = reinterpret_cast<T*>(out);
+	for(size_t c=0; c<nchans; c++)
+	{
+		T* src = static_cast<T*>(block->GetSample(c, first));
+		for(size_t i=0; i<count; i++)
+			dst[i*nchans + c] = src[i];
+	}
+}
+
+/**
+	@brief Interleaves a planar block into the staging buffer, since SigMF stores multiple channels interleaved
+ */
+bool SigMFRecorder::StagePlanar(RxBlock* block)
+{
+	size_t bytesPerSample = GetBytesPerSample(m_meta.m_format);
+	size_t frame = m_meta.GetFrameSize();
+	size_t first = 0;
+	while(first < block->m_length)
+	{
+		//Only whole frames go into the staging buffer, so flush the ragged end early if need be
+		size_t count = min(block->m_length - first, (g_stagingSize - m_stagingUsed) / frame);
+		if(count == 0)
+		{
+			if(!FlushStaging(false))
+				return false;
+			continue;
+		}
+
+		uint8_t* out = m_staging + m_stagingUsed;
+		switch(bytesPerSample)
+		{
+			case 2:
+				InterleaveInto<uint16_t>(block, first, count, out);
+				break;
+
+			case 4:
+				InterleaveInto<uint32_t>(block, first, count, out);
+				break;
+
+			case 8:
+			default:
+				InterleaveInto<uint64_t>(block, first, count, out);
+				break;
+		}
+		m_stagingUsed += count * frame;
+		first += count;
+	}
+	return true;
+}
+
+/**
+	@brief Writes out the staging buffer
+
+	@param final	If false, only whole sectors are written and the remainder is moved to the start of the buffer. If
+					true, everything is written, padded out to a whole sector; Close() trims the padding afterwards.
+ */
+bool SigMFRecorder::FlushStaging(bool final)
+{
+	size_t len = m_stagingUsed & ~(g_directAlign - 1);
+	if(final && (len < m_stagingUsed) )
+	{
+		len += g_directAlign;
+		memset(m_staging + m_stagingUsed, 0, len - m_stagingUsed);
+	}
+
+	if(!WriteAll(m_staging, len))
+		return false;
+
+	if(final)
+		m_stagingUsed = 0;
+	else
+	{
+		m_stagingUsed -= len;
+		memmove(m_staging, m_staging + len, m_stagingUsed);
+	}
+	return true;
+}
+
+/**
+	@brief Writes a buffer to the data file, looping on partial writes
+ */
+bool SigMFRecorder::WriteAll(const void* data, size_t len)
+{
+#ifdef _WIN32
+	(void)data;
+	(void)len;
+	return false;
+#else
+	const uint8_t* p = static_cast<const uint8_t*>(data);
+	while(len > 0)
+	{
+		ssize_t n = write(m_fd, p, len);
+		if(n < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			return false;
+		}
+		p += n;
+		len -= n;
+	}
+	return true;
+#endif
+}
+
+/**
+	@brief Finishes the data file, trimming off the padding from the last O_DIRECT write, and writes the metadata
+ */
+void SigMFRecorder::Close()
+{
+#ifndef _WIN32
+	if(m_fd >= 0)
+	{
+		if(!FlushStaging(true) || (ftruncate(m_fd, m_bytesWritten) != 0) )
+			LogError("Failed to finish recording data file: %s\n", strerror(errno));
+		close(m_fd);
+		m_fd = -1;
+	}
+	free(m_staging);
+	m_staging = nullptr;
+
+	m_meta.m_dropped = m_dropped;
+	if(!m_meta.Write(m_basePath + ".sigmf-meta"))
+		LogError("Failed to write %s.sigmf-meta\n", m_basePath.c_str());
+#endif
+}
@@ -0,0 +1,143 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of SigMFRecorder
+ */
+
+#ifndef SigMFRecorder_h
+#define SigMFRecorder_h
+
+#include "BlockRing.h"
+#include "SigMFMetadata.h"
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+	@brief Writes published blocks to disk as a SigMF recording (a .sigmf-data file plus .sigmf-meta JSON)
+
+	Runs alongside the network subscribers, taking its own reference to each block so nothing is copied on the way in.
+	A writer thread drains a ring of blocks into the data file, opened with O_DIRECT where available so the page cache
+	stays out of the way at full rate. O_DIRECT writes must be aligned, so a block is written straight from its pool
+	buffer when it starts on an aligned file offset and is a whole number of sectors long; anything else (the ragged
+	end of a block, or multi-channel blocks which need interleaving) is copied through an aligned staging buffer.
+	Sample depths which are a multiple of 4 KiB worth of samples therefore never copy.
+
+	If the writer falls behind and the ring fills, new blocks are dropped rather than stalling the data plane; the gap
+	starts a new capture segment in the metadata so the recording stays honest about what's missing. The metadata is
+	written when recording stops.
+ */
+class SigMFRecorder
+{
+public:
+	SigMFRecorder();
+	~SigMFRecorder();
+
+	bool Start(const std::string& path, size_t depth, size_t maxBytes);
+	void Stop();
+	bool Publish(RxBlock* block);
+	std::string GetStatus();
+
+	///@brief Returns true if a recording is in progress
+	bool IsRecording() const
+	{ return m_recording; }
+
+protected:
+	void WriterThread();
+	void WriteBlock(RxBlock* block);
+	void BeginCapture(RxBlock* block, bool discontinuity);
+	bool Stage(const void* data, size_t len);
+	bool StagePlanar(RxBlock* block);
+	bool FlushStaging(bool final);
+	bool WriteAll(const void* data, size_t len);
+	void Close();
+
+	///@brief Protects the recording state against Publish() from the data plane thread
+	std::mutex m_mutex;
+
+	///@brief True while blocks are being accepted
+	std::atomic<bool> m_recording;
+
+	///@brief Set to tell the writer thread to finish up
+	std::atomic<bool> m_stop;
+
+	///@brief Blocks waiting to be written
+	BlockRing m_ring;
+
+	///@brief Total buffer size of the blocks in m_ring
+	std::atomic<size_t> m_queuedBytes;
+
+	///@brief Most buffer memory m_ring may hold on to
+	size_t m_maxQueuedBytes;
+
+	///@brief The writer thread
+	std::thread m_thread;
+
+	///@brief Path of the recording, without the .sigmf-data / .sigmf-meta extension
+	std::string m_basePath;
+
+	///@brief File descriptor of the data file
+	int m_fd;
+
+	///@brief True if m_fd was opened with O_DIRECT
+	bool m_direct;
+
+	///@brief Page-aligned staging buffer
+	uint8_t* m_staging;
+
+	///@brief Bytes of m_staging in use
+	size_t m_stagingUsed;
+
+	///@brief Bytes of sample data in the file (not counting padding)
+	std::atomic<uint64_t> m_bytesWritten;
+
+	///@brief Blocks thrown away because the writer fell behind
+	std::atomic<uint64_t> m_dropped;
+
+	///@brief True once the first block has fixed the format, rate and channel count of the recording
+	bool m_haveFormat;
+
+	///@brief m_recordIndex of the last block written
+	uint64_t m_lastIndex;
+
+	///@brief Format and capture segments so far
+	SigMFMetadata m_meta;
+
+	///@brief True if we already complained about a block that doesn't match the recording
+	bool m_warnedMismatch;
+};
+
+extern SigMFRecorder g_recorder;
+
+#endif
@@ -0,0 +1,703 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of SimRxSource
+ */
+
+#include "uhdbridge.h"
+#include "SimRxSource.h"
+#include <limits>
+#include <math.h>
+
+using namespace std;
+
+//Size of the precomputed noise table, must be a power of two
+static const size_t g_noiseTableSize = 65536;
+
+//Number of samples generated between re-seeding the tone NCO from the exact phase
+static const size_t g_toneChunkSize = 4096;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Helpers
+
+///@brief Converts a float sample to the output type, clamping integer types to their range
+template<class T>
+static inline T ToSample(float v)
+{
+	if(numeric_limits<T>::is_integer)
+		v = roundf(max(min(v, (float)numeric_limits<T>::max()), (float)numeric_limits<T>::min()));
+	return static_cast<T>(v);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// SimRxStream
+
+SimRxStream::SimRxStream(SimRxSource& source, SampleFormat format, const vector<size_t>& channels)
+	: m_source(source)
+	, m_format(format)
+	, m_channels(channels)
+	, m_running(false)
+	, m_continuous(false)
+	, m_remaining(0)
+	, m_sample(0)
+	, m_rng(source.m_seed)
+	, m_late(false)
+{
+}
+
+size_t SimRxStream::GetMaxPacketSize()
+{
+	return m_source.m_packetSize;
+}
+
+void SimRxStream::IssueStreamCommand(const uhd::stream_cmd_t& cmd)
+{
+	switch(cmd.stream_mode)
+	{
+		case uhd::stream_cmd_t::STREAM_MODE_START_CONTINUOUS:
+			m_continuous = true;
+			break;
+
+		case uhd::stream_cmd_t::STREAM_MODE_NUM_SAMPS_AND_DONE:
+		case uhd::stream_cmd_t::STREAM_MODE_NUM_SAMPS_AND_MORE:
+			m_continuous = false;
+			m_remaining = cmd.num_samps;
+			break;
+
+		case uhd::stream_cmd_t::STREAM_MODE_STOP_CONTINUOUS:
+		default:
+			m_running = false;
+			return;
+	}
+
+	m_running = true;
+	m_late = false;
+	uint64_t now = m_source.GetTicksNow();
+	if(cmd.stream_now)
+		m_sample = now;
+	else
+	{
+		//Like the radio, refuse to start a stream in the past
+		m_sample = cmd.time_spec.to_ticks(m_source.m_rate);
+		if(m_sample < now)
+		{
+			m_running = false;
+			m_late = true;
+		}
+	}
+}
+
+size_t SimRxStream::Receive(vector<void*>& buffs, size_t nsamps, uhd::rx_metadata_t& meta, double timeout)
+{
+	meta.reset();
+
+	if(m_late)
+	{
+		m_late = false;
+		meta.error_code = uhd::rx_metadata_t::ERROR_CODE_LATE_COMMAND;
+		return 0;
+	}
+
+	//Nothing streaming, behave like the radio and wait out the timeout
+	if(!m_running)
+	{
+		this_thread::sleep_for(chrono::duration<double>(timeout));
+		meta.error_code = uhd::rx_metadata_t::ERROR_CODE_TIMEOUT;
+		return 0;
+	}
+
+	size_t count = nsamps;
+	if(!m_continuous)
+		count = min<uint64_t>(count, m_remaining);
+	double rate = m_source.m_rate;
+
+	//Inject faults at the configured average rates
+	uniform_real_distribution<double> uniform(0, 1);
+	double seconds = count / rate;
+	if(uniform(m_rng) < m_source.m_overflowRate * seconds)
+	{
+		//Samples were lost, so skip over them
+		m_sample += count;
+		meta.error_code = uhd::rx_metadata_t::ERROR_CODE_OVERFLOW;
+		return 0;
+	}
+	if(uniform(m_rng) < m_source.m_timeoutRate * seconds)
+	{
+		this_thread::sleep_for(chrono::duration<double>(timeout));
+		meta.error_code = uhd::rx_metadata_t::ERROR_CODE_TIMEOUT;
+		return 0;
+	}
+
+	if(!WaitForSamples(m_sample + count, timeout))
+	{
+		meta.error_code = uhd::rx_metadata_t::ERROR_CODE_TIMEOUT;
+		return 0;
+	}
+
+	for(size_t c=0; c<buffs.size(); c++)
+	{
+		switch(m_format)
+		{
+			case FORMAT_SC16:
+				Generate(static_cast<int16_t*>(buffs[c]), m_channels[c], count);
+				break;
+
+			case FORMAT_SC8:
+				Generate(static_cast<int8_t*>(buffs[c]), m_channels[c], count);
+				break;
+
+			case FORMAT_FC32:
+			default:
+				Generate(static_cast<float*>(buffs[c]), m_channels[c], count);
+				break;
+		}
+	}
+
+	meta.error_code = uhd::rx_metadata_t::ERROR_CODE_NONE;
+	meta.has_time_spec = true;
+	meta.time_spec = uhd::time_spec_t::from_ticks(m_sample, rate);
+
+	m_sample += count;
+	if(!m_source.m_realtime)
+		m_source.m_simTime = m_sample / rate;
+	if(!m_continuous)
+	{
+		m_remaining -= count;
+		if(m_remaining == 0)
+		{
+			m_running = false;
+			meta.end_of_burst = true;
+		}
+	}
+	return count;
+}
+
+/**
+	@brief In real time mode, sleeps until the given sample would have been received
+
+	@return False if that's more than the timeout away
+ */
+bool SimRxStream::WaitForSamples(uint64_t end, double timeout)
+{
+	if(!m_source.m_realtime)
+		return true;
+
+	double offset = m_source.GetTimeOffset(m_source.GetElapsedTime());
+	auto when = m_source.m_epoch + chrono::duration_cast<chrono::steady_clock::duration>(
+		chrono::duration<double>(end / m_source.m_rate - offset));
+	auto now = chrono::steady_clock::now();
+	if(when - now > chrono::duration<double>(timeout))
+	{
+		this_thread::sleep_for(chrono::duration<double>(timeout));
+		return false;
+	}
+	this_thread::sleep_until(when);
+	return true;
+}
+
+/**
+	@brief Generates samples for one channel, starting at m_sample
+
+	@param out		Output buffer
+	@param chan		Hardware channel index
+	@param count	Number of samples to generate
+ */
+template<class T>
+void SimRxStream::Generate(T* out, size_t chan, size_t count)
+{
+	auto& src = m_source;
+	float scale = 1.0f / GetFormatScale(m_format);
+	size_t noiseMask = src.m_noise.size() - 1;
+	size_t noisePos = m_rng();
+	const complex<float>* noise = &src.m_noise[0];
+
+	//Replay a file
+	if(!src.m_file.empty())
+	{
+		size_t len = src.m_file.size();
+		size_t pos = m_sample % len;
+		for(size_t i=0; i<count; i++)
+		{
+			complex<float> s = src.m_file[pos] + noise[(noisePos + i) & noiseMask];
+			out[i*2] = ToSample<T>(s.real() * scale);
+			out[i*2 + 1] = ToSample<T>(s.imag() * scale);
+			if(++pos == len)
+				pos = 0;
+		}
+		return;
+	}
+
+	//Gated tone. Each channel gets a different phase so they can be told apart.
+	double rate = src.m_rate;
+	double cyclesPerSample = src.m_toneFrequency / rate;
+	complex<float> step = polar(1.0f, (float)(2 * M_PI * cyclesPerSample));
+	uint64_t period = (src.m_burstPeriod > 0) ? max((uint64_t)1, (uint64_t)(src.m_burstPeriod * rate)) : 0;
+	uint64_t burstLength = src.m_burstLength * rate;
+	uint64_t first = m_sample;
+	float amplitude = src.m_toneAmplitude;
+
+	//Every chunk starts from the exact phase, so they can be generated in parallel to outrun the bridge
+	size_t nchunks = (count + g_toneChunkSize - 1) / g_toneChunkSize;
+	#pragma omp parallel for
+	for(size_t chunk=0; chunk<nchunks; chunk++)
+	{
+		size_t start = chunk * g_toneChunkSize;
+		size_t end = min(start + g_toneChunkSize, count);
+		uint64_t burstPos = period ? ((first + start) % period) : 0;
+		double cycles = cyclesPerSample * static_cast<double>(first + start) + chan * 0.125;
+		complex<float> nco = polar(amplitude, (float)(2 * M_PI * (cycles - floor(cycles))));
+
+		for(size_t i=start; i<end; i++)
+		{
+			complex<float> s = noise[(noisePos + i) & noiseMask];
+			if(!period || (burstPos < burstLength))
+				s += nco;
+			nco *= step;
+			if(period && (++burstPos == period))
+				burstPos = 0;
+
+			out[i*2] = ToSample<T>(s.real() * scale);
+			out[i*2 + 1] = ToSample<T>(s.imag() * scale);
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+SimRxSource::SimRxSource(const string& args)
+	: m_rate(1e6)
+	, m_masterClock(61.44e6)
+	, m_toneFrequency(1e6)
+	, m_toneAmplitude(0.5)
+	, m_noiseAmplitude(0.01)
+	, m_burstPeriod(0)
+	, m_burstLength(-1)
+	, m_overflowRate(0)
+	, m_timeoutRate(0)
+	, m_realtime(true)
+	, m_packetSize(2040)
+	, m_seed(1)
+	, m_epoch(chrono::steady_clock::now())
+	, m_simTime(0)
+	, m_timeOffset(0)
+	, m_ppsEdge(-1)
+	, m_ppsOffset(0)
+{
+	size_t nchans = 2;
+	string file;
+	SampleFormat fileFormat = FORMAT_FC32;
+
+	//Parse key=value,key=value
+	size_t pos = 0;
+	while(pos < args.length())
+	{
+		size_t comma = args.find(',', pos);
+		if(comma == string::npos)
+			comma = args.length();
+		string field = args.substr(pos, comma - pos);
+		pos = comma + 1;
+
+		size_t eq = field.find('=');
+		if(eq == string::npos)
+		{
+			LogWarning("Ignoring simulator option \"%s\" with no value\n", field.c_str());
+			continue;
+		}
+		string key = field.substr(0, eq);
+		string value = field.substr(eq + 1);
+
+		if(key == "chans")
+			nchans = max(stoul(value), 1UL);
+		else if(key == "tone")
+			m_toneFrequency = stod(value);
+		else if(key == "amp")
+			m_toneAmplitude = stof(value);
+		else if(key == "noise")
+			m_noiseAmplitude = stof(value);
+		else if(key == "burst")
+			m_burstPeriod = stod(value);
+		else if(key == "burstlen")
+			m_burstLength = stod(value);
+		else if(key == "overflow")
+			m_overflowRate = stod(value);
+		else if(key == "timeout")
+			m_timeoutRate = stod(value);
+		else if(key == "file")
+			file = value;
+		else if(key == "filefmt")
+		{
+			if(!ParseFormatName(value, fileFormat))
+				LogError("Unrecognized replay file format %s, assuming fc32\n", value.c_str());
+		}
+		else if(key == "realtime")
+			m_realtime = (stoi(value) != 0);
+		else if(key == "spp")
+			m_packetSize = max(stoul(value), 1UL);
+		else if(key == "seed")
+			m_seed = stoul(value);
+		else
+			LogWarning("Unrecognized simulator option \"%s\"\n", key.c_str());
+	}
+
+	if(m_burstLength < 0)
+		m_burstLength = m_burstPeriod / 2;
+
+	m_gain.assign(nchans, 0);
+	m_bandwidth.assign(nchans, 56e6);
+	m_frequency.assign(nchans, 1e9);
+
+	//Each component gets half the noise power
+	minstd_rand rng(m_seed);
+	normal_distribution<float> dist(0, m_noiseAmplitude / sqrt(2.0f));
+	m_noise.resize(g_noiseTableSize);
+	for(auto& n : m_noise)
+		n = complex<float>(dist(rng), dist(rng));
+
+	if(!file.empty())
+		LoadFile(file, fileFormat);
+
+	LogNotice("Using simulated RX source (%zu channels, %s)\n", nchans, m_realtime ? "real time" : "unpaced");
+}
+
+/**
+	@brief Loads a raw IQ file to replay
+ */
+void SimRxSource::LoadFile(const string& path, SampleFormat format)
+{
+	FILE* fp = fopen(path.c_str(), "rb");
+	if(!fp)
+	{
+		LogError("Couldn't open replay file %s, using the test tone instead\n", path.c_str());
+		return;
+	}
+
+	fseek(fp, 0, SEEK_END);
+	size_t bytes = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	vector<uint8_t> raw(bytes);
+	if(fread(&raw[0], 1, bytes, fp) != bytes)
+		LogWarning("Short read from replay file %s\n", path.c_str());
+	fclose(fp);
+
+	size_t bps = GetBytesPerSample(format);
+	size_t count = bytes / bps;
+	float scale = GetFormatScale(format);
+	m_file.resize(count);
+	for(size_t i=0; i<count; i++)
+	{
+		const uint8_t* p = &raw[i * bps];
+		switch(format)
+		{
+			case FORMAT_SC16:
+				{
+					const int16_t* s = reinterpret_cast<const int16_t*>(p);
+					m_file[i] = complex<float>(s[0] * scale, s[1] * scale);
+				}
+				break;
+
+			case FORMAT_SC8:
+				{
+					const int8_t* s = reinterpret_cast<const int8_t*>(p);
+					m_file[i] = complex<float>(s[0] * scale, s[1] * scale);
+				}
+				break;
+
+			case FORMAT_FC32:
+			default:
+				{
+					const float* s = reinterpret_cast<const float*>(p);
+					m_file[i] = complex<float>(s[0], s[1]);
+				}
+				break;
+		}
+	}
+
+	LogVerbose("Loaded %zu samples from replay file %s\n", count, path.c_str());
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Identification
+
+string SimRxSource::GetModel()
+{
+	return "Simulated";
+}
+
+string SimRxSource::GetSerial()
+{
+	return "SIM0001";
+}
+
+string SimRxSource::GetDescription()
+{
+	char buf[256];
+	snprintf(buf, sizeof(buf), "Simulated RX source: %zu channels at %.3f Msps, %s, %s\n",
+		m_gain.size(),
+		m_rate * 1e-6,
+		m_file.empty() ? "test tone" : "file replay",
+		m_realtime ? "real time" : "unpaced");
+	return buf;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Channel setup
+
+void SimRxSource::SetSubdevSpec(const string& /*spec*/)
+{
+	//Channel count comes from the chans= option instead
+}
+
+string SimRxSource::GetSubdevSpec()
+{
+	return "A:A";
+}
+
+size_t SimRxSource::GetChannelCount()
+{
+	return m_gain.size();
+}
+
+void SimRxSource::SetAntenna(const string& /*name*/, size_t /*chan*/)
+{
+}
+
+vector<string> SimRxSource::GetAntennas(size_t /*chan*/)
+{
+	return vector<string>{"TX/RX", "RX2"};
+}
+
+void SimRxSource::SetClockSource(const string& /*source*/)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Tuning (limits are roughly those of an AD9361)
+
+void SimRxSource::SetGain(double gain, size_t chan)
+{
+	m_gain[chan] = GetGainRange(chan).clip(gain);
+}
+
+double SimRxSource::GetGain(size_t chan)
+{
+	return m_gain[chan];
+}
+
+uhd::gain_range_t SimRxSource::GetGainRange(size_t /*chan*/)
+{
+	return uhd::gain_range_t(0, 76, 1);
+}
+
+void SimRxSource::SetBandwidth(double bandwidth, size_t chan)
+{
+	m_bandwidth[chan] = GetBandwidthRange(chan).clip(bandwidth);
+}
+
+double SimRxSource::GetBandwidth(size_t chan)
+{
+	return m_bandwidth[chan];
+}
+
+uhd::freq_range_t SimRxSource::GetBandwidthRange(size_t /*chan*/)
+{
+	return uhd::freq_range_t(200e3, 56e6);
+}
+
+void SimRxSource::SetFrequency(double freq, size_t chan)
+{
+	m_frequency[chan] = GetFrequencyRange(chan).clip(freq);
+}
+
+double SimRxSource::GetFrequency(size_t chan)
+{
+	return m_frequency[chan];
+}
+
+uhd::freq_range_t SimRxSource::GetFrequencyRange(size_t /*chan*/)
+{
+	return uhd::freq_range_t(70e6, 6e9);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Sampling
+
+void SimRxSource::SetSampleRate(double rate)
+{
+	m_rate = GetSampleRates().clip(rate);
+}
+
+double SimRxSource::GetSampleRate()
+{
+	return m_rate;
+}
+
+uhd::meta_range_t SimRxSource::GetSampleRates()
+{
+	//Unpaced, there's no reason to limit the rate to what real hardware can do
+	if(m_realtime)
+		return uhd::meta_range_t(200e3, 61.44e6, 1);
+	return uhd::meta_range_t(200e3, 1e9, 1);
+}
+
+void SimRxSource::SetMasterClockRate(double rate)
+{
+	m_masterClock = GetMasterClockRates().clip(rate);
+}
+
+double SimRxSource::GetMasterClockRate()
+{
+	if(m_realtime)
+		return m_masterClock;
+	return 1e9;
+}
+
+uhd::meta_range_t SimRxSource::GetMasterClockRates()
+{
+	//Adjustable like a B2xx in real time, fixed (like most radios) when unpaced
+	if(m_realtime)
+		return uhd::meta_range_t(5e6, 61.44e6);
+	return uhd::meta_range_t(1e9, 1e9);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Device time
+
+/*
+	In real time mode the PPS edges are on whole seconds of the wall clock since m_epoch, and device time is the wall
+	clock plus an offset which the time setters change. Unpaced, device time only moves when samples are generated, so
+	there's nothing to wait for and SetTimeNextPPS() takes effect immediately.
+ */
+
+void SimRxSource::SetTimeSource(const string& /*source*/)
+{
+}
+
+uhd::time_spec_t SimRxSource::GetTimeNow()
+{
+	if(m_realtime)
+	{
+		double elapsed = GetElapsedTime();
+		return uhd::time_spec_t(elapsed + GetTimeOffset(elapsed));
+	}
+	return uhd::time_spec_t(m_simTime.load());
+}
+
+uhd::time_spec_t SimRxSource::GetTimeLastPPS()
+{
+	if(m_realtime)
+	{
+		double elapsed = GetElapsedTime();
+		double offset = GetTimeOffset(elapsed);
+		return uhd::time_spec_t(floor(elapsed) + offset);
+	}
+	return uhd::time_spec_t(floor(m_simTime.load()));
+}
+
+void SimRxSource::SetTimeNow(const uhd::time_spec_t& time)
+{
+	if(m_realtime)
+	{
+		double elapsed = GetElapsedTime();
+		lock_guard<mutex> lock(m_timeMutex);
+		m_timeOffset = time.get_real_secs() - elapsed;
+		m_ppsEdge = -1;
+	}
+	else
+		m_simTime = time.get_real_secs();
+}
+
+void SimRxSource::SetTimeNextPPS(const uhd::time_spec_t& time)
+{
+	if(m_realtime)
+	{
+		double elapsed = GetElapsedTime();
+		lock_guard<mutex> lock(m_timeMutex);
+		m_ppsEdge = floor(elapsed) + 1;
+		m_ppsOffset = time.get_real_secs() - m_ppsEdge;
+	}
+	else
+		m_simTime = time.get_real_secs();
+}
+
+void SimRxSource::SetCommandTime(const uhd::time_spec_t& /*time*/)
+{
+	//The synthetic signal doesn't depend on the tuning, so there's nothing to schedule
+}
+
+void SimRxSource::ClearCommandTime()
+{
+}
+
+///@brief Returns the current device time in ticks of the sample rate
+uint64_t SimRxSource::GetTicksNow()
+{
+	return GetTimeNow().to_ticks(m_rate);
+}
+
+///@brief Returns the wall clock time since m_epoch, in seconds
+double SimRxSource::GetElapsedTime()
+{
+	return chrono::duration<double>(chrono::steady_clock::now() - m_epoch).count();
+}
+
+/**
+	@brief Returns device time minus wall clock time, switching to the pending PPS offset if its edge has gone by
+
+	@param elapsed	Current wall clock time since m_epoch
+ */
+double SimRxSource::GetTimeOffset(double elapsed)
+{
+	lock_guard<mutex> lock(m_timeMutex);
+	if( (m_ppsEdge >= 0) && (elapsed >= m_ppsEdge) )
+	{
+		m_timeOffset = m_ppsOffset;
+		m_ppsEdge = -1;
+	}
+	return m_timeOffset;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Streaming
+
+unique_ptr<RxStream> SimRxSource::OpenStream(const uhd::stream_args_t& args)
+{
+	SampleFormat format;
+	if(!ParseFormatName(args.cpu_format, format))
+		format = FORMAT_FC32;
+
+	vector<size_t> channels = args.channels;
+	if(channels.empty())
+		channels.push_back(0);
+
+	return unique_ptr<RxStream>(new SimRxStream(*this, format, channels));
+}
@@ -0,0 +1,230 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of SimRxSource
+
+	The simulated source is selected with --device sim:key=value,key=value... Keys (all optional):
+
+		chans=N			Number of RX channels (default 2)
+		tone=Hz			Offset of a test tone from the center frequency (default 1 MHz)
+		amp=A			Tone amplitude, full scale is 1.0 (default 0.5, 0 for no tone)
+		noise=A			RMS amplitude of complex Gaussian noise (default 0.01)
+		burst=s			Gate the tone on and off with this period (default 0, always on)
+		burstlen=s		Length of each burst (default half the period)
+		overflow=N		Average number of overflows to inject per second of stream time
+		timeout=N		Average number of timeouts to inject per second of stream time
+		file=path		Replay raw IQ from a file (looped) instead of the tone
+		filefmt=F		Format of the replay file: fc32 (default), sc16 or sc8
+		realtime=0|1	Pace samples to the sample rate (default 1). With 0, samples are generated as fast as
+						the bridge asks for them, to find its maximum sustainable throughput.
+		spp=N			Samples per packet (default 2040, same as a B210 over USB 3)
+		seed=N			Random seed (default 1), so runs are repeatable
+ */
+
+#ifndef SimRxSource_h
+#define SimRxSource_h
+
+#include "RxSource.h"
+#include "SampleFormat.h"
+#include <atomic>
+#include <chrono>
+#include <complex>
+#include <mutex>
+#include <random>
+
+class SimRxSource;
+
+/**
+	@brief Stream of synthetic samples from a SimRxSource
+ */
+class SimRxStream : public RxStream
+{
+public:
+	SimRxStream(SimRxSource& source, SampleFormat format, const std::vector<size_t>& channels);
+
+	virtual size_t GetMaxPacketSize() override;
+	virtual size_t Receive(std::vector<void*>& buffs, size_t nsamps, uhd::rx_metadata_t& meta, double timeout) override;
+	virtual void IssueStreamCommand(const uhd::stream_cmd_t& cmd) override;
+
+protected:
+	template<class T> void Generate(T* out, size_t chan, size_t count);
+	bool WaitForSamples(uint64_t end, double timeout);
+
+	///@brief The source we belong to
+	SimRxSource& m_source;
+
+	///@brief Format to generate
+	SampleFormat m_format;
+
+	///@brief Hardware channels being streamed
+	std::vector<size_t> m_channels;
+
+	///@brief True if a stream command is in progress
+	bool m_running;
+
+	///@brief True if streaming continuously, false if counting down m_remaining
+	bool m_continuous;
+
+	///@brief Samples left in a NUM_SAMPS_AND_DONE command
+	uint64_t m_remaining;
+
+	///@brief Device time of the next sample, in ticks of the sample rate
+	uint64_t m_sample;
+
+	///@brief Random number generator for noise offsets and fault injection
+	std::minstd_rand m_rng;
+
+	///@brief True if the last timed stream command was for a time already in the past
+	bool m_late;
+};
+
+/**
+	@brief Synthetic radio for testing and benchmarking without hardware
+ */
+class SimRxSource : public RxSource
+{
+public:
+	SimRxSource(const std::string& args);
+
+	virtual std::string GetModel() override;
+	virtual std::string GetSerial() override;
+	virtual std::string GetDescription() override;
+
+	virtual void SetSubdevSpec(const std::string& spec) override;
+	virtual std::string GetSubdevSpec() override;
+	virtual size_t GetChannelCount() override;
+	virtual void SetAntenna(const std::string& name, size_t chan) override;
+	virtual std::vector<std::string> GetAntennas(size_t chan) override;
+	virtual void SetClockSource(const std::string& source) override;
+
+	virtual void SetGain(double gain, size_t chan) override;
+	virtual double GetGain(size_t chan) override;
+	virtual uhd::gain_range_t GetGainRange(size_t chan) override;
+	virtual void SetBandwidth(double bandwidth, size_t chan) override;
+	virtual double GetBandwidth(size_t chan) override;
+	virtual uhd::freq_range_t GetBandwidthRange(size_t chan) override;
+	virtual void SetFrequency(double freq, size_t chan) override;
+	virtual double GetFrequency(size_t chan) override;
+	virtual uhd::freq_range_t GetFrequencyRange(size_t chan) override;
+
+	virtual void SetSampleRate(double rate) override;
+	virtual double GetSampleRate() override;
+	virtual uhd::meta_range_t GetSampleRates() override;
+	virtual void SetMasterClockRate(double rate) override;
+	virtual double GetMasterClockRate() override;
+	virtual uhd::meta_range_t GetMasterClockRates() override;
+
+	virtual void SetTimeSource(const std::string& source) override;
+	virtual uhd::time_spec_t GetTimeNow() override;
+	virtual uhd::time_spec_t GetTimeLastPPS() override;
+	virtual void SetTimeNow(const uhd::time_spec_t& time) override;
+	virtual void SetTimeNextPPS(const uhd::time_spec_t& time) override;
+	virtual void SetCommandTime(const uhd::time_spec_t& time) override;
+	virtual void ClearCommandTime() override;
+
+	virtual std::unique_ptr<RxStream> OpenStream(const uhd::stream_args_t& args) override;
+
+protected:
+	friend class SimRxStream;
+
+	void LoadFile(const std::string& path, SampleFormat format);
+	uint64_t GetTicksNow();
+	double GetElapsedTime();
+	double GetTimeOffset(double elapsed);
+
+	//Per-channel settings
+	std::vector<double> m_gain;
+	std::vector<double> m_bandwidth;
+	std::vector<double> m_frequency;
+
+	///@brief Sample rate, in Hz
+	double m_rate;
+
+	///@brief Master clock rate in real time mode, in Hz
+	double m_masterClock;
+
+	///@brief Tone offset from center, in Hz
+	double m_toneFrequency;
+
+	///@brief Tone amplitude
+	float m_toneAmplitude;
+
+	///@brief RMS noise amplitude
+	float m_noiseAmplitude;
+
+	///@brief Burst period, in seconds (0 for continuous)
+	double m_burstPeriod;
+
+	///@brief Burst length, in seconds
+	double m_burstLength;
+
+	///@brief Injected overflows per second
+	double m_overflowRate;
+
+	///@brief Injected timeouts per second
+	double m_timeoutRate;
+
+	///@brief True to pace samples in real time
+	bool m_realtime;
+
+	///@brief Samples per packet
+	size_t m_packetSize;
+
+	///@brief Random seed
+	unsigned int m_seed;
+
+	///@brief Replay samples, or empty for the tone
+	std::vector< std::complex<float> > m_file;
+
+	///@brief Gaussian noise, precomputed since generating it on the fly is much slower than the radio
+	std::vector< std::complex<float> > m_noise;
+
+	///@brief Wall clock time of device time zero
+	std::chrono::steady_clock::time_point m_epoch;
+
+	///@brief In non-realtime mode, device time advances as samples are generated rather than with the wall clock
+	std::atomic<double> m_simTime;
+
+	///@brief In real time mode, device time minus the wall clock time since m_epoch
+	double m_timeOffset;
+
+	///@brief Wall clock time since m_epoch of the PPS edge where m_ppsOffset takes effect, or negative if none
+	double m_ppsEdge;
+
+	///@brief Time offset to switch to at the next PPS edge
+	double m_ppsOffset;
+
+	///@brief Protects the time offsets
+	std::mutex m_timeMutex;
+};
+
+#endif
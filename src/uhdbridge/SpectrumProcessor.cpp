@@ -0,0 +1,385 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of SpectrumProcessor
+ */
+
+#include "uhdbridge.h"
+#include "SpectrumProcessor.h"
+#include "RxBlockPool.h"
+#include "CpuPlacement.h"
+#include <math.h>
+#include <omp.h>
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+SpectrumProcessor::SpectrumProcessor()
+	: m_fftSize(0)
+	, m_window(WINDOW_RECTANGULAR)
+	, m_average(AVERAGE_LINEAR)
+	, m_channels(0)
+	, m_plan(nullptr)
+	, m_frames(0)
+	, m_blocks(0)
+	, m_rate(1)
+	, m_firstSample(0)
+	, m_timeValid(false)
+	, m_overflow(false)
+	, m_scanStep(0)
+	, m_scanSteps(0)
+{
+}
+
+SpectrumProcessor::~SpectrumProcessor()
+{
+	FreeBuffers();
+}
+
+void SpectrumProcessor::FreeBuffers()
+{
+	if(m_plan)
+		fftwf_destroy_plan(m_plan);
+	m_plan = nullptr;
+
+	for(auto p : m_fftIn)
+		fftwf_free(p);
+	for(auto p : m_fftOut)
+		fftwf_free(p);
+	m_fftIn.clear();
+	m_fftOut.clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Configuration
+
+/**
+	@brief Plans the FFT and computes the window for a new size, and throws away any partial average
+ */
+void SpectrumProcessor::Configure(size_t fftSize, SpectrumWindow window, size_t nchans)
+{
+	FreeBuffers();
+
+	m_fftSize = fftSize;
+	m_window = window;
+	m_channels = nchans;
+
+	//One set of buffers per thread, all sharing a single plan
+	size_t nthreads = omp_get_max_threads();
+	for(size_t i=0; i<nthreads; i++)
+	{
+		m_fftIn.push_back(static_cast<fftwf_complex*>(fftwf_malloc(sizeof(fftwf_complex) * fftSize)));
+		m_fftOut.push_back(static_cast<fftwf_complex*>(fftwf_malloc(sizeof(fftwf_complex) * fftSize)));
+	}
+	m_partial.assign(nthreads, vector<float>(fftSize));
+	m_partialFrames.assign(nthreads, 0);
+
+	//Planning is slow but only happens when the size changes
+	LogDebug("planning %zu point FFT\n", fftSize);
+	m_plan = fftwf_plan_dft_1d(fftSize, m_fftIn[0], m_fftOut[0], FFTW_FORWARD, FFTW_MEASURE);
+
+	m_windowCoeffs.resize(fftSize);
+	double sum = 0;
+	for(size_t i=0; i<fftSize; i++)
+	{
+		double x = 2 * M_PI * i / fftSize;
+		double w;
+		switch(window)
+		{
+			case WINDOW_HANN:
+				w = 0.5 - 0.5*cos(x);
+				break;
+
+			case WINDOW_BLACKMAN_HARRIS:
+				w = 0.35875 - 0.48829*cos(x) + 0.14128*cos(2*x) - 0.01168*cos(3*x);
+				break;
+
+			case WINDOW_FLATTOP:
+				w = 0.21557895 - 0.41663158*cos(x) + 0.277263158*cos(2*x) - 0.083578947*cos(3*x)
+					+ 0.006947368*cos(4*x);
+				break;
+
+			case WINDOW_RECTANGULAR:
+			default:
+				w = 1;
+				break;
+		}
+		m_windowCoeffs[i] = w;
+		sum += w;
+	}
+
+	//Normalize by the coherent gain so a full scale tone reads 0 dBFS whatever the window
+	for(auto& w : m_windowCoeffs)
+		w /= sum;
+
+	Reset();
+}
+
+/**
+	@brief Starts a new average
+ */
+void SpectrumProcessor::Reset()
+{
+	m_average = g_fftAverage.load();
+	m_accum.assign(m_channels, vector<double>(m_fftSize, 0));
+	m_frames = 0;
+	m_blocks = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Processing
+
+/**
+	@brief Adds a block to the current average
+
+	@param in	Block of IQ samples. Ownership passes to the processor.
+
+	@return The finished spectrum if this block completed an average, the input block if spectrum mode is off, or
+			nullptr if there's nothing to send yet
+ */
+RxBlock* SpectrumProcessor::Process(RxBlock* in)
+{
+	//Spectrum payloads need the v1 header to describe them
+	size_t fftSize = g_fftSize.load();
+	if( (fftSize == 0) || (g_dataPlaneVersion.load() < 1) || (in->m_payloadType != PAYLOAD_IQ) )
+		return in;
+	g_threadPlacement.RefreshHelpers();
+
+	//The control plane can change any of these at any time, so look at each once per block
+	SpectrumWindow window = g_fftWindow.load();
+	SpectrumAverage average = g_fftAverage.load();
+	double overlap = min(max(g_fftOverlap.load(), 0.0), 0.95);
+	size_t averageCount = max(g_fftAverageCount.load(), (size_t)1);
+
+	size_t nchans = in->m_channels.size();
+	if( (fftSize != m_fftSize) || (window != m_window) || (nchans != m_channels) )
+		Configure(fftSize, window, nchans);
+	else if( (average != m_average) || (in->m_rate != m_rate) || (in->m_scanSteps != m_scanSteps) )
+		Reset();
+
+	//Remember where this average started
+	if(m_blocks == 0)
+	{
+		m_rate = in->m_rate;
+		m_firstSample = in->m_firstSample;
+		m_startTime = in->m_startTime;
+		m_timeValid = in->m_timeValid;
+		m_overflow = false;
+		m_channelInfo = in->m_channels;
+		m_scanStep = in->m_scanStep;
+		m_scanSteps = in->m_scanSteps;
+	}
+	m_overflow |= in->m_overflow;
+
+	//Step between frames
+	size_t hop = max((size_t)1, (size_t)(fftSize * (1 - overlap)));
+
+	for(size_t c=0; c<nchans; c++)
+	{
+		switch(in->m_format)
+		{
+			case FORMAT_SC16:
+				AccumulateChannel<int16_t>(*in, c, hop);
+				break;
+
+			case FORMAT_SC8:
+				AccumulateChannel<int8_t>(*in, c, hop);
+				break;
+
+			case FORMAT_FC32:
+			default:
+				AccumulateChannel<float>(*in, c, hop);
+				break;
+		}
+	}
+
+	//Every channel has the same number of frames
+	for(auto n : m_partialFrames)
+		m_frames += n;
+	uint64_t sequence = in->m_sequence;
+	g_blockPool.Release(in);
+
+	//Scan steps are never averaged together since they're at different frequencies
+	m_blocks ++;
+	if( (m_scanSteps == 0) && (m_blocks < averageCount) )
+		return nullptr;
+
+	RxBlock* out = MakeOutput();
+	if(out)
+		out->m_sequence = sequence;
+	Reset();
+	return out;
+}
+
+/**
+	@brief FFTs every frame of one channel of a block and adds the results to the accumulator
+ */
+template<class T>
+void SpectrumProcessor::AccumulateChannel(RxBlock& in, size_t chan, size_t hop)
+{
+	size_t len = in.m_length;
+	size_t fftSize = m_fftSize;
+	size_t nframes = (len >= fftSize) ? ((len - fftSize) / hop + 1) : 0;
+	const T* src = static_cast<const T*>(in.GetSample(chan, 0));
+	float scale = GetFormatScale(in.m_format);
+	SpectrumAverage average = m_average;
+
+	for(auto& p : m_partial)
+		fill(p.begin(), p.end(), 0.0f);
+	fill(m_partialFrames.begin(), m_partialFrames.end(), 0);
+
+	//Frames are independent, so spread them across threads. Each thread has its own buffers and accumulator.
+	#pragma omp parallel for schedule(static)
+	for(size_t frame=0; frame<nframes; frame++)
+	{
+		size_t tid = omp_get_thread_num();
+		fftwf_complex* fin = m_fftIn[tid];
+		fftwf_complex* fout = m_fftOut[tid];
+		float* acc = &m_partial[tid][0];
+		const T* base = src + frame*hop*2;
+
+		for(size_t i=0; i<fftSize; i++)
+		{
+			float w = m_windowCoeffs[i] * scale;
+			fin[i][0] = base[i*2] * w;
+			fin[i][1] = base[i*2 + 1] * w;
+		}
+
+		fftwf_execute_dft(m_plan, fin, fout);
+
+		for(size_t i=0; i<fftSize; i++)
+		{
+			float power = fout[i][0]*fout[i][0] + fout[i][1]*fout[i][1];
+			switch(average)
+			{
+				case AVERAGE_LOG:
+					acc[i] += 10 * log10f(power + 1e-30f);
+					break;
+
+				case AVERAGE_MAXHOLD:
+					acc[i] = max(acc[i], power);
+					break;
+
+				case AVERAGE_LINEAR:
+				default:
+					acc[i] += power;
+					break;
+			}
+		}
+		m_partialFrames[tid] ++;
+	}
+
+	//Merge the per-thread results
+	auto& accum = m_accum[chan];
+	for(size_t t=0; t<m_partial.size(); t++)
+	{
+		if(m_partialFrames[t] == 0)
+			continue;
+		const float* partial = &m_partial[t][0];
+		for(size_t i=0; i<fftSize; i++)
+		{
+			if(average == AVERAGE_MAXHOLD)
+				accum[i] = max(accum[i], (double)partial[i]);
+			else
+				accum[i] += partial[i];
+		}
+	}
+}
+
+/**
+	@brief Converts the accumulators to a block of dBFS values, in frequency order
+ */
+RxBlock* SpectrumProcessor::MakeOutput()
+{
+	if(m_frames == 0)
+	{
+		LogWarning("sample depth is smaller than the FFT size, no spectrum computed\n");
+		return nullptr;
+	}
+
+	RxBlock* out = g_blockPool.Acquire();
+	if(!out)
+		return nullptr;
+	out->m_format = FORMAT_F32;
+	out->m_payloadType = PAYLOAD_SPECTRUM;
+	out->m_channels = m_channelInfo;
+	if(out->GetSampleCapacity() < m_fftSize)
+	{
+		LogWarning("FFT size is too big for the sample buffers, no spectrum computed\n");
+		g_blockPool.Release(out);
+		return nullptr;
+	}
+
+	double frames = m_frames;
+	size_t half = m_fftSize / 2;
+	out->m_stride = m_fftSize;
+	for(size_t c=0; c<m_channels; c++)
+	{
+		auto& accum = m_accum[c];
+		float* dst = static_cast<float*>(out->GetSample(c, 0));
+		for(size_t i=0; i<m_fftSize; i++)
+		{
+			double value;
+			switch(m_average)
+			{
+				case AVERAGE_LOG:
+					value = accum[i] / frames;
+					break;
+
+				case AVERAGE_MAXHOLD:
+					value = 10 * log10(accum[i] + 1e-30);
+					break;
+
+				case AVERAGE_LINEAR:
+				default:
+					value = 10 * log10(accum[i] / frames + 1e-30);
+					break;
+			}
+
+			//Swap halves so negative frequencies come first
+			dst[(i + half) % m_fftSize] = value;
+		}
+	}
+
+	out->m_length = m_fftSize;
+	out->m_requested = m_fftSize;
+	out->m_rate = m_rate;
+	out->m_firstSample = m_firstSample;
+	out->m_startTime = m_startTime;
+	out->m_timeValid = m_timeValid;
+	out->m_overflow = m_overflow;
+	out->m_scanStep = m_scanStep;
+	out->m_scanSteps = m_scanSteps;
+	return out;
+}
@@ -0,0 +1,163 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of SpectrumProcessor
+ */
+
+#ifndef SpectrumProcessor_h
+#define SpectrumProcessor_h
+
+#include "RxBlock.h"
+#include <atomic>
+#include <vector>
+#include <fftw3.h>
+
+///@brief Window functions for spectrum mode
+enum SpectrumWindow
+{
+	WINDOW_RECTANGULAR,
+	WINDOW_HANN,
+	WINDOW_BLACKMAN_HARRIS,
+	WINDOW_FLATTOP
+};
+
+///@brief How successive FFT frames are combined into one spectrum
+enum SpectrumAverage
+{
+	///@brief Mean of linear power
+	AVERAGE_LINEAR,
+
+	///@brief Mean of power in dB (video averaging, less sensitive to bursts)
+	AVERAGE_LOG,
+
+	///@brief Peak power in each bin
+	AVERAGE_MAXHOLD
+};
+
+/**
+	@brief Turns blocks of IQ samples into averaged power spectra
+
+	Every block is cut into overlapping windowed frames of g_fftSize samples, and the power spectra of all frames are
+	combined according to g_fftAverage. After g_fftAverageCount blocks the result is converted to dBFS and sent as a
+	single PAYLOAD_SPECTRUM block, so a client watching a 64k bin spectrum only gets 64k floats per update regardless
+	of the sample depth.
+
+	Frames never straddle blocks, so the last partial frame of each block is not used. Blocks from a scan are each at
+	a different frequency, so each one gets its own spectrum whatever g_fftAverageCount is.
+ */
+class SpectrumProcessor
+{
+public:
+	SpectrumProcessor();
+	virtual ~SpectrumProcessor();
+
+	RxBlock* Process(RxBlock* in);
+
+protected:
+	void Configure(size_t fftSize, SpectrumWindow window, size_t nchans);
+	void Reset();
+	void FreeBuffers();
+
+	template<class T> void AccumulateChannel(RxBlock& in, size_t chan, size_t hop);
+	RxBlock* MakeOutput();
+
+	///@brief FFT length
+	size_t m_fftSize;
+
+	///@brief Window function
+	SpectrumWindow m_window;
+
+	///@brief Averaging mode the accumulators were started with
+	SpectrumAverage m_average;
+
+	///@brief Number of channels the accumulators are sized for
+	size_t m_channels;
+
+	///@brief Window coefficients, scaled so a full-scale tone comes out at 0 dBFS
+	std::vector<float> m_windowCoeffs;
+
+	///@brief FFTW plan, shared by all threads via fftwf_execute_dft()
+	fftwf_plan m_plan;
+
+	///@brief Per-thread FFT input buffers
+	std::vector<fftwf_complex*> m_fftIn;
+
+	///@brief Per-thread FFT output buffers
+	std::vector<fftwf_complex*> m_fftOut;
+
+	///@brief Per-thread partial accumulators for the channel being processed
+	std::vector< std::vector<float> > m_partial;
+
+	///@brief Per-thread frame counts for the channel being processed
+	std::vector<size_t> m_partialFrames;
+
+	///@brief Accumulated power (or dB, or peak power) of each bin of each channel
+	std::vector< std::vector<double> > m_accum;
+
+	///@brief Number of frames accumulated so far, per channel
+	size_t m_frames;
+
+	///@brief Number of blocks accumulated so far
+	size_t m_blocks;
+
+	///@brief Sample rate of the blocks being averaged
+	int64_t m_rate;
+
+	///@brief Index of the first sample in the current average
+	uint64_t m_firstSample;
+
+	///@brief Device time of the first sample in the current average
+	uhd::time_spec_t m_startTime;
+
+	///@brief True if m_startTime is valid
+	bool m_timeValid;
+
+	///@brief True if any block in the current average overflowed
+	bool m_overflow;
+
+	///@brief Radio settings of each channel at the start of the current average
+	std::vector<RxBlockChannel> m_channelInfo;
+
+	///@brief Scan step of the block being processed
+	size_t m_scanStep;
+
+	///@brief Number of scan steps, or 0 if the blocks aren't from a scan
+	size_t m_scanSteps;
+};
+
+extern std::atomic<size_t> g_fftSize;
+extern std::atomic<SpectrumWindow> g_fftWindow;
+extern std::atomic<double> g_fftOverlap;
+extern std::atomic<SpectrumAverage> g_fftAverage;
+extern std::atomic<size_t> g_fftAverageCount;
+
+#endif
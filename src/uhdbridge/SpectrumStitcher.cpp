@@ -0,0 +1,291 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of SpectrumStitcher
+ */
+
+#include "uhdbridge.h"
+#include "SpectrumStitcher.h"
+#include "RxBlockPool.h"
+#include <limits>
+#include <math.h>
+#include <string.h>
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+SpectrumStitcher::SpectrumStitcher()
+	: m_segmentCount(0)
+	, m_lastStep(0)
+	, m_fftSize(0)
+	, m_rate(1)
+	, m_firstSample(0)
+	, m_timeValid(false)
+	, m_overflow(false)
+	, m_sequence(0)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Processing
+
+/**
+	@brief Adds one scan step's spectrum to the sweep in progress
+
+	@param in	Block from the spectrum processor. Ownership passes to the stitcher.
+
+	@return The stitched spectrum if this block finished a sweep, the input block if it's not a scan step's spectrum
+			or stitching is off, or nullptr if there's nothing to send yet
+ */
+RxBlock* SpectrumStitcher::Process(RxBlock* in)
+{
+	if(!g_stitchEnabled || (in->m_payloadType != PAYLOAD_SPECTRUM) || (in->m_scanSteps == 0) )
+	{
+		Reset();
+		return in;
+	}
+
+	//If the steps went backwards, or the spectra changed shape, the last sweep ended early (its last step was
+	//skipped, or the scan restarted). Send what we have of it.
+	RxBlock* out = nullptr;
+	if( (m_segmentCount != 0) &&
+		( (in->m_scanStep <= m_lastStep) || (in->m_length != m_fftSize) || (in->m_rate != m_rate) ||
+		  (in->m_channels.size() != m_channelInfo.size()) ) )
+	{
+		out = MakeOutput();
+		Reset();
+	}
+
+	bool last = (in->m_scanStep + 1 == in->m_scanSteps);
+	AddSegment(in);
+
+	//Only one block can go out at a time. If one already is, this sweep goes out when the next one starts.
+	if(last && !out)
+	{
+		out = MakeOutput();
+		Reset();
+	}
+	return out;
+}
+
+/**
+	@brief Ends the sweep in progress, because the scan has ended
+
+	@return The stitched spectrum of whatever steps the sweep has, or nullptr if it has none
+ */
+RxBlock* SpectrumStitcher::Flush()
+{
+	RxBlock* out = MakeOutput();
+	Reset();
+	return out;
+}
+
+/**
+	@brief Starts a new sweep
+ */
+void SpectrumStitcher::Reset()
+{
+	m_segmentCount = 0;
+}
+
+/**
+	@brief Copies the spectrum of one step into the sweep, and releases the block
+ */
+void SpectrumStitcher::AddSegment(RxBlock* in)
+{
+	size_t nchans = in->m_channels.size();
+	if(m_segmentCount == 0)
+	{
+		m_fftSize = in->m_length;
+		m_rate = in->m_rate;
+		m_channelInfo = in->m_channels;
+		m_firstSample = in->m_firstSample;
+		m_startTime = in->m_startTime;
+		m_timeValid = in->m_timeValid;
+		m_overflow = false;
+	}
+	m_overflow |= in->m_overflow;
+	m_sequence = in->m_sequence;
+	m_lastStep = in->m_scanStep;
+
+	if(m_segments.size() <= m_segmentCount)
+		m_segments.resize(m_segmentCount + 1);
+	auto& seg = m_segments[m_segmentCount ++];
+	seg.m_centerFrequency.resize(nchans);
+	seg.m_gain.resize(nchans);
+	seg.m_bins.resize(nchans * m_fftSize);
+	for(size_t c=0; c<nchans; c++)
+	{
+		seg.m_centerFrequency[c] = in->m_channels[c].m_centerFrequency;
+		seg.m_gain[c] = in->m_channels[c].m_gain;
+		memcpy(&seg.m_bins[c * m_fftSize], in->GetSample(c, 0), m_fftSize * sizeof(float));
+	}
+
+	g_blockPool.Release(in);
+}
+
+/**
+	@brief Stitches the segments of the sweep into one spectrum
+ */
+RxBlock* SpectrumStitcher::MakeOutput()
+{
+	if( (m_segmentCount == 0) || (m_fftSize < 2) )
+		return nullptr;
+
+	size_t nchans = m_channelInfo.size();
+	size_t half = m_fftSize / 2;
+	double binWidth = static_cast<double>(m_rate) / m_fftSize;
+	double usable = min(max(g_stitchUsable.load(), 0.0), 1.0);
+	size_t keep = max(static_cast<size_t>(1), static_cast<size_t>(usable * half));
+	size_t notch = g_stitchDcNotch.load();
+
+	//Bins are on a grid of multiples of the bin spacing, wide enough for the kept bins of every step
+	int64_t kmin = INT64_MAX;
+	int64_t kmax = INT64_MIN;
+	for(size_t s=0; s<m_segmentCount; s++)
+	{
+		for(auto f : m_segments[s].m_centerFrequency)
+		{
+			int64_t k = llround(f / binWidth);
+			kmin = min(kmin, k - static_cast<int64_t>(keep));
+			kmax = max(kmax, k + static_cast<int64_t>(keep));
+		}
+	}
+	size_t nbins = kmax - kmin + 1;
+
+	RxBlock* out = g_blockPool.Acquire();
+	if(!out)
+		return nullptr;
+	out->m_format = FORMAT_F32;
+	out->m_payloadType = PAYLOAD_SPECTRUM;
+	out->m_channels = m_channelInfo;
+	size_t capacity = out->GetSampleCapacity();
+	if(capacity == 0)
+	{
+		g_blockPool.Release(out);
+		return nullptr;
+	}
+
+	//Keep the peak of each group of bins if the whole trace doesn't fit
+	size_t reduce = (nbins + capacity - 1) / capacity;
+	size_t nout = (nbins + reduce - 1) / reduce;
+	out->m_stride = nout;
+
+	m_trace.resize(nbins);
+	m_distance.resize(nbins);
+	for(size_t c=0; c<nchans; c++)
+	{
+		fill(m_distance.begin(), m_distance.end(), SIZE_MAX);
+
+		//Take each bin from the step it's nearest the center of
+		for(size_t s=0; s<m_segmentCount; s++)
+		{
+			auto& seg = m_segments[s];
+			int64_t center = llround(seg.m_centerFrequency[c] / binWidth) - kmin;
+			const float* bins = &seg.m_bins[c * m_fftSize];
+			float gain = seg.m_gain[c];
+			for(size_t i = half - min(keep, half); (i <= half + keep) && (i < m_fftSize); i++)
+			{
+				size_t dist = (i > half) ? (i - half) : (half - i);
+				if( (notch != 0) && (dist <= notch) )
+					continue;
+
+				size_t k = center + static_cast<int64_t>(i) - static_cast<int64_t>(half);
+				if(dist < m_distance[k])
+				{
+					m_trace[k] = bins[i] - gain;
+					m_distance[k] = dist;
+				}
+			}
+		}
+
+		//Interpolate across holes no wider than the DC notch. Anything wider is a skipped step, leave it alone.
+		//(Coverage is tracked in m_distance rather than with NaNs, since we're built with -ffast-math.)
+		size_t last = SIZE_MAX;
+		for(size_t k=0; k<nbins; k++)
+		{
+			if(m_distance[k] == SIZE_MAX)
+				continue;
+			if( (last != SIZE_MAX) && (k - last > 1) && (k - last <= 2*notch + 2) )
+			{
+				float a = m_trace[last];
+				float b = m_trace[k];
+				for(size_t j=last+1; j<k; j++)
+				{
+					m_trace[j] = a + (b - a) * (j - last) / (k - last);
+					m_distance[j] = half;
+				}
+			}
+			last = k;
+		}
+
+		float* dst = static_cast<float*>(out->GetSample(c, 0));
+		for(size_t j=0; j<nout; j++)
+		{
+			bool valid = false;
+			float peak = 0;
+			size_t end = min(nbins, (j+1) * reduce);
+			for(size_t k=j*reduce; k<end; k++)
+			{
+				if( (m_distance[k] != SIZE_MAX) && (!valid || (m_trace[k] > peak)) )
+				{
+					peak = m_trace[k];
+					valid = true;
+				}
+			}
+			dst[j] = valid ? peak : numeric_limits<float>::quiet_NaN();
+		}
+	}
+
+	//Describe the grid in the usual spectrum terms: bin 0 at center - span/2, spaced span/bins apart
+	double span = nout * reduce * binWidth;
+	double center = (kmin + (reduce - 1) / 2.0) * binWidth + span / 2;
+	for(auto& chan : out->m_channels)
+	{
+		chan.m_centerFrequency = center;
+		chan.m_gain = 0;
+		chan.m_bandwidth = span;
+	}
+
+	out->m_length = nout;
+	out->m_requested = nout;
+	out->m_rate = llround(span);
+	out->m_firstSample = m_firstSample;
+	out->m_startTime = m_startTime;
+	out->m_timeValid = m_timeValid;
+	out->m_overflow = m_overflow;
+	out->m_sequence = m_sequence;
+	return out;
+}
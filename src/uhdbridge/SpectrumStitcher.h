@@ -0,0 +1,129 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of SpectrumStitcher
+ */
+
+#ifndef SpectrumStitcher_h
+#define SpectrumStitcher_h
+
+#include "RxBlock.h"
+#include <atomic>
+#include <vector>
+
+/**
+	@brief Assembles the per-step spectra of a scan into one wideband spectrum per sweep
+
+	Each step's spectrum is trimmed to the middle g_stitchUsable of its bandwidth, where the radio's filters are flat,
+	and the g_stitchDcNotch bins either side of its center are left out to get rid of the DC spike. Where the trimmed
+	steps still overlap, each bin comes from whichever step it's closest to the center of. Holes left by the DC notch
+	are interpolated across; bins which no step covered (because it was skipped) are NaN. The radio gain of each step
+	is subtracted, so steps at different gains line up and the trace reads in dBFS at 0 dB gain.
+
+	Bins are on a fixed grid of the per-step bin spacing, so traces from successive sweeps line up. If the trace
+	doesn't fit in a sample buffer, it's reduced to fit by keeping the peak of each group of adjacent bins.
+ */
+class SpectrumStitcher
+{
+public:
+	SpectrumStitcher();
+
+	RxBlock* Process(RxBlock* in);
+	RxBlock* Flush();
+
+protected:
+	void AddSegment(RxBlock* in);
+	RxBlock* MakeOutput();
+	void Reset();
+
+	/**
+		@brief Spectrum of one scan step
+	 */
+	class Segment
+	{
+	public:
+		///@brief Actual center frequency of each channel, in Hz
+		std::vector<double> m_centerFrequency;
+
+		///@brief Actual gain of each channel, in dB
+		std::vector<double> m_gain;
+
+		///@brief dBFS of each bin of each channel, planar
+		std::vector<float> m_bins;
+	};
+
+	///@brief Segments of the sweep in progress. Only the first m_segmentCount are valid; the rest are kept for reuse.
+	std::vector<Segment> m_segments;
+
+	///@brief Number of valid segments
+	size_t m_segmentCount;
+
+	///@brief Scan step of the last segment added
+	size_t m_lastStep;
+
+	///@brief Number of bins in each segment
+	size_t m_fftSize;
+
+	///@brief Sample rate of the IQ the segments came from
+	int64_t m_rate;
+
+	///@brief Channel information of the first segment, for the output header
+	std::vector<RxBlockChannel> m_channelInfo;
+
+	///@brief Index of the first IQ sample of the sweep
+	uint64_t m_firstSample;
+
+	///@brief Device time of the first IQ sample of the sweep
+	uhd::time_spec_t m_startTime;
+
+	///@brief True if m_startTime is valid
+	bool m_timeValid;
+
+	///@brief True if any step of the sweep overflowed
+	bool m_overflow;
+
+	///@brief Sequence number of the last segment, given to the output
+	uint64_t m_sequence;
+
+	///@brief Full resolution trace of one channel, kept to avoid reallocating it every sweep
+	std::vector<float> m_trace;
+
+	///@brief Distance of each bin of m_trace from the center of the step it came from, in bins
+	std::vector<size_t> m_distance;
+};
+
+extern std::atomic<bool> g_stitchEnabled;
+extern std::atomic<double> g_stitchUsable;
+extern std::atomic<size_t> g_stitchDcNotch;
+
+#endif
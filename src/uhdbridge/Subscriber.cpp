@@ -0,0 +1,636 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of Subscriber and SubscriberList
+ */
+
+#include "uhdbridge.h"
+#include "Subscriber.h"
+#include "RxBlockPool.h"
+#include "WaveformHeader.h"
+#include "BridgeStats.h"
+#include "CpuPlacement.h"
+#include <string.h>
+
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#else
+#include <netdb.h>
+#endif
+
+using namespace std;
+
+SubscriberList g_subscribers;
+
+//How long the reaper gives the kernel to hand back buffers still in flight before resetting the connection
+static const chrono::milliseconds g_reapTimeout(1000);
+
+static bool SendBlock(DataPlaneSender& sender, RxBlock& block, bool contiguous);
+static string GetPeerAddress(ZSOCKET sock);
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+Subscriber::Subscriber(ZSOCKET sock, size_t id, size_t depth, BlockRing::DropPolicy policy)
+	: m_socket(sock)
+	, m_sender(m_socket, g_zeroCopy)
+	, m_id(id)
+	, m_address(GetPeerAddress(sock))
+	, m_ring(depth)
+	, m_policy(policy)
+	, m_stop(false)
+	, m_alive(true)
+	, m_sent(0)
+	, m_dropped(0)
+{
+	if(!m_socket.DisableNagle())
+		LogWarning("Failed to disable Nagle on socket, performance may be poor\n");
+
+	m_thread = thread(&Subscriber::SendThread, this);
+}
+
+Subscriber::~Subscriber()
+{
+	Stop();
+	Join();
+
+	//Throw away anything we never got around to sending
+	RxBlock* leftover;
+	while( (leftover = m_ring.TryPop()) != nullptr)
+		g_blockPool.Release(leftover);
+}
+
+/**
+	@brief Tells the send thread to shut down, kicking it out of any send() it's blocked in
+ */
+void Subscriber::Stop()
+{
+	m_stop = true;
+#ifdef _WIN32
+	shutdown(m_socket, SD_BOTH);
+#else
+	shutdown(m_socket, SHUT_RDWR);
+#endif
+}
+
+/**
+	@brief Waits for the send thread to finish. Call Stop() first, unless the client has already gone away.
+ */
+void Subscriber::Join()
+{
+	if(m_thread.joinable())
+		m_thread.join();
+}
+
+/**
+	@brief Releases any blocks the kernel has finished sending since the send thread stopped. Never waits.
+
+	Only call after Join().
+
+	@return True if the kernel still has some
+ */
+bool Subscriber::Drain()
+{
+	m_sender.ReapCompletions(false);
+	return m_sender.GetPendingCount() != 0;
+}
+
+/**
+	@brief Resets the connection so the kernel lets go of any blocks it still has, and releases them
+
+	Only call after Join().
+ */
+void Subscriber::Abort()
+{
+	m_sender.Abort();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Publishing
+
+/**
+	@brief Queues a block for this subscriber, applying the drop policy if its ring is full
+
+	Takes a reference of its own to the block; the caller keeps theirs.
+ */
+void Subscriber::Publish(RxBlock* block)
+{
+	if(!m_alive || m_stop)
+		return;
+
+	block->AddRef();
+	if(m_ring.TryPush(block))
+		return;
+
+	switch(m_policy.load())
+	{
+		case BlockRing::DROP_NEWEST:
+			g_blockPool.Release(block);
+			CountDrop();
+			LogDebug("subscriber %zu fell behind, dropped newest waveform\n", m_id);
+			break;
+
+		case BlockRing::DROP_OLDEST:
+			do
+			{
+				RxBlock* old = m_ring.TryPop();
+				if(old)
+				{
+					g_blockPool.Release(old);
+					CountDrop();
+					LogDebug("subscriber %zu fell behind, dropped oldest waveform\n", m_id);
+				}
+			} while(!m_ring.TryPush(block));
+			break;
+
+		//Holds up the data plane thread, and with it every other subscriber
+		case BlockRing::DROP_BLOCK:
+		default:
+			while(!m_ring.TryPush(block))
+			{
+				if(!m_alive || m_stop || g_waveformThreadQuit)
+				{
+					g_blockPool.Release(block);
+					break;
+				}
+				this_thread::sleep_for(chrono::microseconds(100));
+			}
+			break;
+	}
+}
+
+///@brief Records a waveform thrown away because this subscriber fell behind
+void Subscriber::CountDrop()
+{
+	m_dropped ++;
+	g_droppedWaveforms ++;
+	g_stats.m_droppedWaveforms ++;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Sending
+
+/**
+	@brief Send thread for one subscriber
+
+	Runs until the subscriber is stopped or the client goes away.
+ */
+void Subscriber::SendThread()
+{
+#ifdef __linux__
+	pthread_setname_np(pthread_self(), "SendThread");
+#endif
+
+	LogVerbose("Subscriber %zu (%s) connected to data plane socket\n", m_id, m_address.c_str());
+
+	bool havePrevious = false;
+	uint64_t lastIndex = 0;
+	while(!m_stop)
+	{
+		g_threadPlacement.Refresh(THREAD_SEND);
+		RxBlock* block = m_ring.TryPop();
+		if(!block)
+		{
+			this_thread::sleep_for(chrono::microseconds(100));
+			continue;
+		}
+
+		//Contiguous only if we didn't miss anything the data plane thread published in between
+		bool contiguous = havePrevious && block->m_contiguous && (block->m_publishIndex == lastIndex + 1);
+		havePrevious = true;
+		lastIndex = block->m_publishIndex;
+
+		bool ok = SendBlock(m_sender, *block, contiguous);
+		m_sender.Retire(block);
+		if(!ok)
+			break;
+		m_sent ++;
+	}
+
+	m_alive = false;
+	LogDebug("Subscriber %zu disconnected from data plane socket\n", m_id);
+}
+
+///@brief Appends raw bytes to a header buffer
+static void AppendBytes(vector<uint8_t>& buf, const void* data, size_t len)
+{
+	const uint8_t* p = static_cast<const uint8_t*>(data);
+	buf.insert(buf.end(), p, p + len);
+}
+
+/**
+	@brief Sends a single block to the client, using whichever protocol version the client asked for
+
+	The header and all sample buffers go out in a single gathered send. The caller is responsible for retiring the
+	block afterwards.
+
+	@param sender		Sender for the subscriber's socket
+	@param block		The block to send
+	@param contiguous	True if the block immediately follows the previous one sent
+
+	@return False if the socket was closed
+ */
+static bool SendBlock(DataPlaneSender& sender, RxBlock& block, bool contiguous)
+{
+	auto start = chrono::steady_clock::now();
+
+	uint64_t len = block.m_length;
+	size_t nchans = block.m_channels.size();
+	uint64_t channelLength = len * GetBytesPerSample(block.m_format);
+	float scale = GetFormatScale(block.m_format);
+
+	//Build the whole header first, since appending to it may move it
+	auto& hdr = sender.GetHeaderBuffer();
+	if(g_dataPlaneVersion == 0)
+	{
+		//Legacy clients only know about one channel, so send each channel as a separate waveform:
+		//the waveform size, the sample rate, then (for integer formats) the scale factor to convert back to the same
+		//units as fc32, then the sample data
+		uint64_t rate = block.m_rate;
+		size_t legacyLength = 2*sizeof(uint64_t);
+		if(block.m_format != FORMAT_FC32)
+			legacyLength += sizeof(float);
+
+		for(size_t c=0; c<nchans; c++)
+		{
+			AppendBytes(hdr, &len, sizeof(len));
+			AppendBytes(hdr, &rate, sizeof(rate));
+			if(block.m_format != FORMAT_FC32)
+				AppendBytes(hdr, &scale, sizeof(scale));
+		}
+
+		for(size_t c=0; c<nchans; c++)
+		{
+			sender.Append(&hdr[c*legacyLength], legacyLength);
+			sender.Append(block.GetSample(c, 0), channelLength);
+		}
+	}
+
+	else
+	{
+		WaveformHeader header;
+		memset(&header, 0, sizeof(header));
+		header.magic = WAVEFORM_MAGIC;
+		header.version = 1;
+		header.headerLength = sizeof(WaveformHeader);
+		header.channelHeaderLength = sizeof(WaveformChannelHeader);
+		header.numChannels = nchans;
+		if(contiguous)
+			header.flags |= WAVEFORM_FLAG_CONTIGUOUS;
+		if(block.m_overflow)
+			header.flags |= WAVEFORM_FLAG_OVERFLOW;
+		if(block.m_timeValid)
+			header.flags |= WAVEFORM_FLAG_TIME_VALID;
+		if(block.m_length < block.m_requested)
+			header.flags |= WAVEFORM_FLAG_TRUNCATED;
+		if(block.m_interleaved)
+			header.flags |= WAVEFORM_FLAG_INTERLEAVED;
+		if(block.m_triggered)
+			header.flags |= WAVEFORM_FLAG_TRIGGERED;
+		header.payloadType = block.m_payloadType;
+		header.sampleFormat = block.m_format;
+		header.scale = scale;
+		header.payloadLength = channelLength * nchans;
+		header.sequence = block.m_sequence;
+		header.numSamples = len;
+		header.sampleRate = block.m_rate;
+		header.firstSample = block.m_firstSample;
+		header.timeSeconds = block.m_startTime.get_full_secs();
+		header.timeFracSeconds = block.m_startTime.get_frac_secs();
+		header.triggerOffset = block.m_triggerOffset;
+		AppendBytes(hdr, &header, sizeof(header));
+
+		for(auto& info : block.m_channels)
+		{
+			WaveformChannelHeader chan;
+			memset(&chan, 0, sizeof(chan));
+			chan.channel = info.m_index;
+			chan.centerFrequency = info.m_centerFrequency;
+			chan.gain = info.m_gain;
+			chan.bandwidth = info.m_bandwidth;
+			AppendBytes(hdr, &chan, sizeof(chan));
+		}
+
+		sender.Append(&hdr[0], hdr.size());
+		if(block.m_interleaved)
+			sender.Append(block.GetData(), channelLength * nchans);
+		else
+		{
+			for(size_t c=0; c<nchans; c++)
+				sender.Append(block.GetSample(c, 0), channelLength);
+		}
+	}
+
+	if(!sender.Send())
+		return false;
+
+	double dt = chrono::duration_cast<chrono::duration<double>>(chrono::steady_clock::now() - start).count();
+	size_t bytes = sender.GetLastByteCount();
+	g_stats.m_sendTime.Record(dt);
+	g_stats.m_bytesSent += bytes;
+	g_stats.m_waveformsSent ++;
+	LogDebug("sent %zu samples x %zu channels: %.2f MB in %.2f ms (%.1f MB/s, %zu syscalls), "
+		"%zu buffer allocations so far\n",
+		block.m_length,
+		nchans,
+		bytes * 1e-6,
+		dt * 1e3,
+		(dt > 0) ? (bytes * 1e-6 / dt) : 0,
+		sender.GetLastSyscallCount(),
+		(size_t)g_blockPool.GetAllocationCount());
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Status
+
+/**
+	@brief Returns a one-line summary for SUBS?: ID, address, drop policy, queued waveforms, waveforms sent and dropped
+ */
+string Subscriber::GetSummary()
+{
+	char tmp[128];
+	snprintf(tmp, sizeof(tmp), "%zu,%s,%s,%zu,%llu,%llu",
+		m_id,
+		m_address.c_str(),
+		GetDropPolicyName(m_policy),
+		m_ring.GetSize(),
+		(unsigned long long)m_sent,
+		(unsigned long long)m_dropped);
+	return tmp;
+}
+
+/**
+	@brief Returns the address of the other end of a socket, for display
+ */
+static string GetPeerAddress(ZSOCKET sock)
+{
+	sockaddr_storage addr;
+	socklen_t addrlen = sizeof(addr);
+	if(getpeername(sock, reinterpret_cast<sockaddr*>(&addr), &addrlen) != 0)
+		return "unknown";
+
+	char host[NI_MAXHOST];
+	char port[NI_MAXSERV];
+	if(getnameinfo(reinterpret_cast<sockaddr*>(&addr), addrlen, host, sizeof(host), port, sizeof(port),
+		NI_NUMERICHOST | NI_NUMERICSERV) != 0)
+	{
+		return "unknown";
+	}
+
+	if(strchr(host, ':'))
+		return string("[") + host + "]:" + port;
+	return string(host) + ":" + port;
+}
+
+/**
+	@brief Returns the SCPI name of a drop policy
+ */
+const char* GetDropPolicyName(BlockRing::DropPolicy policy)
+{
+	switch(policy)
+	{
+		case BlockRing::DROP_OLDEST:
+			return "OLDEST";
+
+		case BlockRing::DROP_NEWEST:
+			return "NEWEST";
+
+		case BlockRing::DROP_BLOCK:
+		default:
+			return "BLOCK";
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// SubscriberList
+
+SubscriberList::SubscriberList()
+	: m_nextID(1)
+	, m_quit(false)
+{
+}
+
+/**
+	@brief Stops the reaper thread. Subscribers it hasn't got to yet are cleaned up by their destructors.
+ */
+SubscriberList::~SubscriberList()
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_deadReady.notify_all();
+	if(m_reaperThread.joinable())
+		m_reaperThread.join();
+}
+
+/**
+	@brief Adds a newly connected client, with the current default ring depth and drop policy
+ */
+void SubscriberList::Add(ZSOCKET sock)
+{
+	lock_guard<mutex> lock(m_mutex);
+	m_subscribers.push_back(make_shared<Subscriber>(sock, m_nextID ++, g_ringDepth.load(), g_dropPolicy.load()));
+	if(!m_reaperThread.joinable())
+		m_reaperThread = thread(&SubscriberList::ReaperThread, this);
+}
+
+/**
+	@brief Queues a block for every subscriber, and forgets any which have disconnected
+
+	The caller keeps its reference to the block.
+ */
+void SubscriberList::Publish(RxBlock* block)
+{
+	//Copy the list so clients can connect while a DROP_BLOCK subscriber is holding us up
+	vector< shared_ptr<Subscriber> > subscribers;
+	{
+		lock_guard<mutex> lock(m_mutex);
+		subscribers = m_subscribers;
+	}
+
+	bool dead = false;
+	for(auto& s : subscribers)
+	{
+		s->Publish(block);
+		if(!s->IsAlive())
+			dead = true;
+	}
+
+	if(dead)
+	{
+		lock_guard<mutex> lock(m_mutex);
+		RemoveDead();
+	}
+}
+
+/**
+	@brief Returns the number of connected subscribers, forgetting any which have disconnected
+ */
+size_t SubscriberList::GetCount()
+{
+	lock_guard<mutex> lock(m_mutex);
+	RemoveDead();
+	return m_subscribers.size();
+}
+
+/**
+	@brief Hands any subscribers which have disconnected to the reaper thread. Must be called with m_mutex held.
+ */
+void SubscriberList::RemoveDead()
+{
+	bool found = false;
+	for(size_t i=0; i<m_subscribers.size(); )
+	{
+		if(m_subscribers[i]->IsAlive())
+			i++;
+		else
+		{
+			m_dead.push_back(m_subscribers[i]);
+			m_subscribers.erase(m_subscribers.begin() + i);
+			found = true;
+		}
+	}
+	if(found)
+		m_deadReady.notify_one();
+}
+
+/**
+	@brief Cleans up after subscribers which have gone away
+ */
+void SubscriberList::ReaperThread()
+{
+#ifdef __linux__
+	pthread_setname_np(pthread_self(), "SubReaper");
+#endif
+
+	unique_lock<mutex> lock(m_mutex);
+	while(true)
+	{
+		while(!m_quit && m_dead.empty())
+			m_deadReady.wait(lock);
+		if(m_quit)
+			break;
+
+		vector< shared_ptr<Subscriber> > dead;
+		dead.swap(m_dead);
+		lock.unlock();
+		Reap(dead);
+		dead.clear();
+		lock.lock();
+	}
+}
+
+/**
+	@brief Waits for the send threads of some dead subscribers to finish, then gets their buffers back from the kernel
+
+	The kernel normally hands back zero-copy buffers soon after the connection goes away, but if a client just stopped
+	reading, the data can sit in the socket buffer until the connection times out. Those connections are reset once
+	g_reapTimeout is up, so the buffers aren't stuck (or leaked) for good.
+ */
+void SubscriberList::Reap(vector< shared_ptr<Subscriber> >& dead)
+{
+	for(auto& s : dead)
+	{
+		s->Stop();
+		s->Join();
+	}
+
+	auto deadline = chrono::steady_clock::now() + g_reapTimeout;
+	while(!m_quit && (chrono::steady_clock::now() < deadline) )
+	{
+		bool pending = false;
+		for(auto& s : dead)
+		{
+			if(s->Drain())
+				pending = true;
+		}
+		if(!pending)
+			return;
+		this_thread::sleep_for(chrono::milliseconds(10));
+	}
+
+	for(auto& s : dead)
+	{
+		if(s->Drain())
+			s->Abort();
+	}
+}
+
+/**
+	@brief Returns the summaries of all connected subscribers, separated by semicolons
+ */
+string SubscriberList::GetSummary()
+{
+	lock_guard<mutex> lock(m_mutex);
+	string ret;
+	for(auto& s : m_subscribers)
+	{
+		if(!ret.empty())
+			ret += ";";
+		ret += s->GetSummary();
+	}
+	return ret;
+}
+
+/**
+	@brief Changes the drop policy of one subscriber
+
+	@return False if there's no subscriber with that ID
+ */
+bool SubscriberList::SetDropPolicy(size_t id, BlockRing::DropPolicy policy)
+{
+	lock_guard<mutex> lock(m_mutex);
+	for(auto& s : m_subscribers)
+	{
+		if(s->GetID() == id)
+		{
+			s->SetDropPolicy(policy);
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+	@brief Disconnects every subscriber
+ */
+void SubscriberList::DisconnectAll()
+{
+	lock_guard<mutex> lock(m_mutex);
+	for(auto& s : m_subscribers)
+		s->Stop();
+	m_dead.insert(m_dead.end(), m_subscribers.begin(), m_subscribers.end());
+	m_subscribers.clear();
+	m_deadReady.notify_one();
+}
@@ -0,0 +1,175 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of Subscriber and SubscriberList
+ */
+
+#ifndef Subscriber_h
+#define Subscriber_h
+
+#include "../../lib/xptools/Socket.h"
+#include "BlockRing.h"
+#include "DataPlaneSender.h"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+	@brief One client connected to the data plane socket
+
+	Each subscriber has its own ring of blocks waiting to be sent and its own send thread, so a slow client only fills
+	its own ring. What happens then is up to its drop policy: DROP_OLDEST and DROP_NEWEST throw away its waveforms
+	without affecting anyone else, while DROP_BLOCK makes Publish() wait, which holds up every other subscriber and
+	eventually the radio too. That's only sensible for a client (such as a recorder) which must not lose data.
+
+	Blocks are shared between subscribers by reference, never copied.
+ */
+class Subscriber
+{
+public:
+	Subscriber(ZSOCKET sock, size_t id, size_t depth, BlockRing::DropPolicy policy);
+	~Subscriber();
+
+	void Publish(RxBlock* block);
+	void Stop();
+	void Join();
+	bool Drain();
+	void Abort();
+	std::string GetSummary();
+
+	///@brief Returns the ID used to refer to this subscriber over SCPI
+	size_t GetID() const
+	{ return m_id; }
+
+	///@brief Returns false once the client has disconnected
+	bool IsAlive() const
+	{ return m_alive; }
+
+	///@brief Changes what happens when this subscriber's ring is full
+	void SetDropPolicy(BlockRing::DropPolicy policy)
+	{ m_policy = policy; }
+
+protected:
+	void SendThread();
+	void CountDrop();
+
+	///@brief The client's socket
+	Socket m_socket;
+
+	///@brief Sends to m_socket. Only used by the send thread, and once it's finished, whoever called Join().
+	DataPlaneSender m_sender;
+
+	///@brief ID used to refer to this subscriber over SCPI
+	size_t m_id;
+
+	///@brief Address of the client, for display
+	std::string m_address;
+
+	///@brief Blocks waiting to be sent
+	BlockRing m_ring;
+
+	///@brief What to do when m_ring is full
+	std::atomic<BlockRing::DropPolicy> m_policy;
+
+	///@brief Set to shut down the send thread
+	std::atomic<bool> m_stop;
+
+	///@brief Cleared by the send thread when the client goes away
+	std::atomic<bool> m_alive;
+
+	///@brief Waveforms sent to this client
+	std::atomic<uint64_t> m_sent;
+
+	///@brief Waveforms dropped because this client fell behind
+	std::atomic<uint64_t> m_dropped;
+
+	///@brief The send thread
+	std::thread m_thread;
+};
+
+/**
+	@brief Everyone connected to the data plane socket
+
+	Publish() is called from the data plane thread; everything else may be called from any thread.
+
+	Subscribers which have disconnected are handed to a reaper thread, which waits for their send threads to finish and
+	gets their buffers back from the kernel, so none of that ever holds up the data plane thread.
+ */
+class SubscriberList
+{
+public:
+	SubscriberList();
+	~SubscriberList();
+
+	void Add(ZSOCKET sock);
+	void Publish(RxBlock* block);
+	void DisconnectAll();
+	size_t GetCount();
+	std::string GetSummary();
+	bool SetDropPolicy(size_t id, BlockRing::DropPolicy policy);
+
+protected:
+	void RemoveDead();
+	void ReaperThread();
+	void Reap(std::vector< std::shared_ptr<Subscriber> >& dead);
+
+	///@brief Protects m_subscribers and m_dead (but isn't held while publishing, since that can block)
+	std::mutex m_mutex;
+
+	///@brief Everyone currently connected
+	std::vector< std::shared_ptr<Subscriber> > m_subscribers;
+
+	///@brief ID of the next subscriber to connect
+	size_t m_nextID;
+
+	///@brief Subscribers which have gone away, waiting for the reaper thread
+	std::vector< std::shared_ptr<Subscriber> > m_dead;
+
+	///@brief Signalled when subscribers are added to m_dead, or the reaper thread should stop
+	std::condition_variable m_deadReady;
+
+	///@brief The reaper thread, started when the first client connects
+	std::thread m_reaperThread;
+
+	///@brief Set to stop the reaper thread
+	std::atomic<bool> m_quit;
+};
+
+extern SubscriberList g_subscribers;
+
+const char* GetDropPolicyName(BlockRing::DropPolicy policy);
+
+#endif
@@ -0,0 +1,260 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of EdgeTrigger
+ */
+
+#include "uhdbridge.h"
+#include "TriggerEngine.h"
+#include <math.h>
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Scan primitives
+
+/**
+	@brief Returns the value of a sample for the given trigger mode (squared magnitude for magnitude triggers)
+ */
+template<class T>
+static inline float GetTriggerValue(const T* iq, size_t i, TriggerMode mode)
+{
+	float re = iq[i*2];
+	float im = iq[i*2 + 1];
+	switch(mode)
+	{
+		case TRIGGER_I:
+			return re;
+
+		case TRIGGER_Q:
+			return im;
+
+		case TRIGGER_MAGNITUDE:
+		default:
+			return re*re + im*im;
+	}
+}
+
+///@brief Returns the index of the first sample at or above the threshold, or NO_TRIGGER
+template<class T>
+size_t EdgeTrigger::FindFirstAbove(const T* iq, size_t count, float threshold)
+{
+	for(size_t i=0; i<count; i++)
+	{
+		if(GetTriggerValue(iq, i, m_mode) >= threshold)
+			return i;
+	}
+	return NO_TRIGGER;
+}
+
+///@brief Returns the index of the first sample at or below the threshold, or NO_TRIGGER
+template<class T>
+size_t EdgeTrigger::FindFirstBelow(const T* iq, size_t count, float threshold)
+{
+	for(size_t i=0; i<count; i++)
+	{
+		if(GetTriggerValue(iq, i, m_mode) <= threshold)
+			return i;
+	}
+	return NO_TRIGGER;
+}
+
+///@brief fc32 magnitude triggers are the common case at high sample rates, so they get the SIMD kernels
+size_t EdgeTrigger::FindFirstAbove(const float* iq, size_t count, float threshold)
+{
+	if(m_mode == TRIGGER_MAGNITUDE)
+		return m_kernels.m_findAbove(iq, count, threshold);
+	return FindFirstAbove<float>(iq, count, threshold);
+}
+
+size_t EdgeTrigger::FindFirstBelow(const float* iq, size_t count, float threshold)
+{
+	if(m_mode == TRIGGER_MAGNITUDE)
+		return m_kernels.m_findBelow(iq, count, threshold);
+	return FindFirstBelow<float>(iq, count, threshold);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+EdgeTrigger::EdgeTrigger()
+	: m_mode(TRIGGER_MAGNITUDE)
+	, m_edge(EDGE_RISING)
+	, m_format(FORMAT_FC32)
+	, m_level(0)
+	, m_risingArmLevel(0)
+	, m_fallingArmLevel(0)
+	, m_risingArmed(false)
+	, m_fallingArmed(false)
+	, m_kernels(GetMagnitudeKernels())
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Configuration
+
+/**
+	@brief Sets up the trigger and resets its state
+
+	@param mode			Quantity to trigger on
+	@param edge			Edge(s) to trigger on
+	@param level		Trigger level, in fc32 units
+	@param hysteresis	Distance the signal must move away from the level before the trigger re-arms, in fc32 units
+	@param format		Format of the samples which will be passed to Search()
+ */
+void EdgeTrigger::Configure(TriggerMode mode, TriggerEdge edge, double level, double hysteresis, SampleFormat format)
+{
+	m_mode = mode;
+	m_edge = edge;
+	m_format = format;
+
+	//Convert thresholds to raw sample units so we don't have to scale every sample
+	double scale = GetFormatScale(format);
+	double hi = (level + fabs(hysteresis)) / scale;
+	double lo = (level - fabs(hysteresis)) / scale;
+	double mid = level / scale;
+
+	//Magnitude triggers compare against |IQ|^2 to avoid a square root per sample
+	if(mode == TRIGGER_MAGNITUDE)
+	{
+		lo = max(lo, 0.0);
+		mid = max(mid, 0.0);
+		lo *= lo;
+		mid *= mid;
+		hi *= hi;
+	}
+
+	m_level = mid;
+	m_risingArmLevel = lo;
+	m_fallingArmLevel = hi;
+
+	Reset();
+}
+
+/**
+	@brief Forgets any history, so the signal has to cross the hysteresis band again before the next trigger
+ */
+void EdgeTrigger::Reset()
+{
+	m_risingArmed = false;
+	m_fallingArmed = false;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Searching
+
+/**
+	@brief Looks for a trigger in a chunk of samples
+
+	@param samples	Interleaved IQ samples in the format given to Configure()
+	@param count	Number of complex samples
+
+	@return Index of the first sample at or past the trigger level, or NO_TRIGGER
+ */
+size_t EdgeTrigger::Search(const void* samples, size_t count)
+{
+	switch(m_format)
+	{
+		case FORMAT_SC16:
+			return SearchSamples(static_cast<const int16_t*>(samples), count);
+
+		case FORMAT_SC8:
+			return SearchSamples(static_cast<const int8_t*>(samples), count);
+
+		case FORMAT_FC32:
+		default:
+			return SearchSamples(static_cast<const float*>(samples), count);
+	}
+}
+
+template<class T>
+size_t EdgeTrigger::SearchSamples(const T* iq, size_t count)
+{
+	switch(m_edge)
+	{
+		case EDGE_RISING:
+			return SearchRising(iq, count);
+
+		case EDGE_FALLING:
+			return SearchFalling(iq, count);
+
+		case EDGE_ANY:
+		default:
+			{
+				//Run both searches over the whole chunk. If either fires we reset afterwards anyway, so it doesn't
+				//matter that the other one's state has been advanced past the trigger point.
+				size_t rising = SearchRising(iq, count);
+				size_t falling = SearchFalling(iq, count);
+				return min(rising, falling);
+			}
+	}
+}
+
+template<class T>
+size_t EdgeTrigger::SearchRising(const T* iq, size_t count)
+{
+	size_t i = 0;
+	if(!m_risingArmed)
+	{
+		size_t k = FindFirstBelow(iq, count, m_risingArmLevel);
+		if(k == NO_TRIGGER)
+			return NO_TRIGGER;
+		m_risingArmed = true;
+		i = k;
+	}
+
+	size_t k = FindFirstAbove(iq + i*2, count - i, m_level);
+	if(k == NO_TRIGGER)
+		return NO_TRIGGER;
+	m_risingArmed = false;
+	return i + k;
+}
+
+template<class T>
+size_t EdgeTrigger::SearchFalling(const T* iq, size_t count)
+{
+	size_t i = 0;
+	if(!m_fallingArmed)
+	{
+		size_t k = FindFirstAbove(iq, count, m_fallingArmLevel);
+		if(k == NO_TRIGGER)
+			return NO_TRIGGER;
+		m_fallingArmed = true;
+		i = k;
+	}
+
+	size_t k = FindFirstBelow(iq + i*2, count - i, m_level);
+	if(k == NO_TRIGGER)
+		return NO_TRIGGER;
+	m_fallingArmed = false;
+	return i + k;
+}
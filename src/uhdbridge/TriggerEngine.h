@@ -0,0 +1,137 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of EdgeTrigger
+ */
+
+#ifndef TriggerEngine_h
+#define TriggerEngine_h
+
+#include "SampleFormat.h"
+#include "MagnitudeKernels.h"
+#include <atomic>
+#include <cstdint>
+
+///@brief Which quantity the software trigger looks at
+enum TriggerMode
+{
+	///@brief No trigger, every block is sent
+	TRIGGER_FREERUN,
+
+	///@brief Magnitude of the complex sample
+	TRIGGER_MAGNITUDE,
+
+	///@brief In-phase component
+	TRIGGER_I,
+
+	///@brief Quadrature component
+	TRIGGER_Q
+};
+
+///@brief Which edge(s) the software trigger fires on
+enum TriggerEdge
+{
+	EDGE_RISING,
+	EDGE_FALLING,
+	EDGE_ANY
+};
+
+/**
+	@brief Software edge trigger operating on a stream of IQ samples
+
+	To fire on a rising edge the signal must first drop below (level - hysteresis), then rise to at least level;
+	falling edges are the mirror image. The armed/disarmed state carries over between calls to Search() so the stream
+	can be fed in arbitrary chunks.
+
+	Levels are in the same units as fc32 samples (full scale 1.0) regardless of the sample format being searched.
+ */
+class EdgeTrigger
+{
+public:
+	EdgeTrigger();
+
+	void Configure(TriggerMode mode, TriggerEdge edge, double level, double hysteresis, SampleFormat format);
+	void Reset();
+
+	size_t Search(const void* samples, size_t count);
+
+	///@brief Returned by Search() if there was no trigger
+	static const size_t NO_TRIGGER = SIZE_MAX;
+
+protected:
+	template<class T> size_t SearchSamples(const T* iq, size_t count);
+	template<class T> size_t SearchRising(const T* iq, size_t count);
+	template<class T> size_t SearchFalling(const T* iq, size_t count);
+
+	template<class T> size_t FindFirstAbove(const T* iq, size_t count, float threshold);
+	template<class T> size_t FindFirstBelow(const T* iq, size_t count, float threshold);
+	size_t FindFirstAbove(const float* iq, size_t count, float threshold);
+	size_t FindFirstBelow(const float* iq, size_t count, float threshold);
+
+	///@brief Quantity we're triggering on
+	TriggerMode m_mode;
+
+	///@brief Edge(s) we're triggering on
+	TriggerEdge m_edge;
+
+	///@brief Format of the samples being searched
+	SampleFormat m_format;
+
+	///@brief Trigger level, in raw sample units (squared for magnitude triggers)
+	float m_level;
+
+	///@brief Level the signal must go below to arm a rising edge, in raw sample units (squared for magnitude)
+	float m_risingArmLevel;
+
+	///@brief Level the signal must go above to arm a falling edge, in raw sample units (squared for magnitude)
+	float m_fallingArmLevel;
+
+	///@brief True if we've seen the signal below m_risingArmLevel since the last trigger
+	bool m_risingArmed;
+
+	///@brief True if we've seen the signal above m_fallingArmLevel since the last trigger
+	bool m_fallingArmed;
+
+	///@brief Vectorized scans for magnitude triggers on fc32 samples
+	const MagnitudeKernels& m_kernels;
+};
+
+//Protected by g_mutex. The data path reads them from the RxConfig snapshot instead.
+extern TriggerMode g_triggerMode;
+extern TriggerEdge g_triggerEdge;
+extern double g_triggerLevel;
+extern double g_triggerHysteresis;
+extern size_t g_triggerChannel;
+extern uint64_t g_triggerDelay;
+extern std::atomic<bool> g_forceTrigger;
+
+#endif
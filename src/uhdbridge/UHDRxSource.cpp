@@ -0,0 +1,256 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of UHDRxSource
+ */
+
+#include "uhdbridge.h"
+#include "UHDRxSource.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// UHDRxStream
+
+UHDRxStream::UHDRxStream(uhd::rx_streamer::sptr rx)
+	: m_rx(rx)
+{
+}
+
+size_t UHDRxStream::GetMaxPacketSize()
+{
+	return m_rx->get_max_num_samps();
+}
+
+size_t UHDRxStream::Receive(vector<void*>& buffs, size_t nsamps, uhd::rx_metadata_t& meta, double timeout)
+{
+	return m_rx->recv(buffs, nsamps, meta, timeout, false);
+}
+
+void UHDRxStream::IssueStreamCommand(const uhd::stream_cmd_t& cmd)
+{
+	m_rx->issue_stream_cmd(cmd);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+UHDRxSource::UHDRxSource(const string& devpath)
+	: m_sdr(uhd::usrp::multi_usrp::make(devpath))
+{
+	//Get properties of the SDR
+	/*
+	auto props = sdr->get_tree();
+	uhd::fs_path path("/mboards/0/");
+	//auto propnames =  props->list(path);
+	LogDebug("name: %s\n", props->access<string>("/mboards/0/name").get().c_str());
+	LogDebug("fpgaver: %s\n", props->access<string>("/mboards/0/fpga_version").get().c_str());
+	*/
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Identification
+
+string UHDRxSource::GetModel()
+{
+	return m_sdr->get_usrp_rx_info(0)["mboard_name"];
+}
+
+string UHDRxSource::GetSerial()
+{
+	return m_sdr->get_usrp_rx_info(0)["mboard_serial"];
+}
+
+string UHDRxSource::GetDescription()
+{
+	return m_sdr->get_pp_string();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Channel setup
+
+void UHDRxSource::SetSubdevSpec(const string& spec)
+{
+	m_sdr->set_rx_subdev_spec(uhd::usrp::subdev_spec_t(spec));
+}
+
+string UHDRxSource::GetSubdevSpec()
+{
+	return m_sdr->get_rx_subdev_spec().to_string();
+}
+
+size_t UHDRxSource::GetChannelCount()
+{
+	return m_sdr->get_rx_num_channels();
+}
+
+void UHDRxSource::SetAntenna(const string& name, size_t chan)
+{
+	m_sdr->set_rx_antenna(name, chan);
+}
+
+vector<string> UHDRxSource::GetAntennas(size_t chan)
+{
+	return m_sdr->get_rx_antennas(chan);
+}
+
+void UHDRxSource::SetClockSource(const string& source)
+{
+	m_sdr->set_clock_source(source);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Tuning
+
+void UHDRxSource::SetGain(double gain, size_t chan)
+{
+	m_sdr->set_rx_gain(gain, chan);
+}
+
+double UHDRxSource::GetGain(size_t chan)
+{
+	return m_sdr->get_rx_gain(chan);
+}
+
+uhd::gain_range_t UHDRxSource::GetGainRange(size_t chan)
+{
+	return m_sdr->get_rx_gain_range(chan);
+}
+
+void UHDRxSource::SetBandwidth(double bandwidth, size_t chan)
+{
+	m_sdr->set_rx_bandwidth(bandwidth, chan);
+}
+
+double UHDRxSource::GetBandwidth(size_t chan)
+{
+	return m_sdr->get_rx_bandwidth(chan);
+}
+
+uhd::freq_range_t UHDRxSource::GetBandwidthRange(size_t chan)
+{
+	return m_sdr->get_rx_bandwidth_range(chan);
+}
+
+void UHDRxSource::SetFrequency(double freq, size_t chan)
+{
+	m_sdr->set_rx_freq(uhd::tune_request_t(freq), chan);
+}
+
+double UHDRxSource::GetFrequency(size_t chan)
+{
+	return m_sdr->get_rx_freq(chan);
+}
+
+uhd::freq_range_t UHDRxSource::GetFrequencyRange(size_t chan)
+{
+	return m_sdr->get_rx_freq_range(chan);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Sampling
+
+void UHDRxSource::SetSampleRate(double rate)
+{
+	m_sdr->set_rx_rate(rate);
+}
+
+double UHDRxSource::GetSampleRate()
+{
+	return m_sdr->get_rx_rate();
+}
+
+uhd::meta_range_t UHDRxSource::GetSampleRates()
+{
+	return m_sdr->get_rx_rates();
+}
+
+void UHDRxSource::SetMasterClockRate(double rate)
+{
+	m_sdr->set_master_clock_rate(rate);
+}
+
+double UHDRxSource::GetMasterClockRate()
+{
+	return m_sdr->get_master_clock_rate();
+}
+
+uhd::meta_range_t UHDRxSource::GetMasterClockRates()
+{
+	return m_sdr->get_master_clock_rate_range();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Device time
+
+void UHDRxSource::SetTimeSource(const string& source)
+{
+	m_sdr->set_time_source(source);
+}
+
+uhd::time_spec_t UHDRxSource::GetTimeNow()
+{
+	return m_sdr->get_time_now();
+}
+
+uhd::time_spec_t UHDRxSource::GetTimeLastPPS()
+{
+	return m_sdr->get_time_last_pps();
+}
+
+void UHDRxSource::SetTimeNow(const uhd::time_spec_t& time)
+{
+	m_sdr->set_time_now(time);
+}
+
+void UHDRxSource::SetTimeNextPPS(const uhd::time_spec_t& time)
+{
+	m_sdr->set_time_next_pps(time);
+}
+
+void UHDRxSource::SetCommandTime(const uhd::time_spec_t& time)
+{
+	m_sdr->set_command_time(time);
+}
+
+void UHDRxSource::ClearCommandTime()
+{
+	m_sdr->clear_command_time();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Streaming
+
+unique_ptr<RxStream> UHDRxSource::OpenStream(const uhd::stream_args_t& args)
+{
+	return unique_ptr<RxStream>(new UHDRxStream(m_sdr->get_rx_stream(args)));
+}
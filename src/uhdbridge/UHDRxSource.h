@@ -0,0 +1,108 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of UHDRxSource
+ */
+
+#ifndef UHDRxSource_h
+#define UHDRxSource_h
+
+#include "RxSource.h"
+#include <uhd/usrp/multi_usrp.hpp>
+
+/**
+	@brief Stream from a real radio, via UHD
+ */
+class UHDRxStream : public RxStream
+{
+public:
+	UHDRxStream(uhd::rx_streamer::sptr rx);
+
+	virtual size_t GetMaxPacketSize() override;
+	virtual size_t Receive(std::vector<void*>& buffs, size_t nsamps, uhd::rx_metadata_t& meta, double timeout) override;
+	virtual void IssueStreamCommand(const uhd::stream_cmd_t& cmd) override;
+
+protected:
+	uhd::rx_streamer::sptr m_rx;
+};
+
+/**
+	@brief A real radio, via UHD
+ */
+class UHDRxSource : public RxSource
+{
+public:
+	UHDRxSource(const std::string& devpath);
+
+	virtual std::string GetModel() override;
+	virtual std::string GetSerial() override;
+	virtual std::string GetDescription() override;
+
+	virtual void SetSubdevSpec(const std::string& spec) override;
+	virtual std::string GetSubdevSpec() override;
+	virtual size_t GetChannelCount() override;
+	virtual void SetAntenna(const std::string& name, size_t chan) override;
+	virtual std::vector<std::string> GetAntennas(size_t chan) override;
+	virtual void SetClockSource(const std::string& source) override;
+
+	virtual void SetGain(double gain, size_t chan) override;
+	virtual double GetGain(size_t chan) override;
+	virtual uhd::gain_range_t GetGainRange(size_t chan) override;
+	virtual void SetBandwidth(double bandwidth, size_t chan) override;
+	virtual double GetBandwidth(size_t chan) override;
+	virtual uhd::freq_range_t GetBandwidthRange(size_t chan) override;
+	virtual void SetFrequency(double freq, size_t chan) override;
+	virtual double GetFrequency(size_t chan) override;
+	virtual uhd::freq_range_t GetFrequencyRange(size_t chan) override;
+
+	virtual void SetSampleRate(double rate) override;
+	virtual double GetSampleRate() override;
+	virtual uhd::meta_range_t GetSampleRates() override;
+	virtual void SetMasterClockRate(double rate) override;
+	virtual double GetMasterClockRate() override;
+	virtual uhd::meta_range_t GetMasterClockRates() override;
+
+	virtual void SetTimeSource(const std::string& source) override;
+	virtual uhd::time_spec_t GetTimeNow() override;
+	virtual uhd::time_spec_t GetTimeLastPPS() override;
+	virtual void SetTimeNow(const uhd::time_spec_t& time) override;
+	virtual void SetTimeNextPPS(const uhd::time_spec_t& time) override;
+	virtual void SetCommandTime(const uhd::time_spec_t& time) override;
+	virtual void ClearCommandTime() override;
+
+	virtual std::unique_ptr<RxStream> OpenStream(const uhd::stream_args_t& args) override;
+
+protected:
+	uhd::usrp::multi_usrp::sptr m_sdr;
+};
+
+#endif
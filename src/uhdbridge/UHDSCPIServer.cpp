@@ -40,20 +40,352 @@
 		REFCLK [internal|external]
 			Sets the reference clock for the instrument
 
-		RXGAIN [dB]
+		TIMESRC [internal|external|gpsdo]
+			Sets where the device time and PPS come from
+
+		TIME:NOW [seconds]
+			Sets the device time right away
+
+		TIME:NOW?
+			Returns the current device time, in seconds
+
+		TIME:PPS [seconds]
+			Sets the device time at the next PPS edge. Sending the same whole number of seconds to every bridge just
+			after a PPS edge lines up the clocks of radios which share a PPS signal.
+
+		TIME:PPS?
+			Returns the device time of the last PPS edge
+
+		STARTTIME [NOW|PPS|seconds]
+			Schedules the start of the next acquisition. NOW (the default) starts streaming as soon as the trigger is
+			armed. PPS starts on the first PPS edge at least 100 ms after arming, going by the device time of the last
+			edge, so it works whatever the device time was set to. A number starts at that device time. Timed starts
+			apply to the first waveform after arming only, and revert to NOW once used; if the time has already passed
+			when the trigger is armed, the trigger is disarmed with an error. Waveform timestamps (data plane version
+			1) always give the device time of the first sample, so clients can check alignment and measure gaps
+			between waveforms exactly.
+
+		STARTTIME?
+			Returns the pending start mode: NOW, PPS, or the start time in seconds
+
+		[chan:]RXGAIN [dB][,seconds]
 			Sets receiver gain
 
-		RXBW [Hz]
+		[chan:]RXBW [Hz][,seconds]
 			Sets receiver bandwidth
 
-		RXFREQ [Hz]
+		[chan:]RXFREQ [Hz][,seconds]
 			Sets receiver center frequency
+
+			The RX commands apply to a single channel (CH1, CH2, ...) if one is given, or to all channels if not.
+			They are queued and applied by a separate thread, so they return right away and never stall streaming.
+			With a device time, the change is a timed command which takes effect on the radio at exactly that time;
+			in continuous mode the waveform in progress ends on the sample before it, and the next one starts with
+			the new settings, so no waveform mixes old and new tuning. Without a time, the change shows up in
+			waveform headers from the next waveform on. Changes to the sample rate, sample depth or enabled channels
+			restart the stream automatically.
+
+		RXSYNC
+			Waits until every queued RX change has been applied to the radio
+
+		RXCONFIG?
+			Returns the version of the settings the data path is using (incremented by every change), and the number
+			of changes still queued, separated by a comma
+
+		[chan:]GAINRANGE?
+		[chan:]BWRANGE?
+		[chan:]FREQRANGE?
+			Return the gain (dB), bandwidth (Hz) or center frequency (Hz) range of a channel, as start,stop,step.
+			Without a channel, return the range of the first one.
+
+		[chan:]ANTENNAS?
+			Returns the names of the antenna ports of a channel, separated by commas
+
+		SUBDEV?
+			Returns the subdev spec the channels were created from
+
+		RATEPLAN?
+			Returns how the current sample rate is produced, as master clock (Hz), decimation, actual sample rate (Hz),
+			and EXACT or INEXACT. Setting the sample rate picks the master clock and decimation together: an exact
+			integer decimation, from the lowest master clock that can do it if the clock is adjustable (B2xx), or the
+			current clock if it already divides down exactly. Decimation 0 means no clock could produce the rate
+			exactly and the radio got as close as it could.
+
+			Capabilities and the sample rate list (RATES?) are queried from the radio once at startup and answered
+			from a cache, so they don't cost a round trip to the radio. Sample rates are listed only if the startup
+			master clock divides down to them exactly.
+
+		CHLAYOUT [PLANAR|INTERLEAVED]
+			Selects how multi-channel waveforms are laid out on the data plane. PLANAR (the default) sends all samples
+			of each channel in turn, INTERLEAVED sends sample 0 of every channel, then sample 1, etc. Only applies to
+			data plane protocol version 1 and up; version 0 sends each channel as a separate waveform.
+
+		CHLAYOUT?
+			Returns the current channel layout
+
+		STREAMMODE [BLOCK|CONTINUOUS|SCAN]
+			Selects how waveforms are acquired. BLOCK (the default) requests a fixed number of samples per trigger, so
+			there is dead time between waveforms. CONTINUOUS keeps the stream running and slices it into back-to-back
+			waveforms. SCAN steps through the SCAN:FREQS list (see below). Takes effect the next time the trigger is
+			armed.
+
+		STREAMMODE?
+			Returns the current stream mode
+
+		SCAN:FREQS f1,f2,...
+			Sets the center frequencies a scan visits, in Hz, in order
+
+		SCAN:RANGE start,stop,step
+			Sets the scan frequencies to evenly spaced steps from start to stop inclusive, in Hz
+
+		SCAN:SETTLE [seconds]
+			Sets how long to wait after each retune before capturing (default 1 ms), to cover the LO settling
+
+		SCAN?
+			Returns the number of scan frequencies, the first and last, and the settling time
+
+			In SCAN mode every enabled channel is retuned to each frequency in turn, and one waveform of sample depth
+			samples (the dwell) is sent per frequency, with the center frequency in its header. Retunes are timed
+			commands scheduled ahead on a single continuous stream, so each step costs only the settling time plus the
+			dwell, rather than stopping the stream to retune. A freerunning trigger repeats the scan until stopped,
+			single-shot triggering does one pass. The software trigger and the IQ history don't apply. Steps whose
+			retune reaches the radio too late are skipped and counted in STATS?. Radios which can't time LO tuning
+			(B2xx) retune as soon as each command arrives, which can be during an earlier dwell, so scans there are
+			only approximate. When the scan stops, the radio is left tuned to wherever it got to.
+
+		SCAN:STITCH [0|1]
+			With 1, and spectrum mode on (FFT:SIZE), the spectra of every step of a scan are stitched into a single
+			wideband spectrum, sent once per sweep instead of one spectrum per step. Bins are spaced the same as in
+			each step's spectrum, unless the trace doesn't fit in a sample buffer (at least sample depth bins), in which
+			case groups of adjacent bins are reduced to their peak. The trace is in dBFS with each step's RX gain taken
+			off, so it reads as if at 0 dB gain; the channel headers report gain 0 and the span as bandwidth. Bins no
+			step covered, because it was skipped, are NaN. Default 0.
+
+		SCAN:USABLE [percent]
+			Sets how much of each step's bandwidth goes into the stitched spectrum, centered on the step's frequency
+			(default 80). The band edges are dropped since the radio's anti-alias filters roll off there, so the scan
+			step should be no more than this fraction of the sample rate. Where steps still overlap, each bin comes
+			from the step it's closest to the center of.
+
+		SCAN:DCNOTCH [bins]
+			Sets how many bins either side of each step's center are replaced, to get rid of the radio's DC spike
+			(default 4, which covers the main lobe of the default window). Bins from an overlapping step are used if
+			there are any, otherwise they're interpolated from their neighbors. 0 disables the notch.
+
+			The stitching settings all take effect on the next sweep, and have matching queries.
+
+		RINGDEPTH [blocks]
+			Sets the number of waveforms which may be queued between the receive and data plane threads, and for each
+			data plane subscriber. Takes effect the next time a control plane client or subscriber connects.
+
+		RINGDEPTH?
+			Returns the current ring depth
+
+		DROPPOLICY [OLDEST|NEWEST|BLOCK]
+			Selects what to do when a ring fills up. OLDEST (the default) discards the oldest queued waveform, NEWEST
+			discards the waveform just received, BLOCK waits for space. Applies to the ring between the receive and
+			data plane threads (where BLOCK stalls the receive thread, which will cause overflows on the radio), and is
+			the default for subscribers which connect afterwards.
+
+		DROPPOLICY?
+			Returns the current drop policy
+
+		SUB<n>:DROPPOLICY [OLDEST|NEWEST|BLOCK]
+			Selects what to do when subscriber n falls behind and its ring is full. OLDEST and NEWEST only affect that
+			subscriber. BLOCK stalls the data plane thread, and so every other subscriber too, until it catches up;
+			use it only for clients which must see every waveform, such as recorders.
+
+		SUBS?
+			Returns the data plane subscribers, separated by semicolons. Each is a comma separated list of ID, address,
+			drop policy, waveforms queued, waveforms sent, and waveforms dropped.
+
+		DROPS?
+			Returns the number of waveforms dropped since the control plane client connected, both between the
+			receive and data plane threads and by any subscriber
+
+		STATS?
+			Returns the data plane performance counters as comma separated KEY=value pairs: SAMPLES (received from the
+			radio, per channel), BYTES and WAVEFORMS (sent, summed over all subscribers), OVERFLOWS, TIMEOUTS and
+			ERRORS (from the radio), SHORT (block mode waveforms with fewer samples than requested), DROPS (waveforms
+			discarded because a ring was full), DWELLS and SKIPPED (scan steps sent and skipped), RING (waveforms
+			queued between the receive and data plane threads / ring depth), and RECV_P50, RECV_P99, SEND_P50 and
+			SEND_P99 (approximate median and 99th percentile time per radio recv() call and per waveform sent, in
+			microseconds). Counts are cumulative since the bridge started, unlike DROPS?. The same counters are
+			available in Prometheus format with --metrics-port.
+
+		PLACEMENT:RX [cores|ANY]
+		PLACEMENT:PROC [cores|ANY]
+		PLACEMENT:SEND [cores|ANY]
+			Pins the receive thread, the data plane (processing) thread, or the data plane send threads to a list of
+			cores, e.g. 2 or 4-5,8. ANY (the default, unless set with --rx-cpus etc.) lets them run anywhere the
+			process may. Threads pick up changes within one waveform, including while streaming.
+
+		PLACEMENT:PRIORITY [priority]
+			Runs the receive thread at this SCHED_FIFO priority (1-99), and the processing and send threads one below
+			it, so that the radio is always drained first. 0 (the default) is normal scheduling. Needs CAP_SYS_NICE or
+			a high enough RLIMIT_RTPRIO; if the bridge isn't allowed, the threads stay at normal priority with a
+			warning.
+
+		PLACEMENT:BUFNODE [node|ANY]
+			Allocates sample buffers on this NUMA node, normally the one the radio's NIC is attached to (see --nic).
+			Applies to buffers allocated afterwards, i.e. from the next change of sample depth, format or channels.
+
+			These settings all have matching queries.
+
+		PLACEMENT?
+			Returns where the threads actually ended up, as semicolon separated ROLE=cores/policy/priority entries for
+			the most recently placed thread of each role, then the buffer node, e.g.
+			RX=2/FIFO/50;PROC=3/FIFO/49;SEND=DEFAULT;BUFNODE=0. DEFAULT means no thread of that role has been placed.
+
+		REC:START path
+			Starts recording every waveform to disk in SigMF format, as path.sigmf-data and path.sigmf-meta (a path
+			already ending in either extension is fine too). Like every file name a client gives, the path is relative
+			to the directory given with --record-dir, and may not contain ".."; without --record-dir, REC:START and the
+			HIST commands which write files are refused. Only raw IQ is recorded, with the format, sample rate and
+			channel count of the first waveform; in FFT mode, that's the IQ the spectra are made from. Retuning starts
+			a new capture segment. The metadata is written when the recording stops. Waveforms are recorded even if no
+			data plane client is connected, but a recording ends when the control plane client disconnects.
+
+		REC:STOP
+			Stops recording
+
+		REC:DEPTH [blocks]
+			Sets the number of waveforms which may be queued for the recorder (default 32). If the disk can't keep up
+			and the queue fills, waveforms are dropped from the recording. Takes effect on the next REC:START.
+
+		REC:DEPTH?
+			Returns the recorder queue depth
+
+		REC:LIMIT [megabytes]
+			Sets the most sample buffer memory the recorder queue may hold on to (default 1024), whatever its depth.
+			Waveforms which would go over are dropped from the recording. Takes effect on the next REC:START.
+
+		REC:LIMIT?
+			Returns the recorder queue memory limit, in megabytes
+
+		REC:STATUS?
+			Returns IDLE, or RECORDING followed by the number of bytes written and waveforms dropped, e.g.
+			RECORDING,1048576000,0
+
+		HIST:ENABLE path,megabytes
+			Keeps the most recent samples in a memory-mapped ring file of the given size, which is created (or
+			overwritten) and allocated when the next stream starts. The path is relative to --record-dir, as for
+			REC:START. Samples are kept in CONTINUOUS mode and with a software trigger, including those which never end
+			up in a waveform, so the history can be far deeper than the trigger delay. Changing the format, rate or
+			channels starts the history over.
+
+		HIST:DISABLE
+			Stops keeping history. The file is closed when the next stream starts.
+
+		HIST:RANGE?
+			Returns the device times of the oldest and newest samples in the history, e.g.
+			1000.000000000,1060.000000000, or NONE if there's no timestamped history
+
+		HIST:SAVE path,start,end
+			Saves the history between two device times, in seconds, as a SigMF recording (like REC:START). Whatever
+			part of the range is still in the history is saved. The save runs in the background, and replaces any save
+			which is already armed or in progress.
+
+		HIST:ARM path,pre,post
+			Saves the history from pre seconds before to post seconds after the next software trigger, once the
+			post-trigger samples have arrived. Replaces any save which is already armed.
+
+		WIREFMT [FC32|SC16|SC8]
+			Selects the sample format on the data plane socket. FC32 (the default) is complex float32. SC16 and SC8 are
+			the raw integer samples from the radio, at 1/2 and 1/4 the bandwidth; each waveform then carries a float32
+			scale factor after the sample rate, which converts samples to the same units as FC32. Takes effect the next
+			time the trigger is armed.
+
+		WIREFMT?
+			Returns the current wire format
+
+		DATAHDR [version]
+			Selects the data plane protocol version (see WaveformHeader.h). Version 0 (the default) is the legacy
+			length/rate framing; version 1 adds a self-describing header with timestamps, tuning and overflow flags.
+			Requests for versions newer than the bridge supports are ignored, so clients should confirm with DATAHDR?.
+
+		DATAHDR?
+			Returns the current data plane protocol version
+
+		TRIGMODE [FREERUN|MAG|I|Q]
+			Selects what the software trigger looks at: the magnitude of each IQ sample, or its I or Q component.
+			FREERUN (the default) disables the trigger and sends every waveform. When the trigger is enabled the radio
+			streams continuously regardless of STREAMMODE, and only waveforms containing a trigger are sent. The
+			trigger level, source channel, edge and delay come from the standard trigger commands, with levels in the
+			same units as FC32 samples. Takes effect the next time the trigger is armed. Changes to the level, source
+			channel, edge, hysteresis and delay take effect right away, even while armed; changing the delay restarts
+			the stream.
+
+		TRIGMODE?
+			Returns the current trigger mode
+
+		TRIGHYST [level]
+			Sets the trigger hysteresis: the signal must move at least this far to the other side of the trigger level
+			before the trigger can fire again. Same units as the trigger level.
+
+		TRIGHYST?
+			Returns the current trigger hysteresis
+
+		DDC:FREQ [Hz]
+			Sets the frequency of the on-bridge downconverter, relative to the RX center frequency. The signal at this
+			offset is shifted to DC before filtering and decimation. Default 0.
+
+		DDC:FREQ?
+			Returns the current downconverter frequency
+
+		DDC:DECIM [factor]
+			Sets the on-bridge decimation factor. Waveforms are low-pass filtered and decimated by this factor before
+			being sent, and the waveform headers report the reduced sample rate. 1 (the default) disables decimation;
+			if the frequency is also 0 the downconverter is bypassed entirely.
+
+		DDC:DECIM?
+			Returns the current decimation factor
+
+		FFT:SIZE [points]
+			Enables spectrum mode with the given FFT size, or disables it if 0 (the default). In spectrum mode each
+			waveform is replaced by its averaged power spectrum in dBFS (PAYLOAD_SPECTRUM, see WaveformHeader.h).
+			Requires data plane protocol version 1. The FFT size must not be more than the sample depth.
+
+		FFT:WINDOW [RECT|HANN|BLACKMANHARRIS|FLATTOP]
+			Selects the window function. Default is BLACKMANHARRIS.
+
+		FFT:OVERLAP [percent]
+			Sets the overlap between consecutive FFT frames within a waveform, 0 to 95. Default 50.
+
+		FFT:AVGMODE [LINEAR|LOG|MAXHOLD]
+			Selects how FFT frames are combined: mean power (the default), mean of dB, or peak power.
+
+		FFT:AVGCOUNT [waveforms]
+			Sets the number of waveforms combined into each spectrum sent to the client. Default 1, which averages
+			only the frames within one waveform. Ignored in SCAN mode, where each step gets its own spectrum.
+
+			All of the FFT settings also have a matching query.
  */
 
 #include "uhdbridge.h"
 #include "UHDSCPIServer.h"
+#include "RxBlockPool.h"
+#include "BlockRing.h"
+#include "SampleFormat.h"
+#include "WaveformHeader.h"
+#include "TriggerEngine.h"
+#include "DigitalDownconverter.h"
+#include "SpectrumProcessor.h"
+#include "SpectrumStitcher.h"
+#include "RxSource.h"
+#include "BridgeStats.h"
+#include "Subscriber.h"
+#include "SigMFRecorder.h"
+#include "HistoryFile.h"
+#include "DeviceCaps.h"
+#include "SampleRatePlan.h"
+#include "ScanPlan.h"
+#include "CpuPlacement.h"
 #include <string.h>
 #include <math.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
 
 #define __USE_MINGW_ANSI_STDIO 1 // Required for MSYS2 mingw64 to support format "%z" ...
 
@@ -61,12 +393,45 @@ using namespace std;
 
 mutex g_mutex;
 
-bool g_triggerArmed = false;
-bool g_triggerOneShot = false;
-
-size_t g_rxBlockSize = 0;
-int64_t g_centerFrequency = 0;
-int64_t g_rxRate = 1;
+atomic<bool> g_triggerArmed(false);
+atomic<bool> g_triggerOneShot(false);
+atomic<bool> g_continuousMode(false);
+atomic<bool> g_scanMode(false);
+StartMode g_startMode = START_NOW;
+uhd::time_spec_t g_startTime;
+
+atomic<size_t> g_rxBlockSize(0);
+atomic<size_t> g_ringDepth(4);
+atomic<BlockRing::DropPolicy> g_dropPolicy(BlockRing::DROP_OLDEST);
+size_t g_recordDepth = 32;
+size_t g_recordLimit = 1024;
+string g_recordDir;
+atomic<SampleFormat> g_wireFormat(FORMAT_FC32);
+atomic<int> g_dataPlaneVersion(0);
+atomic<int64_t> g_rxRate(1);
+vector<RxChannelConfig> g_rxChannels;
+atomic<bool> g_interleaveChannels(false);
+
+TriggerMode g_triggerMode = TRIGGER_FREERUN;
+TriggerEdge g_triggerEdge = EDGE_RISING;
+double g_triggerLevel = 0;
+double g_triggerHysteresis = 0;
+size_t g_triggerChannel = 0;
+uint64_t g_triggerDelay = 0;
+atomic<bool> g_forceTrigger(false);
+
+atomic<size_t> g_ddcDecimation(1);
+atomic<double> g_ddcFrequency(0);
+
+atomic<size_t> g_fftSize(0);
+atomic<SpectrumWindow> g_fftWindow(WINDOW_BLACKMAN_HARRIS);
+atomic<double> g_fftOverlap(0.5);
+atomic<SpectrumAverage> g_fftAverage(AVERAGE_LINEAR);
+atomic<size_t> g_fftAverageCount(1);
+
+atomic<bool> g_stitchEnabled(false);
+atomic<double> g_stitchUsable(0.8);
+atomic<size_t> g_stitchDcNotch(4);
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Construction / destruction
@@ -74,11 +439,6 @@ int64_t g_rxRate = 1;
 UHDSCPIServer::UHDSCPIServer(ZSOCKET sock)
 	: BridgeSCPIServer(sock)
 {
-	//Select sub device (TODO: expose this somehow)
-	g_sdr->set_rx_subdev_spec(string("A:A"));
-
-	//Select antenna to use (TODO: expose this somehow)
-	g_sdr->set_rx_antenna("TX/RX");
 }
 
 UHDSCPIServer::~UHDSCPIServer()
@@ -86,6 +446,193 @@ UHDSCPIServer::~UHDSCPIServer()
 	LogVerbose("Client disconnected\n");
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Argument parsing helpers
+
+/**
+	@brief Parses a whole number given by a client
+
+	@return False (after logging why) if it isn't a number, or is out of range
+ */
+static bool ParseInt(const string& str, int& value)
+{
+	char* end;
+	errno = 0;
+	long n = strtol(str.c_str(), &end, 10);
+	if( (end == str.c_str()) || (*end != '\0') || (errno == ERANGE) || (n < INT_MIN) || (n > INT_MAX) )
+	{
+		LogError("Expected a whole number, got \"%s\"\n", str.c_str());
+		return false;
+	}
+
+	value = static_cast<int>(n);
+	return true;
+}
+
+/**
+	@brief Parses a number given by a client
+
+	@return False (after logging why) if it isn't a finite number
+ */
+static bool ParseDouble(const string& str, double& value)
+{
+	char* end;
+	errno = 0;
+	double d = strtod(str.c_str(), &end);
+	if( (end == str.c_str()) || (*end != '\0') || (errno == ERANGE) || !isfinite(d) )
+	{
+		LogError("Expected a number, got \"%s\"\n", str.c_str());
+		return false;
+	}
+
+	value = d;
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Data plane helpers
+
+/**
+	@brief Parses the name of a drop policy
+
+	@return False if the name isn't recognized
+ */
+static bool ParseDropPolicy(const string& str, BlockRing::DropPolicy& policy)
+{
+	if(str == "OLDEST")
+		policy = BlockRing::DROP_OLDEST;
+	else if(str == "NEWEST")
+		policy = BlockRing::DROP_NEWEST;
+	else if(str == "BLOCK")
+		policy = BlockRing::DROP_BLOCK;
+	else
+		return false;
+	return true;
+}
+
+/**
+	@brief Parses a subscriber name (SUB1, SUB2, ...) to a subscriber ID, as reported by SUBS?
+ */
+static bool GetSubscriberID(const string& subject, size_t& id)
+{
+	if( (subject.length() < 4) || (subject.compare(0, 3, "SUB") != 0) || !isdigit(subject[3]) )
+		return false;
+	id = stoul(subject.substr(3));
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Recording helpers
+
+/**
+	@brief Turns a file name from a client into a path inside g_recordDir
+
+	Clients can only write files under the recording directory, so absolute paths and ".." are refused.
+
+	@return False if the name isn't allowed, or there's no recording directory
+ */
+static bool GetRecordPath(const string& name, string& path)
+{
+	if(g_recordDir.empty())
+	{
+		LogError("Writing files is disabled, start the bridge with --record-dir to enable it\n");
+		return false;
+	}
+	if(name.empty() || (name[0] == '/') || (name[0] == '\\') || (name.find(':') != string::npos) )
+	{
+		LogError("File name %s must be relative to the recording directory\n", name.c_str());
+		return false;
+	}
+
+	for(size_t start = 0; start != string::npos; )
+	{
+		size_t end = name.find_first_of("/\\", start);
+		if(name.compare(start, (end == string::npos) ? string::npos : end - start, "..") == 0)
+		{
+			LogError("File name %s must not contain ..\n", name.c_str());
+			return false;
+		}
+		start = (end == string::npos) ? end : end + 1;
+	}
+
+	path = g_recordDir + "/" + name;
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Device time helpers
+
+/**
+	@brief Parses a non-negative time in seconds, keeping whole and fractional seconds separate so that large device
+	times (e.g. GPS time) don't lose precision
+
+	@return False (after logging why) if the time is negative or isn't a number
+ */
+static bool ParseTime(const string& str, uhd::time_spec_t& time)
+{
+	if(!str.empty() && (str[0] == '-') )
+	{
+		LogError("Time must not be negative\n");
+		return false;
+	}
+
+	//Seconds, optionally with a fraction: digits and at most one dot, and at least one digit
+	size_t dot = str.find('.');
+	if( (str.find_first_not_of("0123456789.") != string::npos) || (str.find_first_of("0123456789") == string::npos) ||
+		( (dot != string::npos) && (str.find('.', dot + 1) != string::npos) ) )
+	{
+		LogError("Expected a time in seconds, got \"%s\"\n", str.c_str());
+		return false;
+	}
+
+	errno = 0;
+	int64_t full = strtoll(str.substr(0, dot).c_str(), nullptr, 10);
+	if(errno == ERANGE)
+	{
+		LogError("Time %s is out of range\n", str.c_str());
+		return false;
+	}
+	double frac = 0;
+	if(dot != string::npos)
+		frac = strtod(("0" + str.substr(dot)).c_str(), nullptr);
+	time = uhd::time_spec_t(full, frac);
+	return true;
+}
+
+///@brief Formats a time in seconds with nanosecond resolution
+static string FormatTime(const uhd::time_spec_t& time)
+{
+	int64_t full = time.get_full_secs();
+	int64_t ns = llround(time.get_frac_secs() * 1e9);
+	if(ns >= 1000000000)
+	{
+		full ++;
+		ns -= 1000000000;
+	}
+
+	char buf[64];
+	snprintf(buf, sizeof(buf), "%lld.%09lld", (long long)full, (long long)ns);
+	return buf;
+}
+
+/**
+	@brief Parses the name of a thread role, as used in PLACEMENT commands
+
+	@return False if the name isn't recognized
+ */
+static bool ParseThreadRole(const string& str, ThreadRole& role)
+{
+	for(int i=0; i<THREAD_ROLE_COUNT; i++)
+	{
+		if(str == GetThreadRoleName(static_cast<ThreadRole>(i)))
+		{
+			role = static_cast<ThreadRole>(i);
+			return true;
+		}
+	}
+	return false;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Command parsing
 
@@ -96,6 +643,219 @@ bool UHDSCPIServer::OnQuery(
 {
 	if(BridgeSCPIServer::OnQuery(line, subject, cmd))
 		return true;
+	else if(cmd == "STREAMMODE")
+		SendReply(g_scanMode ? "SCAN" : (g_continuousMode ? "CONTINUOUS" : "BLOCK") );
+	else if(cmd == "RINGDEPTH")
+		SendReply(to_string(g_ringDepth));
+	else if(cmd == "DROPPOLICY")
+		SendReply(GetDropPolicyName(g_dropPolicy));
+	else if(cmd == "SUBS")
+		SendReply(g_subscribers.GetSummary());
+	else if(cmd == "DROPS")
+		SendReply(to_string(g_droppedWaveforms));
+	else if(cmd == "STATS")
+		SendReply(g_stats.GetSummary());
+	else if( (subject == "REC") && (cmd == "DEPTH") )
+		SendReply(to_string(g_recordDepth));
+	else if( (subject == "REC") && (cmd == "LIMIT") )
+		SendReply(to_string(g_recordLimit));
+	else if( (subject == "REC") && (cmd == "STATUS") )
+		SendReply(g_recorder.GetStatus());
+	else if( (subject == "HIST") && (cmd == "RANGE") )
+	{
+		uhd::time_spec_t start;
+		uhd::time_spec_t end;
+		if(g_history.GetRange(start, end))
+			SendReply(FormatTime(start) + "," + FormatTime(end));
+		else
+			SendReply("NONE");
+	}
+	else if( (subject == "SCAN") && (cmd == "STITCH") )
+		SendReply(g_stitchEnabled ? "1" : "0");
+	else if( (subject == "SCAN") && (cmd == "USABLE") )
+		SendReply(to_string(g_stitchUsable * 100));
+	else if( (subject == "SCAN") && (cmd == "DCNOTCH") )
+		SendReply(to_string(g_stitchDcNotch));
+	else if(cmd == "SCAN")
+	{
+		lock_guard<mutex> lock(g_mutex);
+		SendReply(g_scanPlan.GetSummary());
+	}
+	else if( (subject == "PLACEMENT") && (cmd == "PRIORITY") )
+		SendReply(to_string(g_threadPlacement.GetPriority()));
+	else if( (subject == "PLACEMENT") && (cmd == "BUFNODE") )
+	{
+		int node = g_blockPool.GetNumaNode();
+		SendReply( (node >= 0) ? to_string(node) : "ANY");
+	}
+	else if(subject == "PLACEMENT")
+	{
+		ThreadRole role;
+		if(!ParseThreadRole(cmd, role))
+			return false;
+		auto cpus = g_threadPlacement.GetCpus(role);
+		SendReply(cpus.empty() ? "ANY" : cpus.ToString());
+	}
+	else if(cmd == "PLACEMENT")
+	{
+		int node = g_blockPool.GetNumaNode();
+		SendReply(g_threadPlacement.GetSummary() + ";BUFNODE=" + ( (node >= 0) ? to_string(node) : "ANY") );
+	}
+	else if(cmd == "SUBDEV")
+		SendReply(g_caps.m_subdevSpec);
+	else if(cmd == "RXCONFIG")
+		SendReply(to_string(g_rxControl.GetVersion()) + "," + to_string(g_rxControl.GetPendingCount()));
+	else if(cmd == "RATEPLAN")
+	{
+		lock_guard<mutex> lock(g_mutex);
+		SendReply(g_ratePlan.GetSummary());
+	}
+	else if( (cmd == "GAINRANGE") || (cmd == "BWRANGE") || (cmd == "FREQRANGE") || (cmd == "ANTENNAS") )
+	{
+		size_t chan = 0;
+		if(!subject.empty() && !GetChannelID(subject, chan))
+			return false;
+		if(chan >= g_caps.m_channels.size())
+			return false;
+
+		lock_guard<mutex> lock(g_mutex);
+		auto& caps = g_caps.m_channels[chan];
+		if(cmd == "GAINRANGE")
+			SendReply(DeviceCaps::FormatRange(caps.m_gainRange));
+		else if(cmd == "BWRANGE")
+			SendReply(DeviceCaps::FormatRange(caps.m_bandwidthRange));
+		else if(cmd == "FREQRANGE")
+			SendReply(DeviceCaps::FormatRange(caps.m_frequencyRange));
+		else
+		{
+			string reply;
+			for(auto& name : caps.m_antennas)
+			{
+				if(!reply.empty())
+					reply += ",";
+				reply += name;
+			}
+			SendReply(reply);
+		}
+	}
+	else if( (subject == "TIME") && (cmd == "NOW") )
+	{
+		lock_guard<mutex> lock(g_mutex);
+		SendReply(FormatTime(g_source->GetTimeNow()));
+	}
+	else if( (subject == "TIME") && (cmd == "PPS") )
+	{
+		lock_guard<mutex> lock(g_mutex);
+		SendReply(FormatTime(g_source->GetTimeLastPPS()));
+	}
+	else if(cmd == "STARTTIME")
+	{
+		lock_guard<mutex> lock(g_mutex);
+		switch(g_startMode)
+		{
+			case START_AT_TIME:
+				SendReply(FormatTime(g_startTime));
+				break;
+
+			case START_NEXT_PPS:
+				SendReply("PPS");
+				break;
+
+			case START_NOW:
+			default:
+				SendReply("NOW");
+				break;
+		}
+	}
+	else if(cmd == "DATAHDR")
+		SendReply(to_string(g_dataPlaneVersion));
+	else if(cmd == "CHLAYOUT")
+		SendReply(g_interleaveChannels ? "INTERLEAVED" : "PLANAR");
+	else if(cmd == "WIREFMT")
+	{
+		string name = GetFormatName(g_wireFormat);
+		for(auto& c : name)
+			c = toupper(c);
+		SendReply(name);
+	}
+	else if(cmd == "TRIGMODE")
+	{
+		lock_guard<mutex> lock(g_mutex);
+		switch(g_triggerMode)
+		{
+			case TRIGGER_MAGNITUDE:
+				SendReply("MAG");
+				break;
+
+			case TRIGGER_I:
+				SendReply("I");
+				break;
+
+			case TRIGGER_Q:
+				SendReply("Q");
+				break;
+
+			case TRIGGER_FREERUN:
+			default:
+				SendReply("FREERUN");
+				break;
+		}
+	}
+	else if(cmd == "TRIGHYST")
+	{
+		lock_guard<mutex> lock(g_mutex);
+		SendReply(to_string(g_triggerHysteresis));
+	}
+	else if( (subject == "DDC") && (cmd == "FREQ") )
+		SendReply(to_string(g_ddcFrequency));
+	else if( (subject == "DDC") && (cmd == "DECIM") )
+		SendReply(to_string(g_ddcDecimation));
+	else if( (subject == "FFT") && (cmd == "SIZE") )
+		SendReply(to_string(g_fftSize));
+	else if( (subject == "FFT") && (cmd == "WINDOW") )
+	{
+		switch(g_fftWindow)
+		{
+			case WINDOW_RECTANGULAR:
+				SendReply("RECT");
+				break;
+
+			case WINDOW_HANN:
+				SendReply("HANN");
+				break;
+
+			case WINDOW_FLATTOP:
+				SendReply("FLATTOP");
+				break;
+
+			case WINDOW_BLACKMAN_HARRIS:
+			default:
+				SendReply("BLACKMANHARRIS");
+				break;
+		}
+	}
+	else if( (subject == "FFT") && (cmd == "OVERLAP") )
+		SendReply(to_string(g_fftOverlap * 100));
+	else if( (subject == "FFT") && (cmd == "AVGMODE") )
+	{
+		switch(g_fftAverage)
+		{
+			case AVERAGE_LOG:
+				SendReply("LOG");
+				break;
+
+			case AVERAGE_MAXHOLD:
+				SendReply("MAXHOLD");
+				break;
+
+			case AVERAGE_LINEAR:
+			default:
+				SendReply("LINEAR");
+				break;
+		}
+	}
+	else if( (subject == "FFT") && (cmd == "AVGCOUNT") )
+		SendReply(to_string(g_fftAverageCount));
 	/*
 	else if(cmd == "POINTS")
 		SendReply(to_string(g_numPixels));
@@ -103,8 +863,9 @@ bool UHDSCPIServer::OnQuery(
 	else
 	{
 		LogDebug("Unrecognized query received: %s\n", line.c_str());
+		return false;
 	}
-	return false;
+	return true;
 }
 
 string UHDSCPIServer::GetMake()
@@ -131,34 +892,13 @@ string UHDSCPIServer::GetFirmwareVersion()
 
 size_t UHDSCPIServer::GetAnalogChannelCount()
 {
-	//TODO: support additional channels
-	return 1;
+	return g_rxChannels.size();
 }
 
 vector<size_t> UHDSCPIServer::GetSampleRates()
 {
-	vector<size_t> rates;
-
-	//List of possible sample rates is probably going to be super long!
-	//Do at least 500 kHz steps to keep the dropdown sane
-	auto range = g_sdr->get_rx_rates();
-	float step = range.step();
-	float minstep = 500000;
-	if(step < minstep)
-		step *= ceil(minstep / step);
-
-	for(float f = range.stop(); f >= range.start(); f -= step)
-	{
-		//TODO: Round the rate as close as possible to a nice round number
-		rates.push_back(f);
-	}
-
-	//DEBUG: add 15 Msps exactly as an option
-	rates.push_back(15 * 1000 * 1000);
-
-	reverse(rates.begin(), rates.end());
-
-	return rates;
+	lock_guard<mutex> lock(g_mutex);
+	return g_caps.m_sampleRates;
 }
 
 vector<size_t> UHDSCPIServer::GetSampleDepths()
@@ -196,60 +936,472 @@ bool UHDSCPIServer::OnCommand(
 	if(BridgeSCPIServer::OnCommand(line, subject, cmd, args))
 		return true;
 
-	else if(cmd == "REFCLK")
+	else if( (cmd == "STREAMMODE") && (args.size() == 1) )
 	{
-		LogDebug("set refclk\n");
-		lock_guard<mutex> lock(g_mutex);
-		g_sdr->set_clock_source(args[0]);
+		if(args[0] == "CONTINUOUS")
+		{
+			g_continuousMode = true;
+			g_scanMode = false;
+		}
+		else if(args[0] == "BLOCK")
+		{
+			g_continuousMode = false;
+			g_scanMode = false;
+		}
+		else if(args[0] == "SCAN")
+		{
+			g_continuousMode = false;
+			g_scanMode = true;
+		}
+		else
+			LogError("Unrecognized stream mode %s\n", args[0].c_str());
+	}
+
+	else if( (cmd == "RINGDEPTH") && (args.size() == 1) )
+	{
+		int depth = stoi(args[0]);
+		if(depth < 1)
+			LogError("Ring depth must be at least 1\n");
+		else
+			g_ringDepth = depth;
+	}
+
+	else if( (subject == "REC") && (cmd == "START") && (args.size() == 1) )
+	{
+		string path;
+		if(GetRecordPath(args[0], path))
+			g_recorder.Start(path, g_recordDepth, g_recordLimit * 1024 * 1024);
+	}
+	else if( (subject == "REC") && (cmd == "STOP") )
+		g_recorder.Stop();
+	else if( (subject == "REC") && (cmd == "DEPTH") && (args.size() == 1) )
+	{
+		int depth;
+		if(!ParseInt(args[0], depth))
+			return true;
+		if(depth < 1)
+			LogError("Recorder depth must be at least 1\n");
+		else
+			g_recordDepth = depth;
+	}
+	else if( (subject == "REC") && (cmd == "LIMIT") && (args.size() == 1) )
+	{
+		int megabytes;
+		if(!ParseInt(args[0], megabytes))
+			return true;
+		if(megabytes < 1)
+			LogError("Recorder limit must be at least 1 MB\n");
+		else
+			g_recordLimit = megabytes;
+	}
+
+	else if( (subject == "HIST") && (cmd == "ENABLE") && (args.size() == 2) )
+	{
+		int megabytes;
+		string path;
+		if(!ParseInt(args[1], megabytes))
+			return true;
+		if(megabytes < 1)
+			LogError("History file must be at least 1 MB\n");
+		else if(GetRecordPath(args[0], path))
+			g_history.Enable(path, static_cast<size_t>(megabytes) * 1024 * 1024);
+	}
+	else if( (subject == "HIST") && (cmd == "DISABLE") )
+		g_history.Disable();
+	else if( (subject == "HIST") && (cmd == "SAVE") && (args.size() == 3) )
+	{
+		uhd::time_spec_t start;
+		uhd::time_spec_t end;
+		string path;
+		if(ParseTime(args[1], start) && ParseTime(args[2], end) && GetRecordPath(args[0], path))
+			g_history.QueueSave(path, start, end);
+	}
+	else if( (subject == "HIST") && (cmd == "ARM") && (args.size() == 3) )
+	{
+		double pre;
+		double post;
+		string path;
+		if(!ParseDouble(args[1], pre) || !ParseDouble(args[2], post))
+			return true;
+		if( (pre < 0) || (post < 0) )
+			LogError("Pre- and post-trigger times must not be negative\n");
+		else if(GetRecordPath(args[0], path))
+			g_history.ArmSave(path, pre, post);
 	}
 
-	//TODO: support >1 channel
-	else if(cmd == "RXGAIN")
+	else if( (subject == "SCAN") && (cmd == "FREQS") && !args.empty() )
 	{
+		vector<double> freqs;
+		for(auto& a : args)
+			freqs.push_back(stod(a));
+
 		lock_guard<mutex> lock(g_mutex);
+		g_scanPlan.m_frequencies = freqs;
+	}
+	else if( (subject == "SCAN") && (cmd == "RANGE") && (args.size() == 3) )
+	{
+		lock_guard<mutex> lock(g_mutex);
+		if(!g_scanPlan.SetRange(stod(args[0]), stod(args[1]), stod(args[2])))
+			LogError("Invalid scan range %s,%s,%s\n", args[0].c_str(), args[1].c_str(), args[2].c_str());
+	}
+	else if( (subject == "SCAN") && (cmd == "SETTLE") && (args.size() == 1) )
+	{
+		double settle = stod(args[0]);
+		if(settle < 0)
+			LogError("Settling time must not be negative\n");
+		else
+		{
+			lock_guard<mutex> lock(g_mutex);
+			g_scanPlan.m_settleTime = settle;
+		}
+	}
+	else if( (subject == "SCAN") && (cmd == "STITCH") && (args.size() == 1) )
+	{
+		g_stitchEnabled = (stoi(args[0]) != 0);
+		if(g_stitchEnabled && ( (g_fftSize == 0) || (g_dataPlaneVersion < 1) ) )
+			LogWarning("Stitching needs spectrum mode (FFT:SIZE) and data plane protocol version 1 (DATAHDR 1)\n");
+	}
+	else if( (subject == "SCAN") && (cmd == "USABLE") && (args.size() == 1) )
+	{
+		double usable = stod(args[0]);
+		if( (usable <= 0) || (usable > 100) )
+			LogError("Usable bandwidth must be between 0 and 100 percent\n");
+		else
+			g_stitchUsable = usable / 100;
+	}
+	else if( (subject == "SCAN") && (cmd == "DCNOTCH") && (args.size() == 1) )
+	{
+		int bins = stoi(args[0]);
+		if(bins < 0)
+			LogError("DC notch width must not be negative\n");
+		else
+			g_stitchDcNotch = bins;
+	}
+
+	else if( (subject == "PLACEMENT") && (cmd == "PRIORITY") && (args.size() == 1) )
+	{
+		int priority = stoi(args[0]);
+		if( (priority < 0) || (priority > 99) )
+			LogError("Real-time priority must be between 0 and 99\n");
+		else
+			g_threadPlacement.SetPriority(priority);
+	}
+	else if( (subject == "PLACEMENT") && (cmd == "BUFNODE") && (args.size() == 1) )
+	{
+		if(args[0] == "ANY")
+			g_blockPool.SetNumaNode(-1);
+		else if(stoi(args[0]) < 0)
+			LogError("Invalid NUMA node %s\n", args[0].c_str());
+		else
+			g_blockPool.SetNumaNode(stoi(args[0]));
+	}
+	else if( (subject == "PLACEMENT") && !args.empty() )
+	{
+		//Core lists contain commas, so they arrive split up
+		string list;
+		for(auto& a : args)
+			list += (list.empty() ? "" : ",") + a;
+
+		ThreadRole role;
+		CpuList cpus;
+		if(!ParseThreadRole(cmd, role))
+			return false;
+		else if(list == "ANY")
+			g_threadPlacement.SetCpus(role, CpuList());
+		else if(cpus.Parse(list))
+			g_threadPlacement.SetCpus(role, cpus);
+		else
+			LogError("Invalid CPU list %s\n", list.c_str());
+	}
+
+	else if( (cmd == "DROPPOLICY") && (args.size() == 1) )
+	{
+		BlockRing::DropPolicy policy;
+		if(!ParseDropPolicy(args[0], policy))
+			LogError("Unrecognized drop policy %s\n", args[0].c_str());
+		else if(subject.empty())
+			g_dropPolicy = policy;
+		else
+		{
+			size_t id;
+			if(!GetSubscriberID(subject, id) || !g_subscribers.SetDropPolicy(id, policy))
+				LogError("Unrecognized subscriber %s\n", subject.c_str());
+		}
+	}
+
+	else if( (cmd == "WIREFMT") && (args.size() == 1) )
+	{
+		SampleFormat format;
+		if(ParseFormatName(args[0], format))
+		{
+			lock_guard<mutex> lock(g_mutex);
+			g_wireFormat = format;
+			UpdateBufferSize();
+		}
+		else
+			LogError("Unrecognized wire format %s\n", args[0].c_str());
+	}
 
-		double requested = stod(args[0]);
-		g_sdr->set_rx_gain(requested);
-		auto actual = g_sdr->get_rx_gain();
+	else if( (cmd == "DATAHDR") && (args.size() == 1) )
+	{
+		int version = stoi(args[0]);
+		if( (version < 0) || (version > WAVEFORM_VERSION_MAX) )
+			LogError("Unsupported data plane version %d\n", version);
+		else
+			g_dataPlaneVersion = version;
+	}
 
-		LogDebug("set rx gain: requested %.1f dB, got %.1f dB\n", requested, actual);
+	else if( (cmd == "CHLAYOUT") && (args.size() == 1) )
+	{
+		if(args[0] == "INTERLEAVED")
+			g_interleaveChannels = true;
+		else if(args[0] == "PLANAR")
+			g_interleaveChannels = false;
+		else
+			LogError("Unrecognized channel layout %s\n", args[0].c_str());
+	}
+
+	else if( (cmd == "TRIGMODE") && (args.size() == 1) )
+	{
+		TriggerMode mode;
+		if(args[0] == "FREERUN")
+			mode = TRIGGER_FREERUN;
+		else if(args[0] == "MAG")
+			mode = TRIGGER_MAGNITUDE;
+		else if(args[0] == "I")
+			mode = TRIGGER_I;
+		else if(args[0] == "Q")
+			mode = TRIGGER_Q;
+		else
+		{
+			LogError("Unrecognized trigger mode %s\n", args[0].c_str());
+			return true;
+		}
+
+		lock_guard<mutex> lock(g_mutex);
+		g_triggerMode = mode;
+		g_rxControl.Publish();
 	}
-	else if(cmd == "RXBW")
+
+	else if( (cmd == "TRIGHYST") && (args.size() == 1) )
 	{
+		double hysteresis = fabs(stod(args[0]));
 		lock_guard<mutex> lock(g_mutex);
+		g_triggerHysteresis = hysteresis;
+		g_rxControl.Publish();
+	}
 
-		double requested = stod(args[0]);
-		g_sdr->set_rx_bandwidth(requested);
-		auto actual = g_sdr->get_rx_bandwidth();
+	else if( (subject == "DDC") && (cmd == "FREQ") && (args.size() == 1) )
+		g_ddcFrequency = stod(args[0]);
 
-		LogDebug("set rx bandwidth: requested %.1f MHz, got %.1f MHz\n", requested*1e-6, actual*1e-6);
+	else if( (subject == "DDC") && (cmd == "DECIM") && (args.size() == 1) )
+	{
+		int decim = stoi(args[0]);
+		if(decim < 1)
+			LogError("Decimation factor must be at least 1\n");
+		else
+			g_ddcDecimation = decim;
 	}
-	else if(cmd == "RXFREQ")
+
+	else if( (subject == "FFT") && (cmd == "SIZE") && (args.size() == 1) )
 	{
+		int size = stoi(args[0]);
+		if(size < 0)
+			LogError("FFT size must not be negative\n");
+		else
+		{
+			g_fftSize = size;
+			if( (size > 0) && (g_dataPlaneVersion < 1) )
+				LogWarning("Spectrum mode needs data plane protocol version 1 (DATAHDR 1), sending IQ for now\n");
+		}
+	}
+
+	else if( (subject == "FFT") && (cmd == "WINDOW") && (args.size() == 1) )
+	{
+		if(args[0] == "RECT")
+			g_fftWindow = WINDOW_RECTANGULAR;
+		else if(args[0] == "HANN")
+			g_fftWindow = WINDOW_HANN;
+		else if(args[0] == "BLACKMANHARRIS")
+			g_fftWindow = WINDOW_BLACKMAN_HARRIS;
+		else if(args[0] == "FLATTOP")
+			g_fftWindow = WINDOW_FLATTOP;
+		else
+			LogError("Unrecognized window %s\n", args[0].c_str());
+	}
+
+	else if( (subject == "FFT") && (cmd == "OVERLAP") && (args.size() == 1) )
+	{
+		double overlap = stod(args[0]);
+		if( (overlap < 0) || (overlap > 95) )
+			LogError("FFT overlap must be between 0 and 95 percent\n");
+		else
+			g_fftOverlap = overlap / 100;
+	}
+
+	else if( (subject == "FFT") && (cmd == "AVGMODE") && (args.size() == 1) )
+	{
+		if(args[0] == "LINEAR")
+			g_fftAverage = AVERAGE_LINEAR;
+		else if(args[0] == "LOG")
+			g_fftAverage = AVERAGE_LOG;
+		else if(args[0] == "MAXHOLD")
+			g_fftAverage = AVERAGE_MAXHOLD;
+		else
+			LogError("Unrecognized averaging mode %s\n", args[0].c_str());
+	}
+
+	else if( (subject == "FFT") && (cmd == "AVGCOUNT") && (args.size() == 1) )
+	{
+		int count = stoi(args[0]);
+		if(count < 1)
+			LogError("Averaging count must be at least 1\n");
+		else
+			g_fftAverageCount = count;
+	}
+
+	else if(cmd == "REFCLK")
+	{
+		LogDebug("set refclk\n");
 		lock_guard<mutex> lock(g_mutex);
+		g_source->SetClockSource(args[0]);
+	}
 
-		double requested = stod(args[0]);
-		uhd::tune_request_t tune(requested);
-		g_sdr->set_rx_freq(tune);
-		auto actual = g_sdr->get_rx_freq();
+	else if( (cmd == "TIMESRC") && (args.size() == 1) )
+	{
+		lock_guard<mutex> lock(g_mutex);
+		g_source->SetTimeSource(args[0]);
+	}
+
+	else if( (subject == "TIME") && (cmd == "NOW") && (args.size() == 1) )
+	{
+		uhd::time_spec_t time;
+		if(ParseTime(args[0], time))
+		{
+			lock_guard<mutex> lock(g_mutex);
+			g_source->SetTimeNow(time);
+		}
+	}
 
-		g_centerFrequency = actual;
+	else if( (subject == "TIME") && (cmd == "PPS") && (args.size() == 1) )
+	{
+		uhd::time_spec_t time;
+		if(ParseTime(args[0], time))
+		{
+			lock_guard<mutex> lock(g_mutex);
+			g_source->SetTimeNextPPS(time);
+		}
+	}
 
-		LogDebug("set rx frequency: requested %.1f MHz, got %.1f MHz\n", requested*1e-6, actual*1e-6);
+	else if( (cmd == "STARTTIME") && (args.size() == 1) )
+	{
+		uhd::time_spec_t time;
+		if(args[0] == "NOW")
+		{
+			lock_guard<mutex> lock(g_mutex);
+			g_startMode = START_NOW;
+		}
+		else if(args[0] == "PPS")
+		{
+			lock_guard<mutex> lock(g_mutex);
+			g_startMode = START_NEXT_PPS;
+		}
+		else if(ParseTime(args[0], time))
+		{
+			lock_guard<mutex> lock(g_mutex);
+			g_startTime = time;
+			g_startMode = START_AT_TIME;
+		}
 	}
 
+	else if( (cmd == "RXGAIN") && !args.empty() )
+		QueueTuning(subject, RxCommand::SET_GAIN, args);
+	else if( (cmd == "RXBW") && !args.empty() )
+		QueueTuning(subject, RxCommand::SET_BANDWIDTH, args);
+	else if( (cmd == "RXFREQ") && !args.empty() )
+		QueueTuning(subject, RxCommand::SET_FREQUENCY, args);
+	else if( (cmd == "RXSYNC") && args.empty() )
+		g_rxControl.Flush();
+
 	else
 		LogError("Unrecognized command %s\n", line.c_str());
 
 	return true;
 }
 
-bool UHDSCPIServer::GetChannelID(const string& /*subject*/, size_t& id_out)
+/**
+	@brief Parses a channel name (CH1, CH2, ... or just a number) to a zero-based channel index
+ */
+bool UHDSCPIServer::GetChannelID(const string& subject, size_t& id_out)
 {
-	id_out = 0;
+	size_t i = 0;
+	while( (i < subject.length()) && !isdigit(subject[i]) )
+		i++;
+	if(i == subject.length())
+		return false;
+
+	size_t n = stoul(subject.substr(i));
+	if( (n < 1) || (n > g_rxChannels.size()) )
+		return false;
+
+	id_out = n - 1;
 	return true;
 }
 
+/**
+	@brief Returns the list of channels an RX command applies to: the one named by the subject, or all if none
+ */
+vector<size_t> UHDSCPIServer::GetTargetChannels(const string& subject)
+{
+	vector<size_t> ret;
+	size_t id;
+	if(subject.empty())
+	{
+		for(size_t i=0; i<g_rxChannels.size(); i++)
+			ret.push_back(i);
+	}
+	else if(GetChannelID(subject, id))
+		ret.push_back(id);
+	else
+		LogError("Unrecognized channel %s\n", subject.c_str());
+	return ret;
+}
+
+/**
+	@brief Queues a change to one RX setting on the channels a command applies to, with an optional device time
+ */
+void UHDSCPIServer::QueueTuning(const string& subject, RxCommand::Type type, const vector<string>& args)
+{
+	double requested = stod(args[0]);
+	vector<RxCommand> commands;
+	for(auto i : GetTargetChannels(subject))
+		commands.push_back(RxCommand(type, i, requested));
+
+	uhd::time_spec_t time;
+	if(args.size() == 1)
+		g_rxControl.Submit(commands);
+	else if(ParseTime(args[1], time))
+		g_rxControl.Submit(commands, time);
+	else
+		LogError("Invalid time %s\n", args[1].c_str());
+}
+
+/**
+	@brief Resizes the block pool to fit one waveform of all enabled channels in the current format
+ */
+void UHDSCPIServer::UpdateBufferSize()
+{
+	size_t nchans = 0;
+	for(auto& c : g_rxChannels)
+	{
+		if(c.m_enabled)
+			nchans ++;
+	}
+	nchans = max(nchans, (size_t)1);
+
+	g_blockPool.SetBufferSize(g_rxBlockSize * GetBytesPerSample(g_wireFormat) * nchans);
+}
+
 BridgeSCPIServer::ChannelType UHDSCPIServer::GetChannelType(size_t /*channel*/)
 {
 	return CH_ANALOG;
@@ -263,17 +1415,46 @@ void UHDSCPIServer::AcquisitionStart(bool oneShot)
 
 void UHDSCPIServer::AcquisitionForceTrigger()
 {
-	g_triggerArmed = true;
-	g_triggerOneShot = false;
+	bool freerun;
+	{
+		lock_guard<mutex> lock(g_mutex);
+		freerun = (g_triggerMode == TRIGGER_FREERUN);
+	}
+
+	//Free running, so just start streaming
+	if(freerun)
+	{
+		g_triggerArmed = true;
+		g_triggerOneShot = false;
+	}
+
+	//Capture one waveform right away without waiting for the trigger
+	else
+	{
+		if(!g_triggerArmed)
+		{
+			g_triggerOneShot = true;
+			g_triggerArmed = true;
+		}
+		g_forceTrigger = true;
+	}
 }
 
 void UHDSCPIServer::AcquisitionStop()
 {
 	g_triggerArmed = false;
+	g_forceTrigger = false;
 }
 
-void UHDSCPIServer::SetChannelEnabled(size_t /*chIndex*/, bool /*enabled*/)
+void UHDSCPIServer::SetChannelEnabled(size_t chIndex, bool enabled)
 {
+	if(chIndex >= g_rxChannels.size())
+		return;
+
+	lock_guard<mutex> lock(g_mutex);
+	g_rxChannels[chIndex].m_enabled = enabled;
+	UpdateBufferSize();
+	g_rxControl.Publish();
 }
 
 void UHDSCPIServer::SetAnalogCoupling(size_t /*chIndex*/, const std::string& /*coupling*/)
@@ -298,28 +1479,68 @@ void UHDSCPIServer::SetDigitalHysteresis(size_t /*chIndex*/, double /*hysteresis
 
 void UHDSCPIServer::SetSampleRate(uint64_t rate_hz)
 {
-	g_sdr->set_rx_rate(rate_hz);
-	g_rxRate = rate_hz;
+	lock_guard<mutex> lock(g_mutex);
 
-	auto actual = g_sdr->get_rx_rate();
-	LogDebug("set rx sample rate: requested %.2f Msps, got %.2f Msps\n", rate_hz*1e-6, actual*1e-6);
+	//Pick the master clock ourselves, rather than letting the radio settle for a fractional resampler
+	auto plan = SampleRatePlan::Choose(rate_hz, g_caps, g_ratePlan.m_masterClockRate);
+	if( (plan.m_decimation != 0) && (plan.m_masterClockRate != g_ratePlan.m_masterClockRate) )
+	{
+		try
+		{
+			g_source->SetMasterClockRate(plan.m_masterClockRate);
+		}
+		catch(uhd::exception& ex)
+		{
+			LogError("Failed to set master clock to %.3f MHz: %s\n", plan.m_masterClockRate*1e-6, ex.what());
+		}
+		plan.m_masterClockRate = g_source->GetMasterClockRate();
+	}
+
+	g_source->SetSampleRate(rate_hz);
+	auto actual = g_source->GetSampleRate();
+	plan.m_actualRate = actual;
+	g_ratePlan = plan;
+
+	//Timestamps and waveform headers need the rate the radio is actually running at
+	g_rxRate = llround(actual);
+	g_rxControl.Publish();
+
+	LogDebug("set rx sample rate: requested %.2f Msps, got %.2f Msps (master clock %.3f MHz / %zu)\n",
+		rate_hz*1e-6, actual*1e-6, plan.m_masterClockRate*1e-6, plan.m_decimation);
+	if(fabs(actual - rate_hz) >= 0.5)
+		LogWarning("Sample rate %.6f Msps is not exact\n", actual*1e-6);
 }
 
 void UHDSCPIServer::SetSampleDepth(uint64_t depth)
 {
+	lock_guard<mutex> lock(g_mutex);
 	g_rxBlockSize = depth;
+	UpdateBufferSize();
+	g_rxControl.Publish();
 }
 
-void UHDSCPIServer::SetTriggerDelay(uint64_t /*delay_fs*/)
+void UHDSCPIServer::SetTriggerDelay(uint64_t delay_fs)
 {
+	lock_guard<mutex> lock(g_mutex);
+	g_triggerDelay = delay_fs;
+	g_rxControl.Publish();
 }
 
-void UHDSCPIServer::SetTriggerSource(size_t /*chIndex*/)
+void UHDSCPIServer::SetTriggerSource(size_t chIndex)
 {
+	if(chIndex >= g_rxChannels.size())
+		return;
+
+	lock_guard<mutex> lock(g_mutex);
+	g_triggerChannel = chIndex;
+	g_rxControl.Publish();
 }
 
-void UHDSCPIServer::SetTriggerLevel(double /*level_V*/)
+void UHDSCPIServer::SetTriggerLevel(double level_V)
 {
+	lock_guard<mutex> lock(g_mutex);
+	g_triggerLevel = level_V;
+	g_rxControl.Publish();
 }
 
 void UHDSCPIServer::SetTriggerTypeEdge()
@@ -329,11 +1550,25 @@ void UHDSCPIServer::SetTriggerTypeEdge()
 
 bool UHDSCPIServer::IsTriggerArmed()
 {
-	//return g_triggerArmed;
-	return true;
+	return g_triggerArmed;
 }
 
-void UHDSCPIServer::SetEdgeTriggerEdge(const string& /*edge*/)
+void UHDSCPIServer::SetEdgeTriggerEdge(const string& edge)
 {
+	TriggerEdge value;
+	if(edge == "RISING")
+		value = EDGE_RISING;
+	else if(edge == "FALLING")
+		value = EDGE_FALLING;
+	else if(edge == "ANY")
+		value = EDGE_ANY;
+	else
+	{
+		LogError("Unsupported trigger edge %s\n", edge.c_str());
+		return;
+	}
 
+	lock_guard<mutex> lock(g_mutex);
+	g_triggerEdge = value;
+	g_rxControl.Publish();
 }
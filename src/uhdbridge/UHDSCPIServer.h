@@ -37,6 +37,7 @@
 #define UHDSCPIServer_h
 
 #include "../../lib/scpi-server-tools/BridgeSCPIServer.h"
+#include "RxConfig.h"
 
 /**
 	@brief SCPI server for managing control plane traffic to a single client
@@ -89,6 +90,10 @@ protected:
 	virtual void SetTriggerTypeEdge() override;
 	virtual void SetEdgeTriggerEdge(const std::string& edge) override;
 	virtual bool IsTriggerArmed() override;
+
+	std::vector<size_t> GetTargetChannels(const std::string& subject);
+	void QueueTuning(const std::string& subject, RxCommand::Type type, const std::vector<std::string>& args);
+	void UpdateBufferSize();
 };
 
 #endif
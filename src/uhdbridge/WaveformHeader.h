@@ -0,0 +1,176 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* uhdbridge                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2012-2024 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Binary waveform header sent on the data plane
+
+	Versions of the data plane protocol:
+
+		0: Legacy. uint64 sample count, uint64 sample rate, float32 scale factor (integer formats only), samples.
+
+		1: WaveformHeader, followed by numChannels WaveformChannelHeader structs, followed by the payload. Multi-channel
+		   payloads are planar (all of channel 0, then all of channel 1...) unless WAVEFORM_FLAG_INTERLEAVED is set.
+
+	All fields are little endian. Clients should use headerLength rather than sizeof() to find the start of the channel
+	headers, and channelHeaderLength to step between them, so that fields can be appended in later versions without
+	breaking anyone.
+ */
+
+#ifndef WaveformHeader_h
+#define WaveformHeader_h
+
+#include <atomic>
+#include <cstdint>
+
+///@brief Magic number at the start of every waveform ("UHDW")
+#define WAVEFORM_MAGIC 0x57444855
+
+///@brief Latest data plane protocol version we know how to send
+#define WAVEFORM_VERSION_MAX 1
+
+///@brief Samples in this waveform immediately follow those in the previous one with no gap
+#define WAVEFORM_FLAG_CONTIGUOUS	0x0001
+
+///@brief The radio overflowed during (or immediately before) this waveform, so some samples were lost
+#define WAVEFORM_FLAG_OVERFLOW		0x0002
+
+///@brief The timestamp fields contain a valid device time
+#define WAVEFORM_FLAG_TIME_VALID	0x0004
+
+///@brief Fewer samples were received than requested (timeout or error)
+#define WAVEFORM_FLAG_TRUNCATED		0x0008
+
+///@brief Multi-channel payload is interleaved (sample 0 of every channel, then sample 1...) rather than planar
+#define WAVEFORM_FLAG_INTERLEAVED	0x0010
+
+///@brief Waveform was captured by the software trigger, and triggerOffset is valid
+#define WAVEFORM_FLAG_TRIGGERED		0x0020
+
+///@brief Payload types
+enum WaveformPayloadType
+{
+	///@brief Raw IQ samples in the format given by sampleFormat
+	PAYLOAD_IQ = 0,
+
+	/**
+		@brief Power spectrum, as numSamples float32 bins (sampleFormat FORMAT_F32) per channel, in dBFS
+
+		Bins are in frequency order: bin 0 is at centerFrequency - sampleRate/2, and they're spaced
+		sampleRate/numSamples apart. firstSample and the timestamp refer to the first IQ sample that went into it.
+	 */
+	PAYLOAD_SPECTRUM = 1
+};
+
+#pragma pack(push, 1)
+
+/**
+	@brief Fixed portion of the per-waveform header
+ */
+struct WaveformHeader
+{
+	///@brief Always WAVEFORM_MAGIC
+	uint32_t magic;
+
+	///@brief Protocol version of this header
+	uint16_t version;
+
+	///@brief Size of this struct in bytes, i.e. offset of the first channel header
+	uint16_t headerLength;
+
+	///@brief Size of each WaveformChannelHeader in bytes
+	uint16_t channelHeaderLength;
+
+	///@brief Number of channel headers following this one
+	uint16_t numChannels;
+
+	///@brief WAVEFORM_FLAG_* bits
+	uint32_t flags;
+
+	///@brief WaveformPayloadType
+	uint16_t payloadType;
+
+	///@brief SampleFormat of the payload
+	uint16_t sampleFormat;
+
+	///@brief Multiply integer samples by this to get the same units as fc32
+	float scale;
+
+	///@brief Total size of the payload after the channel headers, in bytes
+	uint64_t payloadLength;
+
+	///@brief Waveform sequence number, incremented for every waveform captured (so gaps indicate drops)
+	uint64_t sequence;
+
+	///@brief Number of samples per channel
+	uint64_t numSamples;
+
+	///@brief Sample rate, in Hz
+	uint64_t sampleRate;
+
+	///@brief Index of the first sample since the stream was started
+	uint64_t firstSample;
+
+	///@brief Integer part of the device time of the first sample
+	int64_t timeSeconds;
+
+	///@brief Fractional part of the device time of the first sample
+	double timeFracSeconds;
+
+	///@brief Index within the waveform of the sample which fired the trigger
+	uint64_t triggerOffset;
+};
+
+/**
+	@brief Per-channel portion of the waveform header
+ */
+struct WaveformChannelHeader
+{
+	///@brief Hardware channel index
+	uint32_t channel;
+
+	///@brief Reserved for future use, always zero
+	uint32_t flags;
+
+	///@brief Center frequency, in Hz
+	double centerFrequency;
+
+	///@brief Actual RX gain, in dB
+	double gain;
+
+	///@brief Analog bandwidth, in Hz
+	double bandwidth;
+};
+
+#pragma pack(pop)
+
+extern std::atomic<int> g_dataPlaneVersion;
+
+#endif
@@ -30,137 +30,1514 @@
 /**
 	@file
 	@author Andrew D. Zonenberg
-	@brief Waveform data thread (data plane traffic only, no control plane SCPI)
+	@brief Waveform data threads (data plane traffic only, no control plane SCPI)
+
+	While a control plane client is connected there are two threads: a receive thread which does nothing but pull
+	samples from UHD into pooled blocks, and a data plane thread which does any on-bridge processing and publishes the
+	results to every connected subscriber (see Subscriber.h) and to the recorder (see SigMFRecorder.h). They are
+	connected by a lock-free ring so a stalled subscriber never backs up the radio; when the ring fills, g_dropPolicy
+	decides what gets thrown away.
+
+	Data plane clients are accepted by a separate thread for the life of the process, so they can come and go at any
+	time.
  */
 #include "uhdbridge.h"
+#include "RxBlockPool.h"
+#include "BlockRing.h"
+#include "SampleFormat.h"
+#include "WaveformHeader.h"
+#include "Subscriber.h"
+#include "SigMFRecorder.h"
+#include "HistoryFile.h"
+#include "TriggerEngine.h"
+#include "SampleHistory.h"
+#include "DigitalDownconverter.h"
+#include "SpectrumProcessor.h"
+#include "SpectrumStitcher.h"
+#include "RxSource.h"
+#include "RxConfig.h"
+#include "ScanPlan.h"
+#include "BridgeStats.h"
+#include "CpuPlacement.h"
 #include <string.h>
 
 using namespace std;
 
 volatile bool g_waveformThreadQuit = false;
 
+atomic<uint64_t> g_droppedWaveforms(0);
+
+bool g_zeroCopy = false;
+
+///@brief Sequence number of the next block captured by the receive thread
+static uint64_t g_rxSequence = 0;
+
+///@brief Pre-trigger history for RxTriggeredMode, kept around so re-arming doesn't reallocate it
+static SampleHistory g_triggerHistory;
+
+//How far ahead of the samples being received scan retunes are scheduled, in seconds. This has to cover the trip
+//through the control worker to the radio; any more just delays the start of the scan.
+static const double g_scanLookahead = 0.05;
+
+//Least time between scheduling a scan retune and it taking effect, if the scan falls behind
+static const double g_scanMinLead = 0.01;
+
+//Most scan retunes in flight at once, well under the number of snapshots RxController keeps
+static const size_t g_scanMaxInFlight = 32;
+
+/**
+	@brief Settings snapshotted when the trigger is armed, which stay fixed for the life of a streamer
+ */
+class RxStreamConfig
+{
+public:
+	RxStreamConfig()
+		: m_format(FORMAT_FC32)
+		, m_timedStart(false)
+	{}
+
+	///@brief Sample format to request from UHD
+	SampleFormat m_format;
+
+	///@brief Hardware channels to stream, in buffer order
+	vector<size_t> m_channels;
+
+	///@brief True if the first stream command should wait for m_startTime
+	bool m_timedStart;
+
+	///@brief Device time at which to start streaming
+	uhd::time_spec_t m_startTime;
+
+	///@brief Settings when the stream started. Tuning may change later, but nothing that needs a new streamer.
+	RxConfigPtr m_settings;
+};
+
+/**
+	@brief Timestamp reference for a continuous stream: device time of sample number m_sample
+ */
+class StreamAnchor
+{
+public:
+	StreamAnchor()
+		: m_valid(false)
+		, m_sample(0)
+	{}
+
+	///@brief Device time of a sample
+	uhd::time_spec_t GetTime(uint64_t sample, int64_t rate) const
+	{ return m_time + uhd::time_spec_t::from_ticks(sample - m_sample, rate); }
+
+	///@brief False until the first timestamped packet, and again after an overflow
+	bool m_valid;
+
+	///@brief Sample number, counting from the start of the stream
+	uint64_t m_sample;
+
+	///@brief Device time of m_sample
+	uhd::time_spec_t m_time;
+};
+
+/**
+	@brief Follows the settings snapshots published by the control plane during a stream, working out which one
+	applies to each sample
+
+	Timed changes are mapped to a sample number with the stream's anchor, and wait until the stream is anchored to do
+	so. Changes without a time can't be tied to any sample, so they apply from the next block.
+ */
+class SettingsTracker
+{
+public:
+	SettingsTracker(const RxConfigPtr& initial)
+		: m_active(initial)
+		, m_seen(initial->m_version)
+	{}
+
+	bool Poll();
+	uint64_t GetBoundary(const StreamAnchor& anchor, int64_t rate) const;
+	void Advance(uint64_t sample, const StreamAnchor& anchor, int64_t rate);
+
+	///@brief Settings for the samples being received now
+	RxConfigPtr m_active;
+
+	///@brief The most recent timed settings to take effect, if any, even if untimed changes have come since
+	RxConfigPtr m_lastTimed;
+
+	///@brief Newer settings which haven't taken effect yet, oldest first
+	deque<RxConfigPtr> m_pending;
+
+	///@brief Version of the newest snapshot seen
+	uint64_t m_seen;
+};
+
+/**
+	@brief One step of a scan which has been sent to the control worker but not captured yet
+ */
+class ScanHop
+{
+public:
+	ScanHop(size_t step, const uhd::time_spec_t& time)
+		: m_step(step)
+		, m_time(time)
+	{}
+
+	///@brief Index into the scan's frequency list
+	size_t m_step;
+
+	///@brief Device time of the retune
+	uhd::time_spec_t m_time;
+};
+
+static RxBlock* InterleaveBlock(RxBlock* in);
+static void InitBlock(RxBlock* block, const RxStreamConfig& config);
+static void StampBlock(RxBlock* block, const RxConfig& settings);
+static void GetRecvBuffers(RxBlock* block, size_t offset, vector<void*>& buffs);
+static size_t ReceiveSamples(
+	RxStream* rx, vector<void*>& buffs, size_t nsamps, uhd::rx_metadata_t& meta, double timeout);
+static void IssueStreamCommand(RxStream* rx, uhd::stream_cmd_t& cmd, const RxStreamConfig& config, bool first);
+static double GetStartTimeout(const RxStreamConfig& config);
+static void RxThread(BlockRing* ring, atomic<bool>* stop);
+static void RxBlockMode(
+	RxStream* rx, const RxStreamConfig& config, BlockRing& ring, bool oneshot, atomic<bool>& stop);
+static void RxContinuousMode(
+	RxStream* rx, const RxStreamConfig& config, BlockRing& ring, atomic<bool>& stop);
+static void RxTriggeredMode(
+	RxStream* rx, const RxStreamConfig& config, BlockRing& ring, bool oneshot, atomic<bool>& stop);
+static void RxScanMode(
+	RxStream* rx, const RxStreamConfig& config, const ScanPlan& plan, BlockRing& ring, bool oneshot,
+	atomic<bool>& stop);
+static void StopContinuousStream(RxStream* rx, const RxStreamConfig& config);
+static size_t GetPretriggerSamples(const RxConfig& settings, size_t blocksize);
+static size_t ConfigureTrigger(EdgeTrigger& trigger, const RxStreamConfig& config, const RxConfig& settings);
+static bool PushBlock(BlockRing& ring, RxBlock* block, atomic<bool>& stop);
+static void PushScanEnd(BlockRing& ring, atomic<bool>& stop);
+
+/**
+	@brief Accepts data plane connections for the life of the process, adding each one as a subscriber
+ */
+void DataPlaneAcceptThread()
+{
+#ifdef __linux__
+	pthread_setname_np(pthread_self(), "AcceptThread");
+#endif
+
+	while(true)
+	{
+		Socket client = g_dataSocket.Accept();
+		if(!client.IsValid())
+			break;
+		g_subscribers.Add(client.Detach());
+	}
+}
+
+/**
+	@brief Data plane thread, which starts the receive thread and hands what it captures to the subscribers
+ */
 void WaveformServerThread()
 {
 #ifdef __linux__
 	pthread_setname_np(pthread_self(), "WaveformThread");
 #endif
 
-	Socket client = g_dataSocket.Accept();
-	LogVerbose("Client connected to data plane socket\n");
+	g_droppedWaveforms = 0;
 
-	if(!client.IsValid())
-		return;
-	if(!client.DisableNagle())
-		LogWarning("Failed to disable Nagle on socket, performance may be poor\n");
+	//Start the receive thread
+	BlockRing ring(g_ringDepth);
+	g_stats.m_ringDepth = ring.GetDepth();
+	atomic<bool> stop(false);
+	thread rxThread(RxThread, &ring, &stop);
 
+	//Publish blocks as they come in
+	DigitalDownconverter ddc;
+	SpectrumProcessor spectrum;
+	SpectrumStitcher stitcher;
+	bool havePrevious = false;
+	uint64_t nextSample = 0;
+	uint64_t publishIndex = 0;
+	uint64_t recordIndex = 0;
 	while(!g_waveformThreadQuit)
 	{
-		//wait if trigger not armed
-		if(!g_triggerArmed)
+		g_threadPlacement.Refresh(THREAD_PROCESSING);
+		g_stats.m_ringOccupancy = ring.GetSize();
+		RxBlock* block = ring.TryPop();
+		if(!block)
 		{
-			this_thread::sleep_for(chrono::microseconds(1000));
+			this_thread::sleep_for(chrono::microseconds(100));
 			continue;
 		}
 
-		LogDebug("trigger armed\n");
+		//A scan ended, so its last sweep is as complete as it's ever going to be
+		if(block->m_scanEnd)
+		{
+			g_blockPool.Release(block);
+			block = stitcher.Flush();
+			if(block)
+			{
+				block = InterleaveBlock(block);
+				block->m_publishIndex = publishIndex ++;
+				g_subscribers.Publish(block);
+				g_blockPool.Release(block);
+			}
+			continue;
+		}
+
+		//Check for gaps here rather than in the receive thread, since we can't know about evicted blocks there
+		bool contiguous = havePrevious && !block->m_discontinuity && (block->m_firstSample == nextSample);
+		havePrevious = true;
+		nextSample = block->m_firstSample + block->m_length;
+
+		//Let the history file know where the trigger was, before the DDC moves it
+		if(block->m_triggered && block->m_timeValid)
+		{
+			auto offset = uhd::time_spec_t::from_ticks(block->m_triggerOffset, block->m_rate);
+			g_history.OnTrigger(block->m_startTime + offset);
+		}
+
+		//Optional on-bridge processing, done here so the receive thread never waits on it.
+		//Anything which changes the samples has to happen before the block is shared.
+		block = ddc.Process(block, contiguous);
+
+		//Recordings are always IQ, so they get the samples before they can be turned into spectra
+		block->m_contiguous = contiguous;
+		block->m_recordIndex = recordIndex ++;
+		RxBlock* recorded = g_recorder.Publish(block) ? block : nullptr;
+
+		block = spectrum.Process(block);
+		if(block)
+			block = stitcher.Process(block);
+		if(!block)
+			continue;
+		block = InterleaveBlock(block);
+
+		//The recorder only looks at m_contiguous and m_recordIndex, so a block it's holding can still be numbered
+		if(block != recorded)
+			block->m_contiguous = contiguous;
+		block->m_publishIndex = publishIndex ++;
+		g_subscribers.Publish(block);
+		g_blockPool.Release(block);
+	}
+
+	//Shut down the receive thread and throw away anything it left behind
+	stop = true;
+	rxThread.join();
+	RxBlock* leftover;
+	while( (leftover = ring.TryPop()) != nullptr)
+		g_blockPool.Release(leftover);
+	g_stats.m_ringOccupancy = 0;
+}
+
+/**
+	@brief Interleaves the channels of a planar block into a separate buffer
+ */
+template<class T>
+static void InterleaveSamples(RxBlock& in, RxBlock& out)
+{
+	size_t nchans = in.m_channels.size();
+	size_t len = in.m_length;
+	T* dst = static_cast<T*>(out.GetData());
+	for(size_t c=0; c<nchans; c++)
+	{
+		T* src = static_cast<T*>(in.GetSample(c, 0));
+		for(size_t i=0; i<len; i++)
+			dst[i*nchans + c] = src[i];
+	}
+}
+
+/**
+	@brief Interleaves a multi-channel block if the client asked for it, once for all subscribers
+
+	Shuffles into a second buffer from the pool (same size, so no allocation in steady state) and releases the input.
+	If no buffer is available the planar block is returned unchanged.
+ */
+static RxBlock* InterleaveBlock(RxBlock* in)
+{
+	size_t nchans = in->m_channels.size();
+	if( (g_dataPlaneVersion == 0) || !g_interleaveChannels || (nchans < 2) )
+		return in;
+
+	RxBlock* out = g_blockPool.Acquire();
+	if(!out)
+		return in;
+	if(out->GetCapacity() < in->m_length * nchans * GetBytesPerSample(in->m_format))
+	{
+		g_blockPool.Release(out);
+		return in;
+	}
+
+	switch(GetBytesPerSample(in->m_format))
+	{
+		case 2:
+			InterleaveSamples<uint16_t>(*in, *out);
+			break;
+
+		case 4:
+			InterleaveSamples<uint32_t>(*in, *out);
+			break;
+
+		case 8:
+		default:
+			InterleaveSamples<uint64_t>(*in, *out);
+			break;
+	}
+
+	out->m_length = in->m_length;
+	out->m_requested = in->m_requested;
+	out->m_stride = in->m_length;
+	out->m_format = in->m_format;
+	out->m_payloadType = in->m_payloadType;
+	out->m_channels = in->m_channels;
+	out->m_rate = in->m_rate;
+	out->m_startTime = in->m_startTime;
+	out->m_timeValid = in->m_timeValid;
+	out->m_sequence = in->m_sequence;
+	out->m_firstSample = in->m_firstSample;
+	out->m_discontinuity = in->m_discontinuity;
+	out->m_overflow = in->m_overflow;
+	out->m_triggered = in->m_triggered;
+	out->m_triggerOffset = in->m_triggerOffset;
+	out->m_scanStep = in->m_scanStep;
+	out->m_scanSteps = in->m_scanSteps;
+	out->m_interleaved = true;
+	g_blockPool.Release(in);
+	return out;
+}
+
+/**
+	@brief Picks up any settings published since the last call
+
+	@return False if the new settings need a new streamer, in which case the stream should stop and be restarted
+ */
+bool SettingsTracker::Poll()
+{
+	uint64_t latest = g_rxControl.GetVersion();
+	for(uint64_t v = m_seen + 1; v <= latest; v++)
+	{
+		//If we've fallen so far behind that a snapshot is gone, skip to the latest
+		auto config = g_rxControl.GetConfig(v);
+		if(!config)
+		{
+			config = g_rxControl.GetConfig();
+			v = config->m_version;
+		}
+		m_seen = v;
+
+		if(config->IsRestartNeeded(*m_active))
+		{
+			LogDebug("stream settings changed, restarting stream\n");
+			return false;
+		}
+		m_pending.push_back(config);
+	}
+	return true;
+}
 
-		auto config = g_sdr->get_pp_string();
-		LogDebug("%s\n", config.c_str());
+/**
+	@brief Returns the sample number the oldest pending settings take effect at
+
+	Must only be called if there are pending settings. Returns 0 if they apply from the next block (no time, or a time
+	which has already passed), or UINT64_MAX if they're timed but the stream isn't anchored yet so it's not known.
+ */
+uint64_t SettingsTracker::GetBoundary(const StreamAnchor& anchor, int64_t rate) const
+{
+	auto& next = m_pending.front();
+	if(!next->m_timed)
+		return 0;
+	if(!anchor.m_valid)
+		return UINT64_MAX;
+	if(next->m_time < anchor.m_time)
+		return 0;
+	return anchor.m_sample + (next->m_time - anchor.m_time).to_ticks(rate);
+}
+
+/**
+	@brief Switches to any pending settings which take effect at or before a sample
+ */
+void SettingsTracker::Advance(uint64_t sample, const StreamAnchor& anchor, int64_t rate)
+{
+	while(!m_pending.empty() && (GetBoundary(anchor, rate) <= sample) )
+	{
+		m_active = m_pending.front();
+		m_pending.pop_front();
+		if(m_active->m_timed)
+			m_lastTimed = m_active;
+	}
+}
+
+/**
+	@brief Receive thread for the data plane
+
+	Waits for the trigger to be armed, then pulls blocks from the radio and pushes them into the ring until it's
+	disarmed again. Never touches the socket.
+ */
+static void RxThread(BlockRing* ring, atomic<bool>* stop)
+{
+#ifdef __linux__
+	pthread_setname_np(pthread_self(), "RxThread");
+#endif
+
+	g_rxSequence = 0;
+
+	while(!g_waveformThreadQuit && !*stop)
+	{
+		g_threadPlacement.Refresh(THREAD_RX);
+
+		//wait if trigger not armed, if the client hasn't told us how much data it wants yet, or if nobody's listening
+		RxConfigPtr settings = g_rxControl.GetConfig();
+		bool listening = (g_subscribers.GetCount() != 0) || g_recorder.IsRecording() || g_history.IsEnabled();
+		if(!g_triggerArmed || (settings->m_blockSize == 0) || !listening)
+		{
+			this_thread::sleep_for(chrono::microseconds(1000));
+			continue;
+		}
 
 		//Snapshot some variables when we armed the trigger
 		bool oneshot = g_triggerOneShot;
+		bool continuous = g_continuousMode;
+		bool scan = g_scanMode;
+		RxStreamConfig config;
+		config.m_format = g_wireFormat.load();
+		config.m_channels = settings->GetEnabledChannels();
+		config.m_settings = settings;
+
+		//Nothing to do if every channel is turned off
+		if(config.m_channels.empty())
+		{
+			this_thread::sleep_for(chrono::microseconds(1000));
+			continue;
+		}
+
+		ScanPlan plan;
+		if(scan)
+		{
+			lock_guard<mutex> lock(g_mutex);
+			plan = g_scanPlan;
+		}
+		if(scan && plan.m_frequencies.empty())
+		{
+			LogError("no scan frequencies set, disarming\n");
+			g_triggerArmed = false;
+			continue;
+		}
+
+		//Scheduled starts only apply to the first acquisition after arming.
+		//Read and clear under the lock so a STARTTIME arriving right now is either used or kept for next time.
+		{
+			lock_guard<mutex> lock(g_mutex);
+			switch(g_startMode)
+			{
+				case START_AT_TIME:
+					config.m_timedStart = true;
+					config.m_startTime = g_startTime;
+					break;
+
+				case START_NEXT_PPS:
+					{
+						//PPS edges are a whole second apart in device time, but not necessarily on whole seconds.
+						//Leave enough time to get the stream command to the radio before the edge.
+						auto now = g_source->GetTimeNow();
+						auto edge = g_source->GetTimeLastPPS() + uhd::time_spec_t(1.0);
+						if(edge < now + uhd::time_spec_t(0.1))
+							edge = edge + uhd::time_spec_t(1.0);
+						config.m_timedStart = true;
+						config.m_startTime = edge;
+					}
+					break;
+
+				case START_NOW:
+				default:
+					break;
+			}
+			g_startMode = START_NOW;
+		}
+		if(config.m_timedStart)
+			LogDebug("stream scheduled to start at %.6f\n", config.m_startTime.get_real_secs());
+
+		LogDebug("trigger armed\n");
+
+		auto ppstring = g_source->GetDescription();
+		LogDebug("%s\n", ppstring.c_str());
 
 		//TODO: check LO lock detect
 
 		//Make the streamer
-		//For now, always get fp32 data out and use int16 over the wire
-		//For now, only one channel is supported
-		uhd::stream_args_t args("fc32", "sc16");
-		vector<size_t> channels;
-		channels.push_back(0);
-		args.channels = channels;
-		uhd::rx_streamer::sptr rx = g_sdr->get_rx_stream(args);
-
-		//TODO: play with STREAM_MODE_START_CONTINUOUS
-		//For now, grab a constant number of samples each "trigger" then stop (so acquisitions may not be gap-free)
-		while(g_triggerArmed)
-		{
-			LogDebug("starting block\n");
-
-			//Snapshot some values for this block
-			size_t blocksize = g_rxBlockSize;
-			int64_t rate = g_rxRate;
-
-			//Make RX buffer
-			vector<complex<float>> buf(blocksize);
-
-			//Start streaming
-			uhd::stream_cmd_t cmd(uhd::stream_cmd_t::STREAM_MODE_NUM_SAMPS_AND_DONE);
-			cmd.num_samps = blocksize;
-			cmd.stream_now = true;
-			cmd.time_spec = uhd::time_spec_t();
-			rx->issue_stream_cmd(cmd);
-
-			//Receive the data
-			uhd::rx_metadata_t meta;
-			size_t nrx = 0;
-			while(true)
-			{
-				size_t rxsize = rx->recv(&buf.front(), buf.size(), meta, 5.0, false);
-				nrx += rxsize;
-				bool err = true;
-
-				switch(meta.error_code)
-				{
-					case uhd::rx_metadata_t::ERROR_CODE_TIMEOUT:
-						LogError("timeout\n");
-						break;
+		//Integer formats are passed straight through from the radio, fc32 is converted by UHD.
+		//All channels go through the same streamer so they stay time aligned.
+		uhd::stream_args_t args(GetFormatName(config.m_format), GetOTWFormatName(config.m_format));
+		args.channels = config.m_channels;
+		unique_ptr<RxStream> stream = g_source->OpenStream(args);
+		RxStream* rx = stream.get();
 
-					case uhd::rx_metadata_t::ERROR_CODE_OVERFLOW:
-						LogError("overflow\n");
-						break;
+		//Scans ignore the trigger, every dwell is sent.
+		//Software triggering needs an unbroken stream to search, whatever the stream mode.
+		//Otherwise, single-shot acquisitions always use block mode since there's nothing to be gap-free with
+		if(scan)
+			RxScanMode(rx, config, plan, *ring, oneshot, *stop);
+		else if(settings->m_triggerMode != TRIGGER_FREERUN)
+			RxTriggeredMode(rx, config, *ring, oneshot, *stop);
+		else if(continuous && !oneshot)
+			RxContinuousMode(rx, config, *ring, *stop);
+		else
+			RxBlockMode(rx, config, *ring, oneshot, *stop);
+	}
+}
 
-					case uhd::rx_metadata_t::ERROR_CODE_NONE:
-						LogDebug("got %zu samples for total of %zu\n", rxsize, nrx);
-						err = false;
-						break;
+/**
+	@brief Hands a completed block to the data plane thread, applying the drop policy if the ring is full
+
+	@return False if the block itself was thrown away
+ */
+static bool PushBlock(BlockRing& ring, RxBlock* block, atomic<bool>& stop)
+{
+	//Number every block, even ones we end up dropping, so the client can see the gap
+	block->m_sequence = g_rxSequence ++;
+
+	//Pick up placement changes made while streaming
+	g_threadPlacement.Refresh(THREAD_RX);
 
-					default:
-						LogDebug("unknown error\n");
+	if(ring.TryPush(block))
+		return true;
+
+	switch(g_dropPolicy)
+	{
+		case BlockRing::DROP_NEWEST:
+			g_blockPool.Release(block);
+			g_droppedWaveforms ++;
+			g_stats.m_droppedWaveforms ++;
+			LogDebug("ring full, dropped newest waveform\n");
+			return false;
+
+		case BlockRing::DROP_OLDEST:
+			do
+			{
+				RxBlock* old = ring.TryPop();
+				if(old && old->m_scanEnd)
+					g_blockPool.Release(old);
+				else if(old)
+				{
+					g_blockPool.Release(old);
+					g_droppedWaveforms ++;
+					g_stats.m_droppedWaveforms ++;
+					LogDebug("ring full, dropped oldest waveform\n");
+				}
+			} while(!ring.TryPush(block));
+			break;
+
+		case BlockRing::DROP_BLOCK:
+		default:
+			while(!ring.TryPush(block))
+			{
+				if(stop || g_waveformThreadQuit)
+				{
+					g_blockPool.Release(block);
+					return false;
 				}
+				this_thread::sleep_for(chrono::microseconds(100));
+			}
+			break;
+	}
+
+	return true;
+}
+
+/**
+	@brief Tells the data plane thread a scan has ended, so it can send a sweep whose last steps were skipped
+
+	The marker is an empty block. It isn't numbered, since it's never sent, and it waits for room in the ring rather
+	than pushing a real waveform out.
+ */
+static void PushScanEnd(BlockRing& ring, atomic<bool>& stop)
+{
+	RxBlock* marker = g_blockPool.Acquire();
+	if(!marker)
+	{
+		LogDebug("no buffer for the end of scan marker\n");
+		return;
+	}
+	marker->m_scanEnd = true;
+
+	while(!ring.TryPush(marker))
+	{
+		if(stop || g_waveformThreadQuit)
+		{
+			g_blockPool.Release(marker);
+			return;
+		}
+		this_thread::sleep_for(chrono::microseconds(100));
+	}
+}
+
+/**
+	@brief Sets up the format and channel list of a block about to be captured
+ */
+static void InitBlock(RxBlock* block, const RxStreamConfig& config)
+{
+	block->m_format = config.m_format;
+	for(auto i : config.m_channels)
+		block->m_channels.push_back(RxBlockChannel(i));
+}
+
+/**
+	@brief Records the radio settings a block was captured with
+ */
+static void StampBlock(RxBlock* block, const RxConfig& settings)
+{
+	for(auto& c : block->m_channels)
+	{
+		auto& chan = settings.m_channels[c.m_index];
+		c.m_centerFrequency = chan.m_centerFrequency;
+		c.m_gain = chan.m_gain;
+		c.m_bandwidth = chan.m_bandwidth;
+	}
+}
+
+/**
+	@brief Points the per-channel recv() buffers at the given sample offset in a block
+ */
+static void GetRecvBuffers(RxBlock* block, size_t offset, vector<void*>& buffs)
+{
+	for(size_t c=0; c<buffs.size(); c++)
+		buffs[c] = block->GetSample(c, offset);
+}
+
+/**
+	@brief Receives samples from the radio, updating the performance counters
+
+	Same arguments and return value as RxStream::Receive().
+ */
+static size_t ReceiveSamples(
+	RxStream* rx, vector<void*>& buffs, size_t nsamps, uhd::rx_metadata_t& meta, double timeout)
+{
+	auto start = chrono::steady_clock::now();
+	size_t rxsize = rx->Receive(buffs, nsamps, meta, timeout);
+	g_stats.m_recvTime.Record(chrono::duration<double>(chrono::steady_clock::now() - start).count());
+	g_stats.m_samplesReceived += rxsize;
+
+	switch(meta.error_code)
+	{
+		case uhd::rx_metadata_t::ERROR_CODE_NONE:
+			break;
+
+		case uhd::rx_metadata_t::ERROR_CODE_TIMEOUT:
+			g_stats.m_timeouts ++;
+			break;
+
+		case uhd::rx_metadata_t::ERROR_CODE_OVERFLOW:
+			g_stats.m_overflows ++;
+			break;
+
+		default:
+			g_stats.m_recvErrors ++;
+			break;
+	}
+
+	return rxsize;
+}
+
+/**
+	@brief Sends a stream command, starting it slightly in the future if there's more than one channel
+
+	Multi-channel streams need a timed start so that all channels begin on exactly the same sample. The first command
+	after arming uses the scheduled start time instead, if there is one.
+ */
+static void IssueStreamCommand(RxStream* rx, uhd::stream_cmd_t& cmd, const RxStreamConfig& config, bool first)
+{
+	if(first && config.m_timedStart)
+	{
+		cmd.stream_now = false;
+		cmd.time_spec = config.m_startTime;
+	}
+	else if(config.m_channels.size() > 1)
+	{
+		cmd.stream_now = false;
+		cmd.time_spec = g_source->GetTimeNow() + uhd::time_spec_t(0.05);
+	}
+	else
+	{
+		cmd.stream_now = true;
+		cmd.time_spec = uhd::time_spec_t();
+	}
+	rx->IssueStreamCommand(cmd);
+}
 
-				if(nrx >= blocksize)
+/**
+	@brief Returns the recv() timeout to use for the first packet of a stream, allowing for any scheduled start
+ */
+static double GetStartTimeout(const RxStreamConfig& config)
+{
+	double timeout = 5.0;
+	if(config.m_timedStart)
+		timeout += max(0.0, (config.m_startTime - g_source->GetTimeNow()).get_real_secs());
+	return timeout;
+}
+
+/**
+	@brief Grabs a constant number of samples each "trigger" then stops (so acquisitions are not gap-free)
+
+	Runs until the trigger is disarmed.
+ */
+static void RxBlockMode(
+	RxStream* rx, const RxStreamConfig& config, BlockRing& ring, bool oneshot, atomic<bool>& stop)
+{
+	vector<void*> buffs(config.m_channels.size());
+	bool first = true;
+
+	//Device time of the first sample of the first block
+	bool haveOrigin = false;
+	uhd::time_spec_t origin;
+
+	while(g_triggerArmed && !g_waveformThreadQuit && !stop)
+	{
+		LogDebug("starting block\n");
+
+		//Every block is a separate burst, so there's no sample to line changes up with. Just use the latest settings.
+		RxConfigPtr settings = g_rxControl.GetConfig();
+		if(settings->IsRestartNeeded(*config.m_settings))
+		{
+			LogDebug("stream settings changed, restarting stream\n");
+			return;
+		}
+
+		//Grab a buffer to receive into
+		RxBlock* block = g_blockPool.Acquire();
+		if(!block)
+			return;
+
+		//Snapshot some values for this block
+		InitBlock(block, config);
+		size_t blocksize = min(settings->m_blockSize, block->GetSampleCapacity());
+		int64_t rate = settings->m_rate;
+		block->m_rate = rate;
+		block->m_requested = blocksize;
+		block->m_stride = blocksize;
+		block->m_discontinuity = true;
+		StampBlock(block, *settings);
+
+		//Start streaming
+		uhd::stream_cmd_t cmd(uhd::stream_cmd_t::STREAM_MODE_NUM_SAMPS_AND_DONE);
+		cmd.num_samps = blocksize;
+		IssueStreamCommand(rx, cmd, config, first);
+		double timeout = first ? GetStartTimeout(config) : 5.0;
+		first = false;
+
+		//Receive the data
+		uhd::rx_metadata_t meta;
+		size_t nrx = 0;
+		bool late = false;
+		while(nrx < blocksize)
+		{
+			GetRecvBuffers(block, nrx, buffs);
+			size_t rxsize = ReceiveSamples(rx, buffs, blocksize - nrx, meta, timeout);
+			if( (nrx == 0) && (rxsize > 0) )
+			{
+				block->m_startTime = meta.time_spec;
+				block->m_timeValid = meta.has_time_spec;
+			}
+			nrx += rxsize;
+			bool err = true;
+
+			switch(meta.error_code)
+			{
+				case uhd::rx_metadata_t::ERROR_CODE_TIMEOUT:
+					LogError("timeout\n");
 					break;
 
-				if(err)
+				case uhd::rx_metadata_t::ERROR_CODE_OVERFLOW:
+					LogError("overflow\n");
+					block->m_overflow = true;
 					break;
+
+				case uhd::rx_metadata_t::ERROR_CODE_NONE:
+					LogDebug("got %zu samples for total of %zu\n", rxsize, nrx);
+					err = false;
+					break;
+
+				case uhd::rx_metadata_t::ERROR_CODE_LATE_COMMAND:
+					LogError("scheduled start time had already passed, disarming\n");
+					late = true;
+					break;
+
+				default:
+					LogDebug("unknown error\n");
 			}
-			LogDebug("recv done, got %zu of %zu requested samples\n", nrx, blocksize);
 
-			//if we got too many samples, truncate
-			if(nrx > blocksize)
-				nrx = blocksize;
+			if(err)
+				break;
+		}
+		if(late)
+		{
+			g_blockPool.Release(block);
+			g_triggerArmed = false;
+			return;
+		}
+		LogDebug("recv done, got %zu of %zu requested samples\n", nrx, blocksize);
+		block->m_length = nrx;
+		if(nrx < blocksize)
+			g_stats.m_shortBlocks ++;
+
+		//Number samples from the start of the first block, so the client can tell exactly how far apart blocks are
+		if(block->m_timeValid)
+		{
+			if(!haveOrigin)
+			{
+				origin = block->m_startTime;
+				haveOrigin = true;
+			}
+			block->m_firstSample = (block->m_startTime - origin).to_ticks(rate);
+		}
+
+		//Hand it off to the data plane thread
+		PushBlock(ring, block, stop);
+
+		//If one shot, stop
+		if(oneshot)
+		{
+			g_triggerArmed = false;
+			break;
+		}
+	}
+}
+
+/**
+	@brief Streams continuously, slicing the sample stream into back-to-back blocks
 
-			//Send the data out to the client
-			//Just the waveform size then the sample data
-			uint64_t len = nrx;
-			if(!client.SendLooped((uint8_t*)&len, sizeof(len)))
+	Keeps one long-lived stream running and chops it up into blocks of up to g_rxBlockSize samples. Timestamps are
+	extrapolated from the first packet so that consecutive blocks are exactly contiguous; after an overflow the partial
+	block is thrown away, the timestamp reference is re-acquired, and the next block is flagged as discontinuous. The
+	same flag is set on the block following one that was dropped because the ring was full.
+
+	Tuning changes from the control plane take effect at the start of the next block. Timed changes end the block in
+	progress early, on the sample before the change, so the next block starts exactly where the radio retuned.
+
+	Every sample received is also copied into g_history, if enabled.
+
+	Runs until the trigger is disarmed, or until the settings change in a way that needs a new stream.
+ */
+static void RxContinuousMode(
+	RxStream* rx, const RxStreamConfig& config, BlockRing& ring, atomic<bool>& stop)
+{
+	//Block size and rate are fixed for the life of the stream since any change would break continuity anyway
+	SettingsTracker settings(config.m_settings);
+	size_t nchans = config.m_channels.size();
+	size_t bytesPerSample = GetBytesPerSample(config.m_format);
+	size_t blocksize = min(config.m_settings->m_blockSize, g_blockPool.GetBufferSize() / (bytesPerSample * nchans));
+	int64_t rate = config.m_settings->m_rate;
+	LogDebug("starting continuous stream (%zu samples x %zu channels per block)\n", blocksize, nchans);
+
+	g_history.BeginStream(config.m_format, rate, config.m_channels);
+
+	uhd::stream_cmd_t cmd(uhd::stream_cmd_t::STREAM_MODE_START_CONTINUOUS);
+	IssueStreamCommand(rx, cmd, config, true);
+
+	StreamAnchor anchor;
+	uint64_t nextSample = 0;
+	bool discontinuity = false;
+	RxBlock* block = nullptr;
+	vector<void*> buffs(nchans);
+
+	//First packet can take a while to show up, after that they should be back to back
+	double timeout = GetStartTimeout(config);
+
+	while(g_triggerArmed && !g_waveformThreadQuit && !stop)
+	{
+		if(!settings.Poll())
+			break;
+
+		if(!block)
+		{
+			block = g_blockPool.Acquire();
+			if(!block)
 				break;
-			if(!client.SendLooped((uint8_t*)&rate, sizeof(len)))
+			InitBlock(block, config);
+
+			//Buffer size changed under us, can't keep going with the same block size
+			if(block->GetSampleCapacity() < blocksize)
+			{
+				LogWarning("sample depth changed during continuous streaming, stopping\n");
 				break;
-			if(!client.SendLooped((uint8_t*)&buf[0], nrx * sizeof(complex<float>)))
+			}
+
+			block->m_rate = rate;
+			block->m_requested = blocksize;
+			block->m_stride = blocksize;
+			block->m_firstSample = nextSample;
+			block->m_discontinuity = discontinuity;
+			discontinuity = false;
+		}
+
+		//Settings change at the start of a block, and end it early if a timed change lands in the middle
+		if(block->m_length == 0)
+			settings.Advance(block->m_firstSample, anchor, rate);
+		size_t end = blocksize;
+		if(!settings.m_pending.empty())
+		{
+			uint64_t boundary = settings.GetBoundary(anchor, rate);
+			uint64_t pos = block->m_firstSample + block->m_length;
+			if( (boundary > pos) && (boundary < block->m_firstSample + blocksize) )
+				end = boundary - block->m_firstSample;
+		}
+
+		uhd::rx_metadata_t meta;
+		GetRecvBuffers(block, block->m_length, buffs);
+		size_t rxsize = ReceiveSamples(rx, buffs, end - block->m_length, meta, timeout);
+		timeout = 0.5;
+
+		switch(meta.error_code)
+		{
+			case uhd::rx_metadata_t::ERROR_CODE_NONE:
 				break;
 
-			//If one shot, stop
-			if(oneshot)
+			case uhd::rx_metadata_t::ERROR_CODE_TIMEOUT:
+				LogError("timeout\n");
+				continue;
+
+			case uhd::rx_metadata_t::ERROR_CODE_OVERFLOW:
+				LogError("overflow\n");
+
+				//Samples were dropped, so the partial block is no longer contiguous. Start it over.
+				g_history.Break();
+				block->m_length = 0;
+				block->m_discontinuity = true;
+				block->m_overflow = true;
+				anchor.m_valid = false;
+				continue;
+
+			case uhd::rx_metadata_t::ERROR_CODE_LATE_COMMAND:
+				LogError("scheduled start time had already passed, disarming\n");
+				g_triggerArmed = false;
+				continue;
+
+			default:
+				LogError("recv error: %s\n", meta.strerror().c_str());
+				continue;
+		}
+
+		if( (rxsize > 0) && !anchor.m_valid && meta.has_time_spec)
+		{
+			anchor.m_sample = block->m_firstSample + block->m_length;
+			anchor.m_time = meta.time_spec;
+			anchor.m_valid = true;
+		}
+
+		g_history.Append(buffs, rxsize, meta.time_spec, meta.has_time_spec, *settings.m_active);
+		block->m_length += rxsize;
+		if(block->m_length < end)
+			continue;
+
+		//Block is full, timestamp it and hand it off
+		block->m_requested = end;
+		block->m_startTime = anchor.GetTime(block->m_firstSample, rate);
+		block->m_timeValid = anchor.m_valid;
+		StampBlock(block, *settings.m_active);
+		if(block->m_discontinuity)
+			LogDebug("block at sample %zu is discontinuous\n", (size_t)block->m_firstSample);
+		nextSample += end;
+		discontinuity = !PushBlock(ring, block, stop);
+		block = nullptr;
+	}
+	g_blockPool.Release(block);
+
+	StopContinuousStream(rx, config);
+	LogDebug("continuous stream stopped\n");
+}
+
+/**
+	@brief Shuts down a continuous stream and flushes anything still in flight
+ */
+static void StopContinuousStream(RxStream* rx, const RxStreamConfig& config)
+{
+	rx->IssueStreamCommand(uhd::stream_cmd_t(uhd::stream_cmd_t::STREAM_MODE_STOP_CONTINUOUS));
+
+	size_t nchans = config.m_channels.size();
+	size_t bytesPerSample = GetBytesPerSample(config.m_format);
+	size_t scratchSamples = rx->GetMaxPacketSize();
+	vector<uint8_t> scratch(scratchSamples * bytesPerSample * nchans);
+	vector<void*> buffs(nchans);
+	for(size_t c=0; c<nchans; c++)
+		buffs[c] = &scratch[c * scratchSamples * bytesPerSample];
+	uhd::rx_metadata_t meta;
+	while(rx->Receive(buffs, scratchSamples, meta, 0.1) != 0)
+	{}
+}
+
+/**
+	@brief Steps through the frequencies of a scan on a single continuous stream, sending one block per step
+
+	Retunes are timed commands queued through g_rxControl, scheduled up to g_scanLookahead ahead of the samples being
+	received, so the radio retunes while earlier steps are still being captured instead of the stream stopping and
+	starting for each one. Each step is placed on the sample timeline by its device time: the settling samples after
+	the retune are thrown away, then the next sample depth samples become the block, stamped with the settings
+	snapshot the retune published.
+
+	A step is skipped (and counted in BridgeStats::m_scanSkipped) if its retune reached the radio late, or samples
+	were lost during it. If the control worker can't keep up, later steps are pushed back rather than skipped.
+
+	Runs until the trigger is disarmed, until one sweep has been captured in one-shot mode, or until the settings
+	change in a way that needs a new stream.
+ */
+static void RxScanMode(
+	RxStream* rx, const RxStreamConfig& config, const ScanPlan& plan, BlockRing& ring, bool oneshot,
+	atomic<bool>& stop)
+{
+	SettingsTracker settings(config.m_settings);
+	size_t nchans = config.m_channels.size();
+	size_t bytesPerSample = GetBytesPerSample(config.m_format);
+	size_t dwell = min(config.m_settings->m_blockSize, g_blockPool.GetBufferSize() / (bytesPerSample * nchans));
+	int64_t rate = config.m_settings->m_rate;
+	size_t settle = plan.GetSettleSamples(rate);
+	size_t nsteps = plan.m_frequencies.size();
+	auto period = uhd::time_spec_t::from_ticks(settle + dwell, rate);
+	LogDebug("starting scan of %zu frequencies (%zu settling + %zu samples per step)\n", nsteps, settle, dwell);
+
+	//Samples outside of a dwell go here and are thrown away
+	size_t scratchSamples = rx->GetMaxPacketSize();
+	vector<uint8_t> scratch(scratchSamples * bytesPerSample * nchans);
+	vector<void*> scratchBuffs(nchans);
+	for(size_t c=0; c<nchans; c++)
+		scratchBuffs[c] = &scratch[c * scratchSamples * bytesPerSample];
+
+	uhd::stream_cmd_t cmd(uhd::stream_cmd_t::STREAM_MODE_START_CONTINUOUS);
+	IssueStreamCommand(rx, cmd, config, true);
+
+	StreamAnchor anchor;
+	uint64_t pos = 0;
+	deque<ScanHop> hops;
+	size_t nextStep = 0;
+	bool scheduledAll = false;
+	bool haveLast = false;
+	uhd::time_spec_t lastTime;
+	RxBlock* block = nullptr;
+	vector<void*> buffs(nchans);
+
+	//First packet can take a while to show up, after that they should be back to back
+	double timeout = GetStartTimeout(config);
+
+	while(g_triggerArmed && !g_waveformThreadQuit && !stop)
+	{
+		if(!settings.Poll())
+			break;
+
+		//Single-shot scan is over once every step has been either sent or skipped
+		if(scheduledAll && hops.empty())
+		{
+			LogDebug("scan complete\n");
+			g_triggerArmed = false;
+			break;
+		}
+
+		//Keep the retunes scheduled up to the lookahead. Nothing can be scheduled until the stream has a timestamp.
+		if(anchor.m_valid)
+		{
+			auto now = anchor.GetTime(pos, rate);
+			auto horizon = now + uhd::time_spec_t(g_scanLookahead);
+			while(!scheduledAll && (hops.size() < g_scanMaxInFlight) )
 			{
+				auto time = now + uhd::time_spec_t(g_scanMinLead);
+				if(haveLast && (time < lastTime + period) )
+					time = lastTime + period;
+				if(horizon < time)
+					break;
+
+				vector<RxCommand> commands;
+				for(auto i : config.m_channels)
+					commands.push_back(RxCommand(RxCommand::SET_FREQUENCY, i, plan.m_frequencies[nextStep]));
+				g_rxControl.Submit(commands, time);
+				hops.push_back(ScanHop(nextStep, time));
+				haveLast = true;
+				lastTime = time;
+
+				nextStep ++;
+				if(nextStep == nsteps)
+				{
+					nextStep = 0;
+					scheduledAll = oneshot;
+				}
+			}
+		}
+
+		//Work out whether the next samples belong to a dwell or get thrown away
+		bool capture = false;
+		size_t want = scratchSamples;
+		if(anchor.m_valid && !hops.empty())
+		{
+			auto& hop = hops.front();
+			bool missed = (hop.m_time < anchor.m_time);
+			uint64_t dwellStart = 0;
+			if(!missed)
+			{
+				dwellStart = anchor.m_sample + (hop.m_time - anchor.m_time).to_ticks(rate) + settle;
+				missed = !block && (pos > dwellStart);
+			}
+
+			//Lost samples at the start of the dwell, or before the stream was re-anchored after an overflow
+			if(missed)
+			{
+				LogDebug("missed the start of scan step %zu, skipping it\n", hop.m_step);
+				g_stats.m_scanSkipped ++;
+				hops.pop_front();
+				continue;
+			}
+
+			if(pos < dwellStart)
+				want = min<uint64_t>(want, dwellStart - pos);
+			else
+			{
+				if(!block)
+				{
+					block = g_blockPool.Acquire();
+					if(!block)
+						break;
+					InitBlock(block, config);
+
+					//Buffer size changed under us, can't keep going with the same block size
+					if(block->GetSampleCapacity() < dwell)
+					{
+						LogWarning("sample depth changed during scan, stopping\n");
+						break;
+					}
+
+					block->m_rate = rate;
+					block->m_requested = dwell;
+					block->m_stride = dwell;
+					block->m_firstSample = pos;
+					block->m_startTime = anchor.GetTime(pos, rate);
+					block->m_timeValid = true;
+					block->m_discontinuity = true;
+					block->m_scanStep = hop.m_step;
+					block->m_scanSteps = nsteps;
+				}
+				capture = true;
+				want = dwell - block->m_length;
+			}
+		}
+
+		uhd::rx_metadata_t meta;
+		if(capture)
+			GetRecvBuffers(block, block->m_length, buffs);
+		size_t rxsize = ReceiveSamples(rx, capture ? buffs : scratchBuffs, want, meta, timeout);
+		timeout = 0.5;
+
+		switch(meta.error_code)
+		{
+			case uhd::rx_metadata_t::ERROR_CODE_NONE:
+				break;
+
+			case uhd::rx_metadata_t::ERROR_CODE_TIMEOUT:
+				LogError("timeout\n");
+				continue;
+
+			case uhd::rx_metadata_t::ERROR_CODE_OVERFLOW:
+				LogError("overflow\n");
+
+				//Samples were dropped, so the dwell in progress is ruined and the timeline has to be re-anchored
+				if(block)
+				{
+					g_blockPool.Release(block);
+					block = nullptr;
+					g_stats.m_scanSkipped ++;
+					hops.pop_front();
+				}
+				anchor.m_valid = false;
+				continue;
+
+			case uhd::rx_metadata_t::ERROR_CODE_LATE_COMMAND:
+				LogError("scheduled start time had already passed, disarming\n");
+				g_triggerArmed = false;
+				continue;
+
+			default:
+				LogError("recv error: %s\n", meta.strerror().c_str());
+				continue;
+		}
+
+		if( (rxsize > 0) && !anchor.m_valid && meta.has_time_spec)
+		{
+			anchor.m_sample = pos;
+			anchor.m_time = meta.time_spec;
+			anchor.m_valid = true;
+		}
+		pos += rxsize;
+
+		if(!capture)
+			continue;
+		block->m_length += rxsize;
+		if(block->m_length < dwell)
+			continue;
+
+		//Dwell is complete. Only send it if the retune for this step actually landed on time.
+		//Stamp it with the retune's own snapshot since an untimed change since may already carry the next frequency.
+		auto hop = hops.front();
+		hops.pop_front();
+		settings.Advance(block->m_firstSample, anchor, rate);
+		auto tuned = settings.m_lastTimed;
+		if(!tuned || !(tuned->m_time == hop.m_time) || tuned->m_late)
+		{
+			LogDebug("retune for scan step %zu was late, skipping it\n", hop.m_step);
+			g_blockPool.Release(block);
+			g_stats.m_scanSkipped ++;
+		}
+		else
+		{
+			StampBlock(block, *tuned);
+			g_stats.m_scanDwells ++;
+			PushBlock(ring, block, stop);
+		}
+		block = nullptr;
+	}
+	g_blockPool.Release(block);
+
+	StopContinuousStream(rx, config);
+	PushScanEnd(ring, stop);
+	LogDebug("scan stopped\n");
+}
+
+/**
+	@brief Returns the number of samples before the trigger point in each block
+
+	Trigger delay is the time from the start of the waveform to the trigger point.
+ */
+static size_t GetPretriggerSamples(const RxConfig& settings, size_t blocksize)
+{
+	return min(blocksize, (size_t)(settings.m_triggerDelay * 1e-15 * settings.m_rate));
+}
+
+/**
+	@brief Sets up the software trigger from a settings snapshot, keeping the mode the stream was started with
+
+	@return Index of the trigger source channel in the stream
+ */
+static size_t ConfigureTrigger(EdgeTrigger& trigger, const RxStreamConfig& config, const RxConfig& settings)
+{
+	trigger.Configure(
+		config.m_settings->m_triggerMode,
+		settings.m_triggerEdge,
+		settings.m_triggerLevel,
+		settings.m_triggerHysteresis,
+		config.m_format);
+
+	//Find the trigger channel in the stream
+	for(size_t c=0; c<config.m_channels.size(); c++)
+	{
+		if(config.m_channels[c] == settings.m_triggerChannel)
+			return c;
+	}
+	LogWarning("trigger source channel %zu is not enabled, triggering on channel %zu instead\n",
+		settings.m_triggerChannel + 1, config.m_channels[0] + 1);
+	return 0;
+}
+
+/**
+	@brief Streams continuously, running the software trigger over the samples and only keeping blocks that trigger
+
+	Samples are received straight into a SampleHistory deep enough for the pre-trigger part of a block (the trigger
+	delay) plus a couple of recv() calls worth of new data. When the trigger fires, the pre-trigger samples are copied
+	out of the history into a pooled block and the rest of the block is filled in as more samples arrive. Searching
+	resumes after the end of the block, so blocks never overlap. An overflow throws away any partial block and starts
+	searching again from scratch.
+
+	Every sample received is also copied into g_history, if enabled, whether or not it ends up in a block.
+
+	Tuning changes from the control plane apply from the next recv(), or for timed changes from exactly the sample they
+	landed on. Blocks are stamped with the settings in effect when they trigger. Changes to the trigger level, edge,
+	hysteresis and source apply the same way, and re-arm the trigger; a change to the trigger delay restarts the stream,
+	since the history has to be resized. The trigger mode stays as it was when the trigger was armed.
+
+	Runs until the trigger is disarmed, until one block has been captured in one-shot mode, or until the settings change
+	in a way that needs a new stream.
+ */
+static void RxTriggeredMode(
+	RxStream* rx, const RxStreamConfig& config, BlockRing& ring, bool oneshot, atomic<bool>& stop)
+{
+	SettingsTracker settings(config.m_settings);
+	size_t nchans = config.m_channels.size();
+	size_t bytesPerSample = GetBytesPerSample(config.m_format);
+	size_t blocksize = min(config.m_settings->m_blockSize, g_blockPool.GetBufferSize() / (bytesPerSample * nchans));
+	int64_t rate = config.m_settings->m_rate;
+
+	size_t pretrigger = GetPretriggerSamples(*config.m_settings, blocksize);
+
+	EdgeTrigger trigger;
+	size_t trigchan = ConfigureTrigger(trigger, config, *config.m_settings);
+	RxConfigPtr triggerSettings = config.m_settings;
+
+	size_t chunk = rx->GetMaxPacketSize();
+	g_triggerHistory.Reset(nchans, pretrigger + 2*chunk, bytesPerSample);
+
+	LogDebug("starting triggered stream (%zu samples x %zu channels per block, %zu pre-trigger)\n",
+		blocksize, nchans, pretrigger);
+
+	g_history.BeginStream(config.m_format, rate, config.m_channels);
+
+	uhd::stream_cmd_t cmd(uhd::stream_cmd_t::STREAM_MODE_START_CONTINUOUS);
+	IssueStreamCommand(rx, cmd, config, true);
+
+	StreamAnchor anchor;
+
+	//Index of the first sample not yet searched for a trigger
+	uint64_t searchFrom = 0;
+
+	bool discontinuity = false;
+	bool done = false;
+	RxBlock* block = nullptr;
+	vector<void*> buffs(nchans);
+	double timeout = GetStartTimeout(config);
+
+	while(g_triggerArmed && !g_waveformThreadQuit && !stop && !done)
+	{
+		if(!settings.Poll())
+			break;
+
+		//Switch settings if a change lands here, and stop short of the next one if it's timed
+		uint64_t pos = g_triggerHistory.GetEnd();
+		settings.Advance(pos, anchor, rate);
+		size_t want = g_triggerHistory.GetWriteSpace(chunk);
+
+		//Re-arm the trigger if its settings changed with them
+		if(settings.m_active->IsTriggerChanged(*triggerSettings))
+		{
+			if(GetPretriggerSamples(*settings.m_active, blocksize) != pretrigger)
+			{
+				LogDebug("trigger delay changed, restarting stream\n");
+				break;
+			}
+			trigchan = ConfigureTrigger(trigger, config, *settings.m_active);
+			triggerSettings = settings.m_active;
+		}
+		if(!settings.m_pending.empty())
+		{
+			uint64_t boundary = settings.GetBoundary(anchor, rate);
+			if( (boundary > pos) && (boundary < pos + want) )
+				want = boundary - pos;
+		}
+
+		//Receive into the history, never wrapping within one recv() so the new samples are contiguous
+		for(size_t c=0; c<nchans; c++)
+			buffs[c] = g_triggerHistory.GetWritePointer(c);
+		uhd::rx_metadata_t meta;
+		size_t rxsize = ReceiveSamples(rx, buffs, want, meta, timeout);
+		timeout = 0.5;
+
+		switch(meta.error_code)
+		{
+			case uhd::rx_metadata_t::ERROR_CODE_NONE:
+				break;
+
+			case uhd::rx_metadata_t::ERROR_CODE_TIMEOUT:
+				LogError("timeout\n");
+				continue;
+
+			case uhd::rx_metadata_t::ERROR_CODE_OVERFLOW:
+				LogError("overflow\n");
+
+				//History is no longer contiguous, forget it and start searching again
+				g_history.Break();
+				g_blockPool.Release(block);
+				block = nullptr;
+				g_triggerHistory.Invalidate();
+				searchFrom = g_triggerHistory.GetEnd();
+				trigger.Reset();
+				anchor.m_valid = false;
+				discontinuity = true;
+				continue;
+
+			case uhd::rx_metadata_t::ERROR_CODE_LATE_COMMAND:
+				LogError("scheduled start time had already passed, disarming\n");
 				g_triggerArmed = false;
+				continue;
+
+			default:
+				LogError("recv error: %s\n", meta.strerror().c_str());
+				continue;
+		}
+
+		if( (rxsize > 0) && !anchor.m_valid && meta.has_time_spec)
+		{
+			anchor.m_sample = g_triggerHistory.GetEnd();
+			anchor.m_time = meta.time_spec;
+			anchor.m_valid = true;
+		}
+		g_history.Append(buffs, rxsize, meta.time_spec, meta.has_time_spec, *settings.m_active);
+		g_triggerHistory.Commit(rxsize);
+		uint64_t end = g_triggerHistory.GetEnd();
+
+		while(true)
+		{
+			//Copy whatever we have of the block being captured
+			if(block)
+			{
+				uint64_t next = block->m_firstSample + block->m_length;
+				size_t count = min(end, block->m_firstSample + blocksize) - next;
+				for(size_t c=0; c<nchans; c++)
+					g_triggerHistory.CopyOut(c, next, count, block->GetSample(c, block->m_length));
+				block->m_length += count;
+				if(block->m_length < blocksize)
+					break;
+
+				//Block is full, timestamp it and hand it off
+				block->m_startTime = anchor.GetTime(block->m_firstSample, rate);
+				block->m_timeValid = anchor.m_valid;
+				LogDebug("trigger at sample %zu\n", (size_t)(block->m_firstSample + block->m_triggerOffset));
+				PushBlock(ring, block, stop);
+				block = nullptr;
+
+				if(oneshot)
+				{
+					g_triggerArmed = false;
+					done = true;
+					break;
+				}
+			}
+
+			//Look for the next trigger in the unsearched part of the last recv()
+			if(searchFrom >= end)
 				break;
+			uint64_t trig;
+			if(g_forceTrigger.exchange(false))
+				trig = searchFrom;
+			else
+			{
+				size_t hit = trigger.Search(g_triggerHistory.GetSample(trigchan, searchFrom), end - searchFrom);
+				if(hit == EdgeTrigger::NO_TRIGGER)
+				{
+					searchFrom = end;
+					break;
+				}
+				trig = searchFrom + hit;
 			}
+
+			//Start a new block, with as much of the pre-trigger history as we have
+			block = g_blockPool.Acquire();
+			if(!block)
+			{
+				done = true;
+				break;
+			}
+			InitBlock(block, config);
+			if(block->GetSampleCapacity() < blocksize)
+			{
+				LogWarning("sample depth changed during triggered streaming, stopping\n");
+				done = true;
+				break;
+			}
+
+			uint64_t first = (trig > pretrigger) ? (trig - pretrigger) : 0;
+			first = max(first, g_triggerHistory.GetStart());
+			block->m_rate = rate;
+			block->m_requested = blocksize;
+			block->m_stride = blocksize;
+			block->m_firstSample = first;
+			block->m_discontinuity = discontinuity;
+			block->m_overflow = discontinuity;
+			block->m_triggered = true;
+			block->m_triggerOffset = trig - first;
+			discontinuity = false;
+			StampBlock(block, *settings.m_active);
+
+			//Don't look for another trigger until this block is done
+			searchFrom = first + blocksize;
+			trigger.Reset();
 		}
 	}
+	g_blockPool.Release(block);
 
-	LogDebug("Client disconnected from data plane socket\n");
-
-	//Clean up
+	StopContinuousStream(rx, config);
+	LogDebug("triggered stream stopped\n");
 }
@@ -35,14 +35,92 @@
 
 #include "uhdbridge.h"
 #include "UHDSCPIServer.h"
+#include "RxBlockPool.h"
+#include "MagnitudeKernels.h"
+#include "RxSource.h"
+#include "SigMFRecorder.h"
+#include "DeviceCaps.h"
+#include "SampleRatePlan.h"
+#include "RxConfig.h"
+#include "CpuPlacement.h"
 #include <signal.h>
+#include <string.h>
+#include <chrono>
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
 
 using namespace std;
 
+/**
+	@brief Everything needed to serve one radio
+ */
+class DeviceConfig
+{
+public:
+	DeviceConfig()
+		: m_subdev("A:A")
+		, m_antenna("TX/RX")
+		, m_scpiPort(0)
+		, m_waveformPort(0)
+		, m_metricsPort(0)
+		, m_numaNode(-1)
+		, m_rtPriority(0)
+	{}
+
+	///@brief UHD device argument string, or "sim..."
+	string m_devpath;
+
+	///@brief RX subdevice specification
+	string m_subdev;
+
+	///@brief RX antenna for every channel
+	string m_antenna;
+
+	///@brief Control plane port (0 if not given, to be filled in from the defaults)
+	uint16_t m_scpiPort;
+
+	///@brief Data plane port (0 if not given)
+	uint16_t m_waveformPort;
+
+	///@brief Prometheus metrics port (0 if not given, or off)
+	uint16_t m_metricsPort;
+
+	///@brief Cores to run on, or empty for any
+	CpuList m_cpus;
+
+	///@brief NUMA node to allocate memory on (and run on, if m_cpus is empty), or -1 for any
+	int m_numaNode;
+
+	///@brief Cores for each data path thread role, or empty to run anywhere the process may
+	CpuList m_threadCpus[THREAD_ROLE_COUNT];
+
+	///@brief SCHED_FIFO priority of the receive thread, or 0 for normal scheduling
+	int m_rtPriority;
+
+	///@brief Network interface the radio is on, to allocate sample buffers next to, or empty for any node
+	string m_nic;
+};
+
 vector<string> explode(const string& str, char separator);
 string Trim(const string& str);
 
 void help();
+int RunBridge(const DeviceConfig& config);
+void ReportPlacement();
+void Shutdown();
+#ifndef _WIN32
+int RunLauncher(const vector<DeviceConfig>& devices, uint16_t metricsPort);
+pid_t StartWorker(const vector<DeviceConfig>& devices, size_t i);
+void PartitionCpus(vector<DeviceConfig>& devices);
+void ReopenSocket(Socket& sock);
+#endif
 
 void help()
 {
@@ -53,10 +131,43 @@ void help()
 			"    --device \"devstring\"        : Connects to UHD device with the specified device argument string.\n"
 			"                                    For IP connected SDRs use \"addr=hostname_or_ip\".\n"
 			"                                    See Ettus UHD documentation for full details on supported device strings.\n"
-			"  [general options]:\n"
-			"    --help                        : this message...\n"
+			"                                    Use \"sim\" or \"sim:key=value,...\" for a simulated radio\n"
+			"                                    (see SimRxSource.h for options).\n"
+			"    --subdev \"spec\"            : RX subdevice specification (default \"A:A\").\n"
+			"                                    Use e.g. \"A:A A:B\" on a B210 to enable both RX channels.\n"
+			"    --antenna name                : RX antenna to use on all channels (default TX/RX)\n"
 			"    --scpi-port port              : specifies the SCPI control plane port (default 5025)\n"
 			"    --waveform-port port          : specifies the binary waveform data port (default 5026)\n"
+			"    --metrics-port port           : serve Prometheus metrics over HTTP on this port (default off)\n"
+			"    --cpus list                   : run on these cores only, e.g. \"0-3,8\" (default any)\n"
+			"    --numa-node node              : allocate memory on this NUMA node, and run on its cores if\n"
+			"                                    --cpus isn't given (default any)\n"
+			"    --rx-cpus list                : run the receive thread on these cores\n"
+			"    --proc-cpus list              : run the data plane (processing) thread on these cores. FFT and DDC\n"
+			"                                    helper threads run at normal priority, anywhere the process may\n"
+			"    --send-cpus list              : run the data plane send threads on these cores\n"
+			"    --rt-priority prio            : run the receive thread at this SCHED_FIFO priority (1-99), and the\n"
+			"                                    processing and send threads one below it (default 0, not real-time)\n"
+			"    --nic interface               : allocate sample buffers on the NUMA node of this network interface\n"
+			"\n"
+			"    --device may be given more than once to launch a separate bridge process for each of several\n"
+			"    radios from one command. Device options before the first --device apply to every device, those\n"
+			"    after a --device to that device only. Device n (counting from 0) defaults to ports 5025+2n and\n"
+			"    5026+2n, or the given ports plus 2n. With --metrics-port, the metrics of every device are served\n"
+			"    together on that port, labeled by device, and device n's own are on the port plus 1+n. Devices\n"
+			"    which would run on the same cores (because none were given, or the same --cpus or --numa-node) get\n"
+			"    an equal share of them each. A device's process is restarted if it dies, unless it does so within\n"
+			"    10 seconds of starting (e.g. the radio couldn't be opened). The command exits non-zero if any\n"
+			"    device is given up on.\n"
+			"\n"
+			"  [general options]:\n"
+			"    --help                        : this message...\n"
+			"    --hugepages                   : back sample buffers with huge pages if available\n"
+			"    --mlock                       : lock sample buffers into RAM\n"
+			"    --zerocopy                    : send waveform data with MSG_ZEROCOPY (Linux only)\n"
+			"    --record-dir dir              : directory SCPI clients may write recordings and history files in.\n"
+			"                                    File names they give are relative to it. Without it, they can't\n"
+			"                                    write files.\n"
 			"\n"
 			"  [logger options]:\n"
 			"    levels: ERROR, WARNING, NOTICE, VERBOSE, DEBUG\n"
@@ -76,6 +187,7 @@ string g_serial;
 
 Socket g_scpiSocket(AF_INET6, SOCK_STREAM, IPPROTO_TCP);
 Socket g_dataSocket(AF_INET6, SOCK_STREAM, IPPROTO_TCP);
+Socket g_metricsSocket(AF_INET6, SOCK_STREAM, IPPROTO_TCP);
 
 #ifdef _WIN32
 BOOL WINAPI OnQuit(DWORD signal);
@@ -83,22 +195,37 @@ BOOL WINAPI OnQuit(DWORD signal);
 void OnQuit(int signal);
 #endif
 
-uhd::usrp::multi_usrp::sptr g_sdr;
-
 //bool g_triggerArmed;
 
+///@brief Status to exit with when shut down, non-zero if a device had to be given up on
+static int g_exitStatus = 0;
+
+#ifndef _WIN32
+///@brief Worker processes, one per device, if serving more than one
+static vector<pid_t> g_workers;
+
+///@brief When each worker was last started
+static vector<chrono::steady_clock::time_point> g_workerStartTimes;
+
+///@brief Workers which die sooner than this after starting aren't restarted, as they'd most likely die again
+static const chrono::seconds g_minWorkerUptime(10);
+#endif
+
 int main(int argc, char* argv[])
 {
 	//Global settings
 	Severity console_verbosity = Severity::NOTICE;
 
-	//Parse command-line arguments
-	uint16_t scpi_port = 5025;
-	uint16_t waveform_port = 5026;
-	string devpath;
+	//Parse command-line arguments.
+	//Device options before the first --device are defaults for all of them, after that they apply to the last one.
+	DeviceConfig defaults;
+	defaults.m_scpiPort = 5025;
+	defaults.m_waveformPort = 5026;
+	vector<DeviceConfig> devices;
 	for(int i=1; i<argc; i++)
 	{
 		string s(argv[i]);
+		DeviceConfig& device = devices.empty() ? defaults : devices.back();
 
 		//Let the logger eat its args first
 		if(ParseLoggerArguments(i, argc, argv, console_verbosity))
@@ -113,19 +240,106 @@ int main(int argc, char* argv[])
 		else if(s == "--scpi-port")
 		{
 			if(i+1 < argc)
-				scpi_port = atoi(argv[++i]);
+				device.m_scpiPort = atoi(argv[++i]);
 		}
 
 		else if(s == "--device")
 		{
 			if(i+1 < argc)
-				devpath = argv[++i];
+			{
+				DeviceConfig next = defaults;
+				next.m_devpath = argv[++i];
+				next.m_scpiPort = 0;
+				next.m_waveformPort = 0;
+				next.m_metricsPort = 0;
+				devices.push_back(next);
+			}
+		}
+
+		else if(s == "--subdev")
+		{
+			if(i+1 < argc)
+				device.m_subdev = argv[++i];
+		}
+
+		else if(s == "--antenna")
+		{
+			if(i+1 < argc)
+				device.m_antenna = argv[++i];
 		}
 
 		else if(s == "--waveform-port")
 		{
 			if(i+1 < argc)
-				waveform_port = atoi(argv[++i]);
+				device.m_waveformPort = atoi(argv[++i]);
+		}
+
+		else if(s == "--metrics-port")
+		{
+			if(i+1 < argc)
+				device.m_metricsPort = atoi(argv[++i]);
+		}
+
+		else if(s == "--cpus")
+		{
+			if( (i+1 < argc) && !device.m_cpus.Parse(argv[++i]) )
+			{
+				fprintf(stderr, "Invalid CPU list \"%s\"\n", argv[i]);
+				return 1;
+			}
+		}
+
+		else if(s == "--numa-node")
+		{
+			if(i+1 < argc)
+				device.m_numaNode = atoi(argv[++i]);
+		}
+
+		else if( (s == "--rx-cpus") || (s == "--proc-cpus") || (s == "--send-cpus") )
+		{
+			ThreadRole role = THREAD_RX;
+			if(s == "--proc-cpus")
+				role = THREAD_PROCESSING;
+			else if(s == "--send-cpus")
+				role = THREAD_SEND;
+
+			if( (i+1 < argc) && !device.m_threadCpus[role].Parse(argv[++i]) )
+			{
+				fprintf(stderr, "Invalid CPU list \"%s\"\n", argv[i]);
+				return 1;
+			}
+		}
+
+		else if(s == "--rt-priority")
+		{
+			if(i+1 < argc)
+				device.m_rtPriority = atoi(argv[++i]);
+			if( (device.m_rtPriority < 0) || (device.m_rtPriority > 99) )
+			{
+				fprintf(stderr, "Real-time priority must be between 0 and 99\n");
+				return 1;
+			}
+		}
+
+		else if(s == "--nic")
+		{
+			if(i+1 < argc)
+				device.m_nic = argv[++i];
+		}
+
+		else if(s == "--hugepages")
+			g_blockPool.SetHugePages(true);
+
+		else if(s == "--mlock")
+			g_blockPool.SetLocked(true);
+
+		else if(s == "--zerocopy")
+			g_zeroCopy = true;
+
+		else if(s == "--record-dir")
+		{
+			if(i+1 < argc)
+				g_recordDir = argv[++i];
 		}
 
 		else
@@ -138,33 +352,338 @@ int main(int argc, char* argv[])
 	//Set up logging
 	g_log_sinks.emplace(g_log_sinks.begin(), new ColoredSTDLogSink(console_verbosity));
 
-	if(devpath.empty())
+	if(devices.empty())
 	{
 		help();
 		return 0;
 	}
 
+	//Fill in any ports not given for each device
+	for(size_t i=0; i<devices.size(); i++)
+	{
+		auto& device = devices[i];
+		if(device.m_scpiPort == 0)
+			device.m_scpiPort = defaults.m_scpiPort + 2*i;
+		if(device.m_waveformPort == 0)
+			device.m_waveformPort = defaults.m_waveformPort + 2*i;
+
+		//With several devices, the given port is the combined one
+		if( (device.m_metricsPort == 0) && (defaults.m_metricsPort != 0) )
+			device.m_metricsPort = defaults.m_metricsPort + ( (devices.size() > 1) ? (1 + i) : 0);
+	}
+
+	LogVerbose("Using %s trigger kernels\n", GetSimdLevelName(GetBestSimdLevel()));
+
+	if(devices.size() == 1)
+		return RunBridge(devices[0]);
+
+#ifdef _WIN32
+	LogError("Serving more than one device from one command is not supported on Windows\n");
+	return 1;
+#else
+	PartitionCpus(devices);
+	return RunLauncher(devices, defaults.m_metricsPort);
+#endif
+}
+
+#ifndef _WIN32
+/**
+	@brief Splits cores evenly between devices which would otherwise all run on the same ones
+
+	Each device would run on its --cpus, the cores of its --numa-node, or anywhere the process may, in that order.
+	Devices which come out with exactly the same cores each get a contiguous slice of them instead. Devices given
+	distinct cores are left alone.
+ */
+void PartitionCpus(vector<DeviceConfig>& devices)
+{
+	CpuList all = CpuList::GetProcessCpus();
+
+	//Group devices by the cores they'd run on
+	vector<CpuList> pools;
+	vector<vector<size_t>> sharers;
+	for(size_t i=0; i<devices.size(); i++)
+	{
+		CpuList pool = devices[i].m_cpus;
+		if(pool.empty() && (devices[i].m_numaNode >= 0) )
+			pool = CpuList::GetNumaNodeCpus(devices[i].m_numaNode);
+		if(pool.empty())
+			pool = all;
+		if(pool.empty())
+			continue;
+
+		size_t j = 0;
+		while( (j < pools.size()) && (pools[j].m_cpus != pool.m_cpus) )
+			j++;
+		if(j == pools.size())
+		{
+			pools.push_back(pool);
+			sharers.push_back(vector<size_t>());
+		}
+		sharers[j].push_back(i);
+	}
+
+	for(size_t j=0; j<pools.size(); j++)
+	{
+		auto& cpus = pools[j].m_cpus;
+		size_t n = sharers[j].size();
+		if(n < 2)
+			continue;
+		if(cpus.size() < n)
+		{
+			LogWarning("%zu devices share CPUs %s, not enough to give each its own\n",
+				n, pools[j].ToString().c_str());
+			continue;
+		}
+
+		for(size_t k=0; k<n; k++)
+		{
+			CpuList slice;
+			slice.m_cpus.assign(cpus.begin() + k*cpus.size()/n, cpus.begin() + (k+1)*cpus.size()/n);
+			devices[sharers[j][k]].m_cpus = slice;
+		}
+	}
+}
+
+/**
+	@brief Swaps an unbound socket inherited from the launcher for a new one of the worker's own
+
+	A forked socket is the same socket in both processes, so binding it in one worker would bind it in all of them.
+ */
+void ReopenSocket(Socket& sock)
+{
+	ZSOCKET fd = static_cast<ZSOCKET>(sock);
+	int fresh = socket(AF_INET6, SOCK_STREAM, IPPROTO_TCP);
+	if( (fresh < 0) || (dup2(fresh, fd) < 0) )
+		LogError("Failed to create a socket: %s\n", strerror(errno));
+	if(fresh >= 0)
+		close(fresh);
+}
+
+/**
+	@brief Starts a bridge process for each device, and restarts any which die until they've all exited
+
+	This is a launcher, not a shared bridge: every global in the bridge describes a single radio, so each device
+	gets a complete bridge process of its own. They're forked before anything else has started, and each one places
+	itself on its own cores and NUMA node before touching the radio, so the devices don't fight over cores.
+
+	@param devices		The devices to serve
+	@param metricsPort	Port to serve the metrics of all the devices on together, or 0 for none
+
+	@return 0 if every device exited cleanly, 1 if any had to be given up on
+ */
+int RunLauncher(const vector<DeviceConfig>& devices, uint16_t metricsPort)
+{
+	signal(SIGINT, OnQuit);
+	signal(SIGTERM, OnQuit);
+
+	size_t running = 0;
+	g_workers.resize(devices.size(), 0);
+	g_workerStartTimes.resize(devices.size());
+	for(size_t i=0; i<devices.size(); i++)
+	{
+		g_workers[i] = StartWorker(devices, i);
+		if(g_workers[i] > 0)
+			running ++;
+		else
+			g_exitStatus = 1;
+	}
+
+	//Serve everyone's metrics in one place. Bound after forking so the workers don't hold the socket open.
+	if(metricsPort != 0)
+	{
+		vector<uint16_t> ports;
+		for(auto& device : devices)
+			ports.push_back(device.m_metricsPort);
+		g_metricsSocket.Bind(metricsPort);
+		g_metricsSocket.Listen();
+		thread(CombinedMetricsServerThread, ports).detach();
+		LogNotice("Serving metrics for all devices on port %d\n", metricsPort);
+	}
+
+	//Carry on serving whichever devices are still up until they all exit.
+	//Workers only exit by themselves if something went wrong, a clean shutdown takes the launcher down first.
+	while(running > 0)
+	{
+		int status;
+		pid_t pid = wait(&status);
+		if(pid < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			break;
+		}
+
+		for(size_t i=0; i<g_workers.size(); i++)
+		{
+			if(g_workers[i] != pid)
+				continue;
+			g_workers[i] = 0;
+
+			if(WIFSIGNALED(status))
+				LogError("Worker for device %zu was killed by signal %d\n", i, WTERMSIG(status));
+			else if(WEXITSTATUS(status) != 0)
+				LogError("Worker for device %zu exited with status %d\n", i, WEXITSTATUS(status));
+			else
+			{
+				LogNotice("Worker for device %zu exited\n", i);
+				running --;
+				break;
+			}
+
+			//Don't keep restarting a device which can't come up at all
+			if(chrono::steady_clock::now() - g_workerStartTimes[i] < g_minWorkerUptime)
+				LogError("Device %zu (%s) failed right after starting, giving up on it\n", i, devices[i].m_devpath.c_str());
+			else
+			{
+				LogNotice("Restarting worker for device %zu\n", i);
+				g_workers[i] = StartWorker(devices, i);
+			}
+
+			if(g_workers[i] <= 0)
+			{
+				g_exitStatus = 1;
+				running --;
+			}
+			break;
+		}
+	}
+
+	return g_exitStatus;
+}
+
+/**
+	@brief Forks a worker process to serve one device
+
+	The worker never returns from here: it exits with RunBridge's status if the bridge fails, or 0 when shut down.
+
+	@param devices	All of the devices being served
+	@param i		Index of the device to serve
+
+	@return The worker's pid, or -1 if it couldn't be started
+ */
+pid_t StartWorker(const vector<DeviceConfig>& devices, size_t i)
+{
+	pid_t launcher = getpid();
+	pid_t pid = fork();
+	if(pid < 0)
+	{
+		LogError("Failed to start worker for device %zu: %s\n", i, strerror(errno));
+		return -1;
+	}
+
+	//Worker process
+	if(pid == 0)
+	{
+		g_workers.clear();
+
+		//Don't outlive the launcher, even if it died before we got here
+	#ifdef __linux__
+		prctl(PR_SET_PDEATHSIG, SIGINT);
+	#endif
+		if(getppid() != launcher)
+			_exit(1);
+
+		//The listening sockets were created before forking, so are shared with every other process until replaced
+		ReopenSocket(g_scpiSocket);
+		ReopenSocket(g_dataSocket);
+		ReopenSocket(g_metricsSocket);
+
+		exit(RunBridge(devices[i]));
+	}
+
+	LogNotice("Device %zu (%s) is worker %d, SCPI port %d, waveform port %d, CPUs %s\n",
+		i, devices[i].m_devpath.c_str(), (int)pid, devices[i].m_scpiPort, devices[i].m_waveformPort,
+		devices[i].m_cpus.empty() ? "any" : devices[i].m_cpus.ToString().c_str());
+	g_workerStartTimes[i] = chrono::steady_clock::now();
+	return pid;
+}
+#endif
+
+/**
+	@brief Connects to one radio and serves it until the process exits
+
+	A normal shutdown exits the process from OnQuit, so this only returns if the bridge couldn't start or failed.
+
+	@return Exit status for the process
+ */
+int RunBridge(const DeviceConfig& config)
+{
+	//Place ourselves before starting any threads, so they all inherit it
+	CpuList cpus = config.m_cpus;
+	if(config.m_numaNode >= 0)
+	{
+		SetPreferredNumaNode(config.m_numaNode);
+		if(cpus.empty())
+			cpus = CpuList::GetNumaNodeCpus(config.m_numaNode);
+	}
+	if(!cpus.empty())
+		SetProcessAffinity(cpus);
+
+	//Sample buffers go next to the NIC, so the radio's traffic doesn't cross the interconnect
+	if(!config.m_nic.empty())
+	{
+		int node = GetNicNumaNode(config.m_nic);
+		if(node >= 0)
+			g_blockPool.SetNumaNode(node);
+		else
+			LogWarning("No NUMA node for interface %s, sample buffers can go on any node\n", config.m_nic.c_str());
+	}
+
+	//Data path threads pick this up as they start
+	for(int i=0; i<THREAD_ROLE_COUNT; i++)
+	{
+		if(!config.m_threadCpus[i].empty())
+			g_threadPlacement.SetCpus(static_cast<ThreadRole>(i), config.m_threadCpus[i]);
+	}
+	if(config.m_rtPriority != 0)
+		g_threadPlacement.SetPriority(config.m_rtPriority);
+	ReportPlacement();
+
 	try
 	{
-		//Try to connect to the SDR
-		g_sdr = uhd::usrp::multi_usrp::make(devpath);
+		//Try to connect to the SDR (or start the simulator)
+		g_source = RxSource::Create(config.m_devpath);
 
-		//auto config = g_sdr->get_pp_string();
+		//auto config = g_source->GetDescription();
 		//LogDebug("%s\n", config.c_str());
 
-		//Get properties of the SDR
-		/*
-		auto props = sdr->get_tree();
-		uhd::fs_path path("/mboards/0/");
-		//auto propnames =  props->list(path);
-		LogDebug("name: %s\n", props->access<string>("/mboards/0/name").get().c_str());
-		LogDebug("fpgaver: %s\n", props->access<string>("/mboards/0/fpga_version").get().c_str());
-		*/
-
 		//Print info about the device
-		map<string, string> info = g_sdr->get_usrp_rx_info(0);
-		g_model = info["mboard_name"];
-		g_serial = info["mboard_serial"];
+		g_model = g_source->GetModel();
+		g_serial = g_source->GetSerial();
+
+		//Select sub devices and antennas
+		g_source->SetSubdevSpec(config.m_subdev);
+		size_t nchans = g_source->GetChannelCount();
+		LogVerbose("Using subdev spec \"%s\" (%zu RX channels)\n", config.m_subdev.c_str(), nchans);
+
+		//Pick up whatever the radio is currently set to, so waveform headers are correct before the client changes
+		//anything. Only the first channel is on by default, the client can turn on the others.
+		g_rxChannels.resize(nchans);
+		for(size_t i=0; i<nchans; i++)
+		{
+			g_source->SetAntenna(config.m_antenna, i);
+
+			auto& chan = g_rxChannels[i];
+			chan.m_enabled = (i == 0);
+			chan.m_centerFrequency = g_source->GetFrequency(i);
+			chan.m_gain = g_source->GetGain(i);
+			chan.m_bandwidth = g_source->GetBandwidth(i);
+		}
+
+		//Everything the control plane needs to know about the radio, so clients don't wait on the radio to connect
+		g_caps.Refresh(*g_source);
+
+		//Describe whatever rate the radio came up at, until the client picks one
+		double rate = g_source->GetSampleRate();
+		g_ratePlan.m_masterClockRate = g_caps.m_masterClockRate;
+		g_ratePlan.m_requestedRate = rate;
+		g_ratePlan.m_actualRate = rate;
+		if(rate > 0)
+			g_ratePlan.m_decimation = round(g_caps.m_masterClockRate / rate);
+
+		//Hand the settings to the data path, and start applying tuning changes from the control plane
+		g_rxControl.Publish();
+		g_rxControl.Start();
 
 		////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -176,13 +695,31 @@ int main(int argc, char* argv[])
 		signal(SIGPIPE, SIG_IGN);
 	#endif
 
-		//Configure the data plane socket
-		g_dataSocket.Bind(waveform_port);
-		g_dataSocket.Listen();
+		//Configure the data plane socket. Subscribers can connect at any time, whether or not there's a control plane
+		//client connected
+		if(!g_dataSocket.Bind(config.m_waveformPort) || !g_dataSocket.Listen())
+		{
+			LogError("Failed to listen on waveform port %d\n", config.m_waveformPort);
+			Shutdown();
+			return 1;
+		}
+		thread(DataPlaneAcceptThread).detach();
+
+		//Metrics are served for the life of the process, independent of control plane connections
+		if(config.m_metricsPort != 0)
+		{
+			g_metricsSocket.Bind(config.m_metricsPort);
+			g_metricsSocket.Listen();
+			thread(MetricsServerThread).detach();
+		}
 
 		//Launch the control plane socket server
-		g_scpiSocket.Bind(scpi_port);
-		g_scpiSocket.Listen();
+		if(!g_scpiSocket.Bind(config.m_scpiPort) || !g_scpiSocket.Listen())
+		{
+			LogError("Failed to listen on SCPI port %d\n", config.m_scpiPort);
+			Shutdown();
+			return 1;
+		}
 		LogDebug("Ready\n");
 
 		while(true)
@@ -203,15 +740,38 @@ int main(int argc, char* argv[])
 			g_waveformThreadQuit = true;
 			dataThread.join();
 			g_waveformThreadQuit = false;
+
+			//Don't leave a recording running with nobody to stop it
+			g_recorder.Stop();
 		}
 	}
 	catch(uhd::exception& ex)
 	{
 		LogError("UHD exception: %s\n", ex.what());
 	}
+	catch(exception& ex)
+	{
+		LogError("Exception: %s\n", ex.what());
+	}
 
-	OnQuit(SIGQUIT);
-	return 0;
+	Shutdown();
+	return 1;
+}
+
+/**
+	@brief Logs where the process and its memory actually ended up
+
+	Data path threads log their own placement as they apply it.
+ */
+void ReportPlacement()
+{
+	string cpus = CpuList::GetProcessCpus().ToString();
+	int memoryNode = GetPreferredNumaNode();
+	int bufferNode = g_blockPool.GetNumaNode();
+	LogNotice("Running on CPUs %s, memory on %s, sample buffers on %s\n",
+		cpus.empty() ? "any" : cpus.c_str(),
+		(memoryNode >= 0) ? ("NUMA node " + to_string(memoryNode)).c_str() : "any NUMA node",
+		(bufferNode >= 0) ? ("NUMA node " + to_string(bufferNode)).c_str() : "any NUMA node");
 }
 
 #ifdef _WIN32
@@ -222,9 +782,28 @@ BOOL WINAPI OnQuit(DWORD signal)
 void OnQuit(int /*signal*/)
 {
 #endif
+	Shutdown();
+	exit(g_exitStatus);
+}
+
+/**
+	@brief Stops everything which needs stopping before the process exits
+ */
+void Shutdown()
+{
 	LogNotice("Shutting down...\n");
 
-	exit(0);
+	//Stop applying tuning changes before the radio goes away
+	g_rxControl.Stop();
+
+#ifndef _WIN32
+	//Take any workers down with us
+	for(auto pid : g_workers)
+	{
+		if(pid > 0)
+			kill(pid, SIGINT);
+	}
+#endif
 }
 
 /**
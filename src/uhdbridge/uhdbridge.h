@@ -39,32 +39,86 @@
 #endif
 
 #include <thread>
+#include <atomic>
 #include <map>
+#include <vector>
 #include <mutex>
 
 #include <uhd/usrp/multi_usrp.hpp>
 #include <uhd/exception.hpp>
 #include <uhd/types/tune_request.hpp>
 
+/**
+	@brief Settings for a single RX channel
+ */
+class RxChannelConfig
+{
+public:
+	RxChannelConfig()
+		: m_enabled(false)
+		, m_centerFrequency(0)
+		, m_gain(0)
+		, m_bandwidth(0)
+	{}
+
+	///@brief True if the channel should be streamed
+	bool m_enabled;
+
+	///@brief Actual center frequency, in Hz
+	double m_centerFrequency;
+
+	///@brief Actual RX gain, in dB
+	double m_gain;
+
+	///@brief Actual analog bandwidth, in Hz
+	double m_bandwidth;
+};
+
 extern Socket g_scpiSocket;
 extern Socket g_dataSocket;
+extern Socket g_metricsSocket;
 
 void WaveformServerThread();
+void DataPlaneAcceptThread();
+void MetricsServerThread();
+void CombinedMetricsServerThread(std::vector<uint16_t> ports);
 
 extern std::string g_model;
 extern std::string g_serial;
+extern std::string g_recordDir;
 
 extern std::mutex g_mutex;
 
 extern volatile bool g_waveformThreadQuit;
 
-extern bool g_triggerArmed;
-extern bool g_triggerOneShot;
+extern std::atomic<bool> g_triggerArmed;
+extern std::atomic<bool> g_triggerOneShot;
+extern std::atomic<bool> g_continuousMode;
+extern std::atomic<bool> g_scanMode;
+
+///@brief When the radio starts streaming after the trigger is armed
+enum StartMode
+{
+	///@brief Right away
+	START_NOW,
+
+	///@brief At the device time in g_startTime
+	START_AT_TIME,
+
+	///@brief On the first PPS edge at least 100 ms after arming
+	START_NEXT_PPS
+};
 
-extern uhd::usrp::multi_usrp::sptr g_sdr;
+//Protected by g_mutex
+extern StartMode g_startMode;
+extern uhd::time_spec_t g_startTime;
 
-extern size_t g_rxBlockSize;
-extern int64_t g_centerFrequency;
-extern int64_t g_rxRate;
+extern std::atomic<size_t> g_rxBlockSize;
+extern std::atomic<size_t> g_ringDepth;
+extern std::atomic<uint64_t> g_droppedWaveforms;
+extern bool g_zeroCopy;
+extern std::vector<RxChannelConfig> g_rxChannels;
+extern std::atomic<bool> g_interleaveChannels;
+extern std::atomic<int64_t> g_rxRate;
 
 #endif